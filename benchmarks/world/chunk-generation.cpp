@@ -0,0 +1,44 @@
+#include "utils/bench.hpp"
+
+#include <vector>
+#include "Terrain.hpp"
+
+// how many chunks of terrain one thread can generate per second
+
+int main() {
+    const int SIDE = 16;
+    const int COUNT = SIDE * SIDE;
+    std::vector<float> heights(CHUNKSIZE * CHUNKSIZE);
+    Chunk* chunk = (Chunk*)malloc(sizeof(Chunk));
+    double checksum = 0.0;
+
+    START_TIME(scalarHeights);
+    for (int i = 0; i < COUNT; i++) {
+        Terrain::Scalar::heights({i % SIDE, i / SIDE}, 1, heights.data());
+        checksum += heights[i];
+    }
+    END_TIME(scalarHeights);
+
+    START_TIME(simdHeights);
+    for (int i = 0; i < COUNT; i++) {
+        Terrain::heights({i % SIDE, i / SIDE}, 1, heights.data());
+        checksum += heights[i];
+    }
+    END_TIME(simdHeights);
+
+    START_TIME(generate);
+    for (int i = 0; i < COUNT; i++) {
+        Terrain::generate(chunk, {i % SIDE, i / SIDE}, 1);
+        checksum += (*chunk)[i % CHUNKSIZE][0].type;
+    }
+    END_TIME(generate);
+
+    PRINT_TIME(scalarHeights, COUNT);
+    PRINT_TIME(simdHeights, COUNT);
+    PRINT_TIME(generate, COUNT);
+    double seconds = (generate_end - generate_start) / (double)SDL_GetPerformanceFrequency();
+    printf("generated %f chunks per second\n", COUNT / seconds);
+    printf("checksum: %f\n", checksum);
+
+    free(chunk);
+}
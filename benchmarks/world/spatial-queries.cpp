@@ -0,0 +1,119 @@
+#include "utils/bench.hpp"
+
+#include <functional>
+#include <vector>
+#include "SpatialKernels.hpp"
+#include "SpatialGrid.hpp"
+
+// compares the spatial kernels with testing boxes one at a time through callbacks, like the world queries used to
+
+struct Boxes {
+    std::vector<float> minX, minY, maxX, maxY;
+
+    Boxes(int count) : minX(count), minY(count), maxX(count), maxY(count) {
+        srand(1);
+        for (int i = 0; i < count; i++) {
+            minX[i] = (float)rand() / RAND_MAX * 1000.0f;
+            minY[i] = (float)rand() / RAND_MAX * 1000.0f;
+            maxX[i] = minX[i] + 1.0f + (float)rand() / RAND_MAX * 2.0f;
+            maxY[i] = minY[i] + 1.0f + (float)rand() / RAND_MAX * 2.0f;
+        }
+    }
+
+    SpatialKernels::PackedBoxes packed() const {
+        return {minX.data(), minY.data(), maxX.data(), maxY.data(), (int)minX.size()};
+    }
+};
+
+static void forEachBoxInBounds(const Boxes& boxes, Vec2 min, Vec2 max, const std::function<void(int)>& callback) {
+    for (int i = 0; i < (int)boxes.minX.size(); i++) {
+        if (boxes.minX[i] < max.x && boxes.maxX[i] > min.x &&
+            boxes.minY[i] < max.y && boxes.maxY[i] > min.y) {
+            callback(i);
+        }
+    }
+}
+
+int main() {
+    const int COUNT = 100000;
+    const int ITERATIONS = 100;
+    Boxes boxes(COUNT);
+    std::vector<Sint32> hits(COUNT);
+    Vec2 min = {200, 200};
+    Vec2 max = {600, 600};
+    long long totalHits = 0;
+
+    START_TIME(callbackBounds);
+    for (int i = 0; i < ITERATIONS; i++) {
+        int hitCount = 0;
+        forEachBoxInBounds(boxes, min, max, [&](int box){
+            hits[hitCount++] = box;
+        });
+        totalHits += hitCount;
+    }
+    END_TIME(callbackBounds);
+
+    START_TIME(scalarBounds);
+    for (int i = 0; i < ITERATIONS; i++) {
+        totalHits += SpatialKernels::Scalar::overlappingBox(boxes.packed(), min, max, hits.data());
+    }
+    END_TIME(scalarBounds);
+
+    START_TIME(simdBounds);
+    for (int i = 0; i < ITERATIONS; i++) {
+        totalHits += SpatialKernels::overlappingBox(boxes.packed(), min, max, hits.data());
+    }
+    END_TIME(simdBounds);
+
+    START_TIME(scalarRadius);
+    for (int i = 0; i < ITERATIONS; i++) {
+        totalHits += SpatialKernels::Scalar::inCircle(boxes.packed(), {500, 500}, 200, hits.data());
+    }
+    END_TIME(scalarRadius);
+
+    START_TIME(simdRadius);
+    for (int i = 0; i < ITERATIONS; i++) {
+        totalHits += SpatialKernels::inCircle(boxes.packed(), {500, 500}, 200, hits.data());
+    }
+    END_TIME(simdRadius);
+
+    START_TIME(scalarLine);
+    for (int i = 0; i < ITERATIONS; i++) {
+        totalHits += SpatialKernels::Scalar::onLine(boxes.packed(), {0, 0}, {1000, 1000}, hits.data());
+    }
+    END_TIME(scalarLine);
+
+    START_TIME(simdLine);
+    for (int i = 0; i < ITERATIONS; i++) {
+        totalHits += SpatialKernels::onLine(boxes.packed(), {0, 0}, {1000, 1000}, hits.data());
+    }
+    END_TIME(simdLine);
+
+    // the same boxes in a grid, with a query the size of the screen
+    SpatialGrid grid;
+    grid.init();
+    for (int i = 0; i < COUNT; i++) {
+        grid.update(Entity(i + 1, 1), {boxes.minX[i], boxes.minY[i]}, {boxes.maxX[i], boxes.maxY[i]});
+    }
+
+    START_TIME(gridBounds);
+    for (int i = 0; i < ITERATIONS; i++) {
+        grid.forEachOverlapping({480, 480}, {540, 520}, [&](Entity){
+            totalHits++;
+            return false;
+        });
+    }
+    END_TIME(gridBounds);
+
+    PRINT_TIME(callbackBounds, ITERATIONS);
+    PRINT_TIME(scalarBounds, ITERATIONS);
+    PRINT_TIME(simdBounds, ITERATIONS);
+    PRINT_TIME(scalarRadius, ITERATIONS);
+    PRINT_TIME(simdRadius, ITERATIONS);
+    PRINT_TIME(scalarLine, ITERATIONS);
+    PRINT_TIME(simdLine, ITERATIONS);
+    PRINT_TIME(gridBounds, ITERATIONS);
+    printf("hits: %lld\n", totalHits);
+
+    grid.destroy();
+}
@@ -2,6 +2,42 @@
 
 #include <atomic>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// hint to the cpu that we are in a spin wait loop
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+// Test and test-and-set lock for very short critical sections.
+// Satisfies Lockable so it can be used with std::lock_guard
 struct Spinlock {
-    
-};
\ No newline at end of file
+    std::atomic<bool> locked{false};
+
+    void lock() {
+        while (true) {
+            if (!locked.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+            // wait for it to look unlocked before trying again so we don't hammer the cache line
+            while (locked.load(std::memory_order_relaxed)) {
+                cpuRelax();
+            }
+        }
+    }
+
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed)
+            && !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+};
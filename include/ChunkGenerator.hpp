@@ -0,0 +1,75 @@
+#ifndef CHUNK_GENERATOR_INCLUDED
+#define CHUNK_GENERATOR_INCLUDED
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "Chunks.hpp"
+#include "threads.hpp"
+
+/*
+* Generates chunks on background threads so missing chunks never stall a frame.
+* The main thread asks for the chunks around the camera, workers generate their tiles into staging buffers,
+* and the main thread moves finished chunks into the chunk map once per frame.
+* Chunks only depend on their position and the world seed, so it doesn't matter which thread makes them or in what order.
+* Without workers, the main thread generates a chunk per frame instead.
+*/
+struct ChunkGenerator {
+    // chunks are only needed in bursts when the camera moves, so a couple of workers is plenty
+    static constexpr int DefaultWorkerCount = 2;
+
+    // opens up to workerCount threads from the thread manager and keeps them until stop() is called.
+    // returns the number of workers actually started
+    int start(ThreadManager& threadManager, int workerCount);
+
+    // tell the workers to quit once they're done with the chunk they're on, and wait for them
+    void stop(ThreadManager& threadManager);
+
+    /* Queue the missing chunks from minChunk to maxChunk (inclusive) to be generated, closest to center first.
+     * This replaces the chunks that were asked for before and haven't been started, so the queue follows the camera.
+     */
+    void requestArea(const ChunkMap& chunkmap, ChunkCoord minChunk, ChunkCoord maxChunk, Vec2 center);
+
+    // put the generated chunks into the chunk map. Chunks generated with a seed other than the map's,
+    // from before a new world was made or loaded, are thrown away. Returns the number of chunks added. Call once per frame
+    int commit(ChunkMap* chunkmap);
+
+    // generate and commit everything that was asked for, helping out on the calling thread
+    void finish(ChunkMap* chunkmap);
+
+    void destroy();
+private:
+    struct Request {
+        ChunkCoord position;
+        Uint64 seed;
+    };
+
+    struct Generated {
+        ChunkCoord position;
+        Uint64 seed;
+        Chunk* tiles;
+    };
+
+    std::vector<Threads::ThreadID> workers;
+
+    std::mutex mutex;
+    std::condition_variable workAvailable; // signaled on new requests or quit
+    std::condition_variable chunkGenerated;
+    // guarded by mutex
+    std::deque<Request> queue;
+    std::vector<Generated> generated;
+    std::vector<Chunk*> freeBuffers;
+    bool quit = false;
+
+    // requested and not yet committed. Only used by the main thread
+    My::HashMap<ChunkCoord, char, IVec2Hash> pending = My::HashMap<ChunkCoord, char, IVec2Hash>::Empty();
+    std::vector<Generated> committing; // swapped with generated to commit without holding the lock
+
+    static int workerThreadFunc(void* generatorPtr);
+
+    // take the next request and generate it. Must be called with the lock held, which is let go while generating
+    void generateNext(std::unique_lock<std::mutex>& lock);
+};
+
+#endif
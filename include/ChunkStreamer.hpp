@@ -0,0 +1,84 @@
+#ifndef CHUNK_STREAMER_INCLUDED
+#define CHUNK_STREAMER_INCLUDED
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "Chunks.hpp"
+
+/*
+* Keeps the chunk map under a memory budget by evicting the chunks that were least recently close to the camera.
+* Chunks that were never changed are just dropped, since they'll be generated the same way when they're needed again.
+* Changed chunks are run length encoded and spilled to a region file, and read back when they come into view.
+* The region file is scratch space for this run. Saves write spilled chunks out of it, so nothing is lost by deleting it.
+*/
+struct ChunkStreamer {
+    static constexpr size_t DefaultMemoryBudget = 64 * 1024 * 1024; // 2048 chunks
+
+    // bytes of chunk tiles to keep loaded. Evicting goes down a bit below this so it doesn't happen every frame
+    size_t memoryBudget = DefaultMemoryBudget;
+    // where to spill changed chunks. A temporary file is used when this is empty
+    std::string regionPath;
+
+    void init();
+    void destroy();
+
+    // forget every spilled chunk, for when a save is loaded
+    void clear();
+
+    // bring back spilled chunks in the area and mark every chunk in it as used this frame. Call once per frame
+    // before generating the area, so spilled chunks aren't generated over
+    void use(ChunkMap* chunkmap, ChunkCoord minChunk, ChunkCoord maxChunk);
+
+    // evict least recently used chunks until the loaded chunks fit in the memory budget, and give the memory they used back,
+    // along with the entity grid's empty cells. Chunks used this frame are kept even if they don't fit.
+    // Returns the number of chunks evicted
+    int evict(ChunkMap* chunkmap);
+
+    size_t maxLoadedChunks() const {
+        return MAX(memoryBudget / sizeof(Chunk), (size_t)1);
+    }
+
+    // spilled and not loaded right now
+    bool isSpilled(const ChunkMap& chunkmap, ChunkCoord position) const {
+        return records.contains(position) && !chunkmap.existsAt(position);
+    }
+
+    // read a spilled chunk's tiles. Returns false if it isn't spilled or couldn't be read
+    bool readSpilled(ChunkCoord position, Chunk* chunk) const;
+
+    // calls func(position, dirty) for every chunk that's spilled and not loaded
+    template<typename Func>
+    void forEachSpilled(const ChunkMap& chunkmap, Func func) const {
+        records.forEach([&](ChunkCoord position, const Record& record){
+            if (!chunkmap.existsAt(position)) {
+                func(position, record.dirty);
+            }
+        });
+    }
+
+    // spilled chunks count as saved after this
+    void clearDirty();
+private:
+    // where a chunk was last spilled in the region file.
+    // Records are kept after the chunk is loaded again so it can reuse its space the next time it's spilled
+    struct Record {
+        Uint64 offset;
+        Uint32 capacity; // bytes of the region file the chunk can use
+        Uint32 size;
+        bool encoded; // run length encoded, or raw tiles if encoding didn't make it smaller
+        bool dirty; // changed since the last autosave when it was spilled
+    };
+
+    FILE* regionFile = nullptr;
+    Uint64 regionFileEnd = 0;
+    My::HashMap<ChunkCoord, Record, IVec2Hash> records = My::HashMap<ChunkCoord, Record, IVec2Hash>::Empty();
+    Uint32 frame = 0;
+    mutable std::vector<Uint8> buffer;
+
+    bool openRegionFile();
+    bool spill(ChunkCoord position, const ChunkData& chunkdata);
+    bool restore(ChunkMap* chunkmap, ChunkCoord position);
+};
+
+#endif
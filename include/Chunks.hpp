@@ -5,11 +5,13 @@
 #include "My/BucketArray.hpp"
 #include "My/HashMap.hpp"
 #include <unordered_map>
+#include <vector>
 #include "Tiles.hpp"
 #include "constants.hpp"
 #include "utils/vectors_and_rects.hpp"
 #include "ECS/Entity.hpp"
 #include "utils/Metadata.hpp"
+#include "SpatialGrid.hpp"
 
 using ECS::Entity;
 
@@ -20,7 +22,9 @@ typedef IVec2 ChunkCoord;
 struct ChunkData {
     Chunk* chunk; // pointer to chunk tiles. // when this is not null, chunkdata->chunk should never be null
     ChunkCoord position; // chunk position aka floor(tilePosition / CHUNKSIZE), NOT tile position
-    My::Vec<Entity> closeEntities; // entities that are at least partially inside the chunk
+    bool dirty; // tiles changed since the last autosave. New chunks start out dirty
+    bool modified; // tiles changed since the chunk was generated, so it can't just be generated again
+    Uint32 lastUsed; // the last frame the chunk was close to the camera, for evicting the least recently used chunks
 
     ChunkData(Chunk* chunk, IVec2 position);
 
@@ -29,17 +33,6 @@ struct ChunkData {
     Vec2 tilePosition() const {
         return position * CHUNKSIZE;
     }
-
-    bool removeCloseEntity(Entity entity) {
-        for (int e = 0; e < closeEntities.size; e++) {
-            if (closeEntities[e].id == entity.id) {
-                closeEntities[e] = closeEntities.back();
-                closeEntities.pop();
-                return true;
-            }
-        }
-        return false;
-    }
 };
 
 // Get the tile from the chunk at the specified row and column.
@@ -70,7 +63,8 @@ inline IVec2 toChunkPosition(IVec2 position) {
     };
 }
 
-void generateChunk(ChunkData* chunk);
+// fill the chunk's tiles. The tiles only depend on the position and seed, so this can be called from any thread
+void generateChunk(Chunk* chunk, ChunkCoord position, Uint64 seed);
 
 #define CHUNK_BUCKET_SIZE 32
 #define CHUNKDATA_BUCKET_SIZE 64
@@ -81,6 +75,9 @@ struct ChunkMap {
 
     InternalChunkMap map;
     ChunkBucketArray chunkList;
+    std::vector<Chunk*> freeChunks; // slots in chunkList left behind by removed chunks, used before growing chunkList
+    SpatialGrid entityGrid; // entities with a position and view box, by their view box in the world
+    Uint64 seed = 0; // chunks that aren't made yet are generated from this
 
     /* Methods */
 
@@ -101,6 +98,19 @@ struct ChunkMap {
 
     ChunkData* newChunkAt(IVec2 position);
 
+    // remove the chunk, freeing its tiles for the next new chunk. Returns false if there was no chunk there
+    bool removeChunk(IVec2 position);
+
+    // index of the chunk's tiles in chunkList, or -1 if they aren't in it
+    int chunkIndex(const Chunk* chunk) const;
+
+    /*
+    * Move chunks from the end of chunkList into free slots lower down and release the buckets left empty.
+    * Chunk tile pointers change, so this can't be done while anything is holding on to them.
+    * Does nothing if there isn't at least a bucket's worth of free slots. Returns the number of buckets released
+    */
+    int releaseFreeBuckets();
+
     /*
     * Like get() except will create a new chunk if the chunk couldn't be found.
     * The chunk will not be generated, so this shouldn't be used most in most cases.
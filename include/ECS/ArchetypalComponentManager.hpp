@@ -22,7 +22,25 @@ namespace ECS {
 
     struct Hash {
         My::Map::Hash operator()(ComponentGroup group) const {
-            return group.required.words[0] ^ group.rejected.words[0];
+            SignatureHash hash;
+            return mixHashBits(hash(group.required) * 31 + hash(group.rejected));
+        }
+    };
+};
+
+// archetypes are keyed by their components and the prototype of the entities in them
+struct ArchetypeKey {
+    Signature signature;
+    Sint32 prototype;
+
+    bool operator==(ArchetypeKey other) const {
+        return signature == other.signature && prototype == other.prototype;
+    }
+
+    struct Hash {
+        My::Map::Hash operator()(ArchetypeKey key) const {
+            SignatureHash hash;
+            return mixHashBits(hash(key.signature) * 31 + (Uint32)key.prototype);
         }
     };
 };
@@ -102,13 +120,79 @@ struct MultiEntity {
 
 constexpr MultiEntity NullMultiEntity = {NullEntity, 0};
 
-using EntityIndex = StrongType<Uint16>;
+using EntityIndex = StrongType<Uint32>;
+
+// Where an entity is stored, looked up once so each component read after is a single load from the pool.
+// Only valid until entities are removed from or moved around in that pool, which the pool generation tracks
+struct EntityRef {
+    ArchetypeID archetype = NullArchetypeID;
+    Uint32 generation = 0;
+    ArchetypePool::EntityIndex row = 0;
+
+    bool Null() const {
+        return archetype == NullArchetypeID;
+    }
+};
+
+// ids above this are used for fake entities in command buffers
+static constexpr EntityID MaxEntityID = (1 << 24) - 1;
+
+// Maps entity ids to entity indices.
+// Split into pages that are only allocated once an id in them is used, so memory scales with
+// the number of entities that actually exist instead of the number of possible ids.
+// Pages that were never allocated point to a shared page of zeros, so reading never has to check.
+struct EntityIndexTable {
+    static constexpr int PageShift = 12;
+    static constexpr int PageSize = 1 << PageShift; // entity indices per page
+    static constexpr int PageCount = (MaxEntityID >> PageShift) + 1;
+
+    EntityIndex** pages = nullptr;
+    int allocatedPages = 0;
+
+    void init() {
+        pages = (EntityIndex**)malloc(PageCount * sizeof(EntityIndex*));
+        for (int i = 0; i < PageCount; i++) {
+            pages[i] = const_cast<EntityIndex*>(emptyPage);
+        }
+    }
+
+    EntityIndex get(EntityID id) const {
+        assert(id <= MaxEntityID);
+        return pages[id >> PageShift][id & (PageSize - 1)];
+    }
+
+    void set(EntityID id, EntityIndex index) {
+        assert(id <= MaxEntityID);
+        EntityIndex*& page = pages[id >> PageShift];
+        if (UNLIKELY(page == emptyPage)) {
+            // zeroed means every entity in the page starts out as the null entity
+            page = (EntityIndex*)calloc(PageSize, sizeof(EntityIndex));
+            allocatedPages++;
+        }
+        page[id & (PageSize - 1)] = index;
+    }
 
-static constexpr EntityID MaxEntityID = (1 << 15) - 1;
+    // bytes used by the table itself and its allocated pages
+    size_t memoryUsage() const {
+        return PageCount * sizeof(EntityIndex*) + (size_t)allocatedPages * PageSize * sizeof(EntityIndex);
+    }
+
+    void destroy() {
+        if (!pages) return;
+        for (int i = 0; i < PageCount; i++) {
+            if (pages[i] != emptyPage) free(pages[i]);
+        }
+        free(pages);
+        pages = nullptr;
+        allocatedPages = 0;
+    }
+private:
+    static const EntityIndex emptyPage[PageSize];
+};
 
 struct ArchetypalComponentManager {
-    using ArchetypeID = Sint16;
-    static constexpr ArchetypeID NullArchetypeID = -1;
+    using ArchetypeID = ECS::ArchetypeID;
+    static constexpr ArchetypeID NullArchetypeID = ECS::NullArchetypeID;
 
     PoolAllocator poolAllocator;
     ArchetypeAllocator archetypeAllocator;
@@ -116,7 +200,7 @@ struct ArchetypalComponentManager {
     SmallVectorA<ArchetypePool, PoolAllocator, 0> pools;
     My::Vec<Entity> unusedEntities;
     EntityID highestUsedEntity = 0;
-    My::HashMap<Signature, ArchetypeID, SignatureHash> archetypes;
+    My::HashMap<ArchetypeKey, ArchetypeID, ArchetypeKey::Hash> archetypes;
 
     Sint32* componentSizes = nullptr;
     const char** componentNames = nullptr;
@@ -126,7 +210,7 @@ struct ArchetypalComponentManager {
 
     struct EntityLoc {
         ArchetypeID archetype;
-        Sint16 index;
+        ArchetypePool::EntityIndex index;
     };
     static constexpr EntityLoc NullEntityLoc = {0, 0};
 
@@ -139,10 +223,14 @@ struct ArchetypalComponentManager {
 
     int entityCount = 0;
     int entityCapacity = 0;
+    // bumped whenever entities are created or deleted, like ArchetypePool::changeCount
+    Uint32 entityChangeCount = 0;
+    // what pool column ticks are set to when written. Every job or query run takes its own tick,
+    // so anything written after it ran has a higher tick than the one it recorded
+    Uint32 changeTick = 1;
 
-    EntityIndex* entityIndices = nullptr;
+    EntityIndexTable entityIndices;
     static constexpr EntityIndex NullEntityIndex = EntityIndex(0);
-    static const int EntityIndicesLength = MaxEntityID;
 
     struct ComponentWatcher {
         ComponentGroup group;
@@ -158,17 +246,26 @@ struct ArchetypalComponentManager {
     Uint8 watchedComponentAddGroupIndices[MaxComponentIDs]; 
     Uint8 watchedComponentRemoveGroupIndices[MaxComponentIDs];
 
+    // the archetypes matching a component group. Kept up to date as archetypes are made,
+    // so running a query never has to look at every pool
+    struct ArchetypeQuery {
+        ComponentGroup group;
+        SmallVector<ArchetypeID, 8> archetypes; // includes archetypes that are currently empty
+    };
+    // queries are only a cache, so asking for one on a const manager is allowed to make it.
+    // Not thread safe, only get queries from the main thread
+    mutable SmallVector<ArchetypeQuery, 0> queries;
+    mutable My::HashMap<ComponentGroup, int, ComponentGroup::Hash> queryIndices;
+
     /* Methods */
 
     EntityIndex getEntityIndex(EntityID id) const {
-        assert(id < EntityIndicesLength);
-        return entityIndices[id];
+        return entityIndices.get(id);
     }
 
     EntityIndex lookupEntity(Entity entity) const {
-        assert(entity.id < EntityIndicesLength);
-        EntityIndex index = entityIndices[entity.id];
-        auto version = entityData.version[(Uint16)index];
+        EntityIndex index = entityIndices.get(entity.id);
+        auto version = entityData.version[(Uint32)index];
         if (UNLIKELY(version != entity.version)) {
             assert(entity.id == NullEntity.id && "Use of destroyed entity!");
             return NullEntityIndex;
@@ -176,15 +273,56 @@ struct ArchetypalComponentManager {
         return index;
     }
 
+    // null ref if the entity doesn't exist, which unlike lookupEntity isn't treated as a mistake
+    EntityRef getRef(Entity entity) const {
+        EntityIndex index = entityIndices.get(entity.id);
+        if (entityData.version[(Uint32)index] != entity.version) return {};
+        auto location = entityData.location[(Uint32)index];
+        return {location.archetype, pools[location.archetype].generation, location.index};
+    }
+
+    // false once the pool the ref points into has changed, after which the entity has to be looked up again
+    bool refValid(EntityRef ref) const {
+        return !ref.Null() && pools[ref.archetype].generation == ref.generation;
+    }
+
+    // null if the entity doesn't have the component. The ref must be valid
+    void* getComponent(EntityRef ref, ComponentID component) const {
+        DASSERT(refValid(ref) && "Stale entity ref!");
+        const auto& pool = pools[ref.archetype];
+        int arrayNum = pool.getArrayNumber(component);
+        if (arrayNum == -1) return nullptr;
+        return pool.getComponentByIndex(arrayNum, ref.row, componentSizes[component]);
+    }
+
     ArchetypePool* getPool(EntityIndex index) {
-        auto archetype = entityData.location[(Uint16)index].archetype;
+        auto archetype = entityData.location[(Uint32)index].archetype;
         return &pools[archetype];
     }
 
-    ArchetypePool* getOrMakePool(Signature signature, ArchetypeID* newArchetypeIDOut) {
-        auto newArchetypeID = getArchetypeID(signature);
+    // archetype an entity in archetype 'from' ends up in when the component is added or removed.
+    // Uses the edges stored in the pool, so after the first time this is a single array load.
+    // Makes the archetype if it doesn't exist, which invalidates all archetype pool pointers
+    ArchetypeID getAddTransition(ArchetypeID from, ComponentID component) {
+        ArchetypeID to = pools[from].getAddEdge(component);
+        if (LIKELY(to != NullArchetypeID)) return to;
+        return makeTransition(from, component, true);
+    }
+
+    ArchetypeID getRemoveTransition(ArchetypeID from, ComponentID component) {
+        ArchetypeID to = pools[from].getRemoveEdge(component);
+        if (LIKELY(to != NullArchetypeID)) return to;
+        return makeTransition(from, component, false);
+    }
+
+    // same as above for any number of components. Cached per archetype, the first time it follows known edges,
+    // falling back to a lookup by signature
+    ArchetypeID getTransition(ArchetypeID from, Signature added, Signature removed);
+
+    ArchetypePool* getOrMakePool(Signature signature, Sint32 prototype, Signature prototypeSignature, ArchetypeID* newArchetypeIDOut) {
+        auto newArchetypeID = getArchetypeID(signature, prototype);
         if (newArchetypeID == NullArchetypeID) {
-            newArchetypeID = initArchetype(signature);
+            newArchetypeID = initArchetype(signature, prototype, prototypeSignature);
         }
         if (newArchetypeIDOut)
             *newArchetypeIDOut = newArchetypeID;
@@ -192,44 +330,78 @@ struct ArchetypalComponentManager {
     }
 
     __attribute__((pure)) Signature getSignature(EntityIndex index) const {
-        auto archetype = entityData.location[(Uint16)index].archetype;
+        auto archetype = entityData.location[(Uint32)index].archetype;
         const auto* pool = getPool(archetype);
         return pool->signature();
     }
 
     EntityVersion getVersion(EntityIndex index) const {
-        return entityData.version[(Uint16)index];
+        return entityData.version[(Uint32)index];
     }
 
     Sint32 getPrototype(EntityIndex index) const {
-        return entityData.prototype[(Uint16)index];
+        return entityData.prototype[(Uint32)index];
     }
 
     ArchetypeID getArchetype(EntityIndex index) const {
-        return entityData.location[(Uint16)index].archetype;
+        return entityData.location[(Uint32)index].archetype;
     }
 
     ArchetypePool::EntityIndex getPoolIndex(EntityIndex index) const {
-        return entityData.location[(Uint16)index].index;
+        return entityData.location[(Uint32)index].index;
     }
 
     void setEntityLocation(EntityIndex index, EntityLoc entityLocation) {
-        entityData.location[(Uint16)index] = entityLocation;
+        entityData.location[(Uint32)index] = entityLocation;
     }
 
     int addToPool(ArchetypePool* pool, ArrayRef<Entity> entities) {
-        return pool->addNew(entities.size(), entities.data(), &archetypeAllocator, componentSizes);
+        return pool->addNew(entities.size(), entities.data(), &archetypeAllocator, componentSizes, changeTick);
+    }
+
+    // returns the tick to mark writes with and to compare against next run
+    Uint32 takeChangeTick() {
+        return changeTick++;
+    }
+
+    // for writes made through getComponent, so jobs filtering on changes and savers looking at changeCount see them
+    void markChanged(Entity entity, ComponentID component);
+
+    void markChanged(EntityRef ref, ComponentID component) {
+        DASSERT(refValid(ref) && "Stale entity ref!");
+        auto& pool = pools[ref.archetype];
+        int arrayNum = pool.getArrayNumber(component);
+        if (arrayNum == -1) return;
+        pool.changeCount++;
+        pool.setColumnTick(pool.blockOf(ref.row), arrayNum, changeTick);
     }
 
     bool reserveEntities(Sint32 count);
 
+    // takes ids for count entities, reusing deleted ones first, and gives them the entity indices after the last entity.
+    // Only the id and version of the new entities are set. Returns the index of the first one, or NullEntityIndex if out of ids
+    EntityIndex allocateEntities(int count, Entity* entitiesOut);
+
     ArchetypePool* addWatcher(ComponentGroup group, GroupWatcherType type);
 
+    // index of the query for the group, made and filled with the matching archetypes the first time it's asked for
+    int getQuery(ComponentGroup group) const;
+
+    ArrayRef<ArchetypeID> getQueryArchetypes(int query) const {
+        return queries[query].archetypes;
+    }
+
     void init(ArrayRef<ComponentInfo> componentInfo, ArenaAllocator* arena);
 
-    Entity createEntity(Uint32 prototype);
+    // the archetype with no components that entities of the prototype start out in.
+    // prototypeSignature must be the same every time for the same prototype
+    ArchetypeID getPrototypeArchetype(Sint32 prototype, Signature prototypeSignature);
 
-    void createEntities(int count, Entity* entitiesOut, Signature signature);
+    // prototypeSignature is the prototype components of the prototype, see getPrototypeArchetype
+    Entity createEntity(Uint32 prototype, Signature prototypeSignature);
+
+    // same as calling createEntity count times, but only reserves once
+    void createEntities(int count, Entity* entitiesOut, Uint32 prototype, Signature prototypeSignature);
 
     MultiEntity createMultiEntity(Sint32 count);
 
@@ -240,12 +412,22 @@ struct ArchetypalComponentManager {
     void deleteEntity(Entity entity);
     void deleteEntities(ArrayRef<Entity> entities);
 
+    // remove every entity without notifying anything, leaving the manager like it was just initialized.
+    // Archetypes and queries are kept
+    void clearEntities();
+
     __attribute__((pure)) Signature getEntitySignature(Entity entity) const {
         auto entityIndex = lookupEntity(entity);
         auto* pool = &pools[getArchetype(entityIndex)];
         return pool->signature();
     }
 
+    // with the components of the entity's prototype
+    __attribute__((pure)) Signature getEntityFullSignature(Entity entity) const {
+        auto entityIndex = lookupEntity(entity);
+        return pools[getArchetype(entityIndex)].fullSignature();
+    }
+
     __attribute__((pure)) bool hasComponent(Entity entity, ComponentID component) const {
         return getEntitySignature(entity)[component];
     }
@@ -276,14 +458,31 @@ public:
 
     };
 
-    void* addComponent(ArrayRef<Entity> groupedEntities, ComponentID component);
+    // repeated entities only get the component once
+    void addComponent(ArrayRef<Entity> entities, ComponentID component);
 
     void removeComponent(Entity entity, ComponentID component);
 
+    // repeated entities are only moved once
+    void removeComponent(ArrayRef<Entity> entities, ComponentID component);
+
+    struct SignatureChange {
+        Entity entity;
+        Signature added;
+        Signature removed; // must not overlap with added
+    };
+
+    // Apply many signature changes at once.
+    // Entities moving between the same two archetypes are moved together, copying runs of neighbouring
+    // rows with one memcpy per component. New components are left uninitialized.
+    // Changes may be reordered. All of them are worked out from where the entities are before the call,
+    // so only one of the changes to a repeated entity is applied. Merge changes to the same entity first.
+    void changeSignatures(SignatureChange* changes, int count);
+
 private:
     // returns -1 if the archetype doesn't exist
-    ArchetypeID getArchetypeID(Signature signature) const {
-        auto* archetypeID = archetypes.lookup(signature);
+    ArchetypeID getArchetypeID(Signature signature, Sint32 prototype) const {
+        auto* archetypeID = archetypes.lookup({signature, prototype});
         if (archetypeID) {
             return *archetypeID;
         }
@@ -297,9 +496,14 @@ private:
     ArchetypePool* getPool(ArchetypeID id) {
         return &pools[id];
     }
+
+    ArchetypeID makeTransition(ArchetypeID from, ComponentID component, bool add);
+
+    // copy the components both pools have from rows srcIndices[0..count) of src to rows dstStart..dstStart+count of dst
+    void copySharedComponents(const ArchetypePool* src, const int* srcIndices, ArchetypePool* dst, int dstStart, int count);
 public:
 
-    ArchetypeID initArchetype(Signature signature);
+    ArchetypeID initArchetype(Signature signature, Sint32 prototype, Signature prototypeSignature);
 
     __attribute__((pure)) Sint32 getComponentSize(ComponentID component) const {
         assert(component < numComponentTypes && "Invalid component!");
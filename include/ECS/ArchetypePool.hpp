@@ -12,25 +12,66 @@
 #include "ComponentInfo.hpp"
 #include "memory/Allocator.hpp"
 #include "memory/ArenaAllocator.hpp"
+#include "memory/BlockAllocator.hpp"
 
 namespace ECS {
 
-using ArchetypeAllocator = Mallocator;
+// Archetype storage is split into blocks of this many bytes. Every block holds a power of two number of entities,
+// with the entity ids and then each component laid out as its own column. Growing a pool only adds blocks,
+// so components never move when a pool grows.
+static constexpr int ArchetypeBlockSize = 16 * 1024;
+
+using ArchetypeAllocator = BlockAllocator<ArchetypeBlockSize, 8>;
 using PoolAllocator = Mallocator;
 
+using ArchetypeID = Sint16;
+static constexpr ArchetypeID NullArchetypeID = -1;
+
 struct ArchetypePool {
-    using EntityIndex = Sint16;
+    using EntityIndex = Sint32;
     struct ComponentArray {
         ComponentID componentType;
-        char* data;
+        Sint32 offset; // byte offset of the column from the start of each block
     };
     ComponentArray* arrays; // arrays for components
     Sint32 _numComponents; // any component in the signature (signature.count())
     EntityIndex size;
-    EntityIndex capacity;
-    Entity* entities; // contained entities
+    EntityIndex capacity; // numBlocks * blockCapacity()
+    char** blocks; // the entity column is at the start of every block
+    Sint32 numBlocks;
+    Sint32 blockListCapacity;
+    Sint32 blockBytes; // ArchetypeBlockSize, unless a single entity doesn't fit in that
+    Uint8 blockShift; // log2 of entities per block
     Signature _signature; // maybe make this SoA to make queries faster
     uint8_t numComponentsInOrBeforeWord[Signature::WordCount];
+    // archetypes reached by adding or removing one component, filled in the first time each transition is made.
+    // First MaxComponentIDs are add edges, then remove edges. Null until this archetype has any
+    ArchetypeID* edges;
+    // transitions that add or remove more than one component at once, like prototype spawns and batched changes.
+    // A few of the most recent are kept, null until this archetype has any
+    struct MultiEdge {
+        Signature added;
+        Signature removed;
+        ArchetypeID to;
+    };
+    static constexpr int MaxMultiEdges = 8;
+    MultiEdge* multiEdges;
+    Uint8 numMultiEdges;
+    Uint8 nextMultiEdge; // slot the next multi edge replaces once they're all used
+    // bumped whenever entities are added or removed, a system that writes to the pool runs over it,
+    // or a component in it is marked changed, so savers can tell which pools changed.
+    // Writes through getComponent pointers aren't counted unless they're marked
+    Uint32 changeCount;
+    // change tick each column of each block was last written at, _numComponents per block.
+    // Lets jobs skip blocks that haven't changed since they last ran
+    Uint32* columnTicks;
+    // bumped whenever entities are removed or moved around in the pool, so EntityRefs into it can tell they're stale.
+    // Adding entities doesn't move the ones already there, so it doesn't count
+    Uint32 generation;
+    // archetypes are split by prototype, so every entity in a pool shares the same prototype (-1 for none).
+    // prototypeSignature is the prototype components it has, which count as part of the archetype for queries
+    Sint32 prototype;
+    Signature prototypeSignature;
     
     ArchetypePool(Signature signature, const Sint32* componentSizes, PoolAllocator* metaAllocator);
 
@@ -46,6 +87,11 @@ struct ArchetypePool {
         return _signature;
     }
 
+    // stored components and prototype components
+    Signature fullSignature() const {
+        return _signature | prototypeSignature;
+    }
+
     int getArrayNumberFromSignature(ComponentID component) const;
 
     int getArrayNumberLinear(ComponentID component) const {
@@ -68,61 +114,193 @@ struct ArchetypePool {
         return this->_numComponents;
     }
 
-    char* getComponentArray(ComponentID componentType) const {
+    /* Edges */
+
+    ArchetypeID getAddEdge(ComponentID component) const {
+        return edges ? edges[component] : NullArchetypeID;
+    }
+
+    ArchetypeID getRemoveEdge(ComponentID component) const {
+        return edges ? edges[MaxComponentIDs + component] : NullArchetypeID;
+    }
+
+    void setAddEdge(ComponentID component, ArchetypeID archetype, PoolAllocator* allocator) {
+        makeEdges(allocator);
+        edges[component] = archetype;
+    }
+
+    void setRemoveEdge(ComponentID component, ArchetypeID archetype, PoolAllocator* allocator) {
+        makeEdges(allocator);
+        edges[MaxComponentIDs + component] = archetype;
+    }
+
+    ArchetypeID getMultiEdge(Signature added, Signature removed) const {
+        for (int i = 0; i < numMultiEdges; i++) {
+            if (multiEdges[i].added == added && multiEdges[i].removed == removed) return multiEdges[i].to;
+        }
+        return NullArchetypeID;
+    }
+
+    void setMultiEdge(Signature added, Signature removed, ArchetypeID archetype, PoolAllocator* allocator) {
+        if (!multiEdges) {
+            multiEdges = allocator->allocate<MultiEdge>(MaxMultiEdges);
+        }
+        if (numMultiEdges < MaxMultiEdges) {
+            multiEdges[numMultiEdges++] = {added, removed, archetype};
+        } else {
+            multiEdges[nextMultiEdge] = {added, removed, archetype};
+            nextMultiEdge = (nextMultiEdge + 1) % MaxMultiEdges;
+        }
+    }
+
+    /* Blocks */
+
+    int blockCapacity() const {
+        return 1 << blockShift;
+    }
+
+    int blockOf(int index) const {
+        return index >> blockShift;
+    }
+
+    int rowOf(int index) const {
+        return index & (blockCapacity() - 1);
+    }
+
+    // number of entities stored in the block
+    int blockEntityCount(int block) const {
+        int count = size - (block << blockShift);
+        return count < 0 ? 0 : (count > blockCapacity() ? blockCapacity() : count);
+    }
+
+    // number of blocks that have entities in them
+    int usedBlockCount() const {
+        return (size + blockCapacity() - 1) >> blockShift;
+    }
+
+    Entity* getBlockEntities(int block) const {
+        DASSERT(block < numBlocks);
+        return (Entity*)blocks[block];
+    }
+
+    char* getBlockArray(int block, int arrayIndex) const {
+        DASSERT(block < numBlocks && arrayIndex < _numComponents);
+        return blocks[block] + arrays[arrayIndex].offset;
+    }
+
+    Uint32 getColumnTick(int block, int arrayIndex) const {
+        DASSERT(block < numBlocks && arrayIndex < _numComponents);
+        return columnTicks[block * _numComponents + arrayIndex];
+    }
+
+    void setColumnTick(int block, int arrayIndex, Uint32 tick) {
+        DASSERT(block < numBlocks && arrayIndex < _numComponents);
+        columnTicks[block * _numComponents + arrayIndex] = tick;
+    }
+
+    // mark every column of the blocks holding entities first..first+count-1 as written
+    void setTicks(int first, int count, Uint32 tick) {
+        if (count <= 0) return;
+        int lastBlock = blockOf(first + count - 1);
+        for (int b = blockOf(first); b <= lastBlock; b++) {
+            for (int i = 0; i < _numComponents; i++) {
+                columnTicks[b * _numComponents + i] = tick;
+            }
+        }
+    }
+
+    // returns null if the archetype doesn't have the component
+    char* getBlockComponentArray(int block, ComponentID componentType) const {
         int arrayNum = getArrayNumber(componentType);
         if (arrayNum == -1) return nullptr;
-        else return arrays[arrayNum].data;
+        return getBlockArray(block, arrayNum);
     }
 
-    char* getArray(int arrayIndex) const {
-        DASSERT(arrayIndex < _numComponents);
-        return arrays[arrayIndex].data;
+    /* Entities */
+
+    Entity getEntity(int index) const {
+        DASSERT(index < size && index >= 0);
+        return getBlockEntities(blockOf(index))[rowOf(index)];
+    }
+
+    void setEntity(int index, Entity entity) {
+        getBlockEntities(blockOf(index))[rowOf(index)] = entity;
     }
 
     char* getComponentByIndex(int arrayIndex, int componentIndex, int componentSize) const {
-        char* array = arrays[arrayIndex].data;
-        return array + componentIndex * componentSize;
+        return getBlockArray(blockOf(componentIndex), arrayIndex) + rowOf(componentIndex) * componentSize;
     }
 
-    // index must be in bounds
+    // null if the pool doesn't have the component, otherwise index must be in bounds
     char* getComponent(ComponentID component, int index, int componentSize) const {
-        DASSERT(index < size && index >= 0);
         int arrayNum = getArrayNumber(component);
         if (arrayNum == -1) return nullptr;
-        char* array = arrays[arrayNum].data;
-        return array + index * componentSize;
+        DASSERT(index < size && index >= 0);
+        return getComponentByIndex(arrayNum, index, componentSize);
     }
 
-    // returns index where entity is stored
+    // returns index where entity is stored. The blocks the entities went into are marked as written at tick
     // @param newEntities may be null and entities will be left uninitialized, they must be initialized after calling this!
-    int addNew(int count, const Entity* newEntities, ArchetypeAllocator* allocator, const Sint32* componentSizes);
+    int addNew(int count, const Entity* newEntities, ArchetypeAllocator* allocator, const Sint32* componentSizes, Uint32 tick);
 
     void copyIndex(int dstIndex, int srcIndex, const Sint32* componentSizes) {
         for (int i = 0; i < _numComponents; i++) {
             int componentID = arrays[i].componentType;
-            char* componentBuffer = arrays[i].data;
             auto componentSize = componentSizes[componentID];
-            memcpy(componentBuffer + dstIndex * componentSize, componentBuffer + srcIndex * componentSize, componentSize);
+            memcpy(getComponentByIndex(i, dstIndex, componentSize), getComponentByIndex(i, srcIndex, componentSize), componentSize);
         }
-        entities[dstIndex] = entities[srcIndex];
+        setEntity(dstIndex, getEntity(srcIndex));
     }
 
-    void remove(int index, Entity* movedEntity, const Sint32* componentSizes);
+    // the last entity is moved into the hole, so the block at index is marked as written at tick
+    void remove(int index, Entity* movedEntity, const Sint32* componentSizes, Uint32 tick);
+
+    // give back blocks at the end that haven't been used in a while. One empty block is kept
+    // so a pool going back and forth over a block boundary doesn't allocate every time
+    void releaseEmptyBlocks(ArchetypeAllocator* allocator) {
+        if (numBlocks - usedBlockCount() > 1) {
+            releaseBlocks(allocator, usedBlockCount() + 1);
+        }
+    }
 
     // void remove(ArrayRef<int> indices, SmallVectorImpl<EntityID>* movedEntities, const Sint32* componentSizes);
 
     void clear() {
         size = 0;
+        changeCount++;
+        generation++;
     }
 
     void destroy(PoolAllocator* poolAllocator, ArchetypeAllocator* archetypeAllocator, const Sint32* componentSizes) {
-        archetypeAllocator->deallocate(entities, capacity);
-        for (int i = 0; i < _numComponents; i++) {
-            ComponentID component = arrays[i].componentType;
-            archetypeAllocator->deallocate(arrays[i].data, capacity * componentSizes[component], alignof(std::max_align_t));
+        releaseBlocks(archetypeAllocator, 0);
+        free(blocks);
+        free(columnTicks);
+        blocks = nullptr;
+        columnTicks = nullptr;
+        blockListCapacity = 0;
+        if (edges) {
+            poolAllocator->deallocate(edges, 2 * MaxComponentIDs);
+            edges = nullptr;
+        }
+        if (multiEdges) {
+            poolAllocator->deallocate(multiEdges, MaxMultiEdges);
+            multiEdges = nullptr;
+            numMultiEdges = 0;
         }
         poolAllocator->deallocate(arrays, _numComponents);
     }
+private:
+    void makeEdges(PoolAllocator* allocator) {
+        if (edges) return;
+        edges = allocator->allocate<ArchetypeID>(2 * MaxComponentIDs);
+        for (int i = 0; i < 2 * MaxComponentIDs; i++) {
+            edges[i] = NullArchetypeID;
+        }
+    }
+
+    void addBlocks(int count, ArchetypeAllocator* allocator);
+    // free every block from firstBlock on
+    void releaseBlocks(ArchetypeAllocator* allocator, int firstBlock);
 };
 
 } // namespace ECS
@@ -1,14 +1,21 @@
 #ifndef ECS_COMMAND_BUFFER_INCLUDED
 #define ECS_COMMAND_BUFFER_INCLUDED
 
+#include <stdlib.h>
+#include <cstddef>
 #include "Entity.hpp"
 #include "My/Vec.hpp"
 #include "Signature.hpp"
+#include "ADT/ArrayRef.hpp"
 
 namespace ECS {
 
 using PrototypeID = Sint32;
 
+// Commands are recorded into a chain of fixed size blocks and component values into separate blocks that never move,
+// so commands can point straight at their values. Combining buffers links their blocks together instead of copying,
+// which makes it cheap to give every thread its own buffer and merge them after every stage.
+// A buffer is only safe to use from one thread at a time.
 struct EntityCommandBuffer {
     struct Command {
         Entity entity;
@@ -18,7 +25,7 @@ struct EntityCommandBuffer {
 
         struct Add {
             ComponentID component;
-            ssize_t componentValueIndex;
+            const char* value;
         };
 
         struct AddSignature {
@@ -27,7 +34,7 @@ struct EntityCommandBuffer {
 
         struct Set {
             ComponentID component;
-            ssize_t componentValueIndex;
+            const char* value;
         };
 
         struct Remove {
@@ -55,36 +62,97 @@ struct EntityCommandBuffer {
         } type;
     };
 
-    My::Vec<Command> commands = My::Vec<Command>::Empty();
-    My::Vec<char> valueBuffer = My::Vec<char>::Empty();
+    static constexpr int CommandsPerBlock = 256;
 
-    EntityID fakeEntityIDCounter = MaxEntityID+1;
+    struct CommandBlock {
+        CommandBlock* next;
+        int count;
+        Command commands[CommandsPerBlock];
+    };
+
+    static constexpr size_t ValueBlockSize = 16 * 1024;
+    static constexpr size_t ValueAlignment = alignof(std::max_align_t);
+
+    struct alignas(ValueAlignment) ValueBlock {
+        ValueBlock* next;
+        size_t used;
+        size_t capacity;
+
+        char* data() {
+            return (char*)(this + 1);
+        }
+    };
+
+    // A chain of command blocks recorded by the same buffer.
+    // Fake entity ids in a segment that came from another buffer are offset when played back,
+    // so fake entities from different buffers never collide. Ids in segments with a 0 offset are already correct
+    struct Segment {
+        CommandBlock* first;
+        CommandBlock* last;
+        EntityID fakeIDOffset;
+    };
+
+    My::Vec<Segment> segments = My::Vec<Segment>::Empty();
+    ValueBlock* firstValueBlock = nullptr;
+    ValueBlock* lastValueBlock = nullptr;
+    int commandCount = 0;
+
+    static constexpr EntityID FirstFakeEntityID = MaxEntityID+1;
+    EntityID fakeEntityIDCounter = FirstFakeEntityID;
 
     bool empty() const {
-        return commands.empty() && valueBuffer.empty();
+        return commandCount == 0 && !firstValueBlock;
     }
 
+    int size() const {
+        return commandCount;
+    }
+
+    // move all the commands in 'added' to the end of this buffer, leaving 'added' empty.
+    // Only links blocks together, no commands or values are copied
     void combine(EntityCommandBuffer& added) {
-        int indexDiff = this->valueBuffer.size;
-        for (auto& command : added.commands) {
-            if (command.type == Command::CommandAdd) {
-                command.add.componentValueIndex += indexDiff;
+        if (added.empty()) return;
+        EntityID fakeIDOffset = fakeEntityIDCounter - FirstFakeEntityID;
+        for (auto& segment : added.segments) {
+            segments.push(Segment{segment.first, segment.last, segment.fakeIDOffset + fakeIDOffset});
+        }
+        fakeEntityIDCounter += added.fakeEntityIDCounter - FirstFakeEntityID;
+        commandCount += added.commandCount;
+
+        if (added.firstValueBlock) {
+            if (lastValueBlock) {
+                lastValueBlock->next = added.firstValueBlock;
+            } else {
+                firstValueBlock = added.firstValueBlock;
+            }
+            lastValueBlock = added.lastValueBlock;
+        }
+
+        // the blocks belong to this buffer now
+        added.segments.destroy();
+        added.firstValueBlock = added.lastValueBlock = nullptr;
+        added.commandCount = 0;
+        added.fakeEntityIDCounter = FirstFakeEntityID;
+    }
+
+    // calls func(Command&, EntityID fakeIDOffset) for every command in the order they were recorded
+    template<typename Func>
+    void forEachCommand(Func func) {
+        for (auto& segment : segments) {
+            for (CommandBlock* block = segment.first; block; block = block->next) {
+                for (int i = 0; i < block->count; i++) {
+                    func(block->commands[i], segment.fakeIDOffset);
+                }
             }
         }
-        commands.push(added.commands.data, added.commands.size);
-        valueBuffer.push(added.valueBuffer.data, added.valueBuffer.size);
-        added.destroy();
     }
 
     Entity createEntity(PrototypeID prototype) {
         EntityID fakeID = fakeEntityIDCounter++;
-        commands.push(Command{
-            .type = Command::CommandCreate,
-            .entity = {fakeID, 0},
-            .create = {
-                .prototype = prototype
-            }
-        });
+        Command* command = pushCommand();
+        command->type = Command::CommandCreate;
+        command->entity = {fakeID, 0};
+        command->create = {prototype};
         return {fakeID, 0};
     }
 
@@ -95,40 +163,26 @@ struct EntityCommandBuffer {
     };
 
     void addSignature(Entity entity, Signature signature, ArrayRef<char> buffer, ArrayRef<VoidComponentValue> values) {
-        commands.reserve(1 + commands.size + values.size());
-        commands.push(Command{
-            .type = Command::CommandAddSignature,
-            .entity = entity,
-            .addSignature = {
-                .signature = signature
-            }
-        });
+        Command* command = pushCommand();
+        command->type = Command::CommandAddSignature;
+        command->entity = entity;
+        command->addSignature = {signature};
+
+        char* valueData = pushValue(buffer.data(), buffer.size());
         for (auto& value : values) {
-            commands.push(Command{
-                .type = Command::CommandSet,
-                .entity = entity,
-                .set = {
-                    .component = value.id,
-                    .componentValueIndex = valueBuffer.size + value.bufferIndex
-                }
-            });
+            Command* setCommand = pushCommand();
+            setCommand->type = Command::CommandSet;
+            setCommand->entity = entity;
+            setCommand->set = {value.id, valueData + value.bufferIndex};
         }
-        
-        valueBuffer.push(buffer);
     }
 
     void addComponent(Entity entity, ComponentID component, const void* value, size_t componentSize) {
-        auto componentPos = valueBuffer.size;
-        valueBuffer.push((char*)value, componentSize);
-        memcpy(&valueBuffer[componentPos], value, componentSize);
-        commands.push(Command{
-            .type = Command::CommandAdd,
-            .entity = entity,
-            .add = {
-                .component = component,
-                .componentValueIndex = componentPos
-            }
-        });
+        const char* valueData = pushValue(value, componentSize);
+        Command* command = pushCommand();
+        command->type = Command::CommandAdd;
+        command->entity = entity;
+        command->add = {component, valueData};
     }
 
     template<class C>
@@ -137,13 +191,10 @@ struct EntityCommandBuffer {
     }
 
     void removeComponent(Entity entity, ComponentID component) {
-        commands.push(Command{
-            .type = Command::CommandRemove,
-            .entity = entity,
-            .remove = {
-                .component = component
-            }
-        });
+        Command* command = pushCommand();
+        command->type = Command::CommandRemove;
+        command->entity = entity;
+        command->remove = {component};
     }
 
     template<class C>
@@ -152,20 +203,79 @@ struct EntityCommandBuffer {
     }
 
     void deleteEntity(Entity entity) {
-        commands.push(Command{
-            .type = Command::CommandDelete,
-            .entity = entity,
-            .del = {}
-        });
+        Command* command = pushCommand();
+        command->type = Command::CommandDelete;
+        command->entity = entity;
+        command->del = {};
     }
 
     void destroy() {
-        commands.destroy();
-        valueBuffer.destroy();
+        for (auto& segment : segments) {
+            CommandBlock* block = segment.first;
+            while (block) {
+                CommandBlock* next = block->next;
+                free(block);
+                block = next;
+            }
+        }
+        segments.destroy();
 
+        ValueBlock* valueBlock = firstValueBlock;
+        while (valueBlock) {
+            ValueBlock* next = valueBlock->next;
+            free(valueBlock);
+            valueBlock = next;
+        }
+        firstValueBlock = lastValueBlock = nullptr;
+        commandCount = 0;
+        fakeEntityIDCounter = FirstFakeEntityID;
+    }
+private:
+    static CommandBlock* newCommandBlock() {
+        auto* block = (CommandBlock*)malloc(sizeof(CommandBlock));
+        block->next = nullptr;
+        block->count = 0;
+        return block;
+    }
+
+    Command* pushCommand() {
+        // segments taken from other buffers have their own fake id offset, so never record into them
+        if (segments.empty() || segments.back().fakeIDOffset != 0) {
+            CommandBlock* block = newCommandBlock();
+            segments.push(Segment{block, block, 0});
+        }
+        Segment& segment = segments.back();
+        if (segment.last->count == CommandsPerBlock) {
+            CommandBlock* block = newCommandBlock();
+            segment.last->next = block;
+            segment.last = block;
+        }
+        commandCount++;
+        return &segment.last->commands[segment.last->count++];
+    }
+
+    char* pushValue(const void* value, size_t size) {
+        size_t alignedSize = (size + ValueAlignment - 1) & ~(ValueAlignment - 1);
+        if (!lastValueBlock || lastValueBlock->used + alignedSize > lastValueBlock->capacity) {
+            size_t capacity = alignedSize > ValueBlockSize ? alignedSize : ValueBlockSize;
+            auto* block = (ValueBlock*)malloc(sizeof(ValueBlock) + capacity);
+            block->next = nullptr;
+            block->used = 0;
+            block->capacity = capacity;
+            if (lastValueBlock) {
+                lastValueBlock->next = block;
+            } else {
+                firstValueBlock = block;
+            }
+            lastValueBlock = block;
+        }
+        char* data = lastValueBlock->data() + lastValueBlock->used;
+        lastValueBlock->used += alignedSize;
+        memcpy(data, value, size);
+        return data;
     }
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,72 @@
+#ifndef ECS_COMPONENT_ACCESS_INCLUDED
+#define ECS_COMPONENT_ACCESS_INCLUDED
+
+namespace ECS {
+
+namespace Systems {
+
+// How a job or query uses a component.
+// Read and written components are required and passed along, tags are required but not passed,
+// and subtracted components must not be present.
+// Changed components are required, and only the storage blocks where they were written since the group's jobs
+// last ran are visited. Every job on the group visits the same blocks in a frame
+
+template<class C>
+struct ReadOnly {
+    static constexpr bool read = true;
+    static constexpr bool write = false;
+    static constexpr bool subtract = false;
+    static constexpr bool changed = false;
+    using Type = C;
+};
+
+template<class C>
+struct ReadWrite {
+    static constexpr bool read = true;
+    static constexpr bool write = true;
+    static constexpr bool subtract = false;
+    static constexpr bool changed = false;
+    using Type = C;
+};
+
+template<class C>
+struct Tag {
+    static constexpr bool read = false;
+    static constexpr bool write = false;
+    static constexpr bool subtract = false;
+    static constexpr bool changed = false;
+    using Type = C;
+};
+
+template<class C>
+struct Subtract {
+    static constexpr bool read = false;
+    static constexpr bool write = false;
+    static constexpr bool subtract = true;
+    static constexpr bool changed = false;
+    using Type = C;
+};
+
+template<class C>
+using Without = Subtract<C>;
+
+template<class C>
+struct Changed {
+    static constexpr bool read = false;
+    static constexpr bool write = false;
+    static constexpr bool subtract = false;
+    static constexpr bool changed = true;
+    using Type = C;
+};
+
+}
+
+// so queries can be written without the systems namespace
+using Systems::ReadOnly;
+using Systems::ReadWrite;
+using Systems::Tag;
+using Systems::Without;
+
+}
+
+#endif
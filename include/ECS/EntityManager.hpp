@@ -6,6 +6,7 @@
 #include "ArchetypalComponentManager.hpp"
 #include "Entity.hpp"
 #include "PrototypeManager.hpp"
+#include "Relation.hpp"
 #include "CommandBuffer.hpp"
 
 namespace ECS {
@@ -15,7 +16,8 @@ using ComponentManager = ArchetypalComponentManager;
 template<typename Value>
 using ComponentSet = My::DenseSparseSet<Sint8, Value, Uint8, MaxComponentIDs>;
 
-using ComponentDestructor = std::function<void(Entity)>;
+// called with the component being destructed, which isn't always stored on the entity (e.g. a value still in a command buffer)
+using ComponentDestructor = std::function<void(Entity, void* component)>;
 struct ComponentOnAdds {
     struct OnAdd {
         Signature required;
@@ -41,6 +43,8 @@ private:
 
     Signature componentsWithOnAdd = 0;
 public:
+    // told about every deleted entity, see addRelation
+    SmallVector<Relation*, 2> relations;
 
     // component info is copied
     void init(ArrayRef<ComponentInfo> componentInfo, int numPrototypes);
@@ -93,14 +97,13 @@ public:
 
         static constexpr Signature reqSignature = getSignatureNoProto<ReqComponents...>();
 
-        for (Uint32 i = 0; i < components.pools.size(); i++) {
-            auto& pool = components.pools[i];
-            auto signature = pool.signature();
-            if ((signature & reqSignature) == reqSignature) {
-                for (Uint32 e = 0; e < (Uint32)pool.size; e++) {
-                    Entity entity = pool.entities[e];
-                    func(entity);
-                }
+        int query = components.getQuery({reqSignature, Signature{0}});
+        // index every time, archetypes made by func are added to the query while we go
+        for (Uint32 i = 0; i < components.getQueryArchetypes(query).size(); i++) {
+            auto& pool = components.pools[components.getQueryArchetypes(query)[i]];
+            for (Uint32 e = 0; e < (Uint32)pool.size; e++) {
+                Entity entity = pool.getEntity(e);
+                func(entity);
             }
         }
 
@@ -119,7 +122,7 @@ public:
             auto signature = pool.signature();
             if (query(signature)) {
                 for (int e = pool.size-1; e >= 0; e--) {
-                    Entity entity = pool.entities[e];
+                    Entity entity = pool.getEntity(e);
                     func(entity);
                 }
             }
@@ -139,7 +142,7 @@ public:
             auto signature = pool.signature();
             if (query(signature)) {
                 for (int e = pool.size-1; e >= 0; e--) {
-                    Entity entity = pool.entities[e];
+                    Entity entity = pool.getEntity(e);
                     if (func(entity)) {
                         break;
                     }
@@ -153,7 +156,7 @@ public:
     }
 
     Entity createEntity(PrototypeID prototype) {
-        Entity entity = components.createEntity(prototype);
+        Entity entity = components.createEntity(prototype, getPrototypeSignature(prototype));
         return entity;
     }
 
@@ -161,9 +164,21 @@ public:
     // and no command buffering
     void doDeleteEntity(Entity entity) {
         destructComponents(entity, getEntitySignature(entity));
+        relationsEntityDeleted(entity);
         components.deleteEntity(entity);
     }
 
+    // keep the relation free of deleted entities. The relation must outlive the manager or be removed first
+    void addRelation(Relation* relation) {
+        relations.push_back(relation);
+    }
+
+    void relationsEntityDeleted(Entity entity) {
+        for (Relation* relation : relations) {
+            relation->entityDeleted(entity);
+        }
+    }
+
     void deleteEntity(Entity entity);
 
     __attribute__((pure))
@@ -183,6 +198,12 @@ public:
         return getPrototype(getPrototypeID(entity));
     }
 
+    // prototype components the prototype has, none if there is no such prototype
+    Signature getPrototypeSignature(PrototypeID type) const {
+        const Prototype* prototype = getPrototype(type);
+        return prototype ? prototype->signature : Signature{0};
+    }
+
     PrototypeID getPrototypeID(Entity entity) const {
         auto index = components.getEntityIndex(entity.id);
         auto version = components.getVersion(index);
@@ -232,6 +253,29 @@ public:
         return component;
     }
 
+    // look the entity up once for reading several components with getComponent(EntityRef).
+    // Null ref if the entity doesn't exist
+    EntityRef getRef(Entity entity) const {
+        return components.getRef(entity);
+    }
+
+    bool refValid(EntityRef ref) const {
+        return components.refValid(ref);
+    }
+
+    // same as getComponent(Entity) without looking the entity up. The ref must be valid
+    template<class C>
+    __attribute__((pure))
+    std::conditional_t<C::PROTOTYPE, const C*, C*> getComponent(EntityRef ref) const {
+        if constexpr (C::PROTOTYPE) {
+            // archetypes are split by prototype
+            auto* prototype = getPrototype(components.pools[ref.archetype].prototype);
+            return prototype ? prototype->template get<C>() : nullptr;
+        } else {
+            return (C*)components.getComponent(ref, C::ID);
+        }
+    }
+
     // does not work for prototype components maybe TODO?
     __attribute__((pure)) void* getComponent(Entity entity, ComponentID component) const {
         return components.getComponent(entity, component);
@@ -243,11 +287,25 @@ public:
         C* component = getComponent<C>(entity);
         if (component) {
             *component = value;
+            components.markChanged(entity, C::ID);
         } else {
             LogErrorLoc("Component %s does not exist for entity!", getComponentName(C::ID));
         }
     }
 
+    // writes through component pointers aren't seen by jobs filtering on Changed<C> or by change saving unless they're marked
+    template<class C>
+    void markChanged(Entity entity) {
+        static_assert(!C::PROTOTYPE, "Prototype components can't change!");
+        components.markChanged(entity, C::ID);
+    }
+
+    template<class C>
+    void markChanged(EntityRef ref) {
+        static_assert(!C::PROTOTYPE, "Prototype components can't change!");
+        components.markChanged(ref, C::ID);
+    }
+
     ComponentSet<ComponentOnAdds> onAdds;
 
     void* doAddComponent(Entity entity, ComponentID component) {
@@ -275,6 +333,9 @@ protected:
     void destructComponents(Entity entity, Signature signature);
 
     void destructComponent(Entity entity, ComponentID component);
+
+    // run the destructor on a component value that isn't on the entity
+    void destructComponentValue(Entity entity, ComponentID component, void* value);
 public:
 
     void setComponentDestructor(ComponentID component, const ComponentDestructor& destructor) {
@@ -303,12 +364,8 @@ public:
             return false;
         }
 
-        const Prototype* prototype = getPrototype(entity);
-
-        Signature signature = components.getEntitySignature(entity);
-        if (prototype) {
-            signature |= prototype->signature;
-        }
+        // archetypes are split by prototype, so the pool knows the prototype components
+        Signature signature = components.getEntityFullSignature(entity);
         static constexpr Signature componentSignature = getSignature<Components...>();
         return (signature & componentSignature) == componentSignature;
     }
@@ -4,6 +4,7 @@
 #include "ECS/Signature.hpp"
 #include "ECS/EntityManager.hpp"
 #include <vector>
+#include <atomic>
 
 namespace ECS {
 
@@ -17,6 +18,8 @@ struct Job {
 
     Entity* entities;
     void** componentArrays;
+    // prototype of every entity in the chunk being run, null if they have none
+    const Prototype* prototype = nullptr;
     
     EntityCommandBuffer* commandBuffer;
 
@@ -25,6 +28,10 @@ struct Job {
     Signature writeComponents = 0;
 
     uint32_t size;
+    const char* name = "Job"; // type name of the job, for profiling and debugging
+
+    // entities per chunk when run in parallel. 0 picks a size from the measured cost per entity
+    int chunkSize = 0;
 
     bool parallelize     : 1;
     bool mainThread      : 1;
@@ -59,9 +66,10 @@ struct JobData {
 
     EntityCommandBuffer* commandBuffer;
 
+    // only valid for indices in the same storage block as indexBegin
     template<class Component>
     Component* getComponentArray() const {
-        char* poolComponentArray = pool->getComponentArray(Component::ID);
+        char* poolComponentArray = pool->getComponent(Component::ID, indexBegin, sizeof(Component));
         assert(poolComponentArray && "Archetype pool does not have this component!");
 
         // need to adjust to make the pointer point 'componentIndex' number of components behind itself,
@@ -77,7 +85,7 @@ struct JobData {
     }
 
     Entity* getEntityArray() const {
-        return pool->entities - indexBegin;
+        return pool->getBlockEntities(pool->blockOf(indexBegin)) + pool->rowOf(indexBegin) - indexBegin;
     }
 };
 
@@ -146,13 +154,26 @@ public:
     }
 };
 
+// counts down the chunks of one scheduled job, so the scheduler can tell when the whole job is done
+struct JobCounter {
+    std::atomic<int> remaining{0};
+    int node = -1; // job graph node this counter belongs to
+
+    // timing for the chunks of this job, in SDL_GetTicksNS() nanoseconds
+    uint64_t submitTime = 0;
+    std::atomic<uint64_t> workNanoseconds{0}; // time spent running chunks, summed over all threads
+    std::atomic<uint64_t> lastChunkEnd{0};
+};
+
 struct JobChunk {
     const Job* job;
     void* groupVars;
     const ArchetypePool* pool;
     int indexBegin;
     int indexEnd; // exclusive
-    int poolOffset;
+    int poolOffset; // pool index of the first entity. Chunks never cross a storage block
+    const Prototype* prototype = nullptr; // the same for the whole pool, since archetypes are split by prototype
+    JobCounter* counter = nullptr; // decremented when the chunk finishes. May be null
 };
 
 struct GroupArrayT {
@@ -166,6 +187,7 @@ struct IComponentGroup {
     Signature write;
     Signature signature;
     Signature subtract;
+    Signature changed; // only blocks where one of these was written since the group's jobs last ran are visited
 };
 
 struct Group {
@@ -182,6 +204,13 @@ struct Group {
     TriggerType trigger;
     std::vector<GroupArrayT> arrays;
     ArchetypePool* watcherPool = nullptr;
+    int query = -1; // component manager query of archetypes in the group, for EntityInGroup groups
+    // Blocks visited this frame when filtering on changed components. Found by the first job on the group each frame
+    // and shared by the rest, so jobs passing a GroupArray between them agree on which entities it was filled for
+    Uint32 changedSinceTick = 0; // change tick the blocks were last found at
+    Uint32 changedBlocksFrame = 0; // frame changedBlocks is for
+    std::vector<int> changedBlocks; // block numbers, one pool after another
+    std::vector<int> changedBlocksStart; // where each pool's blocks start in changedBlocks, and the end
 
     Group(IComponentGroup group, TriggerType trigger) : group(group), trigger(trigger) {}
 
@@ -197,6 +226,7 @@ struct Group {
     bool operator==(const Group& other) const {
         return group.signature == other.group.signature
             && group.subtract  == other.group.subtract
+            && group.changed   == other.group.changed
             && trigger == other.trigger;
     }
 };
@@ -266,6 +296,7 @@ struct MakeJobber<JobT, Execute, std::tuple<Vars...>> {
 template<typename Derived, typename... Components>
 struct JobDecl : Job {
     static_assert(sizeof...(Components) <= 8, "Jobs must use a maximum of 8 component arrays!");
+    static_assert((!Components::PROTOTYPE && ...), "Prototype components have no arrays, read them with GetPrototype instead!");
     // because of Job::componentIDs array being 8 elements
 
     template<typename Component, typename... Cs>
@@ -290,6 +321,7 @@ struct JobDecl : Job {
         this->executeFunc = MakeJobber<Derived, &Derived::Execute, JobGroupVars<&Derived::Execute>>::makeExecuteFunc();
 
         size = sizeof(Derived);
+        name = getTypeName<Derived>();
     }
 
     template<class C>
@@ -315,6 +347,15 @@ struct JobDecl : Job {
         return entities[N];
     }
 
+    // prototype component shared by every entity in the chunk.
+    // Prototype components aren't job template arguments, the group has to require them instead
+    template<class Component>
+    [[nodiscard]] LLVM_ATTRIBUTE_ALWAYS_INLINE const Component& GetPrototype() const {
+        static_assert(Component::PROTOTYPE, "Component must be a prototype component!");
+        DASSERT(this->prototype && this->prototype->template has<Component>() && "Job group doesn't require this prototype component!");
+        return *this->prototype->template get<Component>();
+    }
+
     template<auto Exe, class FirstComponentNeeded, class... RestComponentsNeeded>
     void addConditionalExecute() {
         if (nConditionalExecutions == MaxConditionalExecutions) {
@@ -0,0 +1,116 @@
+#ifndef ECS_JOB_SCHEDULER_INCLUDED
+#define ECS_JOB_SCHEDULER_INCLUDED
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "ECS/Job.hpp"
+#include "ECS/CommandBuffer.hpp"
+#include "ADT/ArrayRef.hpp"
+#include "ADT/concurrent/Spinlock.hpp"
+#include "utils/system/sysinfo.hpp"
+#include "threads.hpp"
+
+namespace ECS {
+
+namespace Systems {
+
+// adds commands to commandBuffer
+void executeJobChunk(const JobChunk& chunk, EntityCommandBuffer* commandBuffer, const EntityManager* entityManager);
+
+// Long lived worker threads that run job chunks.
+// Every worker has its own deque of chunks. Workers pop from the back of their own deque
+// and steal from the front of other workers' deques when they run out.
+// Idle workers park on a condition variable instead of spinning, so they cost nothing between frames.
+struct JobScheduler {
+    struct alignas(CACHE_LINE_SIZE) Worker {
+        JobScheduler* scheduler = nullptr;
+        int index = 0;
+        Threads::ThreadID thread = Threads::ThreadManager::NullThread;
+
+        Spinlock queueLock;
+        std::deque<JobChunk> queue;
+
+        // commands made by jobs run on this worker. Only touched by the worker until the batch is finished
+        EntityCommandBuffer commandBuffer;
+    };
+private:
+    Worker* workers = nullptr;
+    int numWorkers = 0;
+    // round robin index for distributing submitted chunks
+    int nextSubmitWorker = 0;
+
+    const EntityManager* entityManager = nullptr;
+
+    // chunks sitting in a queue, not yet taken by anyone
+    alignas(CACHE_LINE_SIZE) std::atomic<int> queuedChunks{0};
+    // chunks submitted but not finished executing
+    alignas(CACHE_LINE_SIZE) std::atomic<int> unfinishedChunks{0};
+    std::atomic<bool> quit{false};
+
+    std::mutex parkMutex;
+    std::condition_variable workAvailable; // signaled when chunks are submitted or on quit
+    std::condition_variable mainWake; // signaled when unfinishedChunks reaches 0 or a counter finishes
+    // counters that reached zero and haven't been collected yet. Guarded by parkMutex
+    std::vector<JobCounter*> finishedCounters;
+
+    // number of times an idle worker checks for work before parking
+    static constexpr int SpinsBeforePark = 256;
+
+    static int workerThreadFunc(void* workerPtr);
+
+    bool popOwn(Worker* worker, JobChunk* chunk);
+    bool stealFrom(Worker* victim, JobChunk* chunk);
+    // try to take a chunk from any worker's queue, starting at startWorker
+    bool steal(int startWorker, JobChunk* chunk);
+    void finishChunk(const JobChunk& chunk);
+    // execute the chunk, time it if it has a counter or the profiler is on, then finish it
+    void runChunk(const JobChunk& chunk, EntityCommandBuffer* commandBuffer);
+public:
+    JobScheduler() {}
+
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    // opens workerCount threads from the thread manager and keeps them until stop() is called.
+    // returns the number of workers actually started, which may be less if the manager ran out of threads
+    int start(ThreadManager& threadManager, int workerCount);
+
+    // tell all workers to quit and wait for them to close. Any chunks still queued are dropped
+    void stop(ThreadManager& threadManager);
+
+    bool started() const {
+        return numWorkers > 0;
+    }
+
+    int workerCount() const {
+        return numWorkers;
+    }
+
+    // queue chunks to be run on the workers. Chunks are executed with the given entity manager.
+    // Only one thread may submit and wait at a time
+    void submit(ArrayRef<JobChunk> chunks, const EntityManager* entityManager);
+
+    // wait for all submitted chunks to finish. The calling thread runs queued chunks itself
+    // while it waits, putting their commands into commandBuffer
+    void wait(EntityCommandBuffer* commandBuffer);
+
+    // wait until at least one chunk counter reaches zero and return the finished counters, running
+    // queued chunks on the calling thread in the meantime. Returns empty if nothing is left running,
+    // as nothing more can finish then
+    void waitForCounters(EntityCommandBuffer* commandBuffer, std::vector<JobCounter*>* finished);
+
+    // move all commands made by workers into commandBuffer. Must only be called when no chunks are running
+    void flushCommands(EntityCommandBuffer* commandBuffer);
+
+    ~JobScheduler() {
+        assert(numWorkers == 0 && "Job scheduler must be stopped before being destroyed!");
+    }
+};
+
+}
+
+}
+
+#endif
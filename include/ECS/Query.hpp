@@ -0,0 +1,140 @@
+#ifndef ECS_QUERY_INCLUDED
+#define ECS_QUERY_INCLUDED
+
+#include <tuple>
+#include <type_traits>
+#include "ECS/EntityManager.hpp"
+#include "ECS/ComponentAccess.hpp"
+
+namespace ECS {
+
+template<class T>
+struct QueryColumn {
+    Sint32 offset; // of the column in every block of the pool
+
+    T* in(char* block) const {
+        return (T*)(block + offset);
+    }
+};
+
+/* Iterate entities by the components they have, like Query<ReadOnly<A>, ReadWrite<B>, Without<C>>.
+ * Runs over the matching archetypes a block at a time, handing out pointers straight into the component columns,
+ * so no per entity lookups are done. ReadOnly and ReadWrite components are passed to the callback in the order given,
+ * Tag components are required but not passed. Prototype components can be used as Tag or Without,
+ * and since archetypes are split by prototype that filters whole archetypes too.
+ * Like forEachEntity, structural changes made while iterating go to the manager's command buffer, so one must be in use
+ * if entities may be created, destroyed or have components added or removed.
+ * Queries with a ReadWrite component count as changing the pools they run over, for the change log, and mark the columns
+ * they write as changed for jobs filtering on Changed. Unless the callback says otherwise, every block it's given counts
+ * as written, so only use ReadWrite for components that are actually written, or return whether anything was written.
+ */
+template<class... Accesses>
+struct Query {
+    static_assert(((!Accesses::Type::PROTOTYPE || !(Accesses::read || Accesses::write)) && ...),
+        "Prototype components have no columns, they can only be Tag or Without!");
+    static_assert(((!Accesses::changed) && ...), "Queries don't keep track of when they last ran, so they can't filter on changes!");
+
+    static constexpr bool Writes = (Accesses::write || ...);
+    using Manager = std::conditional_t<Writes, EntityManager, const EntityManager>;
+
+    static constexpr Signature required() {
+        Signature signature{0};
+        ((Accesses::subtract ? void() : (void)signature.set(Accesses::Type::ID)), ...);
+        return signature;
+    }
+
+    static constexpr Signature rejected() {
+        Signature signature{0};
+        ((Accesses::subtract ? (void)signature.set(Accesses::Type::ID) : void()), ...);
+        return signature;
+    }
+
+    /* Calls func(int count, const Entity* entities, A* a, const B* b, ...) for every block of matching entities.
+     * Columns of ReadOnly components are const. The arrays are plain and contiguous, so loops over them can be vectorized.
+     * func can return a bool saying whether it wrote to the block, so blocks and pools left alone aren't marked as changed.
+     */
+    template<class Func>
+    static void forEachBlock(Manager& entityManager, Func func) {
+        bool locked = entityManager.lock();
+        auto& components = entityManager.components;
+
+        Uint32 tick = 0;
+        if constexpr (Writes) {
+            tick = components.takeChangeTick();
+        }
+
+        int query = components.getQuery({required(), rejected()});
+        // index every time, archetypes made by func are added to the query while we go
+        for (Uint32 i = 0; i < components.getQueryArchetypes(query).size(); i++) {
+            auto& pool = components.pools[components.getQueryArchetypes(query)[i]];
+            if (pool.empty()) continue;
+            int writtenArrays[sizeof...(Accesses)];
+            int numWritten = 0;
+            if constexpr (Writes) {
+                ((Accesses::write ? (void)(writtenArrays[numWritten++] = pool.getArrayNumber(Accesses::Type::ID)) : void()), ...);
+            }
+
+            auto columns = std::tuple_cat(columnOf<Accesses>(pool) ...);
+            bool poolWritten = false;
+            for (int block = 0; block < pool.usedBlockCount(); block++) {
+                char* blockData = pool.blocks[block];
+                int count = pool.blockEntityCount(block);
+                bool blockWritten = std::apply([&](auto... column){
+                    if constexpr (std::is_same_v<decltype(func(count, (const Entity*)blockData, column.in(blockData) ...)), bool>) {
+                        return func(count, (const Entity*)blockData, column.in(blockData) ...);
+                    } else {
+                        func(count, (const Entity*)blockData, column.in(blockData) ...);
+                        return true;
+                    }
+                }, columns);
+                if (Writes && blockWritten) {
+                    for (int w = 0; w < numWritten; w++) {
+                        pool.setColumnTick(block, writtenArrays[w], tick);
+                    }
+                    poolWritten = true;
+                }
+            }
+            if constexpr (Writes) {
+                if (poolWritten) pool.changeCount++;
+            }
+        }
+
+        if (locked) {
+            entityManager.unlock();
+        }
+    }
+
+    // Calls func(Entity entity, A& a, const B& b, ...) for every matching entity.
+    // Like forEachBlock, func can return whether it wrote to the entity
+    template<class Func>
+    static void forEach(Manager& entityManager, Func func) {
+        forEachBlock(entityManager, [&func](int count, const Entity* entities, auto*... columns){
+            if constexpr (std::is_same_v<decltype(func(entities[0], columns[0] ...)), bool>) {
+                bool written = false;
+                for (int i = 0; i < count; i++) {
+                    written |= func(entities[i], columns[i] ...);
+                }
+                return written;
+            } else {
+                for (int i = 0; i < count; i++) {
+                    func(entities[i], columns[i] ...);
+                }
+            }
+        });
+    }
+private:
+    template<class Access, class Pool>
+    static auto columnOf(Pool& pool) {
+        if constexpr (Access::read || Access::write) {
+            using T = std::conditional_t<Access::write, typename Access::Type, const typename Access::Type>;
+            int arrayNum = pool.getArrayNumber(Access::Type::ID);
+            return std::tuple<QueryColumn<T>>(QueryColumn<T>{pool.arrays[arrayNum].offset});
+        } else {
+            return std::tuple<>();
+        }
+    }
+};
+
+}
+
+#endif
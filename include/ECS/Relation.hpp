@@ -0,0 +1,94 @@
+#ifndef ECS_RELATION_INCLUDED
+#define ECS_RELATION_INCLUDED
+
+#include <vector>
+#include "ADT/ArrayRef.hpp"
+#include "My/HashMap.hpp"
+#include "Entity.hpp"
+
+namespace ECS {
+
+/* A relationship from source entities to target entities, like following or being the child of something.
+ * Every source has at most one target, while a target can have any number of sources.
+ * Pairs are kept sorted by target, so the sources of a target are next to each other and a system can go
+ * target by target, looking each target up once for all of its sources.
+ * Relations added to an entity manager with addRelation are told about deleted entities, and drop every pair
+ * the entity was part of, so no relation ever points at a dead entity.
+ */
+struct Relation {
+    struct Pair {
+        Entity target;
+        Entity source;
+    };
+
+    Relation() {
+        pairsBySource = decltype(pairsBySource)::Empty();
+        sourceCounts = decltype(sourceCounts)::Empty();
+    }
+
+    // replaces the source's old target if it had one
+    void set(Entity source, Entity target);
+
+    void remove(Entity source);
+
+    // null if the source has no target
+    Entity getTarget(Entity source) const {
+        const Pair* pair = pairsBySource.lookup(source.id);
+        return (pair && pair->source == source) ? pair->target : NullEntity;
+    }
+
+    bool isTarget(Entity target) const {
+        return sourceCounts.contains(target.id);
+    }
+
+    int size() const {
+        return pairsBySource.size;
+    }
+
+    // the pairs with the target, sorted by source id
+    ArrayRef<Pair> getSources(Entity target);
+
+    /* Calls func(Entity target, ArrayRef<Pair> pairs) once for every target, with all of the pairs it's the target of.
+     * The relation must not be changed while iterating, so deletes should go through a command buffer.
+     */
+    template<class Func>
+    void forEachTarget(Func func) {
+        sort();
+        for (size_t start = 0; start < pairs.size();) {
+            size_t end = start + 1;
+            while (end < pairs.size() && pairs[end].target == pairs[start].target) end++;
+            func(pairs[start].target, ArrayRef<Pair>(pairs.data() + start, end - start));
+            start = end;
+        }
+    }
+
+    // calls func(Entity source, Entity target) for every pair, in no particular order
+    template<class Func>
+    void forEachPair(Func func) const {
+        pairsBySource.forEach([&](EntityID, const Pair& pair){
+            func(pair.source, pair.target);
+        });
+    }
+
+    // drop every pair the entity is in, as either source or target
+    void entityDeleted(Entity entity);
+
+    void clear();
+
+    void destroy();
+private:
+    // may have stale or repeated pairs in it until sorted, pairsBySource is always up to date
+    std::vector<Pair> pairs;
+    My::HashMap<EntityID, Pair> pairsBySource;
+    My::HashMap<EntityID, Sint32> sourceCounts; // number of sources of each target
+    bool sorted = true;
+
+    void countSource(Entity target, int change);
+
+    // drop stale pairs and sort the rest by target, then source
+    void sort();
+};
+
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef ECS_SERIALIZATION_INCLUDED
+#define ECS_SERIALIZATION_INCLUDED
+
+#include <stdio.h>
+#include <functional>
+#include <vector>
+#include "ECS/EntityManager.hpp"
+
+namespace ECS {
+
+// Writes binary data to a file or to memory, keeping track of the position so sections can be aligned
+struct SaveWriter {
+    FILE* file = nullptr;
+    std::vector<char>* buffer = nullptr; // appended to instead of writing to file when not null
+    size_t bufferStart = 0;
+    size_t position = 0;
+    bool failed = false;
+
+    SaveWriter(FILE* file) : file(file) {}
+
+    SaveWriter(std::vector<char>* buffer) : buffer(buffer), bufferStart(buffer->size()) {}
+
+    void write(const void* data, size_t size) {
+        if (size == 0) return;
+        if (buffer) {
+            buffer->insert(buffer->end(), (const char*)data, (const char*)data + size);
+        } else if (fwrite(data, 1, size, file) != size) {
+            failed = true;
+        }
+        position += size;
+    }
+
+    template<typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be written directly");
+        write(&value, sizeof(T));
+    }
+
+    // start a block of data prefixed by its size in bytes, so readers can skip it.
+    // Returns what to pass to endBlock
+    size_t beginBlock() {
+        write(Uint64(0));
+        return position;
+    }
+
+    void endBlock(size_t blockStart) {
+        Uint64 size = position - blockStart;
+        if (buffer) {
+            memcpy(buffer->data() + bufferStart + blockStart - sizeof(Uint64), &size, sizeof(size));
+            return;
+        }
+        long end = ftell(file);
+        fseek(file, end - (long)size - (long)sizeof(Uint64), SEEK_SET);
+        if (fwrite(&size, sizeof(size), 1, file) != 1) failed = true;
+        fseek(file, end, SEEK_SET);
+    }
+
+    // pad with zeros until the position is a multiple of alignment
+    void align(size_t alignment) {
+        static const char zeros[64] = {0};
+        size_t padding = (alignment - position % alignment) % alignment;
+        write(zeros, padding);
+    }
+};
+
+// Reads binary data out of memory, usually a mapped file. Reading past the end sets failed and returns null/false
+struct SaveReader {
+    const char* data;
+    size_t size;
+    size_t position = 0;
+    bool failed = false;
+
+    SaveReader(const char* data, size_t size) : data(data), size(size) {}
+
+    // pointer to the next 'bytes' bytes, which stay valid as long as the data does
+    const char* read(size_t bytes) {
+        if (failed || bytes > size - position) {
+            failed = true;
+            return nullptr;
+        }
+        const char* result = data + position;
+        position += bytes;
+        return result;
+    }
+
+    template<typename T>
+    bool read(T* value) {
+        static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be read directly");
+        const char* bytes = read(sizeof(T));
+        if (!bytes) return false;
+        memcpy(value, bytes, sizeof(T));
+        return true;
+    }
+
+    void align(size_t alignment) {
+        size_t padding = (alignment - position % alignment) % alignment;
+        read(padding);
+    }
+};
+
+// Columns are written raw, which is wrong for components that point to memory.
+// A serializer writes what a component points to after its column, and fixes the pointers back up when loaded
+struct ComponentSerializer {
+    // called for every component of the type, in column order
+    std::function<void(const void* component, SaveWriter& writer)> save;
+    // component holds the raw bytes that were saved. Returns false if the data is bad
+    std::function<bool(void* component, SaveReader& reader)> load;
+};
+
+// indexed by component id. Components without a serializer are saved and loaded as raw bytes
+using ComponentSerializers = std::vector<ComponentSerializer>;
+
+// The change counters of an entity manager as of the last save, so the next save can write only what changed
+struct SavedVersions {
+    bool valid = false; // false until a full save has been made
+    Uint32 entityChangeCount = 0;
+    std::vector<Uint32> poolChangeCounts; // indexed by archetype id
+
+    void invalidate() {
+        valid = false;
+        poolChangeCounts.clear();
+    }
+};
+
+/*
+* Entities are saved with their ids and versions, so entity references inside components stay valid.
+* Components are matched up by name when loading, so components can be added, removed or reordered between versions.
+* Components that are missing or changed size are dropped with a warning.
+* If versions isn't null it's set to the manager's current change counters.
+*/
+void saveEntities(const EntityManager& entityManager, SaveWriter& writer, const ComponentSerializers* serializers, SavedVersions* versions = nullptr);
+
+// replaces every entity in entityManager with the saved ones. No destructors or add callbacks are called.
+// returns 0 on success
+int loadEntities(EntityManager& entityManager, SaveReader& reader, const ComponentSerializers* serializers);
+
+// like saveEntities, but only writes the pools that changed since versions, and the entity table if entities
+// were created or deleted. Versions must be valid
+void saveEntityChanges(const EntityManager& entityManager, SaveWriter& writer, const ComponentSerializers* serializers, SavedVersions* versions);
+
+// apply changes written by saveEntityChanges on top of entities loaded by loadEntities.
+// Changed pools are replaced whole. Memory owned by the replaced components is not freed.
+// returns 0 on success. On failure the manager is left cleared
+int loadEntityChanges(EntityManager& entityManager, SaveReader& reader, const ComponentSerializers* serializers);
+
+// every pair in the relation. Relations are small, so they're written whole every time
+void saveRelation(const Relation& relation, SaveWriter& writer);
+
+// replaces the pairs in relation with the saved ones. Load the entities first,
+// pairs with entities that don't exist are dropped. returns 0 on success
+int loadRelation(const EntityManager& entityManager, Relation& relation, SaveReader& reader);
+
+}
+
+#endif
@@ -154,18 +154,24 @@ struct Signature : My::Bitset<MaxComponentIDs> {
     }
 };
 
+// MurmurHash3 finalizer. Every input bit affects every output bit,
+// so signatures that differ in a single component still land in different buckets
+inline uint64_t mixHashBits(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
 struct SignatureHash {
     size_t operator()(Signature self) const {
-        //TODO: OMPTIMIZE improve hash
-        // intsPerHash will always be 1 or greater as IntegerT cannot be larger than size_t
-        constexpr size_t intsPerHash = sizeof(size_t) / sizeof(Signature::Word);
-        size_t hash = 0;
+        uint64_t hash = 0;
         for (unsigned i = 0; i < Signature::WordCount; i++) {
-            for (unsigned j = 0; j < intsPerHash; j++) {
-                hash ^= (size_t)self.words[i] << j * sizeof(Signature::Word) * CHAR_BIT;
-            }
+            hash = mixHashBits(hash ^ (uint64_t)self.words[i]);
         }
-        return hash;
+        return (size_t)hash;
     }
 };
 
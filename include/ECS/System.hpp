@@ -5,6 +5,8 @@
 #include "ECS/EntityManager.hpp"
 #include "ECS/ArchetypePool.hpp"
 #include "ECS/Job.hpp"
+#include "ECS/JobScheduler.hpp"
+#include "ECS/ComponentAccess.hpp"
 #include "ADT/SmallVector.hpp"
 #include "llvm/TinyPtrVector.h"
 #include "memory/BlockAllocator.hpp"
@@ -39,20 +41,77 @@ struct DependencyList {
 
 struct System;
 
-// returns number of eligible entities
+// The jobs of every system in a manager as one dependency graph, so jobs can start as soon as
+// the jobs they depend on or conflict with are done instead of waiting for a whole stage.
+// Each system also gets a begin and end node that run BeforeExecution and AfterExecution on the main thread
+struct JobGraph {
+    struct Node {
+        enum Type {
+            SystemBegin,
+            SystemEnd,
+            RunJob
+        } type;
+        System* system;
+        int systemIndex; // index into SystemManager::systems
+        int job; // index into system->jobs, -1 for begin and end nodes
+        SmallVector<int, 4> successors = {};
+        int dependencyCount = 0;
+    };
+
+    std::vector<Node> nodes;
+    bool valid = false; // false if never built or it has a dependency loop
+
+    int addNode(Node::Type type, System* system, int systemIndex, int job) {
+        nodes.push_back(Node{type, system, systemIndex, job});
+        return nodes.size() - 1;
+    }
+
+    void addEdge(int from, int to) {
+        auto& successors = nodes[from].successors;
+        for (int successor : successors) {
+            if (successor == to) return;
+        }
+        successors.push_back(to);
+        nodes[to].dependencyCount++;
+    }
+
+    void clear() {
+        nodes.clear();
+        valid = false;
+    }
+};
+
+// returns number of eligible entities. Empty pools are left out
 int findEligiblePools(Signature required, Signature rejected, const EntityManager& entityManager, std::vector<const ArchetypePool*>* eligiblePools);
+// same using a query from the entity manager's component manager
+int findEligiblePools(int query, const EntityManager& entityManager, std::vector<const ArchetypePool*>* eligiblePools);
 
 struct SystemManager {
     std::vector<System*> systems;
 
     std::vector<Group> groups;
+    // non empty pools of each group this frame. Kept between frames to reuse the memory
+    std::vector<std::vector<const ArchetypePool*>> groupPools;
     
     EntityManager* entityManager = nullptr;
     EntityCommandBuffer unexecutedCommands;
     bool allowParallelization = USE_MULTITHREADING;
+    // shared between system managers. Jobs run single threaded when this is null or not started
+    JobScheduler* jobScheduler = nullptr;
 
     BlockAllocator<128, 16> jobAllocator;
 
+    JobGraph jobGraph;
+
+    Uint32 frame = 0; // counts executeSystems calls
+
+    // add dependencies between jobs in the same system that touch the same components or group arrays
+    // and weren't ordered explicitly. Jobs scheduled earlier run first
+    bool inferJobDependencies = true;
+    // log hazards between jobs that were not declared explicitly and explicit dependencies between
+    // jobs that share no data when systems are set up
+    bool debugJobDependencies = false;
+
     bool wasSetup = false;
 public:
     SystemManager() {}
@@ -81,6 +140,8 @@ public:
             if (trigger & Group::EntityExited)
                 type |= ECS::GroupWatcherTypes::ExitedGroup;
             newGroup.watcherPool = entityManager->makeWatcher({newGroup.group.signature, newGroup.group.subtract}, type);
+        } else {
+            newGroup.query = entityManager->components.getQuery({newGroup.group.signature, newGroup.group.subtract});
         }
         GroupID id = groups.size();
         groups.push_back(newGroup);
@@ -96,10 +157,28 @@ struct System {
     EntityCommandBuffer commands;
 
     // job schedule
+    struct GroupArrayAccess {
+        const void* array; // address of the GroupArray
+        bool write;
+    };
+
+    // measurements from previous runs, used to size parallel chunks
+    struct JobStats {
+        double nsPerEntity = 0.0; // moving average, 0 until the job has run in parallel
+        int entityCount = 0;
+        int chunkSize = 0; // chunk size used last run
+        int chunkCount = 0;
+        // wall time from submission to the last chunk finishing, divided by the time it would take
+        // if the work was split perfectly between the threads used. 1.0 is perfectly balanced
+        double imbalance = 0.0;
+    };
+
     struct ScheduledJob {
         GroupID group;
         Job* job;
         void* args;
+        SmallVector<GroupArrayAccess, 2> arrayAccesses = {};
+        JobStats stats = {};
     };
     SmallVector<ScheduledJob> jobs;
     TinyPtrVectorVector<System::ScheduledJob> stageJobs;
@@ -110,6 +189,7 @@ struct System {
 
     static constexpr int NullSystemOrder = -1;
 
+    const char* name; // for profiling
     int systemOrder = NullSystemOrder;
     bool enabled;
     bool flushCommandBuffers = false; // flush command buffers prior to execution
@@ -124,7 +204,7 @@ struct System {
         .type = Trigger::Type::EveryUpdate
     };
 
-    System(SystemManager& manager) : systemManager(&manager), enabled(true) {
+    System(SystemManager& manager, const char* name = "System") : systemManager(&manager), name(name), enabled(true) {
         manager.addSystem(this);
     }
 
@@ -146,6 +226,9 @@ struct System {
         // we could change that, but since we only ever schedule once per job rn, it doesn't matter and we could just leak it if we wanted
         void* argsPtr = new JobArgPtrs<JobT>(args);
         jobs.push_back({group, job, argsPtr});
+        std::apply([&](auto... argPtrs){
+            (recordArrayAccess(&jobs.back(), argPtrs), ...);
+        }, args);
         jobDependencies.push_back({});
         for (JobHandle jobDependency : dependencyList.jobDependencies) {
             AddDependency(handle, jobDependency);
@@ -186,11 +269,21 @@ struct System {
         }
     }
 
+    // jobs that can't run at the same time but don't care about order, like ones sharing state outside the ECS.
+    // Conflicts on components and group arrays are found automatically, so they don't need this.
+    // The job scheduled first runs first
     void Conflict(JobHandle jobA, JobHandle jobB) {
-        // TODO: optimize
-        AddDependency(jobA, jobB);
+        AddDependency(MAX(jobA, jobB), MIN(jobA, jobB));
     }
 
+    template<typename T>
+    static void recordArrayAccess(ScheduledJob* job, const GroupArray<T>* array) {
+        job->arrayAccesses.push_back({array, !std::is_const_v<T>});
+    }
+
+    template<typename T>
+    static void recordArrayAccess(ScheduledJob* job, const T* arg) {}
+
     template<typename GroupC>
     GroupID MakeGroup(const GroupC& cgroup, Group::TriggerType trigger = Group::EntityInGroup) {
         return systemManager->getOrMakeGroup(cgroup, trigger);
@@ -265,49 +358,18 @@ GroupArray<T>::GroupArray(System* system, GroupID group) {
 }
 
 struct IBarrier : System {
-    IBarrier(SystemManager& manager) : System(manager) {
+    IBarrier(SystemManager& manager) : System(manager, "Barrier") {
         flushCommandBuffers = true;
         enabled = false;
     }
 };
 
-template<class C>
-struct ReadOnly {
-    static constexpr bool read = true;
-    static constexpr bool write = false;
-    static constexpr bool subtract = false;
-    using Type = C;
-};
-
-template<class C>
-struct ReadWrite {
-    static constexpr bool read = true;
-    static constexpr bool write = true;
-    static constexpr bool subtract = false;
-    using Type = C;
-};
-
-template<class C>
-struct Tag {
-    static constexpr bool read = false;
-    static constexpr bool write = false;
-    static constexpr bool subtract = false;
-    using Type = C;
-};
-
-template<class C>
-struct Subtract {
-    static constexpr bool read = false;
-    static constexpr bool write = false;
-    static constexpr bool subtract = true;
-    using Type = C;
-};
-
 template<class ...Cs>
 struct ComponentGroup : IComponentGroup {
     template<class C>
     constexpr void setComponentUses() {
-        if (C::read || C::write)
+        // everything but subtracted components is required, including tags like prototype components
+        if (!C::subtract)
             signature.set(C::Type::ID);
         if (C::read) {
             read.set(C::Type::ID);
@@ -318,6 +380,9 @@ struct ComponentGroup : IComponentGroup {
         if (C::subtract) {
             subtract.set(C::Type::ID);
         }
+        if (C::changed) {
+            changed.set(C::Type::ID);
+        }
     }
 
     constexpr ComponentGroup() {
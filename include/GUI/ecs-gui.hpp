@@ -75,14 +75,12 @@ struct GuiManager : ECS::EntityManager {
         addComponent(screen, EC::DisplayBox{});
         addComponent(screen, EC::Hidden{});
 
-        setComponentDestructor(EC::Update::ID, [this](Entity entity){
-            auto* component = getComponent_<EC::Update>(entity);
-            component->destroy();
+        setComponentDestructor(EC::Update::ID, [](Entity entity, void* component){
+            ((EC::Update*)component)->destroy();
         });
 
-        setComponentDestructor(EC::Button::ID, [this](Entity entity){
-            auto* component = getComponent_<EC::Button>(entity);
-            component->destroy();
+        setComponentDestructor(EC::Button::ID, [](Entity entity, void* component){
+            ((EC::Button*)component)->destroy();
         });
     }
 
@@ -34,7 +34,7 @@ struct SizeConstraintSystem : System {
 
     EnforceMinMaxSizeJob minMaxSizeJob;
 
-    SizeConstraintSystem(SystemManager& manager) : System(manager) {
+    SizeConstraintSystem(SystemManager& manager) : System(manager, getTypeName<SizeConstraintSystem>()) {
         Schedule(group, minMaxSizeJob);
     }
 };
@@ -164,7 +164,7 @@ struct RenderBackgroundSystem : System {
     GuiRenderer* guiRenderer;
 
     RenderBackgroundSystem(SystemManager& manager, GuiRenderer* guiRenderer)
-    : System(manager), bdBuffer(guiRenderer), bgBufferQuads(guiRenderer), guiRenderer(guiRenderer) {
+    : System(manager, getTypeName<RenderBackgroundSystem>()), bdBuffer(guiRenderer), bgBufferQuads(guiRenderer), guiRenderer(guiRenderer) {
         auto bufferQuadsJob = Do({
             Schedule(backgroundGroup, bgColorQuadJob, bgQuads.refMut())
         }).Then(
@@ -228,7 +228,7 @@ struct RenderTexturesSystem : System {
     MakeTextureQuadsJob makeTextureQuads{&guiRenderer->guiAtlas};
 
     RenderTexturesSystem(SystemManager& manager, GuiRenderer* guiRenderer)
-    : System(manager), guiRenderer(guiRenderer) {
+    : System(manager, getTypeName<RenderTexturesSystem>()), guiRenderer(guiRenderer) {
         Schedule(textureGroup, bufferQuads, quads.refConst(),
             Schedule(textureGroup, makeTextureQuads, quads.refMut())
         );
@@ -255,7 +255,7 @@ public:
     DoElementUpdatesJob updatesJob{game};
 
     DoElementUpdatesSystem(SystemManager& manager, Game* game)
-    : System(manager), game(game) {
+    : System(manager, getTypeName<DoElementUpdatesSystem>()), game(game) {
         Schedule(group, updatesJob);
     }
 };
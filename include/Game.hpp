@@ -10,6 +10,7 @@
 #include "constants.hpp"
 #include "rendering/textures.hpp"
 #include "GameState.hpp"
+#include "GameSave.hpp"
 #include "PlayerControls.hpp"
 #include "GUI/Gui.hpp"
 #include "sdl.hpp"
@@ -46,6 +47,7 @@ namespace World {
 }
 
 struct GameEntitySystems {
+    ECS::Systems::JobScheduler jobScheduler;
     ECS::Systems::SystemManager ecsRenderSystems;
     ECS::Systems::SystemManager ecsStateSystems;
 
@@ -54,6 +56,8 @@ struct GameEntitySystems {
     World::Systems::GunSystem* gunSys;
 
     void init(GameState* state, RenderContext* renderContext, Camera& camera);
+
+    void destroy();
 };
 
 struct Game {
@@ -69,6 +73,7 @@ struct Game {
     MetadataTracker metadata;
     RenderContext* renderContext = nullptr;
     GameEntitySystems systems;
+    GameSave::Autosaver autosaver;
     Mode mode;
 private:
     bool m_paused = false;
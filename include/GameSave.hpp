@@ -0,0 +1,96 @@
+#ifndef GAME_SAVE_INCLUDED
+#define GAME_SAVE_INCLUDED
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include "GameState.hpp"
+#include "ECS/Serialization.hpp"
+
+/*
+* Binary snapshots of the whole game state.
+* A save is a header followed by tagged sections, each prefixed by its size so unknown sections can be skipped.
+* Entity managers are written as raw archetype columns (see ECS/Serialization.hpp)
+* and loaded chunks are written as whole tile arrays, so loading is mostly memcpys out of a mapped file.
+* Changed chunks that were evicted to the chunk streamer's region file are written after them as plain tiles.
+* A save can have a log of changes next to it (the save path + ".log"), which is applied on top when loading.
+*/
+namespace GameSave {
+
+// bump whenever the layout of a section changes in a way older loaders can't handle
+constexpr Uint32 Version = 8;
+
+// returns 0 on success
+int save(const GameState& state, const char* filepath);
+
+// load a save and its change log into a state that was just initialized with GameState::init, instead of calling createWorld.
+// returns 0 on success. On failure the state is left without a world, and createWorld should be called to make a new one
+int load(GameState* state, const char* filepath);
+
+// rename a save that couldn't be loaded and its change log to "<filepath>.v<version>.bak", so a new world doesn't save over it.
+// returns 0 on success
+int moveAside(const char* filepath);
+
+// how far along a full save being copied over several frames is
+struct FullSaveProgress {
+    std::vector<IVec2> chunksLeft; // there when the save began and not copied yet
+    size_t chunksBlock = 0;
+    size_t chunkCountPosition = 0;
+    Sint32 chunksCopied = 0;
+};
+
+/*
+* Saves the game every so often without stalling the game loop.
+* A full save is written first and then every few autosaves. In between, only the pools, chunks and player
+* that changed are appended to the save's change log.
+* What's saved is copied into memory on the main thread, then written to disk on a background thread.
+* Chunks are most of a full save, so autosaves copy them a few per frame, and the chunks that changed after they were
+* copied are written again along with everything else on the last frame.
+*/
+struct Autosaver {
+    Uint64 intervalMilliseconds = 30 * 1000;
+    int changeSavesPerFullSave = 10;
+    size_t fullSaveChunksPerFrame = 64;
+
+    void init(const char* filepath);
+
+    // start an autosave if it's been long enough and the last one is done being written. Call once per frame
+    void update(GameState* state);
+
+    // save right away, waiting for the last autosave to be written first. A full save that's being copied is finished.
+    // Clears dirty chunk flags
+    void save(GameState* state, bool full);
+
+    // wait for the background write to finish
+    void wait();
+
+    void destroy();
+private:
+    std::string filepath;
+    std::string logPath;
+    std::thread writerThread;
+    std::atomic<bool> writing{false};
+    std::atomic<bool> writeFailed{false};
+    // what the writer thread writes. Only touched by the writer while writing is true
+    std::vector<char> buffer;
+    ECS::SaveWriter writer = ECS::SaveWriter(&buffer);
+    bool copyingFullSave = false;
+    FullSaveProgress fullSaveProgress;
+    Uint64 saveID = 0; // changes are only applied to the full save with the same id
+    int changeSaves = 0; // since the last full save
+    Uint64 lastSaveTicks = 0;
+    Uint64 copyNanoseconds = 0; // spent copying the save being made
+    ECS::SavedVersions worldVersions;
+    ECS::SavedVersions itemVersions;
+
+    bool needsFullSave();
+    void startFullSave(GameState* state);
+    void finishFullSave(GameState* state);
+    // hand the buffer to the writer thread
+    void startWriting(bool full);
+};
+
+}
+
+#endif
@@ -7,12 +7,16 @@
 #include "utils/vectors_and_rects.hpp"
 #include "Tiles.hpp"
 #include "Chunks.hpp"
+#include "ChunkGenerator.hpp"
+#include "ChunkStreamer.hpp"
 #include "world/EntityWorld.hpp"
 #include "world/functions.hpp"
 #include "Player.hpp"
 
 struct GameState {
     ChunkMap chunkmap;
+    ChunkGenerator chunkGenerator;
+    ChunkStreamer chunkStreamer;
     EntityWorld* ecs;
     ECS::Systems::SystemManager* ecsSystems;
     Player player;
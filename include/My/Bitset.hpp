@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "llvm/MathExtras.h"
+#include "utils/compiler.hpp"
 #include <array>
 
 template<typename Word, class F>
@@ -128,7 +129,7 @@ public:
     }
 
     constexpr bool hasAny(SelfParamT aBitset) const {
-        return *this & aBitset;
+        return (*this & aBitset).any();
     }
 
     constexpr bool hasNone(SelfParamT aBitset) const {
@@ -107,6 +107,14 @@ struct BucketArray {
         }
     }
 
+    // free the top bucket along with everything in it
+    void popBucket() {
+        assert(!buckets.empty() && "no bucket to pop");
+        allocators.template getAllocator<BucketAllocator>().deallocate(buckets.back());
+        buckets.pop_back();
+        topBucketSlotsUsed = buckets.empty() ? 0 : BucketSize;
+    }
+
     // may be null
     T* getBucket(int bucketIndex) const {
         if (buckets.size() > bucketIndex)
@@ -427,6 +427,16 @@ public:
         return false;
     }
 
+    // calls func(key, value) for every entry in the map, in bucket order
+    template<typename Func>
+    void forEach(Func func) const {
+        for (int i = 0; i < bucketCount; i++) {
+            if (buckets()[i].state == Bucket_Filled) {
+                func(keys()[i], values()[i]);
+            }
+        }
+    }
+
     void clear() {
         memset(memory, 0, bucketCount * (sizeof(Bucket) + sizeof(K) + sizeof(V)));
         size = 0;
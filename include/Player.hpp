@@ -50,7 +50,7 @@ struct ItemHold {
 
 struct Player {
     Entity entity;
-    const EntityWorld* ecs = NULL;
+    EntityWorld* ecs = NULL;
 
     unsigned int numHotbarSlots = 9;
     ItemHold heldItemStack;
@@ -90,10 +90,13 @@ struct Player {
         }
     }
 
+    // the inventory may be changed through the pointer, so it's marked changed for the change log.
+    // Use the const version to only read it
     Inventory* inventory() {
         if (ecs->EntityExists(entity)) {
             auto component = ecs->Get<World::EC::Inventory>(entity);
             if (component) {
+                ecs->MarkChanged<World::EC::Inventory>(entity);
                 return &component->inventory;
             }
         }
@@ -101,7 +104,20 @@ struct Player {
     }
     
     const Inventory* inventory() const {
-        return const_cast<Player*>(this)->inventory();        
+        if (ecs->EntityExists(entity)) {
+            auto component = ecs->Get<World::EC::Inventory>(entity);
+            if (component) {
+                return &component->inventory;
+            }
+        }
+        return nullptr;
+    }
+
+    // call after changing the held item stack, it may be a slot in the inventory
+    void heldItemStackChanged() {
+        if (heldItemStack.type == ItemHold::Inventory) {
+            inventory();
+        }
     }
 
     float getSpeed() const {
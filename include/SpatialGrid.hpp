@@ -0,0 +1,183 @@
+#ifndef SPATIAL_GRID_INCLUDED
+#define SPATIAL_GRID_INCLUDED
+
+#include <vector>
+#include "My/HashMap.hpp"
+#include "utils/vectors_and_rects.hpp"
+#include "ECS/Entity.hpp"
+#include "SpatialKernels.hpp"
+
+using ECS::Entity;
+
+/* A uniform grid of cells for finding entities by their bounding boxes.
+ * An entity is put in the one cell its min corner is in, so an entity no bigger than a cell overlaps a box only if
+ * its cell is in the box or one cell below or left of it. Entities bigger than a cell go in a separate list that
+ * every query checks, there should only be a few of them.
+ * Cells store entities and each coordinate of their boxes in separate arrays, so queries never have to look at the ECS
+ * and test boxes with the spatial kernels, and every entity keeps its place in its cell so it can be moved or removed
+ * without searching.
+ * Cells that become empty are recycled, so the grid only takes as many cells as there are places with entities,
+ * not the whole area entities have ever been in.
+ */
+struct SpatialGrid {
+    static constexpr float CellSize = 8.0f;
+
+    void init();
+    void destroy();
+
+    // remove every entity, keeping memory for the cells
+    void clear();
+
+    // give back the memory of emptied cells and shrink the cell lookup to the cells in use,
+    // for when the world around them was unloaded and entities aren't coming back soon
+    void releaseFreeCells();
+
+    // bytes allocated by the grid
+    size_t memoryUsage() const;
+
+    // put the entity in the grid, or move it if it's already in it
+    void update(Entity entity, Vec2 min, Vec2 max);
+
+    // returns false if the entity wasn't in the grid
+    bool remove(Entity entity);
+
+    bool contains(Entity entity) const {
+        return entity.id < slots.size() && slots[entity.id].cell != NotInGrid
+            && cells[slots[entity.id].cell].entities[slots[entity.id].index] == entity;
+    }
+
+    int size() const {
+        return count;
+    }
+
+    // cells made so far, including empty ones waiting to be reused
+    int cellCount() const {
+        return (int)cells.size();
+    }
+
+    /* The queries call func(Entity entity) for every entity found.
+     * They stop early if func returns true, and return true if they were stopped.
+     * The grid must not be changed while iterating.
+     */
+
+    // entities whose box overlaps the box from min to max
+    template<class Func>
+    bool forEachOverlapping(Vec2 min, Vec2 max, Func func) const {
+        return forEachHit(min, max, [min, max](SpatialKernels::PackedBoxes boxes, Sint32* hits){
+            return SpatialKernels::overlappingBox(boxes, min, max, hits);
+        }, func);
+    }
+
+    // entities with any part of their box closer than radius to center
+    template<class Func>
+    bool forEachInCircle(Vec2 center, float radius, Func func) const {
+        return forEachHit(center - Vec2(radius), center + Vec2(radius), [center, radius](SpatialKernels::PackedBoxes boxes, Sint32* hits){
+            return SpatialKernels::inCircle(boxes, center, radius, hits);
+        }, func);
+    }
+
+    // entities whose box the line from start to end goes through
+    template<class Func>
+    bool forEachOnLine(Vec2 start, Vec2 end, Func func) const {
+        Vec2 min = {MIN(start.x, end.x), MIN(start.y, end.y)};
+        Vec2 max = {MAX(start.x, end.x), MAX(start.y, end.y)};
+        return forEachHit(min, max, [start, end](SpatialKernels::PackedBoxes boxes, Sint32* hits){
+            return SpatialKernels::onLine(boxes, start, end, hits);
+        }, func);
+    }
+
+    // every entity in the cells that could overlap the box, whether they do or not
+    template<class Func>
+    bool forEachNear(Vec2 min, Vec2 max, Func func) const {
+        return forEachCell(min, max, [&](const Cell& cell){
+            for (Entity entity : cell.entities) {
+                if (func(entity)) return true;
+            }
+            return false;
+        });
+    }
+private:
+    struct Cell {
+        IVec2 position;
+        std::vector<Entity> entities;
+        std::vector<float> minX;
+        std::vector<float> minY;
+        std::vector<float> maxX;
+        std::vector<float> maxY;
+
+        SpatialKernels::PackedBoxes boxes(int start, int count) const {
+            return {minX.data() + start, minY.data() + start, maxX.data() + start, maxY.data() + start, count};
+        }
+    };
+
+    // where each entity is in its cell, indexed by entity id
+    struct Slot {
+        Sint32 cell;
+        Sint32 index;
+    };
+
+    // IVec2Hash leaves y out of the low bits, so with power of two bucket counts every cell in a column
+    // would collide. Mix the coordinates together instead
+    struct CellHash {
+        size_t operator()(const IVec2& cell) const {
+            Uint64 hash = (Uint64)(Uint32)cell.x * 0x9E3779B97F4A7C15ull + (Uint32)cell.y;
+            hash ^= hash >> 32;
+            hash *= 0xD6E8FEB86659FD93ull;
+            return (size_t)(hash ^ (hash >> 32));
+        }
+    };
+
+    static constexpr Sint32 NotInGrid = -1;
+    static constexpr Sint32 OversizedCell = 0;
+    static constexpr int HitBatchSize = 64; // boxes tested at once, so the hits can go on the stack
+
+    std::vector<Cell> cells;
+    // cells that were emptied, reused before making new ones. They keep their memory, since entities usually come back
+    std::vector<Sint32> freeCells;
+    My::HashMap<IVec2, Sint32, CellHash> cellIndices;
+    int removedCellIndices = 0; // removed markers left in cellIndices since it was last rehashed
+    std::vector<Slot> slots;
+    int count = 0;
+
+    static IVec2 toCell(Vec2 position) {
+        return {(int)floor(position.x / CellSize), (int)floor(position.y / CellSize)};
+    }
+
+    Sint32 getOrMakeCell(Vec2 min, Vec2 max);
+
+    void removeFromCell(Slot slot);
+
+    void freeCell(Sint32 cell);
+
+    // calls func(const Cell&) for every cell that could have an entity overlapping the box
+    template<class Func>
+    bool forEachCell(Vec2 min, Vec2 max, Func func) const {
+        if (func(cells[OversizedCell])) return true;
+        IVec2 minCell = toCell(min - Vec2(CellSize));
+        IVec2 maxCell = toCell(max);
+        for (int y = minCell.y; y <= maxCell.y; y++) {
+            for (int x = minCell.x; x <= maxCell.x; x++) {
+                const Sint32* cell = cellIndices.lookup({x, y});
+                if (cell && func(cells[*cell])) return true;
+            }
+        }
+        return false;
+    }
+
+    template<class Kernel, class Func>
+    bool forEachHit(Vec2 min, Vec2 max, Kernel kernel, Func& func) const {
+        return forEachCell(min, max, [&](const Cell& cell){
+            Sint32 hits[HitBatchSize];
+            int entityCount = (int)cell.entities.size();
+            for (int start = 0; start < entityCount; start += HitBatchSize) {
+                int hitCount = kernel(cell.boxes(start, MIN(entityCount - start, HitBatchSize)), hits);
+                for (int i = 0; i < hitCount; i++) {
+                    if (func(cell.entities[start + hits[i]])) return true;
+                }
+            }
+            return false;
+        });
+    }
+};
+
+#endif
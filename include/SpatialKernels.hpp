@@ -0,0 +1,43 @@
+#ifndef SPATIAL_KERNELS_INCLUDED
+#define SPATIAL_KERNELS_INCLUDED
+
+#include "utils/ints.hpp"
+#include "utils/vectors_and_rects.hpp"
+
+/* Tests for many boxes at once, for spatial queries.
+ * Boxes are packed with each coordinate in its own array, so they can be tested several at a time with SSE,
+ * or AVX when it's enabled. Other cpus get the scalar versions.
+ * Every test writes the indices of the boxes that passed to hits in order, and returns how many there were.
+ * hits must have room for boxes.count indices.
+ */
+namespace SpatialKernels {
+
+struct PackedBoxes {
+    const float* minX;
+    const float* minY;
+    const float* maxX;
+    const float* maxY;
+    int count;
+};
+
+// boxes that overlap the box from min to max. Boxes that only touch it don't count
+int overlappingBox(PackedBoxes boxes, Vec2 min, Vec2 max, Sint32* hits);
+
+// boxes with any part closer than radius to center
+int inCircle(PackedBoxes boxes, Vec2 center, float radius, Sint32* hits);
+
+// boxes the line from start to end goes through
+int onLine(PackedBoxes boxes, Vec2 start, Vec2 end, Sint32* hits);
+
+// one box at a time, the same results as above on every cpu
+namespace Scalar {
+
+int overlappingBox(PackedBoxes boxes, Vec2 min, Vec2 max, Sint32* hits);
+int inCircle(PackedBoxes boxes, Vec2 center, float radius, Sint32* hits);
+int onLine(PackedBoxes boxes, Vec2 start, Vec2 end, Sint32* hits);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef TERRAIN_INCLUDED
+#define TERRAIN_INCLUDED
+
+#include "utils/ints.hpp"
+#include "Chunks.hpp"
+
+/* Terrain made from layered value noise.
+ * Heights only depend on the world seed and the tile position, so a chunk comes out exactly the same every time
+ * it's generated, on any thread, and lines up with its neighbors.
+ * Noise is evaluated a whole chunk at a time, several tiles at once with SSE or AVX when it's available.
+ */
+namespace Terrain {
+
+struct Octave {
+    int wavelength; // in tiles. Must be a power of two, at least 16
+    float amplitude;
+};
+
+// big features first. Adding up to 1 keeps heights in the range 0 to 1
+constexpr Octave Octaves[] = {
+    {512, 0.5f},
+    {128, 0.25f},
+    {64,  0.125f},
+    {32,  0.0625f},
+    {16,  0.0625f}
+};
+
+// heights below these are water and sand, the rest is grass
+constexpr float WaterLevel = 0.45f;
+constexpr float SandLevel  = 0.49f;
+
+// heights for every tile in the chunk, row by row. heights must have room for CHUNKSIZE * CHUNKSIZE floats
+void heights(ChunkCoord position, Uint64 seed, float* heights);
+
+TileType tileForHeight(float height);
+
+// fill chunk with terrain
+void generate(Chunk* chunk, ChunkCoord position, Uint64 seed);
+
+// one tile at a time, the same heights as above give or take rounding
+namespace Scalar {
+
+void heights(ChunkCoord position, Uint64 seed, float* heights);
+
+}
+
+}
+
+#endif
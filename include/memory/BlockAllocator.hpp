@@ -40,7 +40,7 @@ public:
 
     void* allocate(size_t size, size_t alignment) {
         void* ptr;
-        if (LIKELY(size < BlockSize && alignment <= BlockAlignment)) {
+        if (LIKELY(size <= BlockSize && alignment <= BlockAlignment)) {
             ptr = allocateBlock();
         #ifndef NDEBUG
             blockBytesAllocated += size;
@@ -107,7 +107,7 @@ private:
 public:
 
     void deallocate(void* ptr, size_t size, size_t alignment) {
-        if (size < BlockSize && alignment <= BlockAlignment) {
+        if (size <= BlockSize && alignment <= BlockAlignment) {
             deallocateBlock((char*)ptr);
         #ifndef NDEBUG
             blockBytesAllocated -= size;
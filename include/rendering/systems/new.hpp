@@ -103,6 +103,15 @@ struct EntityColorJob : JobParallelFor<EntityColorJob, const EC::Health> {
     }
 };
 
+// entities of prototypes with a render layer draw their main texture on it.
+// The layer is shared by the whole prototype, so it's read once per chunk instead of looked up for every entity.
+// Only blocks where Render was written are visited, so it doesn't mark every pool as changed each frame
+struct PrototypeRenderLayerJob : JobParallelFor<PrototypeRenderLayerJob, EC::Render> {
+    void Execute(int N) {
+        Get<EC::Render>(N).textures[0].layer = GetPrototype<EC::Proto::EntityRenderLayer>().layer;
+    }
+};
+
 using RenderSystem = System;
 
 struct RenderEntitySystem : RenderSystem {
@@ -127,6 +136,14 @@ struct RenderEntitySystem : RenderSystem {
 
     GlModelSOA model;
 
+    GroupID prototypeLayerGroup = MakeGroup(ComponentGroup<
+        ReadWrite<EC::Render>,
+        Tag<EC::Proto::EntityRenderLayer>,
+        Changed<EC::Render>
+    >());
+
+    PrototypeRenderLayerJob prototypeRenderLayer;
+
     RenderContext& ren;
     const Camera& camera;
     const EntityWorld& ecs;
@@ -161,7 +178,7 @@ struct RenderEntitySystem : RenderSystem {
 
     
     RenderEntitySystem(SystemManager& manager, RenderContext& renderContext, const Camera& camera, const EntityWorld& ecs, const ChunkMap& chunkmap)
-    : RenderSystem(manager), ren(renderContext), camera(camera), ecs(ecs), chunkmap(chunkmap) {
+    : RenderSystem(manager, getTypeName<RenderEntitySystem>()), ren(renderContext), camera(camera), ecs(ecs), chunkmap(chunkmap) {
         auto vertexFormat = GlMakeVertexFormat(0, {
             {3, GL_FLOAT, sizeof(GLfloat)}, // pos
             {2, GL_FLOAT, sizeof(GLfloat)}, // size
@@ -171,6 +188,8 @@ struct RenderEntitySystem : RenderSystem {
         });
 
         model = makeModelSOA(verticesPerBatch, nullptr, GL_STREAM_DRAW, vertexFormat);
+
+        Schedule(prototypeLayerGroup, prototypeRenderLayer);
     }
 
     void BeforeExecution() {
@@ -0,0 +1,29 @@
+#ifndef UTILS_MAPPED_FILE_INCLUDED
+#define UTILS_MAPPED_FILE_INCLUDED
+
+#include <stddef.h>
+
+/*
+* A whole file mapped read only into memory.
+* Uses mmap where it's available, otherwise the file is read into a buffer.
+*/
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+private:
+    bool mapped = false; // false if data was read into a malloc'd buffer
+public:
+    // returns 0 on success
+    int open(const char* filepath);
+
+    void close();
+
+    bool isOpen() const {
+        return data != nullptr;
+    }
+};
+
+// true if a file exists at the path and can be opened for reading
+bool fileExists(const char* filepath);
+
+#endif
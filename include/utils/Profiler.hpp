@@ -0,0 +1,144 @@
+#ifndef UTILS_PROFILER_INCLUDED
+#define UTILS_PROFILER_INCLUDED
+
+#include <atomic>
+#include <string>
+#include <SDL3/SDL_timer.h>
+#include "utils/ints.hpp"
+#include "utils/system/sysinfo.hpp"
+
+/*
+* Frame profiler for systems, jobs and job chunks.
+* Every thread records into its own ring buffer, which only it writes to, so recording never takes a lock.
+* Old events are overwritten once a buffer is full.
+* Recording is off until Profiler::start() is called, and costs a single atomic load while it is off.
+*/
+namespace Profiler {
+
+enum class Category : Uint8 {
+    Frame,
+    System,
+    Job,
+    Chunk,
+    CommandFlush,
+    Wait,
+    Count
+};
+
+const char* categoryName(Category category);
+
+struct Event {
+    const char* name; // must be a static string, it is stored as a pointer
+    Uint64 begin; // SDL_GetTicksNS() nanoseconds
+    Uint64 end;
+    Sint32 arg; // optional number shown with the event, -1 for none
+    Category category;
+};
+
+// an event in a thread buffer. Other threads read slots while the owning thread may be overwriting them,
+// so every field is atomic and readers check afterwards whether the slot was overwritten
+struct EventSlot {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<Uint64> begin{0};
+    std::atomic<Uint64> end{0};
+    std::atomic<Sint32> arg{-1};
+    std::atomic<Category> category{Category::Frame};
+
+    void store(const Event& event) {
+        name.store(event.name, std::memory_order_relaxed);
+        begin.store(event.begin, std::memory_order_relaxed);
+        end.store(event.end, std::memory_order_relaxed);
+        arg.store(event.arg, std::memory_order_relaxed);
+        category.store(event.category, std::memory_order_relaxed);
+    }
+
+    Event load() const {
+        return Event{
+            name.load(std::memory_order_relaxed),
+            begin.load(std::memory_order_relaxed),
+            end.load(std::memory_order_relaxed),
+            arg.load(std::memory_order_relaxed),
+            category.load(std::memory_order_relaxed)
+        };
+    }
+};
+
+struct alignas(CACHE_LINE_SIZE) ThreadBuffer {
+    static constexpr int Capacity = 1 << 14;
+
+    std::atomic<Uint64> written{0}; // total events ever written, the next event goes in events[written % Capacity]
+    std::atomic<Uint64> started{0}; // total events the owning thread has started writing, one ahead of written while it writes
+    int threadIndex = 0;
+    char threadName[32] = {0};
+    EventSlot events[Capacity];
+};
+
+static constexpr int MaxThreads = 64;
+
+extern std::atomic<bool> enabled;
+
+inline bool isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+// buffer for the calling thread, made on first use. Returns null if too many threads are profiling
+ThreadBuffer* getThreadBuffer();
+
+// name the calling thread in traces
+void setThreadName(const char* name);
+
+inline void record(const char* name, Category category, Uint64 begin, Uint64 end, Sint32 arg = -1) {
+    if (!isEnabled()) return;
+    ThreadBuffer* buffer = getThreadBuffer();
+    if (!buffer) return;
+    // only this thread writes to the buffer, so a relaxed load of our own counter is fine
+    Uint64 index = buffer->written.load(std::memory_order_relaxed);
+    // announce the overwrite before touching the slot, so readers copying it know to throw it away
+    buffer->started.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    buffer->events[index % ThreadBuffer::Capacity].store(Event{name, begin, end, arg, category});
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+inline Uint64 now() {
+    return SDL_GetTicksNS();
+}
+
+void start();
+
+void stop();
+
+// forget all recorded events
+void clear();
+
+// write every recorded event as chrome trace_event json, to be opened in chrome://tracing or perfetto.
+// returns 0 on success
+int writeChromeTrace(const char* filepath);
+
+// total time, count and max duration of every event name recorded in the last 'milliseconds' milliseconds
+std::string summary(int milliseconds);
+
+struct Scope {
+    const char* name;
+    Uint64 begin;
+    Sint32 arg;
+    Category category;
+
+    Scope(const char* name, Category category, Sint32 arg = -1)
+    : name(name), begin(isEnabled() ? now() : 0), arg(arg), category(category) {}
+
+    ~Scope() {
+        if (begin != 0) {
+            record(name, category, begin, now(), arg);
+        }
+    }
+};
+
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// profile from here until the end of the scope
+#define PROFILE_SCOPE(name, category, ...) Profiler::Scope PROFILE_CONCAT(profileScope_, __LINE__){name, Profiler::Category::category, ##__VA_ARGS__}
+
+#endif
@@ -2,6 +2,7 @@
 #define UTILS_RANDOM_INCLUDED
 
 #include <stdlib.h>
+#include "utils/ints.hpp"
 
 // returns a random integer in the range of min to max, inclusive.
 inline int randomInt(int min, int max) {
@@ -14,4 +15,31 @@ inline int randomIntHalfNegative(int min, int max) {
     return randomInt(min, max) * (randomInt(0, 1) ? 1 : -1);
 }
 
+/* A small random number generator that keeps its own state, so it's safe to use on any thread and gives the same
+ * numbers for the same seed every time, unlike rand(). SplitMix64
+ */
+struct RandomGenerator {
+    Uint64 state;
+
+    RandomGenerator(Uint64 seed) : state(seed) {}
+
+    Uint64 next() {
+        Uint64 z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // in the range 0 to 1, not including 1
+    float nextFloat() {
+        return (float)(next() >> 40) / (float)(1 << 24);
+    }
+};
+
+// mix a seed with a grid position, for a different seed in every cell of a grid
+inline Uint64 seedForPosition(Uint64 seed, int x, int y) {
+    RandomGenerator generator(seed ^ ((Uint64)(Uint32)x << 32 | (Uint32)y));
+    return generator.next();
+}
+
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef SYSTEM_INFO_INCLUDED
 #define SYSTEM_INFO_INCLUDED
 
+#include <thread>
+
 constexpr bool SystemIsBigEndian = false;
 constexpr bool SystemIsLittleEndian = !SystemIsBigEndian;
 
@@ -8,6 +10,21 @@ constexpr bool SystemIsLittleEndian = !SystemIsBigEndian;
 
 #define MACOS 1
 
+// upper limit on job worker threads, more than this and scheduling overhead outweighs the gains
+#define MAX_JOB_WORKER_THREADS 15
+
+// number of logical cores (hardware threads) on the system. Always at least 1
+inline int getLogicalCoreCount() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? (int)count : 1;
+}
 
+// number of threads that should be used for jobs besides the main thread.
+// The main thread helps run jobs while it waits, so leave a core for it
+inline int getIdealWorkerThreadCount() {
+    int workers = getLogicalCoreCount() - 1;
+    if (workers > MAX_JOB_WORKER_THREADS) workers = MAX_JOB_WORKER_THREADS;
+    return workers;
+}
 
-#endif
\ No newline at end of file
+#endif
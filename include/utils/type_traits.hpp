@@ -3,7 +3,10 @@
 
 #include <type_traits>
 #include <tuple>
+#include <string>
+#include <string_view>
 #include "utils/common-macros.hpp"
+#include "llvm/Compiler.h"
 
 template<typename... Ts>
 constexpr size_t sumSizes() {
@@ -129,4 +132,19 @@ struct is_instantiation_of<Template<Args...>, Template> : std::true_type {};
 template<typename T, template<typename...> class Template>
 constexpr bool is_instantiation_of_v = is_instantiation_of<T, Template>::value;
 
+// Readable name of a type, pulled out of the compiler's pretty function string since we don't have rtti.
+// The string is static so it can be kept around
+template<typename T>
+const char* getTypeName() {
+    static const std::string name = [](std::string_view pretty){
+        // clang: "... [T = Name]", gcc: "... [with T = Name; ...]"
+        size_t begin = pretty.find("T = ");
+        if (begin == std::string_view::npos) return std::string(pretty);
+        begin += 4;
+        size_t end = pretty.find_first_of(";]", begin);
+        return std::string(pretty.substr(begin, end - begin));
+    }(LLVM_PRETTY_FUNCTION);
+    return name.c_str();
+}
+
 #endif
\ No newline at end of file
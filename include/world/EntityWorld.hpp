@@ -35,6 +35,9 @@ struct EntityWorld : ECS::EntityManager {
 protected:
     using Base = ECS::EntityManager;
 public:
+    // the entity each entity with EC::Follow is following. Followers of a deleted entity are left with no target
+    ECS::Relation follows;
+
     EntityWorld() = default;
 
     void init();
@@ -50,6 +53,7 @@ public:
      * Essentially a destructor.
      */
     void destroy() {
+        follows.destroy();
         Base::destroy();
     }
 
@@ -144,6 +148,26 @@ public:
         return Base::getComponent(entity, component);
     }
 
+    /* Look the entity up once, to read several of its components with Get(EntityRef) without looking it up each time.
+     * The ref stays usable until entities are removed from or moved within the entity's archetype, check with RefValid if unsure.
+     * @return A ref to the entity, or a null ref if it doesn't exist.
+     */
+    ECS::EntityRef GetRef(Entity entity) const {
+        return Base::getRef(entity);
+    }
+
+    bool RefValid(ECS::EntityRef ref) const {
+        return Base::refValid(ref);
+    }
+
+    /* Same as Get(Entity) using a ref from GetRef, which must still be valid.
+     * @return A pointer to a component of the type or null if the entity doesn't have it.
+     */
+    template<class T>
+    T* Get(ECS::EntityRef ref) const {
+        return Base::getComponent<T>(ref);
+    }
+
     template<class T>
     T* Set(Entity entity, const T& value) {
         static_assert(!std::is_const<T>(), "Component must not be const to set values!");
@@ -153,11 +177,26 @@ public:
         // perhaps add a NULL check here and log an error instead of dereferencing immediately?
         // could hurt performance depending on where it's used
         // decided to add check as otherwise this method is useless, so only use it if a null check is intended.
-        if (component)
+        if (component) {
             *component = value;
+            Base::markChanged<T>(entity);
+        }
         return component;
     }
 
+    /* Let jobs filtering on Changed<T> and the change log know the component was written through a pointer from Get.
+     * Values set with Set or by jobs with write access are marked automatically.
+     */
+    template<class T>
+    void MarkChanged(Entity entity) {
+        Base::markChanged<T>(entity);
+    }
+
+    template<class T>
+    void MarkChanged(ECS::EntityRef ref) {
+        Base::markChanged<T>(ref);
+    }
+
     void Set(Entity entity, ECS::ComponentID componentID, void* value);
 
     /* Add a component of the type to the entity, immediately initializing the value to param startValue.
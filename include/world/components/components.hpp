@@ -273,12 +273,12 @@ END_COMPONENT(Rotatable)
 
 // Entity that must have components
 
+// who is followed is kept in EntityWorld::follows
 BEGIN_COMPONENT(Follow)
-    Entity entity;
     float speed;
 
-    Follow(Entity following, float speed)
-    : entity(following), speed(speed) {
+    Follow(float speed)
+    : speed(speed) {
         
     }
 END_COMPONENT(Follow)
@@ -31,11 +31,14 @@ void forEachEntityInBounds(const EntityWorld& ecs, const ChunkMap* chunkmap, Box
 Entity findClosestEntityToPosition(const EntityWorld& ecs, const ChunkMap* chunkmap, Vec2 position);
 
 SmallVectorA<Entity, VirtualAllocator, 4> getAllEntitiesInBounds(const EntityWorld& ecs, const ChunkMap* chunkmap, Boxf bounds, VirtualAllocator allocator);
+SmallVectorA<Entity, VirtualAllocator, 4> getAllEntitiesInRange(const EntityWorld& ecs, const ChunkMap* chunkmap, Vec2 pos, float radius, VirtualAllocator allocator);
+SmallVectorA<Entity, VirtualAllocator, 4> getAllEntitiesOnLine(const EntityWorld& ecs, const ChunkMap* chunkmap, Vec2 start, Vec2 end, VirtualAllocator allocator);
 SmallVectorA<Entity, VirtualAllocator, 0> getAllEntitiesNearBounds(const EntityWorld& ecs, const ChunkMap* chunkmap, Boxf bounds, VirtualAllocator allocator);
 
 void entityCreated(GameState* state, Entity entity);
 
-void entityViewChanged(ChunkMap* chunkmap, Entity entity, Vec2 newPos, Vec2 oldPos, Box newViewbox, Box oldViewbox, bool justMade);
+// put the entity in the entity grid at its new view box, or add it if it isn't there yet
+void entityViewChanged(ChunkMap* chunkmap, Entity entity, Vec2 position, Box viewbox);
 void entityPositionChanged(GameState* state, Entity entity, Vec2 oldPos);
 void entityViewboxChanged(GameState* state, Entity entity, Box oldViewbox);
 void entityViewAndPosChanged(GameState* state, Entity entity, Vec2 oldPos, Box oldViewbox);
@@ -28,7 +28,8 @@ struct GunSystem : System {
             auto rotation = Get<EC::Rotation>(N);
             Vec2 dir = get_sincosf(rotation.degrees * M_PI / 180.0f);
             Vec2 delta = dir * gun.projectileSpeed;
-            if (tick - gun.lastFired > gun.cooldown) {
+            // guns loaded from a save with a projectile that no longer exists can't fire
+            if (gun.projectileFired && tick - gun.lastFired > gun.cooldown) {
                 Entity projectile = gun.projectileFired(commandBuffer, position.vec2());
                 commandBuffer->addComponent(projectile, EC::Velocity{delta});
                 commandBuffer->addComponent(projectile, EC::Rotation(rotation));
@@ -38,7 +39,7 @@ struct GunSystem : System {
         }
     } shootJob;
 
-    GunSystem(SystemManager& manager, EntityWorld* ecs) : System(manager), shootJob(ecs) {
+    GunSystem(SystemManager& manager, EntityWorld* ecs) : System(manager, getTypeName<GunSystem>()), shootJob(ecs) {
         Schedule(group, shootJob, &currentTick);
     }
 
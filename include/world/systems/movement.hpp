@@ -35,7 +35,7 @@ struct ChangeEntityPosJob : JobSingleThreaded<ChangeEntityPosJob, const EC::View
             oldPosition.y = newPosition.pos.y;
             auto viewbox = Get<EC::ViewBox>(N);
             auto entity = GetEntity(N);
-            World::entityViewChanged(chunkmap, entity, newPosition.pos, oldPosition.vec2(), viewbox.box, viewbox.box, false);
+            World::entityViewChanged(chunkmap, entity, newPosition.pos, viewbox.box);
         }
     }
 };
@@ -49,18 +49,20 @@ struct SetChunkMapPosJob : JobSingleThreaded<SetChunkMapPosJob> {
     void Execute(int N) {
         auto entity = GetEntity(N);
         if (!ecs->EntityExists(entity)) return;
-        // entityViewChanged(chunkmap, entity[N], position[N].vec2(), position[N].vec2(), viewbox[N].box, viewbox[N].box, true);
         auto position = *ecs->Get<EC::Position>(entity);
         auto viewbox = *ecs->Get<EC::ViewBox>(entity);
-        entityViewChanged(chunkmap, entity, position.vec2(), position.vec2(), viewbox.box, viewbox.box, true);
+        entityViewChanged(chunkmap, entity, position.vec2(), viewbox.box);
     }
 };
 
 struct DynamicEntitySystem : System {
+    // only entities in blocks where Dynamic was written since last tick can have moved,
+    // so entities that stand still cost nothing
     GroupID dynamicGroup = MakeGroup(ComponentGroup<
         ReadWrite<EC::Position>,
         ReadWrite<EC::Dynamic>,
-        ReadOnly<EC::ViewBox>
+        ReadOnly<EC::ViewBox>,
+        Changed<EC::Dynamic>
     >());
 
     GroupID velGroup = MakeGroup(ComponentGroup<
@@ -95,7 +97,7 @@ struct DynamicEntitySystem : System {
     } velocityJob;
 
     DynamicEntitySystem(SystemManager& manager, ChunkMap* chunkmap, EntityWorld* ecs)
-    : System(manager), chunkmap(chunkmap), setChunkMapPos(chunkmap, ecs) {
+    : System(manager, getTypeName<DynamicEntitySystem>()), chunkmap(chunkmap), setChunkMapPos(chunkmap, ecs) {
         Do(
             Schedule(velGroup, velocityJob)
         ).Then(
@@ -119,20 +121,8 @@ struct UpdateEntityViewBoxChunkPosJob : JobBlocking<UpdateEntityViewBoxChunkPosJ
         auto position = Get<EC::Position>(N);
         auto entity = GetEntity(N);
 
-        Vec2 pos = position.vec2();
-
-        IVec2 minChunkPosition = toChunkPosition(pos + viewBox.box.min);
-        IVec2 maxChunkPosition = toChunkPosition(pos + viewBox.box.max());
-        for (int col = minChunkPosition.x; col <= maxChunkPosition.x; col++) {
-            for (int row = minChunkPosition.y; row <= maxChunkPosition.y; row++) {
-                IVec2 chunkPosition = {col, row};
-                // add entity to new chunk
-                ChunkData* newChunkdata = chunkmap->get(chunkPosition);
-                if (newChunkdata) {
-                    newChunkdata->closeEntities.push(entity);
-                }
-            }
-        }
+        Vec2 min = position.vec2() + viewBox.box.min;
+        chunkmap->entityGrid.update(entity, min, min + viewBox.box.size);
     }
 };
 
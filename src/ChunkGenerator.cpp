@@ -0,0 +1,159 @@
+#include "ChunkGenerator.hpp"
+#include <algorithm>
+#include "utils/Profiler.hpp"
+
+int ChunkGenerator::workerThreadFunc(void* generatorPtr) {
+    ChunkGenerator* generator = (ChunkGenerator*)generatorPtr;
+    Profiler::setThreadName("Chunk generator");
+    std::unique_lock<std::mutex> lock(generator->mutex);
+    while (true) {
+        generator->workAvailable.wait(lock, [generator](){
+            return generator->quit || !generator->queue.empty();
+        });
+        if (generator->quit) break;
+        generator->generateNext(lock);
+    }
+    return 0;
+}
+
+void ChunkGenerator::generateNext(std::unique_lock<std::mutex>& lock) {
+    Request request = queue.front();
+    queue.pop_front();
+    Chunk* tiles;
+    if (!freeBuffers.empty()) {
+        tiles = freeBuffers.back();
+        freeBuffers.pop_back();
+    } else {
+        tiles = (Chunk*)malloc(sizeof(Chunk));
+    }
+
+    lock.unlock();
+    generateChunk(tiles, request.position, request.seed);
+    lock.lock();
+
+    generated.push_back({request.position, request.seed, tiles});
+    chunkGenerated.notify_all();
+}
+
+int ChunkGenerator::start(ThreadManager& threadManager, int workerCount) {
+    assert(workers.empty() && "Chunk generator already started!");
+    workerCount = MIN(workerCount, threadManager.unusedThreads());
+    quit = false;
+    for (int i = 0; i < workerCount; i++) {
+        auto thread = threadManager.openThread(workerThreadFunc, this);
+        if (thread == Threads::ThreadManager::NullThread) break;
+        workers.push_back(thread);
+    }
+    if (!workers.empty()) {
+        LogInfo("Started chunk generator with %d workers", (int)workers.size());
+    }
+    return (int)workers.size();
+}
+
+void ChunkGenerator::stop(ThreadManager& threadManager) {
+    if (workers.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    workAvailable.notify_all();
+    for (auto thread : workers) {
+        threadManager.waitThread(thread);
+    }
+    workers.clear();
+}
+
+void ChunkGenerator::requestArea(const ChunkMap& chunkmap, ChunkCoord minChunk, ChunkCoord maxChunk, Vec2 center) {
+    std::unique_lock<std::mutex> lock(mutex);
+    // chunks asked for before and not started yet are dropped, and asked for again below if they're still wanted
+    for (const Request& request : queue) {
+        pending.remove(request.position);
+    }
+    queue.clear();
+
+    for (int y = minChunk.y; y <= maxChunk.y; y++) {
+        for (int x = minChunk.x; x <= maxChunk.x; x++) {
+            ChunkCoord position = {x, y};
+            if (chunkmap.existsAt(position) || pending.contains(position)) continue;
+            pending.insert(position, 1);
+            queue.push_back({position, chunkmap.seed});
+        }
+    }
+    if (queue.empty()) return;
+
+    std::sort(queue.begin(), queue.end(), [center](const Request& lhs, const Request& rhs){
+        Vec2 lhsDelta = Vec2(lhs.position) + Vec2(0.5f) - center;
+        Vec2 rhsDelta = Vec2(rhs.position) + Vec2(0.5f) - center;
+        return lhsDelta.x * lhsDelta.x + lhsDelta.y * lhsDelta.y < rhsDelta.x * rhsDelta.x + rhsDelta.y * rhsDelta.y;
+    });
+    lock.unlock();
+    workAvailable.notify_all();
+}
+
+int ChunkGenerator::commit(ChunkMap* chunkmap) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        // no one to generate chunks, so make one here. Only one so the frame doesn't take too long
+        if (workers.empty() && !queue.empty()) {
+            generateNext(lock);
+        }
+        committing.swap(generated);
+    }
+
+    int committed = 0;
+    for (const Generated& chunk : committing) {
+        pending.remove(chunk.position);
+        // the seed changed after this was asked for, the chunk is from another world
+        if (chunk.seed != chunkmap->seed) continue;
+        // the chunk could have been made some other way in the meantime, like by loading a save
+        if (chunkmap->existsAt(chunk.position)) continue;
+        ChunkData* chunkdata = chunkmap->newChunkAt(chunk.position);
+        if (!chunkdata) {
+            LogError("Failed to create generated chunk at tile (%d,%d)", chunk.position.x * CHUNKSIZE, chunk.position.y * CHUNKSIZE);
+            continue;
+        }
+        memcpy(chunkdata->chunk, chunk.tiles, sizeof(Chunk));
+        committed++;
+    }
+
+    if (!committing.empty()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Generated& chunk : committing) {
+            freeBuffers.push_back(chunk.tiles);
+        }
+    }
+    committing.clear();
+    return committed;
+}
+
+void ChunkGenerator::finish(ChunkMap* chunkmap) {
+    while (true) {
+        commit(chunkmap);
+        if (pending.size == 0) break;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!queue.empty()) {
+            generateNext(lock);
+        } else {
+            // the rest are being generated by workers
+            chunkGenerated.wait(lock, [this](){
+                return !generated.empty();
+            });
+        }
+    }
+}
+
+void ChunkGenerator::destroy() {
+    assert(workers.empty() && "Chunk generator must be stopped before being destroyed!");
+    for (Chunk* buffer : freeBuffers) {
+        free(buffer);
+    }
+    for (const Generated& chunk : generated) {
+        free(chunk.tiles);
+    }
+    freeBuffers.clear();
+    generated.clear();
+    queue.clear();
+    pending.destroy();
+    pending = decltype(pending)::Empty();
+}
@@ -0,0 +1,228 @@
+#include "ChunkStreamer.hpp"
+#include <algorithm>
+
+namespace {
+
+constexpr int TilesPerChunk = CHUNKSIZE * CHUNKSIZE;
+
+static_assert(sizeof(Tile) == sizeof(Uint16), "Tiles are encoded as their type");
+
+// runs of the same tile as (length, type) pairs. Terrain is mostly big patches of the same tile, so this shrinks a lot
+Uint32 encodeTiles(const Chunk* chunk, std::vector<Uint8>& out) {
+    const Tile* tiles = &(*chunk)[0][0];
+    out.resize(TilesPerChunk * 2 * sizeof(Uint16));
+    Uint16* pairs = (Uint16*)out.data();
+    int pairCount = 0;
+    int i = 0;
+    while (i < TilesPerChunk) {
+        Uint16 type = tiles[i].type;
+        int run = 1;
+        while (i + run < TilesPerChunk && tiles[i + run].type == type) run++;
+        pairs[pairCount * 2] = (Uint16)(run - 1); // a whole chunk of one tile doesn't fit in 16 bits otherwise
+        pairs[pairCount * 2 + 1] = type;
+        pairCount++;
+        i += run;
+    }
+    return pairCount * 2 * sizeof(Uint16);
+}
+
+bool decodeTiles(const Uint8* data, Uint32 size, Chunk* chunk) {
+    Tile* tiles = &(*chunk)[0][0];
+    const Uint16* pairs = (const Uint16*)data;
+    int pairCount = size / (2 * sizeof(Uint16));
+    int i = 0;
+    for (int p = 0; p < pairCount; p++) {
+        int run = pairs[p * 2] + 1;
+        if (i + run > TilesPerChunk) return false;
+        Uint16 type = pairs[p * 2 + 1];
+        for (int j = 0; j < run; j++) {
+            tiles[i + j].type = type;
+        }
+        i += run;
+    }
+    return i == TilesPerChunk;
+}
+
+}
+
+void ChunkStreamer::init() {
+    records = decltype(records)::WithBuckets(64);
+    regionFile = nullptr;
+    regionFileEnd = 0;
+    frame = 0;
+}
+
+void ChunkStreamer::destroy() {
+    if (regionFile) {
+        fclose(regionFile);
+        regionFile = nullptr;
+        if (!regionPath.empty()) {
+            remove(regionPath.c_str());
+        }
+    }
+    records.destroy();
+    records = decltype(records)::Empty();
+    buffer = std::vector<Uint8>();
+}
+
+void ChunkStreamer::clear() {
+    records.clear();
+    // the old records' space in the file is just written over
+    regionFileEnd = 0;
+}
+
+bool ChunkStreamer::openRegionFile() {
+    if (regionFile) return true;
+    if (regionPath.empty()) {
+        regionFile = tmpfile();
+    } else {
+        regionFile = fopen(regionPath.c_str(), "w+b");
+    }
+    if (!regionFile) {
+        LogError("Failed to open chunk region file %s!", regionPath.empty() ? "(temporary)" : regionPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ChunkStreamer::spill(ChunkCoord position, const ChunkData& chunkdata) {
+    if (!openRegionFile()) return false;
+
+    Uint32 size = encodeTiles(chunkdata.chunk, buffer);
+    bool encoded = size < sizeof(Chunk);
+    const void* data = buffer.data();
+    if (!encoded) {
+        size = sizeof(Chunk);
+        data = chunkdata.chunk;
+    }
+
+    Record* record = records.lookup(position);
+    Record newRecord;
+    if (record && record->capacity >= size) {
+        newRecord = *record;
+    } else {
+        // doesn't fit where it was before, so it goes at the end. The old space is left unused
+        newRecord.offset = regionFileEnd;
+        newRecord.capacity = size;
+    }
+    newRecord.size = size;
+    newRecord.encoded = encoded;
+    newRecord.dirty = chunkdata.dirty;
+
+    if (fseek(regionFile, (long)newRecord.offset, SEEK_SET) != 0
+     || fwrite(data, 1, size, regionFile) != size) {
+        LogError("Failed to spill chunk (%d,%d) to the region file!", position.x, position.y);
+        return false;
+    }
+    if (newRecord.offset + newRecord.capacity > regionFileEnd) {
+        regionFileEnd = newRecord.offset + newRecord.capacity;
+    }
+    if (record) {
+        *record = newRecord;
+    } else {
+        records.insert(position, newRecord);
+    }
+    return true;
+}
+
+bool ChunkStreamer::readSpilled(ChunkCoord position, Chunk* chunk) const {
+    const Record* record = records.lookup(position);
+    if (!record || !regionFile) return false;
+    buffer.resize(record->size);
+    if (fseek(regionFile, (long)record->offset, SEEK_SET) != 0
+     || fread(buffer.data(), 1, record->size, regionFile) != record->size) {
+        return false;
+    }
+    if (record->encoded) {
+        return decodeTiles(buffer.data(), record->size, chunk);
+    }
+    if (record->size != sizeof(Chunk)) return false;
+    memcpy(chunk, buffer.data(), sizeof(Chunk));
+    return true;
+}
+
+bool ChunkStreamer::restore(ChunkMap* chunkmap, ChunkCoord position) {
+    ChunkData* chunkdata = chunkmap->newChunkAt(position);
+    if (!chunkdata) return false;
+    if (!readSpilled(position, chunkdata->chunk)) {
+        LogError("Failed to read chunk (%d,%d) back from the region file!", position.x, position.y);
+        // generating it again is better than a hole in the world
+        chunkmap->removeChunk(position);
+        records.remove(position);
+        return false;
+    }
+    chunkdata->modified = true;
+    chunkdata->dirty = records.lookup(position)->dirty;
+    return true;
+}
+
+void ChunkStreamer::use(ChunkMap* chunkmap, ChunkCoord minChunk, ChunkCoord maxChunk) {
+    frame++;
+    for (int y = minChunk.y; y <= maxChunk.y; y++) {
+        for (int x = minChunk.x; x <= maxChunk.x; x++) {
+            ChunkCoord position = {x, y};
+            ChunkData* chunkdata = chunkmap->get(position);
+            if (!chunkdata && records.size > 0 && records.contains(position)) {
+                if (restore(chunkmap, position)) {
+                    chunkdata = chunkmap->get(position);
+                }
+            }
+            if (chunkdata) {
+                chunkdata->lastUsed = frame;
+            }
+        }
+    }
+}
+
+int ChunkStreamer::evict(ChunkMap* chunkmap) {
+    size_t maxChunks = maxLoadedChunks();
+    if (chunkmap->size() <= maxChunks) return 0;
+    // go a bit under the budget so the whole map isn't looked through again the next time a chunk is made
+    size_t targetChunks = maxChunks - maxChunks / 8;
+
+    struct Candidate {
+        Uint32 lastUsed;
+        ChunkCoord position;
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve(chunkmap->size());
+    chunkmap->map.forEach([&](ChunkCoord position, const ChunkData& chunkdata){
+        if (chunkdata.lastUsed != frame) {
+            candidates.push_back({chunkdata.lastUsed, position});
+        }
+    });
+
+    size_t evictCount = MIN(chunkmap->size() - targetChunks, candidates.size());
+    if (evictCount < candidates.size()) {
+        std::nth_element(candidates.begin(), candidates.begin() + evictCount, candidates.end(),
+            [](const Candidate& lhs, const Candidate& rhs){
+            return lhs.lastUsed < rhs.lastUsed;
+        });
+    }
+
+    int evicted = 0;
+    for (size_t i = 0; i < evictCount; i++) {
+        ChunkCoord position = candidates[i].position;
+        const ChunkData* chunkdata = chunkmap->get(position);
+        // changed chunks stay loaded if they can't be spilled, rather than being lost
+        if (chunkdata->modified && !spill(position, *chunkdata)) continue;
+        chunkmap->removeChunk(position);
+        evicted++;
+    }
+
+    if (evicted > 0) {
+        // removed entries leave markers behind that make looking up missing chunks slower, so clean them up
+        chunkmap->map.rehash(chunkmap->map.bucketCount);
+        // otherwise the slots are only reused, and memory stays at the most chunks ever loaded
+        chunkmap->releaseFreeBuckets();
+        // the same goes for the grid cells entities left behind in the unloaded area
+        chunkmap->entityGrid.releaseFreeCells();
+    }
+    return evicted;
+}
+
+void ChunkStreamer::clearDirty() {
+    records.forEach([](ChunkCoord, Record& record){
+        record.dirty = false;
+    });
+}
@@ -1,41 +1,30 @@
 #include "Tiles.hpp"
 #include "Chunks.hpp"
 #include "global.hpp"
+#include "Terrain.hpp"
 
 ChunkData::ChunkData(Chunk* chunk, IVec2 position) {
     this->chunk = chunk;
     this->position = position;
-    this->closeEntities = My::Vec<Entity>(0);
+    this->dirty = true;
+    this->modified = false;
+    this->lastUsed = 0;
 }
 
-void generateChunk(ChunkData* chunkdata) {
-    if (!chunkdata) return;
-    Chunk& chunk = *chunkdata->chunk;
-    float r = fmod(chunkdata->position.x, 4.0f) / 4.0f * 0.2f;
-    for (int row = 0; row < CHUNKSIZE; row++) {
-        for (int col = 0; col < CHUNKSIZE; col++) {
-            TileType tileType = TileTypes::Space;
-            r = (float)rand() / RAND_MAX;
-            if (r < 0.2f) {
-                tileType = TileTypes::Water;
-            } else if (r < 0.4f) {
-                tileType = TileTypes::Space;
-            } else {
-                tileType = TileTypes::Grass;
-            }
-            
-            chunk[row][col] = Tile(tileType);
-        }
-    }
+void generateChunk(Chunk* chunk, ChunkCoord position, Uint64 seed) {
+    Terrain::generate(chunk, position, seed);
 }
 
 void ChunkMap::init() {
     map = InternalChunkMap::WithBuckets(128);
+    entityGrid.init();
 }
 
 void ChunkMap::destroy() {
     chunkList.destroy();
+    freeChunks = std::vector<Chunk*>();
     map.destroy();
+    entityGrid.destroy();
 }
 
 /*
@@ -61,7 +50,13 @@ ChunkData* ChunkMap::newChunkAt(IVec2 position) {
         }
     }
 
-    Chunk* chunk = chunkList.reserveBack();
+    Chunk* chunk;
+    if (!freeChunks.empty()) {
+        chunk = freeChunks.back();
+        freeChunks.pop_back();
+    } else {
+        chunk = chunkList.reserveBack();
+    }
     if (chunk) { // check for possible memory errors
         return map.insert(position, ChunkData(chunk, position));
     }
@@ -70,6 +65,60 @@ ChunkData* ChunkMap::newChunkAt(IVec2 position) {
     return nullptr;
 }
 
+bool ChunkMap::removeChunk(IVec2 position) {
+    ChunkData* chunkdata = map.lookup(position);
+    if (!chunkdata) return false;
+    freeChunks.push_back(chunkdata->chunk);
+    map.remove(position);
+    return true;
+}
+
+int ChunkMap::chunkIndex(const Chunk* chunk) const {
+    for (int b = 0; b < (int)chunkList.buckets.size(); b++) {
+        const Chunk* bucket = chunkList.buckets[b];
+        if (chunk >= bucket && chunk < bucket + CHUNK_BUCKET_SIZE) {
+            return b * CHUNK_BUCKET_SIZE + (int)(chunk - bucket);
+        }
+    }
+    return -1;
+}
+
+int ChunkMap::releaseFreeBuckets() {
+    if (freeChunks.size() < CHUNK_BUCKET_SIZE) return 0;
+
+    int slotCount = chunkList.size();
+    std::vector<ChunkData*> owners(slotCount, nullptr);
+    map.forEach([&](IVec2, ChunkData& chunkdata){
+        owners[chunkIndex(chunkdata.chunk)] = &chunkdata;
+    });
+
+    // fill the lowest free slot with the highest used one until they meet
+    int low = 0;
+    int high = slotCount - 1;
+    while (true) {
+        while (low < slotCount && owners[low]) low++;
+        while (high >= 0 && !owners[high]) high--;
+        if (low >= high) break;
+        ChunkData* chunkdata = owners[high];
+        memcpy(&chunkList[low], chunkdata->chunk, sizeof(Chunk));
+        chunkdata->chunk = &chunkList[low];
+        owners[low] = chunkdata;
+        owners[high] = nullptr;
+    }
+
+    int usedSlots = high + 1;
+    int bucketsNeeded = (usedSlots + CHUNK_BUCKET_SIZE - 1) / CHUNK_BUCKET_SIZE;
+    int released = 0;
+    while ((int)chunkList.buckets.size() > bucketsNeeded) {
+        chunkList.popBucket();
+        released++;
+    }
+    // the rest of the top bucket is handed out by reserveBack again
+    chunkList.topBucketSlotsUsed = usedSlots - MAX(bucketsNeeded - 1, 0) * CHUNK_BUCKET_SIZE;
+    freeChunks.clear();
+    return released;
+}
+
 ChunkData* ChunkMap::getOrMakeNew(IVec2 position) {
     // newChunkAt already does this but it produces a warning so we just do it here to not produce a warning.
     ChunkData* chunkdata = get(position);
@@ -1,7 +1,10 @@
 #include "ECS/ArchetypalComponentManager.hpp"
+#include <algorithm>
 
 namespace ECS {
 
+const EntityIndex EntityIndexTable::emptyPage[EntityIndexTable::PageSize] = {};
+
 void ArchetypalComponentManager::init(ArrayRef<ComponentInfo> componentInfo, ArenaAllocator* arena) {
     numComponentTypes = componentInfo.size();
     componentSizes = ALLOC(Sint32, numComponentTypes, *arena);
@@ -19,14 +22,17 @@ void ArchetypalComponentManager::init(ArrayRef<ComponentInfo> componentInfo, Are
     auto nullPool = ArchetypePool(Signature{0}, componentSizes, &poolAllocator);
     pools.push_back(nullPool);
     archetypes = decltype(archetypes)::Empty();
+    // so removing an entity's last component sends it back to the null pool
+    archetypes.insert({Signature{0}, -1}, 0);
+    queryIndices = decltype(queryIndices)::Empty();
     unusedEntities = My::Vec<Entity>::WithCapacity(512);
 
     memset(watchedComponentAddGroupIndices, NullWatcherIndex, sizeof(watchedComponentAddGroupIndices));
     memset(watchedComponentRemoveGroupIndices, NullWatcherIndex, sizeof(watchedComponentRemoveGroupIndices));
 
-    // calloc setting all to 0 means by default all entity data references nullentity,
-    // meaning any uninitialized entity automatically behaves as null without any extra effort
-    entityIndices = (EntityIndex*)calloc(MaxEntityID, sizeof(EntityIndex));
+    // all indices start at 0, meaning by default all entity data references nullentity,
+    // so any uninitialized entity automatically behaves as null without any extra effort
+    entityIndices.init();
 
     reserveEntities(64);
 
@@ -134,7 +140,17 @@ ArchetypePool* ArchetypalComponentManager::addWatcher(ComponentGroup group, Grou
     
 // }
 
-Entity ArchetypalComponentManager::createEntity(Uint32 prototype) {
+ArchetypalComponentManager::ArchetypeID ArchetypalComponentManager::getPrototypeArchetype(Sint32 prototype, Signature prototypeSignature) {
+    ArchetypeID archetype = getArchetypeID({0}, prototype);
+    if (archetype == NullArchetypeID) {
+        archetype = initArchetype({0}, prototype, prototypeSignature);
+    }
+    DASSERT(pools[archetype].prototypeSignature == prototypeSignature && "Prototype components changed after entities were made!");
+    return archetype;
+}
+
+Entity ArchetypalComponentManager::createEntity(Uint32 prototype, Signature prototypeSignature) {
+    ArchetypeID archetype = getPrototypeArchetype((Sint32)prototype, prototypeSignature);
     Entity entity;
     if (!unusedEntities.empty()) {
         entity = unusedEntities.popBack();
@@ -148,21 +164,64 @@ Entity ArchetypalComponentManager::createEntity(Uint32 prototype) {
     reserveEntities(1);
 
     auto entityIndex = EntityIndex(entityCount++);
-    entityIndices[entity.id] = entityIndex;
-    entityData.version[(Uint16)entityIndex] = entity.version;
-    entityData.prototype[(Uint16)entityIndex] = prototype;
-    entityData.location[(Uint16)entityIndex] = {
-        .archetype = 0,
+    entityIndices.set(entity.id, entityIndex);
+    entityData.version[(Uint32)entityIndex] = entity.version;
+    entityData.prototype[(Uint32)entityIndex] = prototype;
+    entityData.location[(Uint32)entityIndex] = {
+        .archetype = archetype,
         .index = 0
     };
-    entityData.id[(Uint16)entityIndex] = entity.id;
+    entityData.id[(Uint32)entityIndex] = entity.id;
+    entityChangeCount++;
 
     return entity;
 }
 
+EntityIndex ArchetypalComponentManager::allocateEntities(int count, Entity* entitiesOut) {
+    int reused = MIN(count, unusedEntities.size);
+    int fresh = count - reused;
+    if (UNLIKELY(fresh > (int)(MaxEntityID - highestUsedEntity)) || !reserveEntities(count)) {
+        return NullEntityIndex;
+    }
+
+    memcpy(entitiesOut, unusedEntities.end() - reused, reused * sizeof(Entity));
+    unusedEntities.size -= reused;
+    for (int i = reused; i < count; i++) {
+        entitiesOut[i] = {highestUsedEntity++, 1};
+    }
+
+    auto firstIndex = EntityIndex(entityCount);
+    for (int i = 0; i < count; i++) {
+        Uint32 index = entityCount + i;
+        entityIndices.set(entitiesOut[i].id, EntityIndex(index));
+        entityData.version[index] = entitiesOut[i].version;
+        entityData.id[index] = entitiesOut[i].id;
+    }
+    entityCount += count;
+    entityChangeCount++;
+    return firstIndex;
+}
+
+void ArchetypalComponentManager::createEntities(int count, Entity* entitiesOut, Uint32 prototype, Signature prototypeSignature) {
+    if (count <= 0) return;
+    ArchetypeID archetype = getPrototypeArchetype((Sint32)prototype, prototypeSignature);
+    EntityIndex firstIndex = allocateEntities(count, entitiesOut);
+    if (!firstIndex) {
+        LogCrash(CrashReason::UnrecoverableError, "All possible entity IDs used!");
+    }
+    for (int i = 0; i < count; i++) {
+        Uint32 index = (Uint32)firstIndex + i;
+        entityData.prototype[index] = prototype;
+        entityData.location[index] = {
+            .archetype = archetype,
+            .index = 0
+        };
+    }
+}
+
 MultiEntity ArchetypalComponentManager::createMultiEntity(Sint32 count) {
     if (count < 1) return NullMultiEntity;
-    return {createEntity(-1), count};
+    return {createEntity(-1, {0}), count};
 }
 
 EntityCreationError ArchetypalComponentManager::clone(Entity entity, int count, Entity* clonesOut) {
@@ -172,64 +231,39 @@ EntityCreationError ArchetypalComponentManager::clone(Entity entity, int count,
     EntityIndex entityIndex = lookupEntity(entity);
     if (!entityIndex) return {EntityCreationError::InvalidEntity};
 
-    auto location = entityData.location[(Uint16)entityIndex];
+    auto location = entityData.location[(Uint32)entityIndex];
     auto archetype = location.archetype;
     auto* pool = &pools[archetype];
 
     Signature entitySignature = pool->signature();
 
-    reserveEntities(count);
-
-    EntityID unusedIDs = (MaxEntityID - 1) - highestUsedEntity;
-    EntityIndex clonesFirstIndex;
-    Entity* clones = nullptr;
-    if (unusedIDs >= count) {
-        EntityID firstID = highestUsedEntity + 1;
-        clonesFirstIndex = EntityIndex(entityCount);
-        for (int i = 0; i < count; i++) {
-            entityIndices[firstID + i] = EntityIndex(clonesFirstIndex + i);
-            clonesOut[i] = {firstID + i, 1};
-        }
-        clones = clonesOut;
-
-        highestUsedEntity = firstID + count - 1;
-    } else if (unusedEntities.size >= count) {
-        clones = unusedEntities.end() - count;
-        memcpy(clonesOut, clones, count * sizeof(Entity));
-        unusedEntities.size -= count;
-
-        Sint32 clonesFirstIndex = entityCount;
-        for (int i = 0; i < count; i++) {
-            entityIndices[clones[i].id] = EntityIndex(clonesFirstIndex + i);
-        }
-
-    } else {
+    Entity* clones = clonesOut;
+    EntityIndex clonesFirstIndex = allocateEntities(count, clones);
+    if (!clonesFirstIndex) {
         return {EntityCreationError::EntityLimitReached};
     }
 
     for (int i = 0; i < count; i++) {
-        entityData.location[clonesFirstIndex  + i] = entityData.location[(Uint16)entityIndex];
-        entityData.prototype[clonesFirstIndex + i] = entityData.prototype[(Uint16)entityIndex];
-        entityData.version[clonesFirstIndex   + i] = clones[i].version;
+        entityData.location[clonesFirstIndex  + i] = entityData.location[(Uint32)entityIndex];
+        entityData.prototype[clonesFirstIndex + i] = entityData.prototype[(Uint32)entityIndex];
     }
 
     if (!pool->null()) {
-        int startPoolIndex = pool->addNew(count, clones, &archetypeAllocator, componentSizes);
+        int startPoolIndex = pool->addNew(count, clones, &archetypeAllocator, componentSizes, changeTick);
         for (int i = 0; i < count; i++) {
             entityData.location[clonesFirstIndex+i].index = startPoolIndex + i;
 
             signatureAdded(clones[i], entitySignature, {0});
         }
 
-        entitySignature.forEachSet([this, count, pool, entityIndex](ComponentID componentID){
-            auto size = this->componentSizes[componentID];
-            void* component = pool->getComponent(componentID, entityData.location[(Uint16)entityIndex].index, size);
-            void* clonesStart = pool->getComponent(componentID, pool->size - count, size);
+        int sourcePoolIndex = entityData.location[(Uint32)entityIndex].index;
+        for (int a = 0; a < pool->numComponentArrays(); a++) {
+            auto size = this->componentSizes[pool->arrays[a].componentType];
+            const void* component = pool->getComponentByIndex(a, sourcePoolIndex, size);
             for (int i = 0; i < count; i++) {
-                void* cloneComponent = (char*)clonesStart + i * size;
-                memcpy(cloneComponent, component, size);
+                memcpy(pool->getComponentByIndex(a, startPoolIndex + i, size), component, size);
             }
-        });
+        }
     } else {
         // maybe unnecessary, since we shouldn't be accessing this anyway if there isn't an archetype/pool for the entity?
         for (int i = 0; i < count; i++) {
@@ -247,19 +281,28 @@ void* ArchetypalComponentManager::getComponent(Entity entity, ComponentID compon
 
     const auto& pool = pools[getArchetype(index)];
     auto poolIndex = getPoolIndex(index);
-    char* array = pool.getComponentArray(component);
-    if (!array) return nullptr; // doesnt have it
-    return array + poolIndex * getComponentSize(component);
+    // null if it doesnt have it
+    return pool.getComponent(component, poolIndex, getComponentSize(component));
+}
+
+void ArchetypalComponentManager::markChanged(Entity entity, ComponentID component) {
+    auto index = lookupEntity(entity);
+    auto& pool = pools[getArchetype(index)];
+    int arrayNum = pool.getArrayNumber(component);
+    if (arrayNum == -1) return;
+    pool.changeCount++;
+    pool.setColumnTick(pool.blockOf(getPoolIndex(index)), arrayNum, changeTick);
 }
 
 void ArchetypalComponentManager::removeEntityIndexFromPool(int index, ArchetypePool* pool) {
     assert(pool);
     Entity movedEntity;
-    pool->remove(index, &movedEntity, componentSizes);
+    pool->remove(index, &movedEntity, componentSizes, changeTick);
     if (movedEntity.NotNull()) {
-        auto movedEntityIndex = entityIndices[movedEntity.id];
-        entityData.location[(Uint16)movedEntityIndex].index = index;
+        auto movedEntityIndex = entityIndices.get(movedEntity.id);
+        entityData.location[(Uint32)movedEntityIndex].index = index;
     }
+    pool->releaseEmptyBlocks(&archetypeAllocator);
 }
 
 void ArchetypalComponentManager::removeEntityIndicesFromPool(ArrayRef<int> indices, ArchetypePool* pool) {
@@ -300,14 +343,15 @@ int ArchetypalComponentManager::moveEntitiesToSuperArchetype(ArrayRef<Entity> en
         return newPoolStartIndex;
     }
 
-    for (int i = 0; i < oldArchetype->numComponentArrays(); i++) {
-        ComponentID transferComponent = oldArchetype->arrays[i].componentType;
+    for (int a = 0; a < oldArchetype->numComponentArrays(); a++) {
+        ComponentID transferComponent = oldArchetype->arrays[a].componentType;
         auto componentSize = componentSizes[transferComponent];
-        char* newComponents = newArchetype->getComponent(transferComponent, newPoolStartIndex, componentSize);
-        assert(newComponents);
+        int newArrayNumber = newArchetype->getArrayNumber(transferComponent);
+        assert(newArrayNumber != -1);
         for (int i = 0; i < entities.size(); i++) {
-            const char* oldComponent = oldArchetype->getComponentByIndex(i, oldPoolIndices[i], componentSize);
-            memcpy(newComponents + i * componentSize, oldComponent, componentSize);
+            const char* oldComponent = oldArchetype->getComponentByIndex(a, oldPoolIndices[i], componentSize);
+            char* newComponent = newArchetype->getComponentByIndex(newArrayNumber, newPoolStartIndex + i, componentSize);
+            memcpy(newComponent, oldComponent, componentSize);
         }
     };
 
@@ -351,18 +395,16 @@ void* ArchetypalComponentManager::addComponent(Entity entity, ComponentID compon
         return getPool(oldArchetypeID)->getComponent(component, oldPoolIndex, getComponentSize(component));
     }
 
-    Signature newSignature = oldSignature; newSignature.set(component);
-
-    ArchetypeID newArchetypeID;
     // all archetype pool pointers are invalidated by this call
-    ArchetypePool* newArchetype = getOrMakePool(newSignature, &newArchetypeID);
+    ArchetypeID newArchetypeID = getAddTransition(oldArchetypeID, component);
+    ArchetypePool* newArchetype = getPool(newArchetypeID);
 
     // don't waste time for components that have no groups associated with them
     signatureAdded(entity, Signature::OneComponent(component), oldSignature);
 
     int newPoolIndex = moveEntityToSuperArchetype(entity, getPool(oldArchetypeID), newArchetype, oldPoolIndex);
 
-    setEntityLocation(entityIndex, {newArchetypeID, (Sint16)newPoolIndex}); // new archetype pushed back last
+    setEntityLocation(entityIndex, {newArchetypeID, (ArchetypePool::EntityIndex)newPoolIndex}); // new archetype pushed back last
 
     return newArchetype->getComponent(component, newPoolIndex, componentSizes[component]);
 }
@@ -371,6 +413,10 @@ void ArchetypalComponentManager::signatureAdded(Entity entity, Signature addedSi
     Signature newSignature = oldSignature | addedSignature;
     Signature watchedAdds = addedSignature & watchedComponentAdds;
     if (watchedAdds.any()) {
+        // prototype components count towards groups, and the entity keeps its prototype through the change
+        Signature prototypeSignature = getPool(getArchetype(lookupEntity(entity)))->prototypeSignature;
+        oldSignature |= prototypeSignature;
+        newSignature |= prototypeSignature;
         for (auto& watcher : componentAddWatchers[0]) {
             bool inGroupNow = watcher.group.contains(newSignature);
             bool wasInGroup = watcher.group.contains(oldSignature);
@@ -391,6 +437,9 @@ void ArchetypalComponentManager::signatureRemoved(Entity entity, Signature remov
     Signature newSignature = oldSignature ^ removedSignature;
     Signature watchedRemoves = removedSignature & watchedComponentRemoves;
     if (watchedRemoves.any()) {
+        Signature prototypeSignature = getPool(getArchetype(lookupEntity(entity)))->prototypeSignature;
+        oldSignature |= prototypeSignature;
+        newSignature |= prototypeSignature;
         for (auto& watcher : componentAddWatchers[0]) {
             bool inGroupNow = watcher.group.contains(newSignature);
             bool wasInGroup = watcher.group.contains(oldSignature);
@@ -423,16 +472,15 @@ ArchetypalComponentManager::EntityLoc ArchetypalComponentManager::addSignature(E
         return {oldArchetypeID, oldPoolIndex};
     }
 
-    Signature newSignature = oldSignature | components;
-    ArchetypeID newArchetypeID;
-    ArchetypePool* newArchetype = getOrMakePool(newSignature, &newArchetypeID);
+    ArchetypeID newArchetypeID = getTransition(oldArchetypeID, components & ~oldSignature, {0});
+    ArchetypePool* newArchetype = getPool(newArchetypeID);
 
     // don't waste time for components that have no groups associated with them
     signatureAdded(entity, components, oldSignature);
 
     int newPoolIndex = moveEntityToSuperArchetype(entity, getPool(oldArchetypeID), newArchetype, oldPoolIndex);
 
-    auto location = EntityLoc{newArchetypeID, (Sint16)newPoolIndex};
+    auto location = EntityLoc{newArchetypeID, (ArchetypePool::EntityIndex)newPoolIndex};
     setEntityLocation(entityIndex, location);
 
     return location;
@@ -447,17 +495,165 @@ void ArchetypalComponentManager::removeComponent(Entity entity, ComponentID comp
 
     Signature oldSignature = getPool(oldArchetypeID)->signature();
     DASSERT(oldSignature[component]);
-    Signature newSignature = oldSignature; newSignature.flipBit(component);
-    ArchetypeID newArchetypeID;
-    ArchetypePool* newArchetype = getOrMakePool(newSignature, &newArchetypeID);
+    ArchetypeID newArchetypeID = getRemoveTransition(oldArchetypeID, component);
+    ArchetypePool* newArchetype = getPool(newArchetypeID);
     
     signatureRemoved(entity, Signature::OneComponent(component), oldSignature);
 
     int newPoolIndex = moveEntityToSubArchetype(entity, getPool(oldArchetypeID), newArchetype, oldPoolIndex);
-    auto location = EntityLoc{newArchetypeID, (Sint16)newPoolIndex};
+    auto location = EntityLoc{newArchetypeID, (ArchetypePool::EntityIndex)newPoolIndex};
     setEntityLocation(entityIndex, location);
 } 
 
+void ArchetypalComponentManager::addComponent(ArrayRef<Entity> entities, ComponentID component) {
+    debugCheckComponent(component);
+    SmallVector<SignatureChange, 0> changes;
+    changes.reserve(entities.size());
+    for (Entity entity : entities) {
+        changes.push_back({entity, Signature::OneComponent(component), {0}});
+    }
+    changeSignatures(changes.data(), changes.size());
+}
+
+void ArchetypalComponentManager::removeComponent(ArrayRef<Entity> entities, ComponentID component) {
+    debugCheckComponent(component);
+    SmallVector<SignatureChange, 0> changes;
+    changes.reserve(entities.size());
+    for (Entity entity : entities) {
+        changes.push_back({entity, {0}, Signature::OneComponent(component)});
+    }
+    changeSignatures(changes.data(), changes.size());
+}
+
+void ArchetypalComponentManager::copySharedComponents(const ArchetypePool* src, const int* srcIndices, ArchetypePool* dst, int dstStart, int count) {
+    for (int a = 0; a < src->numComponentArrays(); a++) {
+        ComponentID component = src->arrays[a].componentType;
+        int dstArray = dst->getArrayNumber(component);
+        if (dstArray == -1) continue; // being removed
+        auto componentSize = componentSizes[component];
+        if (componentSize == 0) continue;
+
+        for (int i = 0; i < count;) {
+            // extend the run while rows are neighbours on both sides and stay inside one block
+            int run = 1;
+            while (i + run < count
+                && srcIndices[i + run] == srcIndices[i] + run
+                && src->rowOf(srcIndices[i] + run) != 0
+                && dst->rowOf(dstStart + i + run) != 0) {
+                run++;
+            }
+            memcpy(dst->getComponentByIndex(dstArray, dstStart + i, componentSize),
+                   src->getComponentByIndex(a, srcIndices[i], componentSize),
+                   run * componentSize);
+            i += run;
+        }
+    }
+}
+
+void ArchetypalComponentManager::changeSignatures(SignatureChange* changes, int count) {
+    struct Move {
+        Entity entity;
+        EntityIndex index;
+        ArchetypeID oldArchetype;
+        Signature added; // components the entity doesn't already have
+        Signature removed; // components the entity has
+    };
+    SmallVector<Move, 0> moves;
+    moves.reserve(count);
+    for (int i = 0; i < count; i++) {
+        const SignatureChange& change = changes[i];
+        debugCheckSignature(change.added | change.removed);
+        assert(!change.added.hasAny(change.removed) && "Can't add and remove the same component at once!");
+        EntityIndex index = lookupEntity(change.entity);
+        if (index == NullEntityIndex) continue;
+        ArchetypeID oldArchetype = getArchetype(index);
+        Signature oldSignature = getPool(oldArchetype)->signature();
+        Signature added = change.added & ~oldSignature;
+        Signature removed = change.removed & oldSignature;
+        if (!added.any() && !removed.any()) continue;
+        moves.push_back({change.entity, index, oldArchetype, added, removed});
+    }
+    // moves between the same two archetypes end up next to each other
+    auto sameMove = [](const Move& lhs, const Move& rhs){
+        return lhs.oldArchetype == rhs.oldArchetype && lhs.added == rhs.added && lhs.removed == rhs.removed;
+    };
+    std::sort(moves.begin(), moves.end(), [](const Move& lhs, const Move& rhs){
+        if (lhs.oldArchetype != rhs.oldArchetype) return lhs.oldArchetype < rhs.oldArchetype;
+        int addedOrder = memcmp(&lhs.added, &rhs.added, sizeof(Signature));
+        if (addedOrder != 0) return addedOrder < 0;
+        return memcmp(&lhs.removed, &rhs.removed, sizeof(Signature)) < 0;
+    });
+
+    struct Row {
+        int oldPoolIndex;
+        Entity entity;
+        EntityIndex index;
+    };
+    SmallVector<Row, 0> rows;
+    SmallVector<Entity, 0> rowEntities;
+    SmallVector<int, 0> oldPoolIndices;
+    for (int groupStart = 0; groupStart < moves.size();) {
+        int groupEnd = groupStart + 1;
+        while (groupEnd < moves.size() && sameMove(moves[groupEnd], moves[groupStart])) groupEnd++;
+        const Move& move = moves[groupStart];
+
+        Signature oldSignature = getPool(move.oldArchetype)->signature();
+        // one lookup for the whole group. All archetype pool pointers are invalidated by this call
+        ArchetypeID newArchetypeID = getTransition(move.oldArchetype, move.added, move.removed);
+        ArchetypePool* newPool = getPool(newArchetypeID);
+        ArchetypePool* oldPool = getPool(move.oldArchetype);
+
+        rows.clear();
+        for (int i = groupStart; i < groupEnd; i++) {
+            // a repeated entity with a different change was already moved by an earlier group, only that change is applied
+            if (getArchetype(moves[i].index) != move.oldArchetype) continue;
+            rows.push_back({getPoolIndex(moves[i].index), moves[i].entity, moves[i].index});
+        }
+        // keep rows in the order they are stored so neighbours can be copied together
+        std::sort(rows.begin(), rows.end(), [](const Row& lhs, const Row& rhs){
+            return lhs.oldPoolIndex < rhs.oldPoolIndex;
+        });
+        // the same entity repeated with the same change is one row, moving it twice would break the pools
+        rows.erase(std::unique(rows.begin(), rows.end(), [](const Row& lhs, const Row& rhs){
+            return lhs.oldPoolIndex == rhs.oldPoolIndex;
+        }), rows.end());
+        int count = rows.size();
+        if (count == 0) {
+            groupStart = groupEnd;
+            continue;
+        }
+        for (auto& row : rows) {
+            if (move.added.any()) signatureAdded(row.entity, move.added, oldSignature);
+            if (move.removed.any()) signatureRemoved(row.entity, move.removed, oldSignature | move.added);
+        }
+
+        int newStart = 0;
+        if (!newPool->null()) {
+            rowEntities.clear();
+            oldPoolIndices.clear();
+            for (auto& row : rows) {
+                rowEntities.push_back(row.entity);
+                oldPoolIndices.push_back(row.oldPoolIndex);
+            }
+            newStart = addToPool(newPool, rowEntities);
+            if (!oldPool->null()) {
+                copySharedComponents(oldPool, oldPoolIndices.data(), newPool, newStart, count);
+            }
+        }
+        if (!oldPool->null()) {
+            // highest first, so the entities filling the holes are never ones we still have to remove
+            for (int r = count - 1; r >= 0; r--) {
+                removeEntityIndexFromPool(rows[r].oldPoolIndex, oldPool);
+            }
+        }
+        for (int r = 0; r < count; r++) {
+            setEntityLocation(rows[r].index, {newArchetypeID, newPool->null() ? 0 : newStart + r});
+        }
+
+        groupStart = groupEnd;
+    }
+}
+
 void ArchetypalComponentManager::deleteEntity(Entity entity) {
     auto entityIndex = lookupEntity(entity);
     if (!entityIndex) return;
@@ -475,14 +671,36 @@ void ArchetypalComponentManager::deleteEntity(Entity entity) {
     // reuse the entity index
     // move the top most entity to this entities position
     auto topEntity = EntityIndex(entityCount-1);
-    entityData.location[(Uint16)entityIndex] = entityData.location[(Uint16)topEntity];
-    entityData.version[(Uint16)entityIndex] = entityData.version[(Uint16)topEntity];
-    entityData.prototype[(Uint16)entityIndex] = entityData.prototype[(Uint16)topEntity];
-    auto topEntityID = entityData.id[(Uint16)topEntity];
-    entityIndices[topEntityID] = entityIndex;
-    entityIndices[entity.id] = NullEntityIndex;
+    entityData.location[(Uint32)entityIndex] = entityData.location[(Uint32)topEntity];
+    entityData.version[(Uint32)entityIndex] = entityData.version[(Uint32)topEntity];
+    entityData.prototype[(Uint32)entityIndex] = entityData.prototype[(Uint32)topEntity];
+    auto topEntityID = entityData.id[(Uint32)topEntity];
+    entityData.id[(Uint32)entityIndex] = topEntityID;
+    entityIndices.set(topEntityID, entityIndex);
+    entityIndices.set(entity.id, NullEntityIndex);
     unusedEntities.push({entity.id, entity.version + 1});
     entityCount--;
+    entityChangeCount++;
+}
+
+void ArchetypalComponentManager::clearEntities() {
+    for (auto& pool : pools) {
+        pool.clear();
+        pool.releaseEmptyBlocks(&archetypeAllocator);
+    }
+    for (auto& watchers : componentAddWatchers) {
+        for (auto& watcher : watchers) watcher.pool->clear();
+    }
+    for (auto& watchers : componentRemoveWatchers) {
+        for (auto& watcher : watchers) watcher.pool->clear();
+    }
+    entityIndices.destroy();
+    entityIndices.init();
+    unusedEntities.clear();
+    // just the null entity
+    entityCount = 1;
+    highestUsedEntity = 1;
+    entityChangeCount++;
 }
 
 void ArchetypalComponentManager::deleteEntities(ArrayRef<Entity> entities) {
@@ -492,12 +710,106 @@ void ArchetypalComponentManager::deleteEntities(ArrayRef<Entity> entities) {
     }
 }
 
-ArchetypalComponentManager::ArchetypeID ArchetypalComponentManager::initArchetype(Signature signature) {
-    DASSERT(!archetypes.contains(signature));
+ArchetypalComponentManager::ArchetypeID ArchetypalComponentManager::makeTransition(ArchetypeID from, ComponentID component, bool add) {
+    Signature signature = pools[from].signature();
+    // adding a component the archetype already has, or removing one it doesn't, goes nowhere
+    if (signature[component] == add) return from;
+    signature.set(component, add);
+
+    // entities never change prototype, so transitions stay inside the prototype's archetypes
+    Sint32 prototype = pools[from].prototype;
+    ArchetypeID to = getArchetypeID(signature, prototype);
+    if (to == NullArchetypeID) {
+        to = initArchetype(signature, prototype, pools[from].prototypeSignature);
+    }
+    // fill in both directions, the way back is usually needed soon after
+    if (add) {
+        pools[from].setAddEdge(component, to, &poolAllocator);
+        pools[to].setRemoveEdge(component, from, &poolAllocator);
+    } else {
+        pools[from].setRemoveEdge(component, to, &poolAllocator);
+        pools[to].setAddEdge(component, from, &poolAllocator);
+    }
+    return to;
+}
+
+ArchetypalComponentManager::ArchetypeID ArchetypalComponentManager::getTransition(ArchetypeID from, Signature added, Signature removed) {
+    size_t changed = added.count() + removed.count();
+    if (changed == 0) return from;
+    if (changed == 1) {
+        if (added.any()) return getAddTransition(from, added.highestSet());
+        return getRemoveTransition(from, removed.highestSet());
+    }
+
+    ArchetypeID cached = pools[from].getMultiEdge(added, removed);
+    if (cached != NullArchetypeID) return cached;
+
+    // follow edges that are already known, without making archetypes for every step in between
+    ArchetypeID current = from;
+    for (int w = 0; w < Signature::WordCount; w++) {
+        auto bits = added.words[w];
+        while (bits) {
+            ComponentID component = w * Signature::WordBits + llvm::countTrailingZeros(bits);
+            current = pools[current].getAddEdge(component);
+            if (current == NullArchetypeID) goto lookup;
+            bits &= bits - 1;
+        }
+        bits = removed.words[w];
+        while (bits) {
+            ComponentID component = w * Signature::WordBits + llvm::countTrailingZeros(bits);
+            current = pools[current].getRemoveEdge(component);
+            if (current == NullArchetypeID) goto lookup;
+            bits &= bits - 1;
+        }
+    }
+    pools[from].setMultiEdge(added, removed, current, &poolAllocator);
+    return current;
+
+lookup:
+    Signature signature = (pools[from].signature() | added) & ~removed;
+    Sint32 prototype = pools[from].prototype;
+    ArchetypeID to = getArchetypeID(signature, prototype);
+    if (to == NullArchetypeID) {
+        to = initArchetype(signature, prototype, pools[from].prototypeSignature);
+    }
+    pools[from].setMultiEdge(added, removed, to, &poolAllocator);
+    return to;
+}
+
+ArchetypalComponentManager::ArchetypeID ArchetypalComponentManager::initArchetype(Signature signature, Sint32 prototype, Signature prototypeSignature) {
+    DASSERT(!archetypes.contains({signature, prototype}));
 
     pools.emplace_back(signature, componentSizes, &poolAllocator);
-    archetypes.insert(signature, pools.size()-1);
-    return pools.size()-1;
+    ArchetypeID id = pools.size()-1;
+    pools[id].prototype = prototype;
+    pools[id].prototypeSignature = prototypeSignature;
+    archetypes.insert({signature, prototype}, id);
+    // archetypes without components never have entities put in them
+    if (!signature.any()) return id;
+    for (auto& query : queries) {
+        if (query.group.contains(pools[id].fullSignature())) {
+            query.archetypes.push_back(id);
+        }
+    }
+    return id;
+}
+
+int ArchetypalComponentManager::getQuery(ComponentGroup group) const {
+    int* existing = queryIndices.lookup(group);
+    if (existing) return *existing;
+
+    ArchetypeQuery query;
+    query.group = group;
+    // skip the archetypes without components, entities are never actually put in them
+    for (ArchetypeID id = 1; id < (ArchetypeID)pools.size(); id++) {
+        if (!pools[id].null() && group.contains(pools[id].fullSignature())) {
+            query.archetypes.push_back(id);
+        }
+    }
+    int index = queries.size();
+    queries.push_back(std::move(query));
+    queryIndices.insert(group, index);
+    return index;
 }
 
 void ArchetypalComponentManager::destroy() {
@@ -506,7 +818,9 @@ void ArchetypalComponentManager::destroy() {
         pool.destroy(&poolAllocator, &archetypeAllocator, componentSizes);
     }
     archetypes.destroy();
-    free(entityIndices);
+    queries.clear();
+    queryIndices.destroy();
+    entityIndices.destroy();
 }
 
 }
\ No newline at end of file
@@ -5,13 +5,13 @@ namespace ECS {
 ArchetypePool::ArchetypePool(Signature signature, const Sint32* componentSizes, PoolAllocator* metaAllocator) {
     _signature = signature;
     _numComponents = signature.count();
-    entities = nullptr;
+    changeCount = 0;
     arrays = metaAllocator->allocate<ComponentArray>(_numComponents);
     int i = 0;
     _signature.forEachSet([&](ComponentID component){
         arrays[i++] = {
             .componentType = component,
-            .data = nullptr
+            .offset = 0
         };
     });
 
@@ -24,6 +24,34 @@ ArchetypePool::ArchetypePool(Signature signature, const Sint32* componentSizes,
         numComponentsInOrBeforeWord[i] = numComponentsInWord + numComponentsInOrBeforeWord[i - 1];
     }
 
+    // pick the most entities per block that still fits all of the columns
+    auto layoutBytes = [&](int blockCapacity) -> int {
+        size_t offset = blockCapacity * sizeof(Entity);
+        for (int i = 0; i < _numComponents; i++) {
+            offset = getAlignedOffset(offset, alignof(std::max_align_t));
+            arrays[i].offset = offset;
+            offset += (size_t)blockCapacity * componentSizes[arrays[i].componentType];
+        }
+        return offset;
+    };
+    blockShift = 0;
+    while (blockShift < 16 && layoutBytes(2 << blockShift) <= ArchetypeBlockSize) {
+        blockShift++;
+    }
+    // huge entities that don't fit in a block just get a block each, allocated separately
+    blockBytes = MAX(layoutBytes(1 << blockShift), ArchetypeBlockSize);
+
+    edges = nullptr;
+    multiEdges = nullptr;
+    numMultiEdges = 0;
+    nextMultiEdge = 0;
+    blocks = nullptr;
+    columnTicks = nullptr;
+    generation = 0;
+    prototype = -1;
+    prototypeSignature = {0};
+    numBlocks = 0;
+    blockListCapacity = 0;
     size = 0;
     capacity = 0;
 }
@@ -47,25 +75,51 @@ int ArchetypePool::getArrayNumberFromSignature(ComponentID component) const {
     return index;
 }
 
-int ArchetypePool::addNew(int count, const Entity* newEntities, ArchetypeAllocator* allocator, const Sint32* componentSizes) {
-    int nNewEntities = count;
-    if (size + nNewEntities > capacity) {
-        int newCapacity = (capacity * 2 >= size + nNewEntities) ? capacity * 2 : size + nNewEntities;
-        entities = allocator->reallocate(entities, (size_t)capacity, (size_t)newCapacity);
-        for (int i = 0; i < _numComponents; i++) {
-            ComponentID componentID = arrays[i].componentType;
-            auto componentSize = componentSizes[componentID];
-            arrays[i].data = (char*)allocator->reallocate(arrays[i].data, capacity * componentSize, newCapacity * componentSize, alignof(max_align_t));
+void ArchetypePool::addBlocks(int count, ArchetypeAllocator* allocator) {
+    if (numBlocks + count > blockListCapacity) {
+        blockListCapacity = MAX(blockListCapacity * 2, numBlocks + count);
+        blocks = Realloc<char*>(blocks, blockListCapacity);
+        columnTicks = Realloc<Uint32>(columnTicks, blockListCapacity * _numComponents);
+    }
+    for (int i = 0; i < count; i++) {
+        for (int c = 0; c < _numComponents; c++) {
+            columnTicks[numBlocks * _numComponents + c] = 0;
         }
-        capacity = newCapacity;
+        blocks[numBlocks++] = (char*)allocator->allocate(blockBytes, alignof(std::max_align_t));
+    }
+    capacity = numBlocks << blockShift;
+}
+
+void ArchetypePool::releaseBlocks(ArchetypeAllocator* allocator, int firstBlock) {
+    for (int b = firstBlock; b < numBlocks; b++) {
+        allocator->deallocate(blocks[b], blockBytes, alignof(std::max_align_t));
+    }
+    numBlocks = MIN(numBlocks, firstBlock);
+    capacity = numBlocks << blockShift;
+}
+
+int ArchetypePool::addNew(int count, const Entity* newEntities, ArchetypeAllocator* allocator, const Sint32* componentSizes, Uint32 tick) {
+    if (size + count > capacity) {
+        int blocksNeeded = (size + count - capacity + blockCapacity() - 1) >> blockShift;
+        addBlocks(blocksNeeded, allocator);
     }
 
     int startIndex = size;
     
-    if (newEntities)
-        memcpy(entities + size, newEntities, nNewEntities * sizeof(Entity));
+    if (newEntities) {
+        // copy in runs that stay inside a block
+        int copied = 0;
+        while (copied < count) {
+            int index = startIndex + copied;
+            int run = MIN(count - copied, blockCapacity() - rowOf(index));
+            memcpy(getBlockEntities(blockOf(index)) + rowOf(index), newEntities + copied, run * sizeof(Entity));
+            copied += run;
+        }
+    }
 
-    size += nNewEntities;
+    size += count;
+    changeCount++;
+    setTicks(startIndex, count, tick);
     return startIndex;
 }
 
@@ -83,14 +137,15 @@ int ArchetypePool::addNew(int count, const Entity* newEntities, ArchetypeAllocat
 //     entities[middleIndex] = entities[srcIndex];
 // }
 
-void ArchetypePool::remove(int index, Entity* movedEntity, const Sint32* componentSizes) {
+void ArchetypePool::remove(int index, Entity* movedEntity, const Sint32* componentSizes, Uint32 tick) {
     assert(index < size);
 
     const int lastIndex = size - 1;
     if (index < size-1) {
         // much simpler
-        *movedEntity = entities[lastIndex];
+        *movedEntity = getEntity(lastIndex);
         copyIndex(index, lastIndex, componentSizes);
+        setTicks(index, 1, tick);
     } else {
         // removing very last entity.
         // doesn't matter whether it's dirty or not,
@@ -99,6 +154,8 @@ void ArchetypePool::remove(int index, Entity* movedEntity, const Sint32* compone
     }
 
     size--;
+    changeCount++;
+    generation++;
 }
 
 // void ArchetypePool::remove(ArrayRef<int> indices, EntityLoc* entityLocations, const Sint32* componentSizes) {
@@ -1,5 +1,6 @@
 #include "ECS/EntityManager.hpp"
 #include <SDL3/SDL_assert.h>
+#include <algorithm>
 
 namespace ECS {
 
@@ -16,59 +17,193 @@ void EntityManager::init(ArrayRef<ComponentInfo> componentList, int numPrototype
 
 void EntityManager::executeCommandBuffer(EntityCommandBuffer* commandBuffer) {
     assert(commandBuffer);
-    struct FakeEntity {
-        EntityID fakeID;
-        Entity real;
+    using Command = EntityCommandBuffer::Command;
+    using SignatureChange = ArchetypalComponentManager::SignatureChange;
+
+    // gather the commands from the buffer's blocks, moving fake ids from combined buffers into this buffer's range
+    std::vector<Command*> commands;
+    commands.reserve(commandBuffer->size());
+    commandBuffer->forEachCommand([&](Command& command, EntityID fakeIDOffset){
+        if (command.entity.id > MaxEntityID) {
+            command.entity.id += fakeIDOffset;
+        }
+        commands.push_back(&command);
+    });
+
+    // Fake ids are handed out one after another starting after MaxEntityID, so they index straight into an array.
+    // Every entity the buffer creates is made up front, with one call for each prototype
+    constexpr EntityID FirstFakeID = EntityCommandBuffer::FirstFakeEntityID;
+    std::vector<Entity> createdEntities; // real entity for each create command, in command order
+    {
+        std::vector<std::pair<PrototypeID, int>> creates; // prototype, create command number
+        for (Command* command : commands) {
+            if (command->type == Command::CommandCreate) {
+                creates.push_back({command->create.prototype, (int)creates.size()});
+            }
+        }
+        std::sort(creates.begin(), creates.end());
+        createdEntities.resize(creates.size());
+        std::vector<Entity> made;
+        for (size_t run = 0; run < creates.size();) {
+            size_t runEnd = run + 1;
+            while (runEnd < creates.size() && creates[runEnd].first == creates[run].first) runEnd++;
+            made.resize(runEnd - run);
+            components.createEntities(made.size(), made.data(), creates[run].first, getPrototypeSignature(creates[run].first));
+            for (size_t i = run; i < runEnd; i++) {
+                createdEntities[creates[i].second] = made[i - run];
+            }
+            run = runEnd;
+        }
+    }
+    // fake id - FirstFakeID -> real entity, null until its create command is reached
+    std::vector<Entity> fakeEntities(commandBuffer->fakeEntityIDCounter - FirstFakeID, NullEntity);
+    int createIndex = 0;
+
+    // resolve fake entities in command order, since a fake id is only valid after its create command
+    for (Command* commandPtr : commands) {
+        Command& command = *commandPtr;
+        if (command.type == Command::CommandCreate) {
+            // made fake entity - register it so we can detect it in future commands
+            fakeEntities[(EntityID)command.entity.id - FirstFakeID] = createdEntities[createIndex++];
+            continue;
+        }
+        if (command.entity.id > MaxEntityID) {
+            EntityID fakeIndex = (EntityID)command.entity.id - FirstFakeID;
+            Entity real = fakeIndex < fakeEntities.size() ? fakeEntities[fakeIndex] : NullEntity;
+            if (real.Null()) {
+                LogError("Command on fake entity %u that was never created!", (EntityID)command.entity.id);
+            }
+            command.entity = real;
+        }
+    }
+
+    // Commands are played back sorted by entity, keeping the order of commands on the same entity.
+    // All adds and removes on an entity are merged into its final signature so it moves archetype at most once,
+    // and only the last value given to each component is copied.
+    // Entities are handled in id order, so playback doesn't depend on which thread recorded a command
+    std::vector<std::pair<EntityID, int>> order; // entity id, command index
+    order.reserve(commands.size());
+    for (int i = 0; i < (int)commands.size(); i++) {
+        auto& command = *commands[i];
+        if (command.type != Command::CommandCreate && command.entity.NotNull()) {
+            order.push_back({(EntityID)command.entity.id, i});
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    struct ComponentValue {
+        Entity entity;
+        ComponentID component;
+        const char* value;
     };
-    SmallVector<FakeEntity> fakeEntities;
-    for (auto& command : commandBuffer->commands) {
-        // check if the command is on a 'fake entity' 
-        // one that is used only to represent an entity that will be made
-        // sometime in the future
-        
-        // there can't be a real entity yet for an entity just being created
-        if (command.type != EntityCommandBuffer::Command::CommandCreate 
-            && command.entity.id > NullEntity.id) {
-            // is fake entity
-            for (auto& entity : fakeEntities) {
-                if (command.entity.id == entity.fakeID) {
-                    // substitute for real one
-                    command.entity = entity.real;
-                    goto realFound;
+    std::vector<SignatureChange> changes;
+    std::vector<ComponentValue> values;
+    const char* componentValues[MaxComponentIDs]; // only valid for components in hasValue
+
+    for (size_t groupStart = 0; groupStart < order.size();) {
+        size_t groupEnd = groupStart + 1;
+        while (groupEnd < order.size() && order[groupEnd].first == order[groupStart].first) groupEnd++;
+
+        // commands with an old version of the entity are skipped below, the rest still go to the live entity
+        Entity entity = NullEntity;
+        for (size_t i = groupStart; i < groupEnd; i++) {
+            if (entityExists(commands[order[i].second]->entity)) {
+                entity = commands[order[i].second]->entity;
+                break;
+            }
+        }
+        if (entity.Null()) {
+            LogError("Command on entity that doesn't exist! Entity: %s", commands[order[groupStart].second]->entity.DebugStr());
+            groupStart = groupEnd;
+            continue;
+        }
+        Signature start = getEntitySignature(entity);
+        Signature current = start;
+        Signature hasValue = {0};
+        Signature destructed = {0}; // components that were there at the start and have been destructed
+        bool deleted = false;
+
+        // destruct a component the entity has as of this command, with the value it would have had
+        auto destructCurrent = [&](ComponentID component){
+            if (!componentsWithDestructors[component]) return;
+            if (hasValue[component]) {
+                // the newest value is still in the buffer, destruct it there. It never gets copied to the entity,
+                // so a component only added in this buffer never has to move the entity to an archetype with it
+                destructComponentValue(entity, component, (void*)componentValues[component]);
+                if (start[component]) destructed.set(component);
+            } else if (start[component] && !destructed[component]) {
+                destructComponent(entity, component);
+                destructed.set(component);
+            }
+        };
+
+        for (size_t i = groupStart; i < groupEnd && !deleted; i++) {
+            auto& command = *commands[order[i].second];
+            if (command.entity != entity) {
+                LogError("Command on entity that doesn't exist! Entity: %s", command.entity.DebugStr());
+                continue;
+            }
+            switch (command.type) {
+            case Command::CommandAdd: {
+                ComponentID component = command.add.component;
+                current.set(component);
+                hasValue.set(component);
+                componentValues[component] = command.add.value;
+                break; }
+            case Command::CommandAddSignature:
+                current |= command.addSignature.signature;
+                break;
+            case Command::CommandSet: {
+                ComponentID component = command.set.component;
+                if (!current[component]) {
+                    LogError("Setting component %s that the entity doesn't have!", getComponentName(component));
+                    break;
                 }
+                hasValue.set(component);
+                componentValues[component] = command.set.value;
+                break; }
+            case Command::CommandRemove: {
+                ComponentID component = command.remove.component;
+                if (current[component]) {
+                    destructCurrent(component);
+                }
+                current.set(component, false);
+                hasValue.set(component, false);
+                break; }
+            case Command::CommandDelete:
+                current.forEachSet(destructCurrent);
+                relationsEntityDeleted(entity);
+                components.deleteEntity(entity);
+                deleted = true;
+                break;
+            default:
+                LogError("Invalid command type!");
             }
-            // no real found
-            LogError("no real?");
         }
-    realFound:
-        switch (command.type) {
-        case EntityCommandBuffer::Command::CommandCreate: {
-            Entity realEntity = createEntity(command.create.prototype);
-            // made fake entity - register it so we can detect it in future commands
-            fakeEntities.push_back({(EntityID)command.entity.id, realEntity});
-            break; }
-        case EntityCommandBuffer::Command::CommandAdd: {
-            void* componentPtr = doAddComponent(command.entity, command.add.component);
-            if (componentPtr) {
-                memcpy(componentPtr, command.add.componentValueIndex + commandBuffer->valueBuffer.data, getComponentSize(command.add.component));
+
+        if (!deleted) {
+            Signature added = current & ~start;
+            Signature removed = start & ~current;
+            if (added.any() || removed.any()) {
+                changes.push_back({entity, added, removed});
+            }
+            for (int w = 0; w < Signature::WordCount; w++) {
+                auto bits = hasValue.words[w];
+                while (bits) {
+                    ComponentID component = w * Signature::WordBits + llvm::countTrailingZeros(bits);
+                    values.push_back({entity, component, componentValues[component]});
+                    bits &= bits - 1;
+                }
             }
-            break; }
-        case EntityCommandBuffer::Command::CommandAddSignature:
-            addSignature(command.entity, command.addSignature.signature);
-            break;
-        case EntityCommandBuffer::Command::CommandSet: {
-            void* component = getComponent(command.entity, command.set.component);
-            void* value = &commandBuffer->valueBuffer[command.set.componentValueIndex];
-            memcpy(component, value, getComponentSize(command.set.component));
-            break; }
-        case EntityCommandBuffer::Command::CommandRemove:
-            doRemoveComponent(command.entity, command.remove.component);
-            break;
-        case EntityCommandBuffer::Command::CommandDelete:
-            doDeleteEntity(command.entity);
-            break;
-        default:
-            LogError("Invalid command type!");
+        }
+        groupStart = groupEnd;
+    }
+
+    components.changeSignatures(changes.data(), changes.size());
+    for (auto& value : values) {
+        void* component = getComponent(value.entity, value.component);
+        if (component) {
+            memcpy(component, value.value, getComponentSize(value.component));
         }
     }
 
@@ -78,12 +213,7 @@ void EntityManager::executeCommandBuffer(EntityCommandBuffer* commandBuffer) {
 bool EntityManager::entityHas(Entity entity, Signature needComponents) const {
     if (entity.Null()) return false;
 
-    const Prototype* prototype = getPrototype(entity);
-
-    Signature signature = components.getEntitySignature(entity);
-    if (prototype) {
-        signature |= prototype->signature;
-    }
+    Signature signature = components.getEntityFullSignature(entity);
     return (signature & needComponents) == needComponents;
 }
 
@@ -109,10 +239,10 @@ bool EntityManager::addSignature(Entity entity, Signature signature) {
  void EntityManager::destructComponents(Entity entity, Signature signature) {
     Signature neededDestructors = signature & componentsWithDestructors;
     auto& componentDestructors = this->componentDestructors;
-    neededDestructors.forEachSet([&componentDestructors, entity](ComponentID component){
+    neededDestructors.forEachSet([this, &componentDestructors, entity](ComponentID component){
         auto* destructor = componentDestructors.lookup((Sint8)component);
         assert(destructor && "componentsWithDestructors and componentDestructors set mis match!");
-        destructor->operator()(entity);
+        destructor->operator()(entity, getComponent(entity, component));
     });
 }
 
@@ -120,7 +250,14 @@ void EntityManager::destructComponent(Entity entity, ComponentID component) {
     if (!componentsWithDestructors[component]) return;
     auto* destructor = componentDestructors.lookup((Sint8)component);
     assert(destructor && "componentsWithDestructors and componentDestructors set mis match!");
-    destructor->operator()(entity);
+    destructor->operator()(entity, getComponent(entity, component));
+}
+
+void EntityManager::destructComponentValue(Entity entity, ComponentID component, void* value) {
+    if (!componentsWithDestructors[component]) return;
+    auto* destructor = componentDestructors.lookup((Sint8)component);
+    assert(destructor && "componentsWithDestructors and componentDestructors set mis match!");
+    destructor->operator()(entity, value);
 }
 
 void EntityManager::removeComponent(Entity entity, ComponentID component) {
@@ -0,0 +1,239 @@
+#include "ECS/JobScheduler.hpp"
+#include "utils/Log.hpp"
+#include "utils/Profiler.hpp"
+
+using namespace ECS;
+using namespace ECS::Systems;
+
+int JobScheduler::workerThreadFunc(void* workerPtr) {
+    Worker* worker = (Worker*)workerPtr;
+    JobScheduler* scheduler = worker->scheduler;
+    JobChunk chunk;
+
+    char threadName[32];
+    snprintf(threadName, sizeof(threadName), "Job worker %d", worker->index);
+    Profiler::setThreadName(threadName);
+    while (true) {
+        if (scheduler->popOwn(worker, &chunk) || scheduler->steal(worker->index + 1, &chunk)) {
+            scheduler->runChunk(chunk, &worker->commandBuffer);
+            continue;
+        }
+
+        // out of work. spin for a little in case more is about to be submitted, then park
+        for (int spins = 0; spins < SpinsBeforePark; spins++) {
+            if (scheduler->queuedChunks.load(std::memory_order_relaxed) > 0
+             || scheduler->quit.load(std::memory_order_relaxed)) break;
+            cpuRelax();
+        }
+        if (scheduler->quit.load(std::memory_order_acquire)) break;
+        if (scheduler->queuedChunks.load(std::memory_order_relaxed) > 0) continue;
+
+        std::unique_lock<std::mutex> lock(scheduler->parkMutex);
+        scheduler->workAvailable.wait(lock, [scheduler](){
+            return scheduler->quit.load(std::memory_order_relaxed)
+                || scheduler->queuedChunks.load(std::memory_order_relaxed) > 0;
+        });
+    }
+    return 0;
+}
+
+bool JobScheduler::popOwn(Worker* worker, JobChunk* chunk) {
+    std::lock_guard<Spinlock> lock(worker->queueLock);
+    if (worker->queue.empty()) return false;
+    *chunk = worker->queue.back();
+    worker->queue.pop_back();
+    queuedChunks.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool JobScheduler::stealFrom(Worker* victim, JobChunk* chunk) {
+    // don't wait on a busy queue, just move on to the next one
+    if (!victim->queueLock.try_lock()) return false;
+    bool stole = false;
+    if (!victim->queue.empty()) {
+        *chunk = victim->queue.front();
+        victim->queue.pop_front();
+        queuedChunks.fetch_sub(1, std::memory_order_relaxed);
+        stole = true;
+    }
+    victim->queueLock.unlock();
+    return stole;
+}
+
+bool JobScheduler::steal(int startWorker, JobChunk* chunk) {
+    // keep trying while there is work around, since try_lock can miss chunks in contended queues
+    while (queuedChunks.load(std::memory_order_relaxed) > 0) {
+        for (int i = 0; i < numWorkers; i++) {
+            if (stealFrom(&workers[(startWorker + i) % numWorkers], chunk)) {
+                return true;
+            }
+        }
+        cpuRelax();
+    }
+    return false;
+}
+
+void JobScheduler::finishChunk(const JobChunk& chunk) {
+    bool counterFinished = chunk.counter && chunk.counter->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    if (counterFinished) {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        finishedCounters.push_back(chunk.counter);
+    }
+    // must be last, the waiter may return and reuse anything once this hits zero
+    if (unfinishedChunks.fetch_sub(1, std::memory_order_acq_rel) == 1 || counterFinished) {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        mainWake.notify_all();
+    }
+}
+
+void JobScheduler::runChunk(const JobChunk& chunk, EntityCommandBuffer* commandBuffer) {
+    JobCounter* counter = chunk.counter;
+    if (counter || Profiler::isEnabled()) {
+        Uint64 start = SDL_GetTicksNS();
+        executeJobChunk(chunk, commandBuffer, entityManager);
+        Uint64 end = SDL_GetTicksNS();
+        if (counter) {
+            counter->workNanoseconds.fetch_add(end - start, std::memory_order_relaxed);
+            uint64_t lastEnd = counter->lastChunkEnd.load(std::memory_order_relaxed);
+            while (lastEnd < end && !counter->lastChunkEnd.compare_exchange_weak(lastEnd, end, std::memory_order_relaxed)) {}
+        }
+        Profiler::record(chunk.job->name, Profiler::Category::Chunk, start, end, chunk.indexEnd - chunk.indexBegin);
+    } else {
+        executeJobChunk(chunk, commandBuffer, entityManager);
+    }
+    finishChunk(chunk);
+}
+
+int JobScheduler::start(ThreadManager& threadManager, int workerCount) {
+    assert(numWorkers == 0 && "Job scheduler already started!");
+    workerCount = MIN(workerCount, threadManager.unusedThreads());
+    if (workerCount <= 0) return 0;
+
+    quit.store(false);
+    queuedChunks.store(0);
+    unfinishedChunks.store(0);
+    nextSubmitWorker = 0;
+
+    // set worker count before any threads are opened so every worker sees the same value
+    workers = new Worker[workerCount];
+    numWorkers = workerCount;
+    for (int i = 0; i < workerCount; i++) {
+        workers[i].scheduler = this;
+        workers[i].index = i;
+    }
+    for (int i = 0; i < workerCount; i++) {
+        workers[i].thread = threadManager.openThread(workerThreadFunc, &workers[i]);
+        // we checked unused threads above, so this shouldn't happen
+        assert(workers[i].thread != Threads::ThreadManager::NullThread);
+    }
+
+    LogInfo("Started job scheduler with %d workers", workerCount);
+    return workerCount;
+}
+
+void JobScheduler::stop(ThreadManager& threadManager) {
+    if (numWorkers == 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        quit.store(true, std::memory_order_release);
+    }
+    workAvailable.notify_all();
+
+    for (int i = 0; i < numWorkers; i++) {
+        threadManager.waitThread(workers[i].thread);
+        workers[i].commandBuffer.destroy();
+    }
+    delete[] workers;
+    workers = nullptr;
+    numWorkers = 0;
+}
+
+void JobScheduler::submit(ArrayRef<JobChunk> chunks, const EntityManager* entityManager) {
+    int count = (int)chunks.size();
+    if (count == 0) return;
+    assert(numWorkers > 0 && "Job scheduler isn't started!");
+
+    this->entityManager = entityManager;
+    // count before pushing so no one can take a chunk before it has been counted
+    unfinishedChunks.fetch_add(count, std::memory_order_relaxed);
+    queuedChunks.fetch_add(count, std::memory_order_relaxed);
+
+    // give each worker a contiguous run of chunks, so neighbouring chunks of a pool tend to stay on one core
+    int perWorker = count / numWorkers;
+    int leftover = count % numWorkers;
+    int chunkIndex = 0;
+    for (int i = 0; i < numWorkers && chunkIndex < count; i++) {
+        Worker* worker = &workers[nextSubmitWorker];
+        nextSubmitWorker = (nextSubmitWorker + 1) % numWorkers;
+        int runSize = perWorker + (i < leftover ? 1 : 0);
+        if (runSize == 0) continue;
+
+        std::lock_guard<Spinlock> lock(worker->queueLock);
+        worker->queue.insert(worker->queue.end(), chunks.begin() + chunkIndex, chunks.begin() + chunkIndex + runSize);
+        chunkIndex += runSize;
+    }
+
+    // take the lock so a worker can't miss the wake up between checking for work and parking
+    { std::lock_guard<std::mutex> lock(parkMutex); }
+    workAvailable.notify_all();
+}
+
+void JobScheduler::wait(EntityCommandBuffer* commandBuffer) {
+    JobChunk chunk;
+    while (unfinishedChunks.load(std::memory_order_acquire) > 0) {
+        // help out instead of sitting idle
+        if (steal(0, &chunk)) {
+            runChunk(chunk, commandBuffer);
+            continue;
+        }
+
+        PROFILE_SCOPE("Wait for jobs", Wait);
+        std::unique_lock<std::mutex> lock(parkMutex);
+        mainWake.wait(lock, [this](){
+            return unfinishedChunks.load(std::memory_order_acquire) == 0
+                || queuedChunks.load(std::memory_order_relaxed) > 0;
+        });
+    }
+}
+
+void JobScheduler::waitForCounters(EntityCommandBuffer* commandBuffer, std::vector<JobCounter*>* finished) {
+    JobChunk chunk;
+    while (true) {
+        // load before checking the finished list, counters are pushed before unfinishedChunks is decremented
+        bool nothingRunning = unfinishedChunks.load(std::memory_order_acquire) == 0;
+        {
+            std::lock_guard<std::mutex> lock(parkMutex);
+            if (!finishedCounters.empty()) {
+                finished->insert(finished->end(), finishedCounters.begin(), finishedCounters.end());
+                finishedCounters.clear();
+                return;
+            }
+        }
+        if (nothingRunning) {
+            // nothing else can finish
+            return;
+        }
+
+        if (steal(0, &chunk)) {
+            runChunk(chunk, commandBuffer);
+            continue;
+        }
+
+        PROFILE_SCOPE("Wait for jobs", Wait);
+        std::unique_lock<std::mutex> lock(parkMutex);
+        mainWake.wait(lock, [this](){
+            return !finishedCounters.empty()
+                || unfinishedChunks.load(std::memory_order_acquire) == 0
+                || queuedChunks.load(std::memory_order_relaxed) > 0;
+        });
+    }
+}
+
+void JobScheduler::flushCommands(EntityCommandBuffer* commandBuffer) {
+    for (int i = 0; i < numWorkers; i++) {
+        if (!workers[i].commandBuffer.empty()) {
+            commandBuffer->combine(workers[i].commandBuffer);
+        }
+    }
+}
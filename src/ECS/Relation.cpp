@@ -0,0 +1,98 @@
+#include "ECS/Relation.hpp"
+#include <algorithm>
+
+namespace ECS {
+
+void Relation::countSource(Entity target, int change) {
+    Sint32* count = sourceCounts.lookup(target.id);
+    if (count) {
+        *count += change;
+        if (*count <= 0) sourceCounts.remove(target.id);
+    } else if (change > 0) {
+        sourceCounts.insert(target.id, change);
+    }
+}
+
+void Relation::set(Entity source, Entity target) {
+    assert(source.NotNull() && target.NotNull());
+    Pair pair = {target, source};
+    Pair* existing = pairsBySource.lookup(source.id);
+    if (existing) {
+        if (existing->source == source && existing->target == target) return;
+        // the old pair is left in the list, and dropped on the next sort
+        countSource(existing->target, -1);
+        *existing = pair;
+        sorted = false;
+    } else {
+        pairsBySource.insert(source.id, pair);
+    }
+    countSource(target, 1);
+    if (!pairs.empty() && (pairs.back().target.id > target.id
+        || (pairs.back().target.id == target.id && pairs.back().source.id > source.id))) {
+        sorted = false;
+    }
+    pairs.push_back(pair);
+}
+
+void Relation::remove(Entity source) {
+    Pair* existing = pairsBySource.lookup(source.id);
+    if (!existing || existing->source != source) return;
+    countSource(existing->target, -1);
+    pairsBySource.remove(source.id);
+    sorted = false;
+}
+
+ArrayRef<Relation::Pair> Relation::getSources(Entity target) {
+    if (!isTarget(target)) return {};
+    sort();
+    auto byTarget = [](const Pair& lhs, const Pair& rhs){
+        return lhs.target.id < rhs.target.id;
+    };
+    Pair key = {target, NullEntity};
+    auto range = std::equal_range(pairs.begin(), pairs.end(), key, byTarget);
+    return ArrayRef<Pair>(pairs.data() + (range.first - pairs.begin()), range.second - range.first);
+}
+
+void Relation::entityDeleted(Entity entity) {
+    remove(entity);
+    if (isTarget(entity)) {
+        for (const Pair& pair : getSources(entity)) {
+            pairsBySource.remove(pair.source.id);
+        }
+        sourceCounts.remove(entity.id);
+        sorted = false;
+    }
+}
+
+void Relation::sort() {
+    if (sorted) return;
+    auto stale = [this](const Pair& pair){
+        const Pair* current = pairsBySource.lookup(pair.source.id);
+        return !current || current->source != pair.source || current->target != pair.target;
+    };
+    pairs.erase(std::remove_if(pairs.begin(), pairs.end(), stale), pairs.end());
+    std::sort(pairs.begin(), pairs.end(), [](const Pair& lhs, const Pair& rhs){
+        if (lhs.target.id != rhs.target.id) return lhs.target.id < rhs.target.id;
+        return lhs.source.id < rhs.source.id;
+    });
+    // a pair that was removed and set again is in the list twice
+    pairs.erase(std::unique(pairs.begin(), pairs.end(), [](const Pair& lhs, const Pair& rhs){
+        return lhs.source == rhs.source && lhs.target == rhs.target;
+    }), pairs.end());
+    sorted = true;
+}
+
+void Relation::clear() {
+    pairs.clear();
+    pairsBySource.clear();
+    sourceCounts.clear();
+    sorted = true;
+}
+
+void Relation::destroy() {
+    pairs = std::vector<Pair>();
+    pairsBySource.destroy();
+    sourceCounts.destroy();
+}
+
+}
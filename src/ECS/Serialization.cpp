@@ -0,0 +1,434 @@
+#include "ECS/Serialization.hpp"
+#include "utils/Log.hpp"
+#include <string.h>
+
+namespace ECS {
+
+// columns are aligned in the file so they can be copied straight out of a mapped file
+static constexpr size_t ColumnAlignment = 16;
+
+// calls func(row, count) for each run of rows in [first, first + count) that are in the same block,
+// so columns can be copied with one memcpy per block
+template<typename Func>
+static void forEachBlockRun(const ArchetypePool& pool, int first, int count, Func func) {
+    int end = first + count;
+    int row = first;
+    while (row < end) {
+        int runLength = MIN(end - row, pool.blockCapacity() - pool.rowOf(row));
+        func(row, runLength);
+        row += runLength;
+    }
+}
+
+template<typename Func>
+static void forEachComponent(Signature signature, Func func) {
+    for (size_t w = 0; w < Signature::WordCount; w++) {
+        auto bits = signature.words[w];
+        while (bits) {
+            func((ComponentID)(w * Signature::WordBits + llvm::countTrailingZeros(bits)));
+            bits &= bits - 1;
+        }
+    }
+}
+
+static const ComponentSerializer* getSerializer(const ComponentSerializers* serializers, ComponentID component) {
+    if (!serializers || component >= (ComponentID)serializers->size()) return nullptr;
+    return &(*serializers)[component];
+}
+
+/*
+* Format, shared by full saves and change saves:
+* component table, whether the entity table follows, the entity table, then pool records.
+* Loading a pool record replaces everything in the pool with the same signature and prototype.
+*/
+
+static void writeComponentTable(const EntityManager& entityManager, SaveWriter& writer) {
+    const auto& components = entityManager.components;
+    Sint32 componentCount = entityManager.nComponents;
+    writer.write(componentCount);
+    for (ComponentID c = 0; c < componentCount; c++) {
+        const char* name = entityManager.componentInfo[c].name;
+        Uint16 nameLength = strlen(name);
+        writer.write(components.componentSizes[c]);
+        writer.write(nameLength);
+        writer.write(name, nameLength);
+    }
+    writer.align(8);
+}
+
+static void writeEntityTable(const ArchetypalComponentManager& components, SaveWriter& writer) {
+    Sint32 entityCount = components.entityCount;
+    Sint32 unusedCount = components.unusedEntities.size;
+    writer.write(entityCount);
+    writer.write((Uint32)components.highestUsedEntity);
+    writer.write(unusedCount);
+    writer.write(components.unusedEntities.data, unusedCount * sizeof(Entity));
+    writer.write(components.entityData.id, entityCount * sizeof(EntityID));
+    writer.write(components.entityData.version, entityCount * sizeof(EntityVersion));
+    writer.write(components.entityData.prototype, entityCount * sizeof(Sint32));
+}
+
+static void writePool(const ArchetypePool& pool, const ArchetypalComponentManager& components, SaveWriter& writer, const ComponentSerializers* serializers) {
+    writer.write(pool.signature());
+    writer.write((Sint32)pool.prototype);
+    writer.write((Sint32)pool.size);
+
+    writer.align(ColumnAlignment);
+    forEachBlockRun(pool, 0, pool.size, [&](int row, int count){
+        writer.write(pool.getBlockEntities(pool.blockOf(row)) + pool.rowOf(row), count * sizeof(Entity));
+    });
+
+    forEachComponent(pool.signature(), [&](ComponentID component){
+        Sint32 size = components.componentSizes[component];
+        if (size == 0) return;
+        writer.align(ColumnAlignment);
+        forEachBlockRun(pool, 0, pool.size, [&](int row, int count){
+            writer.write(pool.getComponent(component, row, size), count * size);
+        });
+
+        // whatever the components point to
+        const ComponentSerializer* serializer = getSerializer(serializers, component);
+        if (serializer && serializer->save) {
+            size_t block = writer.beginBlock();
+            for (int row = 0; row < pool.size; row++) {
+                serializer->save(pool.getComponent(component, row, size), writer);
+            }
+            writer.endBlock(block);
+        } else {
+            writer.write(Uint64(0));
+        }
+    });
+}
+
+static void recordVersions(const ArchetypalComponentManager& components, SavedVersions* versions) {
+    versions->valid = true;
+    versions->entityChangeCount = components.entityChangeCount;
+    versions->poolChangeCounts.resize(components.pools.size());
+    for (int i = 0; i < (int)components.pools.size(); i++) {
+        versions->poolChangeCounts[i] = components.pools[i].changeCount;
+    }
+}
+
+void saveEntities(const EntityManager& entityManager, SaveWriter& writer, const ComponentSerializers* serializers, SavedVersions* versions) {
+    const auto& components = entityManager.components;
+    writeComponentTable(entityManager, writer);
+    writer.write(Uint32(1));
+    writeEntityTable(components, writer);
+
+    Sint32 poolCount = 0;
+    for (const auto& pool : components.pools) {
+        if (pool.size > 0) poolCount++;
+    }
+    writer.write(poolCount);
+    for (const auto& pool : components.pools) {
+        if (pool.size == 0) continue;
+        writePool(pool, components, writer, serializers);
+    }
+
+    if (versions) recordVersions(components, versions);
+}
+
+void saveEntityChanges(const EntityManager& entityManager, SaveWriter& writer, const ComponentSerializers* serializers, SavedVersions* versions) {
+    assert(versions->valid && "Need a full save before saving changes!");
+    const auto& components = entityManager.components;
+    writeComponentTable(entityManager, writer);
+
+    bool entitiesChanged = components.entityChangeCount != versions->entityChangeCount;
+    writer.write(Uint32(entitiesChanged));
+    if (entitiesChanged) {
+        writeEntityTable(components, writer);
+    }
+
+    auto poolChanged = [&](ArchetypeID id) -> bool {
+        const auto& pool = components.pools[id];
+        if (pool.null()) return false;
+        // pools made since the last save always count as changed
+        if (id >= (ArchetypeID)versions->poolChangeCounts.size()) return true;
+        return pool.changeCount != versions->poolChangeCounts[id];
+    };
+    Sint32 poolCount = 0;
+    for (ArchetypeID id = 0; id < (ArchetypeID)components.pools.size(); id++) {
+        if (poolChanged(id)) poolCount++;
+    }
+    // emptied pools still have to be written, so they're emptied when loading too
+    writer.write(poolCount);
+    for (ArchetypeID id = 0; id < (ArchetypeID)components.pools.size(); id++) {
+        if (poolChanged(id)) writePool(components.pools[id], components, writer, serializers);
+    }
+
+    recordVersions(components, versions);
+}
+
+namespace {
+
+struct ComponentTable {
+    Sint32 savedCount;
+    // saved component id -> current component id, or NullComponentID if it was dropped
+    ComponentID map[MaxComponentIDs];
+    Sint32 savedSizes[MaxComponentIDs];
+};
+
+}
+
+static bool readComponentTable(const EntityManager& entityManager, SaveReader& reader, ComponentTable* table) {
+    const auto& components = entityManager.components;
+    if (!reader.read(&table->savedCount) || table->savedCount < 0 || table->savedCount > MaxComponentIDs) {
+        LogError("Bad component count in save!");
+        return false;
+    }
+    for (int i = 0; i < table->savedCount; i++) {
+        Uint16 nameLength;
+        if (!reader.read(&table->savedSizes[i]) || !reader.read(&nameLength)) return false;
+        const char* name = reader.read(nameLength);
+        if (!name) return false;
+
+        table->map[i] = NullComponentID;
+        bool found = false;
+        for (ComponentID c = 0; c < entityManager.nComponents; c++) {
+            const char* currentName = entityManager.getComponentName(c);
+            if (strlen(currentName) != nameLength || memcmp(currentName, name, nameLength) != 0) continue;
+            found = true;
+            if (components.componentSizes[c] == table->savedSizes[i]) {
+                table->map[i] = c;
+            } else {
+                LogWarn("Component %s changed size from %d to %d since the save was made, dropping it", currentName, table->savedSizes[i], components.componentSizes[c]);
+            }
+            break;
+        }
+        if (!found) {
+            LogWarn("Saved component %.*s doesn't exist anymore, dropping it", (int)nameLength, name);
+        }
+    }
+    reader.align(8);
+    return true;
+}
+
+static bool readEntityTable(const EntityManager& entityManager, ArchetypalComponentManager& components, SaveReader& reader) {
+    Sint32 entityCount;
+    Uint32 highestUsedEntity;
+    Sint32 unusedCount;
+    if (!reader.read(&entityCount) || !reader.read(&highestUsedEntity) || !reader.read(&unusedCount)) return false;
+    if (entityCount < 1 || (EntityID)entityCount > MaxEntityID || unusedCount < 0 || highestUsedEntity > MaxEntityID) {
+        LogError("Bad entity counts in save!");
+        return false;
+    }
+    const char* unused = reader.read(unusedCount * sizeof(Entity));
+    const char* idData = reader.read(entityCount * sizeof(EntityID));
+    const char* versions = reader.read(entityCount * sizeof(EntityVersion));
+    const char* prototypes = reader.read(entityCount * sizeof(Sint32));
+    if (reader.failed) return false;
+
+    std::vector<EntityID> ids(entityCount);
+    memcpy(ids.data(), idData, entityCount * sizeof(EntityID));
+    for (int i = 1; i < entityCount; i++) {
+        if (ids[i] > MaxEntityID) {
+            LogError("Bad entity id in save!");
+            return false;
+        }
+    }
+
+    // entities in pools that aren't in the save keep their place, and entity indices may have moved around
+    std::vector<ArchetypalComponentManager::EntityLoc> locations(entityCount, ArchetypalComponentManager::NullEntityLoc);
+    for (int i = 1; i < entityCount; i++) {
+        EntityIndex oldIndex = components.entityIndices.get(ids[i]);
+        if (!(oldIndex == ArchetypalComponentManager::NullEntityIndex)) {
+            locations[i] = components.entityData.location[(Uint32)oldIndex];
+        }
+    }
+    for (int i = 1; i < components.entityCount; i++) {
+        components.entityIndices.set(components.entityData.id[i], ArchetypalComponentManager::NullEntityIndex);
+    }
+
+    if (!components.reserveEntities(MAX(entityCount - components.entityCount, 0))) return false;
+    memcpy(components.entityData.id, ids.data(), entityCount * sizeof(EntityID));
+    memcpy(components.entityData.version, versions, entityCount * sizeof(EntityVersion));
+    memcpy(components.entityData.prototype, prototypes, entityCount * sizeof(Sint32));
+    for (int i = 1; i < entityCount; i++) {
+        components.entityIndices.set(ids[i], EntityIndex(i));
+        if (locations[i].archetype == ArchetypalComponentManager::NullEntityLoc.archetype) {
+            // entities without components still go in their prototype's empty archetype. Ones with components get moved by their pool record
+            Sint32 prototype = components.entityData.prototype[i];
+            locations[i].archetype = components.getPrototypeArchetype(prototype, entityManager.getPrototypeSignature(prototype));
+        }
+        components.entityData.location[i] = locations[i];
+    }
+    components.entityCount = entityCount;
+    components.highestUsedEntity = highestUsedEntity;
+    components.unusedEntities.size = 0;
+    for (int i = 0; i < unusedCount; i++) {
+        Entity entity;
+        memcpy(&entity, unused + i * sizeof(Entity), sizeof(Entity));
+        components.unusedEntities.push(entity);
+    }
+    components.entityChangeCount++;
+    return true;
+}
+
+// replace the contents of the pool with the saved signature with the saved rows.
+// replacedPools tracks pools already filled by this load, which are added to instead,
+// since saved pools can end up with the same signature when components are dropped
+static bool readPool(EntityManager& entityManager, SaveReader& reader, const ComponentTable& table, const ComponentSerializers* serializers, std::vector<bool>* replacedPools) {
+    auto& components = entityManager.components;
+    Signature savedSignature;
+    Sint32 prototype;
+    Sint32 size;
+    if (!reader.read(&savedSignature) || !reader.read(&prototype) || !reader.read(&size) || size < 0) return false;
+    reader.align(ColumnAlignment);
+    const char* entityColumn = reader.read(size * sizeof(Entity));
+    if (!entityColumn) return false;
+    std::vector<Entity> entities(size);
+    memcpy(entities.data(), entityColumn, size * sizeof(Entity));
+    for (int i = 0; i < size; i++) {
+        if (entities[i].id > MaxEntityID) {
+            LogError("Bad entity id in saved pool!");
+            return false;
+        }
+    }
+
+    Signature signature = {0};
+    bool badSignature = false;
+    forEachComponent(savedSignature, [&](ComponentID saved){
+        if (saved >= table.savedCount) badSignature = true;
+        else if (table.map[saved] != NullComponentID) signature.set(table.map[saved]);
+    });
+    if (badSignature) {
+        LogError("Bad archetype signature in save!");
+        return false;
+    }
+
+    ArchetypeID archetype;
+    ArchetypePool* pool = components.getOrMakePool(signature, prototype, entityManager.getPrototypeSignature(prototype), &archetype);
+    if (archetype >= (ArchetypeID)replacedPools->size()) replacedPools->resize(archetype + 1, false);
+    if (!(*replacedPools)[archetype]) {
+        pool->clear();
+        (*replacedPools)[archetype] = true;
+    }
+    int start = 0;
+    if (!pool->null()) {
+        start = components.addToPool(pool, ArrayRef<Entity>(entities.data(), entities.size()));
+    }
+    for (int i = 0; i < size; i++) {
+        EntityIndex index = components.getEntityIndex(entities[i].id);
+        if (index == ArchetypalComponentManager::NullEntityIndex) {
+            LogError("Saved pool has an entity that doesn't exist!");
+            return false;
+        }
+        components.setEntityLocation(index, ArchetypalComponentManager::EntityLoc{archetype, pool->null() ? 0 : start + i});
+    }
+
+    bool failed = false;
+    forEachComponent(savedSignature, [&](ComponentID saved){
+        if (failed || table.savedSizes[saved] == 0) return;
+        Sint32 componentSize = table.savedSizes[saved];
+        reader.align(ColumnAlignment);
+        const char* column = reader.read((size_t)size * componentSize);
+        Uint64 extraBytes;
+        if (!column || !reader.read(&extraBytes)) {
+            failed = true;
+            return;
+        }
+
+        ComponentID component = table.map[saved];
+        if (component == NullComponentID) {
+            reader.read(extraBytes);
+            return;
+        }
+        forEachBlockRun(*pool, start, size, [&](int row, int count){
+            memcpy(pool->getComponent(component, row, componentSize), column + (size_t)(row - start) * componentSize, (size_t)count * componentSize);
+        });
+
+        const ComponentSerializer* serializer = getSerializer(serializers, component);
+        size_t extraEnd = reader.position + extraBytes;
+        if (serializer && serializer->load) {
+            for (int row = start; row < start + size; row++) {
+                if (!serializer->load(pool->getComponent(component, row, componentSize), reader)) {
+                    LogError("Failed to load component %s", entityManager.getComponentName(component));
+                    failed = true;
+                    return;
+                }
+            }
+        } else if (extraBytes != 0) {
+            LogError("Component %s was saved with a serializer but has none to load with", entityManager.getComponentName(component));
+            failed = true;
+            return;
+        }
+        if (reader.failed || reader.position != extraEnd) {
+            LogError("Component %s loaded a different amount of data than was saved", entityManager.getComponentName(component));
+            failed = true;
+        }
+    });
+    return !failed && !reader.failed;
+}
+
+static int readEntities(EntityManager& entityManager, SaveReader& reader, const ComponentSerializers* serializers) {
+    auto& components = entityManager.components;
+
+    ComponentTable table;
+    if (!readComponentTable(entityManager, reader, &table)) return -1;
+
+    Uint32 hasEntityTable;
+    if (!reader.read(&hasEntityTable)) return -1;
+    if (hasEntityTable && !readEntityTable(entityManager, components, reader)) return -1;
+
+    Sint32 poolCount;
+    if (!reader.read(&poolCount) || poolCount < 0) return -1;
+    std::vector<bool> replacedPools;
+    for (int p = 0; p < poolCount; p++) {
+        if (!readPool(entityManager, reader, table, serializers, &replacedPools)) return -1;
+    }
+    return 0;
+}
+
+// relations are loaded after the entities, and can't keep pairs of entities that are gone
+static void clearEntities(EntityManager& entityManager) {
+    entityManager.components.clearEntities();
+    for (Relation* relation : entityManager.relations) {
+        relation->clear();
+    }
+}
+
+int loadEntities(EntityManager& entityManager, SaveReader& reader, const ComponentSerializers* serializers) {
+    clearEntities(entityManager);
+    int result = readEntities(entityManager, reader, serializers);
+    if (result != 0) {
+        // don't leave half an entity manager around
+        clearEntities(entityManager);
+    }
+    return result;
+}
+
+int loadEntityChanges(EntityManager& entityManager, SaveReader& reader, const ComponentSerializers* serializers) {
+    int result = readEntities(entityManager, reader, serializers);
+    if (result != 0) {
+        clearEntities(entityManager);
+    }
+    return result;
+}
+
+void saveRelation(const Relation& relation, SaveWriter& writer) {
+    writer.write((Sint32)relation.size());
+    relation.forEachPair([&](Entity source, Entity target){
+        writer.write(source);
+        writer.write(target);
+    });
+}
+
+int loadRelation(const EntityManager& entityManager, Relation& relation, SaveReader& reader) {
+    relation.clear();
+    Sint32 count;
+    if (!reader.read(&count) || count < 0) return -1;
+    for (int i = 0; i < count; i++) {
+        Entity source, target;
+        if (!reader.read(&source) || !reader.read(&target)) {
+            relation.clear();
+            return -1;
+        }
+        bool valid = source.NotNull() && target.NotNull() && source.id <= MaxEntityID && target.id <= MaxEntityID;
+        if (valid && entityManager.entityExists(source) && entityManager.entityExists(target)) {
+            relation.set(source, target);
+        }
+    }
+    return 0;
+}
+
+}
@@ -2,27 +2,28 @@
 #include "ADT/SmallVector.hpp"
 #include "llvm/TinyPtrVector.h"
 #include "global.hpp"
-#include "moodycamel/concurrentqueue.h"
-#include "ADT/concurrent/AtomicCountdown.hpp"
 #include "memory/allocators.hpp"
 #include "utils/system/sysinfo.hpp"
 #include "memory/StackAllocate.hpp"
+#include <deque>
+#include "utils/Profiler.hpp"
 
 using namespace ECS;
 using namespace ECS::Systems;
 
 int ECS::Systems::findEligiblePools(Signature required, Signature rejected, const ECS::EntityManager& entityManager, std::vector<const ArchetypePool*>* eligiblePools) {
+    int query = entityManager.components.getQuery({required, rejected});
+    return findEligiblePools(query, entityManager, eligiblePools);
+}
+
+int ECS::Systems::findEligiblePools(int query, const ECS::EntityManager& entityManager, std::vector<const ArchetypePool*>* eligiblePools) {
     int eligibleEntities = 0;
-    for (int p = 0; p < entityManager.components.pools.size(); p++) {
-        auto& pool = entityManager.components.pools[p];
+    for (ArchetypeID archetype : entityManager.components.getQueryArchetypes(query)) {
+        auto& pool = entityManager.components.pools[archetype];
         if (pool.size == 0) continue;
-        auto poolSignature = pool.signature();
-        if (poolSignature.hasAll(required)
-         && poolSignature.hasNone(rejected)) {
-            if (eligiblePools)
-                eligiblePools->push_back(&pool);
-            eligibleEntities += pool.size;
-        }
+        if (eligiblePools)
+            eligiblePools->push_back(&pool);
+        eligibleEntities += pool.size;
     }
     return eligibleEntities;
 }
@@ -73,26 +74,31 @@ int calculateSystemStages(System* source, int stage) {
     return highestStage;
 }
 
-// adds commands to commandBuffer
-void executeJobChunk(const JobChunk& chunk, EntityCommandBuffer* commandBuffer, const EntityManager* entityManager) {
+void ECS::Systems::executeJobChunk(const JobChunk& chunk, EntityCommandBuffer* commandBuffer, const EntityManager* entityManager) {
     alignas(Job) StackAllocate<char, 256> jobBuf{(int)chunk.job->size};
     Job* job = (Job*)jobBuf.data();
     memcpy((void*)job, (void*)chunk.job, chunk.job->size);
     job->commandBuffer = commandBuffer;
+    const ArchetypePool* pool = chunk.pool;
+    int block = pool->blockOf(chunk.poolOffset);
+    DASSERT(pool->blockOf(chunk.poolOffset + (chunk.indexEnd - chunk.indexBegin) - 1) == block && "Job chunk crosses a storage block!");
+    // group index of the first entity in the block
+    int blockBase = chunk.indexBegin - pool->rowOf(chunk.poolOffset);
     void* componentArrays[8] = {nullptr};
     for (int i = 0; job->componentIDs[i] != 255; i++) {
         auto componentID = job->componentIDs[i];
-        char* poolComponentArray = chunk.pool->getComponentArray(componentID);
-        assert(poolComponentArray && "Archetype pool does not have this component!");
+        char* blockComponentArray = pool->getBlockComponentArray(block, componentID);
+        assert(blockComponentArray && "Archetype pool does not have this component!");
 
         // need to adjust to make the pointer point 'componentIndex' number of components behind itself,
         // so when indexBegin is added to the base index in the for loop,
-        // the range is actually 0...chunkSize
-        poolComponentArray -= chunk.indexBegin * entityManager->getComponentSize(componentID);
-        componentArrays[i] = poolComponentArray;
+        // the range is actually row...row + chunkSize in the block
+        blockComponentArray -= blockBase * entityManager->getComponentSize(componentID);
+        componentArrays[i] = blockComponentArray;
     }
     job->componentArrays = componentArrays;
-    job->entities = chunk.pool->entities - chunk.indexBegin;
+    job->entities = pool->getBlockEntities(block) - blockBase;
+    job->prototype = chunk.prototype;
 
     chunk.job->executeFunc(job, chunk.groupVars, chunk.indexBegin, chunk.indexEnd);
     for (int i = 0; i < chunk.job->nConditionalExecutions; i++) {
@@ -103,55 +109,104 @@ void executeJobChunk(const JobChunk& chunk, EntityCommandBuffer* commandBuffer,
     }
 }
 
-template<typename T>
-using SharedQueue = moodycamel::ConcurrentQueue<T>;
-
-using TaskQueue = SharedQueue<JobChunk>;
-
-struct ThreadData {
-    struct PerThread {
-        int threadNumber;
-        EntityCommandBuffer commandBuffer;
-    };
-    PerThread personal;
-    const EntityManager* entityManager;
-    struct SharedData {
-        TaskQueue* taskQueue;
-        std::atomic<bool> quit;
-        AtomicCountdown tasksToComplete;
-    };
-    SharedData* shared;
-};
+// components that either job writes while the other one uses them
+static Signature conflictingComponents(Signature readA, Signature writeA, Signature readB, Signature writeB) {
+    return (writeA & (readB | writeB)) | (writeB & (readA | writeA));
+}
 
-struct Thread {
-    ThreadData* threadData;
-    Threads::ThreadID id;
-};
+static Signature conflictingComponents(const Job* a, const Job* b) {
+    return conflictingComponents(a->readComponents, a->writeComponents, b->readComponents, b->writeComponents);
+}
 
-int executeJobTask(EntityCommandBuffer* commandBuffer, const JobChunk& task, const EntityManager* entityManager) {
-    executeJobChunk(task, commandBuffer, entityManager);
+// true if either job writes a group array the other one uses
+static bool groupArraysConflict(const System::ScheduledJob& a, const System::ScheduledJob& b) {
+    for (auto& accessA : a.arrayAccesses) {
+        for (auto& accessB : b.arrayAccesses) {
+            if (accessA.array == accessB.array && (accessA.write || accessB.write)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-    return 0;
+static void formatComponentNames(const EntityManager* entityManager, Signature components, char* buf, int bufSize) {
+    int written = 0;
+    buf[0] = '\0';
+    for (ComponentID component = 0; component < entityManager->nComponents && written < bufSize; component++) {
+        if (components[component]) {
+            written += snprintf(buf + written, bufSize - written, "%s%s", written ? ", " : "", entityManager->getComponentName(component));
+        }
+    }
 }
 
-int jobThreadFunc(void* dataPtr) {
-    ThreadData* threadData = (ThreadData*)dataPtr;
-    auto& queue = threadData->shared->taskQueue;
-    ThreadData::PerThread& personalData = threadData->personal;
-    JobChunk task;
-    auto* entityManager = threadData->entityManager;
-    while (!threadData->shared->quit.load(std::memory_order_relaxed)) {
-        if (queue->try_dequeue(task)) {
-            int taskSuccess = executeJobTask(&personalData.commandBuffer, task, entityManager);
-            int counter = threadData->shared->tasksToComplete.decrement();
-            if (counter == 1) {
-                // we could tell the main thread we are done
+// dependsOn[a][b] is true if job a has to wait for job b, directly or through other jobs
+static void calculateJobReachability(System* system, std::vector<std::vector<bool>>* dependsOn) {
+    int numJobs = system->jobs.size();
+    dependsOn->assign(numJobs, std::vector<bool>(numJobs, false));
+    for (int job = 0; job < numJobs; job++) {
+        auto& reached = (*dependsOn)[job];
+        SmallVector<JobHandle, 8> stack(system->jobDependencies[job].begin(), system->jobDependencies[job].end());
+        while (!stack.empty()) {
+            JobHandle dependency = stack.pop_back_val();
+            if (reached[dependency]) continue;
+            reached[dependency] = true;
+            for (JobHandle next : system->jobDependencies[dependency]) {
+                stack.push_back(next);
             }
         }
     }
-    return 0;
 }
 
+// Find read after write, write after read and write after write hazards between jobs in the
+// same system that aren't already ordered, and order them by when they were scheduled
+void inferJobDependencies(SystemManager& sysManager, System* system, int systemIndex) {
+    int numJobs = system->jobs.size();
+    std::vector<std::vector<bool>> dependsOn;
+    calculateJobReachability(system, &dependsOn);
+
+    char componentNames[256];
+
+    if (sysManager.debugJobDependencies) {
+        for (int job = 0; job < numJobs; job++) {
+            for (JobHandle dependency : system->jobDependencies[job]) {
+                auto& a = system->jobs[job];
+                auto& b = system->jobs[dependency];
+                if (conflictingComponents(a.job, b.job).empty() && !groupArraysConflict(a, b)) {
+                    LogInfo("System %d: job %d depends on job %d, but they share no written components or group arrays. "
+                        "The dependency is only needed if they share other state", systemIndex, job, dependency);
+                }
+            }
+        }
+    }
+
+    for (int later = 1; later < numJobs; later++) {
+        for (int earlier = 0; earlier < later; earlier++) {
+            if (dependsOn[later][earlier] || dependsOn[earlier][later]) continue;
+
+            auto& a = system->jobs[earlier];
+            auto& b = system->jobs[later];
+            Signature components = conflictingComponents(a.job, b.job);
+            bool arrays = groupArraysConflict(a, b);
+            if (components.empty() && !arrays) continue;
+
+            if (sysManager.debugJobDependencies) {
+                formatComponentNames(sysManager.entityManager, components, componentNames, sizeof(componentNames));
+                LogWarn("System %d: jobs %d and %d conflict on %s%s%s without a dependency between them.%s",
+                    systemIndex, earlier, later,
+                    componentNames, (components.any() && arrays) ? " and " : "", arrays ? "group arrays" : "",
+                    sysManager.inferJobDependencies ? " Running them in schedule order" : "");
+            }
+            if (sysManager.inferJobDependencies) {
+                system->AddDependency(later, earlier);
+                calculateJobReachability(system, &dependsOn);
+            }
+        }
+    }
+}
+
+void buildJobGraph(SystemManager& sysManager);
+
 void ECS::Systems::setupSystems(SystemManager& sysManager) {
     for (System* system : sysManager.systems) {
         if (system->systemOrder == System::NullSystemOrder) {
@@ -165,13 +220,17 @@ void ECS::Systems::setupSystems(SystemManager& sysManager) {
     });
 
     
-    for (System* system : sysManager.systems) {
+    for (int s = 0; s < sysManager.systems.size(); s++) {
+        System* system = sysManager.systems[s];
         int numJobs = system->jobs.size();
         if (numJobs > 0) {
+            inferJobDependencies(sysManager, system, s);
             calculateJobStages(system, &system->stageJobs);
         }
     }
 
+    buildJobGraph(sysManager);
+
     sysManager.wasSetup = true;
 }
 
@@ -179,150 +238,428 @@ void ECS::Systems::cleanupSystems(SystemManager& sysManager) {
 
 }
 
+void makeJobChunks(System::ScheduledJob& scheduledJob, Group& group, const std::vector<const ArchetypePool*>& eligiblePools, int chunkSize, Uint32 tick, Uint32 frame, const EntityManager* entityManager, std::vector<JobChunk>* chunks);
+
 void runSystemJobsSinglethreaded(SystemManager& sysManager, const TinyPtrVectorVector<System::ScheduledJob>& jobs, const std::vector<std::vector<const ArchetypePool*>>& groupPools) {
+    std::vector<JobChunk> chunks;
     for (int stage = jobs.size() - 1; stage >= 0; stage--) {
         auto& stageJobList = jobs[stage];
         for (auto& scheduledJob : stageJobList) {
-            Job* job = scheduledJob->job;
-            GroupID group = scheduledJob->group;
-            auto& eligiblePools = groupPools[group];
-            job->commandBuffer = &sysManager.unexecutedCommands;
-            void* componentArrays[8] = {nullptr};
-            job->componentArrays = componentArrays;
-            int index = 0;
-            for (const auto* pool : eligiblePools) {
-                for (int i = 0; job->componentIDs[i] != 255; i++) {
-                    auto componentID = job->componentIDs[i];
-                    char* poolComponentArray = pool->getComponentArray(componentID);
-                    assert(poolComponentArray && "Archetype pool does not have this component!");
-                    componentArrays[i] = poolComponentArray - index;
-                }
-                job->entities = pool->entities - index;
+            // one chunk per storage block
+            chunks.clear();
+            makeJobChunks(*scheduledJob, sysManager.groups[scheduledJob->group], groupPools[scheduledJob->group], 0,
+                sysManager.entityManager->components.takeChangeTick(), sysManager.frame, sysManager.entityManager, &chunks);
+            for (auto& chunk : chunks) {
+                executeJobChunk(chunk, &sysManager.unexecutedCommands, sysManager.entityManager);
+            }
+        }
+    }
+}
 
-                job->executeFunc(job, scheduledJob->args, index, index + pool->size);
-                for (int i = 0; i < job->nConditionalExecutions; i++) {
-                    auto& conditionalExecutions = job->conditionalExecutions[i];
-                    if (pool->signature().hasAll(conditionalExecutions.required)) {
-                        conditionalExecutions.execute(job, scheduledJob->args, index, index + pool->size);
-                    }
+// pick the blocks a group filtering on changed components visits this frame, the ones where a changed component
+// was written since the last frame the group's jobs ran
+static void findChangedBlocks(Group& group, const std::vector<const ArchetypePool*>& eligiblePools, Uint32 tick, Uint32 frame) {
+    Uint32 since = group.changedSinceTick;
+    group.changedSinceTick = tick;
+    group.changedBlocksFrame = frame;
+    group.changedBlocks.clear();
+    group.changedBlocksStart.clear();
+    SmallVector<int, 4> changedArrays;
+    for (const ArchetypePool* pool : eligiblePools) {
+        group.changedBlocksStart.push_back(group.changedBlocks.size());
+        changedArrays.clear();
+        group.group.changed.forEachSet([&](ComponentID component){
+            changedArrays.push_back(pool->getArrayNumber(component));
+        });
+        int blockCount = pool->usedBlockCount();
+        for (int b = 0; b < blockCount; b++) {
+            for (int arrayNum : changedArrays) {
+                if (pool->getColumnTick(b, arrayNum) > since) {
+                    group.changedBlocks.push_back(b);
+                    break;
                 }
             }
         }
     }
+    group.changedBlocksStart.push_back(group.changedBlocks.size());
 }
 
-void runSystemJobsParallel(SystemManager& sysManager, 
-    const TinyPtrVectorVector<System::ScheduledJob>& jobs, 
-    const std::vector<std::vector<const ArchetypePool*>>& groupPools,
-    ArrayRef<Thread> threads, TaskQueue& taskQueue, AtomicCountdown& taskCounter)
-{
-    int totalStageEntities = 0;
-    for (int stage = jobs.size() - 1; stage >= 0; stage--) {
-        auto& stageJobList = jobs[stage];
+// split a job into chunks of at most chunkSize entities, never crossing storage blocks.
+// chunkSize 0 makes one chunk per block. Blocks ruled out by the group's changed filter are skipped.
+// Every chunk gets the prototype of its pool, for jobs reading prototype components
+// Jobs hold raw pointers to the columns, so the columns the job writes are marked as written at tick up front
+void makeJobChunks(System::ScheduledJob& scheduledJob, Group& group, const std::vector<const ArchetypePool*>& eligiblePools, int chunkSize, Uint32 tick, Uint32 frame, const EntityManager* entityManager, std::vector<JobChunk>* chunks) {
+    Job* job = scheduledJob.job;
+    bool filtered = group.group.changed.any();
+    if (filtered && group.changedBlocksFrame != frame) {
+        findChangedBlocks(group, eligiblePools, tick, frame);
+    }
+    int groupEntityOffset = 0;
+    SmallVector<int, 8> writtenArrays;
+    for (int p = 0; p < eligiblePools.size(); p++) {
+        ArchetypePool* pool = const_cast<ArchetypePool*>(eligiblePools[p]);
+        // archetypes are split by prototype, so one lookup covers every chunk of the pool
+        const Prototype* prototype = entityManager->getPrototype(pool->prototype);
+        writtenArrays.clear();
+        job->writeComponents.forEachSet([&](ComponentID component){
+            // conditional executions can write components the pool doesn't have
+            int arrayNum = pool->getArrayNumber(component);
+            if (arrayNum != -1) writtenArrays.push_back(arrayNum);
+        });
+
+        bool wrote = false;
+        int blockCount = pool->usedBlockCount();
+        int visitCount = filtered ? group.changedBlocksStart[p+1] - group.changedBlocksStart[p] : blockCount;
+        for (int v = 0; v < visitCount; v++) {
+            int b = filtered ? group.changedBlocks[group.changedBlocksStart[p] + v] : v;
+            // entities removed since the blocks were picked can leave a block empty
+            if (b >= blockCount) break;
+            for (int arrayNum : writtenArrays) {
+                pool->setColumnTick(b, arrayNum, tick);
+            }
+            wrote |= !writtenArrays.empty();
+
+            int blockEntities = pool->blockEntityCount(b);
+            int ChunkSize = chunkSize > 0 ? MIN(chunkSize, blockEntities) : blockEntities;
+            int blockStart = b * pool->blockCapacity();
+            for (int row = 0; row < blockEntities; row += ChunkSize) {
+                int count = MIN(ChunkSize, blockEntities - row);
+                JobChunk chunk = {
+                    .job = job,
+                    .pool = pool,
+                    .indexBegin = groupEntityOffset + blockStart + row,
+                    .indexEnd = groupEntityOffset + blockStart + row + count,
+                    .poolOffset = blockStart + row,
+                    .groupVars = scheduledJob.args
+                };
+                chunk.prototype = prototype;
+                chunks->push_back(chunk);
+            }
+        }
+        if (wrote) {
+            pool->changeCount++;
+        }
+        groupEntityOffset += pool->size;
+    }
+}
 
-        // break jobs up into chunks
-        std::vector<JobChunk> jobThreadChunks;
-        std::vector<JobChunk> mainThreadChunks; // chunks to be run on main thread (this one)
-        std::vector<JobChunk> blockingChunks; // chunks that can only be run when no other jobs are running
-        
-        // split jobs into chunks while the stage is the same
-        for (auto scheduledJob : stageJobList) {
-            Job* job = scheduledJob->job;
-            GroupID group = scheduledJob->group;
-            auto& eligiblePools = groupPools[group];
-
-            int groupEntityOffset = 0;
-            for (const ArchetypePool* pool : eligiblePools) {
-                if (pool->size == 0) continue;
-
-                // break up into chunks if pool is large enough.
-                std::vector<JobChunk>* chunks;
-                if (job->mainThread || !job->parallelize) {
-                    chunks = &mainThreadChunks;
-                } else if (job->blocking) {
-                    chunks = &blockingChunks;
-                    assert(!job->parallelize && "Blocking job can't be parallelized!");
-                } else {
-                    chunks = &jobThreadChunks;
-                }
+// chunks cheaper than this spend a noticeable part of their time on scheduling
+static constexpr double MinChunkNanoseconds = 20000.0;
+// give every thread a few chunks, so threads that finish early can steal from the slow ones
+static constexpr int ChunksPerThread = 4;
+// used until the job has been measured
+static constexpr int DefaultChunkSize = 512;
+
+int pickChunkSize(const Job* job, const System::JobStats& stats, int entityCount, int threadCount) {
+    if (job->chunkSize > 0) return job->chunkSize;
+    if (stats.nsPerEntity <= 0.0) return DefaultChunkSize;
+
+    int minChunkSize = (int)ceil(MinChunkNanoseconds / stats.nsPerEntity);
+    int balancedChunkSize = (entityCount + threadCount * ChunksPerThread - 1) / (threadCount * ChunksPerThread);
+    int chunkSize = MAX(minChunkSize, balancedChunkSize);
+    return MAX(chunkSize, 1);
+}
 
-                int ChunkSize = job->parallelize ? 512 : pool->size;
-                
-                int remainderChunkSize = pool->size % ChunkSize;
-                if (remainderChunkSize > 0) {
-                    JobChunk chunk = {
-                        .job = job,
-                        .pool = pool,
-                        .indexBegin = groupEntityOffset,
-                        .indexEnd = groupEntityOffset + remainderChunkSize,
-                        .poolOffset = 0,
-                        .groupVars = scheduledJob->args
-                    };
-                    chunks->push_back(chunk);
-                }
-                int additionalChunkCount = pool->size / ChunkSize;
-                for (int i = 0; i < additionalChunkCount; i++) {
-                    JobChunk chunk = {
-                        .job = job,
-                        .pool = pool,
-                        .indexBegin = groupEntityOffset + remainderChunkSize,
-                        .indexEnd = groupEntityOffset + ChunkSize + remainderChunkSize,
-                        .poolOffset = i * ChunkSize + remainderChunkSize,
-                        .groupVars = scheduledJob->args
-                    };
-                    chunks->push_back(chunk);
-                }
-                groupEntityOffset += pool->size;
+static bool runsOnWorkers(const Job* job) {
+    return job->parallelize && !job->mainThread && !job->blocking;
+}
+
+
+void buildJobGraph(SystemManager& sysManager) {
+    JobGraph& graph = sysManager.jobGraph;
+    graph.clear();
+
+    auto& systems = sysManager.systems;
+    int systemCount = systems.size();
+    std::vector<int> beginNodes(systemCount);
+    std::vector<int> endNodes(systemCount);
+    std::vector<int> firstJobNodes(systemCount);
+    // BeforeExecution and AfterExecution can use anything the system's jobs do
+    std::vector<Signature> systemReads(systemCount, Signature{0});
+    std::vector<Signature> systemWrites(systemCount, Signature{0});
+
+    for (int s = 0; s < systemCount; s++) {
+        System* system = systems[s];
+        for (auto& scheduledJob : system->jobs) {
+            systemReads[s] |= scheduledJob.job->readComponents;
+            systemWrites[s] |= scheduledJob.job->writeComponents;
+        }
+        beginNodes[s] = graph.addNode(JobGraph::Node::SystemBegin, system, s, -1);
+        firstJobNodes[s] = graph.nodes.size();
+        for (int j = 0; j < system->jobs.size(); j++) {
+            graph.addNode(JobGraph::Node::RunJob, system, s, j);
+        }
+        endNodes[s] = graph.addNode(JobGraph::Node::SystemEnd, system, s, -1);
+    }
+
+    for (int s = 0; s < systemCount; s++) {
+        System* system = systems[s];
+        for (int j = 0; j < system->jobs.size(); j++) {
+            int node = firstJobNodes[s] + j;
+            graph.addEdge(beginNodes[s], node);
+            graph.addEdge(node, endNodes[s]);
+            for (JobHandle dependency : system->jobDependencies[j]) {
+                graph.addEdge(firstJobNodes[s] + dependency, node);
             }
         }
 
-        // add tasks to queue
-        taskCounter.increment(jobThreadChunks.size());
-        taskQueue.enqueue_bulk(jobThreadChunks.data(), jobThreadChunks.size());
+        // keep BeforeExecution and AfterExecution calls in system order
+        if (s > 0) {
+            graph.addEdge(beginNodes[s-1], beginNodes[s]);
+            graph.addEdge(endNodes[s-1], endNodes[s]);
+        }
 
-        // do main thread jobs after we have queued up job thread jobs
-        for (int i = 0; i < mainThreadChunks.size(); i++) {
-            auto& chunk = mainThreadChunks[i];
-            // put commands straight into unexecuted command list
-            executeJobChunk(chunk, &sysManager.unexecutedCommands, sysManager.entityManager);
+        // explicitly ordered systems wait for everything in the systems they're ordered after
+        for (System* dependency : system->systemDependencies) {
+            auto it = std::find(systems.begin(), systems.end(), dependency);
+            if (it != systems.end()) {
+                graph.addEdge(endNodes[it - systems.begin()], beginNodes[s]);
+            }
         }
 
-        // wait for tasks to finish
-        taskCounter.wait();
-        for (int i = 0; i < threads.size(); i++) {
-            // add thread command buffer to unexecuted command list
-            sysManager.unexecutedCommands.combine(threads[i].threadData->personal.commandBuffer);
+        // command buffers can only be flushed when nothing else is running
+        if (system->flushCommandBuffers) {
+            for (int t = 0; t < systemCount; t++) {
+                if (t < s) graph.addEdge(endNodes[t], beginNodes[s]);
+                if (t > s) graph.addEdge(endNodes[s], beginNodes[t]);
+            }
         }
 
-        // do blocking jobs after job threads have closed
-        for (int i = 0; i < blockingChunks.size(); i++) {
-            auto& chunk = blockingChunks[i];
-            // put commands straight into unexecuted command list
-            executeJobChunk(chunk, &sysManager.unexecutedCommands, sysManager.entityManager);
+        // jobs in different systems only need to wait on each other if they touch the same components
+        for (int t = 0; t < s; t++) {
+            System* earlierSystem = systems[t];
+            for (int a = 0; a < earlierSystem->jobs.size(); a++) {
+                for (int b = 0; b < system->jobs.size(); b++) {
+                    if (conflictingComponents(earlierSystem->jobs[a].job, system->jobs[b].job).any()) {
+                        graph.addEdge(firstJobNodes[t] + a, firstJobNodes[s] + b);
+                    }
+                }
+            }
+
+            // the same goes for the begin and end nodes, against the jobs of the other system.
+            // Begin and end nodes all run on the main thread, so they can't overlap each other
+            for (int a = 0; a < earlierSystem->jobs.size(); a++) {
+                const Job* job = earlierSystem->jobs[a].job;
+                if (conflictingComponents(job->readComponents, job->writeComponents, systemReads[s], systemWrites[s]).any()) {
+                    graph.addEdge(firstJobNodes[t] + a, beginNodes[s]);
+                }
+            }
+            for (int b = 0; b < system->jobs.size(); b++) {
+                const Job* job = system->jobs[b].job;
+                if (conflictingComponents(systemReads[t], systemWrites[t], job->readComponents, job->writeComponents).any()) {
+                    graph.addEdge(endNodes[t], firstJobNodes[s] + b);
+                }
+            }
+        }
+    }
+
+    // check for loops by doing a topological sort
+    int nodeCount = graph.nodes.size();
+    std::vector<int> pending(nodeCount);
+    std::vector<int> ready;
+    for (int i = 0; i < nodeCount; i++) {
+        pending[i] = graph.nodes[i].dependencyCount;
+        if (pending[i] == 0) ready.push_back(i);
+    }
+    int visited = 0;
+    while (!ready.empty()) {
+        int node = ready.back();
+        ready.pop_back();
+        visited++;
+        for (int successor : graph.nodes[node].successors) {
+            if (--pending[successor] == 0) ready.push_back(successor);
         }
     }
+    if (visited != nodeCount) {
+        LogError("Job dependency loop detected! Systems will run single threaded");
+        return;
+    }
+    graph.valid = true;
 }
 
-void executeSystemParallel(SystemManager& sysManager, System* system, const std::vector<std::vector<const ArchetypePool*>>& groupPools, ArrayRef<Thread> threads, ThreadData::SharedData* threadData) {
-    if (system->flushCommandBuffers) {
-        sysManager.entityManager->executeCommandBuffer(&sysManager.unexecutedCommands);
+struct JobGraphExecution {
+    SystemManager& sysManager;
+    const std::vector<std::vector<const ArchetypePool*>>& groupPools;
+    JobScheduler& scheduler;
+
+    const JobGraph& graph;
+    std::vector<int> pending; // number of unfinished dependencies for each node
+    std::vector<JobCounter> counters;
+    std::deque<int> mainThreadReady; // nodes that have to be run on the main thread, in the order they became ready
+    std::vector<int> completed; // finished nodes whose successors haven't been released yet
+    std::vector<JobChunk> chunks;
+    std::vector<Uint64> systemBeginTimes; // for profiling
+    int nodesLeft;
+
+    JobGraphExecution(SystemManager& sysManager, const std::vector<std::vector<const ArchetypePool*>>& groupPools, JobScheduler& scheduler)
+    : sysManager(sysManager), groupPools(groupPools), scheduler(scheduler), graph(sysManager.jobGraph),
+      pending(graph.nodes.size()), counters(graph.nodes.size()), systemBeginTimes(sysManager.systems.size()) {
+        nodesLeft = graph.nodes.size();
     }
-    // systems still flush command buffers (if value is set) when disabled
-    if (!system->enabled) return;
 
-    system->BeforeExecution();
+    void startNode(int nodeIndex) {
+        const JobGraph::Node& node = graph.nodes[nodeIndex];
+        if (node.type == JobGraph::Node::RunJob) {
+            System::ScheduledJob& scheduledJob = node.system->jobs[node.job];
+            if (!node.system->enabled) {
+                completed.push_back(nodeIndex);
+                return;
+            }
+            if (runsOnWorkers(scheduledJob.job)) {
+                auto& pools = groupPools[scheduledJob.group];
+                System::JobStats& stats = node.system->jobs[node.job].stats;
+                int entityCount = 0;
+                for (const ArchetypePool* pool : pools) {
+                    entityCount += pool->size;
+                }
+                int chunkSize = pickChunkSize(scheduledJob.job, stats, entityCount, scheduler.workerCount() + 1);
+
+                chunks.clear();
+                makeJobChunks(scheduledJob, sysManager.groups[scheduledJob.group], pools, chunkSize,
+                    sysManager.entityManager->components.takeChangeTick(), sysManager.frame, sysManager.entityManager, &chunks);
+                if (chunks.empty()) {
+                    completed.push_back(nodeIndex);
+                    return;
+                }
+                // blocks skipped by a changed filter don't count towards the cost per entity
+                if (sysManager.groups[scheduledJob.group].group.changed.any()) {
+                    entityCount = 0;
+                    for (auto& chunk : chunks) {
+                        entityCount += chunk.indexEnd - chunk.indexBegin;
+                    }
+                }
+                stats.entityCount = entityCount;
+                stats.chunkSize = chunkSize;
+                stats.chunkCount = chunks.size();
+
+                JobCounter* counter = &counters[nodeIndex];
+                counter->node = nodeIndex;
+                counter->submitTime = SDL_GetTicksNS();
+                counter->remaining.store(chunks.size(), std::memory_order_relaxed);
+                for (auto& chunk : chunks) {
+                    chunk.counter = counter;
+                }
+                scheduler.submit(chunks, sysManager.entityManager);
+                return;
+            }
+        }
+        mainThreadReady.push_back(nodeIndex);
+    }
 
-    int numJobs = system->jobs.size();
-    if (numJobs > 0) {
-        runSystemJobsParallel(sysManager, system->stageJobs, groupPools, threads, *threadData->taskQueue, threadData->tasksToComplete);
+    // update the job's cost estimate after all of its chunks have finished
+    void recordJobStats(const JobCounter& counter) {
+        const JobGraph::Node& node = graph.nodes[counter.node];
+        System::JobStats& stats = node.system->jobs[node.job].stats;
+        uint64_t work = counter.workNanoseconds.load(std::memory_order_relaxed);
+        if (work == 0 || stats.entityCount == 0) return;
+
+        double nsPerEntity = (double)work / stats.entityCount;
+        // smooth it out so one slow frame doesn't throw off the chunk size
+        stats.nsPerEntity = stats.nsPerEntity > 0.0 ? stats.nsPerEntity * 0.8 + nsPerEntity * 0.2 : nsPerEntity;
+
+        int threadsUsed = MIN(scheduler.workerCount() + 1, stats.chunkCount);
+        double wallTime = (double)(counter.lastChunkEnd.load(std::memory_order_relaxed) - counter.submitTime);
+        stats.imbalance = wallTime * threadsUsed / work;
+
+        Profiler::record(node.system->jobs[node.job].job->name, Profiler::Category::Job,
+            counter.submitTime, counter.lastChunkEnd.load(std::memory_order_relaxed), node.systemIndex);
     }
 
-    // all jobs executed
-    system->AfterExecution();
-}
+    void releaseNode(int nodeIndex) {
+        nodesLeft--;
+        for (int successor : graph.nodes[nodeIndex].successors) {
+            if (--pending[successor] == 0) {
+                startNode(successor);
+            }
+        }
+    }
+
+    void runMainThreadNode(int nodeIndex) {
+        const JobGraph::Node& node = graph.nodes[nodeIndex];
+        System* system = node.system;
+        switch (node.type) {
+        case JobGraph::Node::SystemBegin:
+            systemBeginTimes[node.systemIndex] = Profiler::now();
+            if (system->flushCommandBuffers) {
+                PROFILE_SCOPE("Flush commands", CommandFlush);
+                // the graph makes sure nothing else is running at this point
+                scheduler.flushCommands(&sysManager.unexecutedCommands);
+                sysManager.entityManager->executeCommandBuffer(&sysManager.unexecutedCommands);
+            }
+            // systems still flush command buffers (if value is set) when disabled
+            if (system->enabled) system->BeforeExecution();
+            break;
+        case JobGraph::Node::SystemEnd:
+            if (system->enabled) system->AfterExecution();
+            // spans from the system's begin node to its end node, including its worker jobs
+            Profiler::record(system->name, Profiler::Category::System, systemBeginTimes[node.systemIndex], Profiler::now(), node.systemIndex);
+            break;
+        case JobGraph::Node::RunJob: {
+            System::ScheduledJob& scheduledJob = system->jobs[node.job];
+            if (scheduledJob.job->blocking) {
+                // blocking jobs can only be run when no other jobs are running
+                scheduler.wait(&sysManager.unexecutedCommands);
+            }
+            PROFILE_SCOPE(scheduledJob.job->name, Job, node.systemIndex);
+            chunks.clear();
+            makeJobChunks(scheduledJob, sysManager.groups[scheduledJob.group], groupPools[scheduledJob.group], 0,
+                sysManager.entityManager->components.takeChangeTick(), sysManager.frame, sysManager.entityManager, &chunks);
+            for (auto& chunk : chunks) {
+                // put commands straight into unexecuted command list
+                executeJobChunk(chunk, &sysManager.unexecutedCommands, sysManager.entityManager);
+            }
+            break;
+        }
+        }
+    }
+
+    void run() {
+        for (int i = 0; i < graph.nodes.size(); i++) {
+            pending[i] = graph.nodes[i].dependencyCount;
+        }
+        for (int i = 0; i < graph.nodes.size(); i++) {
+            if (pending[i] == 0) startNode(i);
+        }
+
+        std::vector<JobCounter*> finished;
+        while (true) {
+            // release finished nodes first so worker jobs get queued before we get busy on the main thread
+            while (!completed.empty()) {
+                int node = completed.back();
+                completed.pop_back();
+                releaseNode(node);
+            }
+            if (nodesLeft == 0) break;
+
+            if (!mainThreadReady.empty()) {
+                int node = mainThreadReady.front();
+                mainThreadReady.pop_front();
+                runMainThreadNode(node);
+                completed.push_back(node);
+                continue;
+            }
+
+            // wait for worker jobs to finish, helping with them in the meantime
+            finished.clear();
+            scheduler.waitForCounters(&sysManager.unexecutedCommands, &finished);
+            if (finished.empty()) {
+                LogError("Job graph stalled with %d nodes left!", nodesLeft);
+                break;
+            }
+            for (JobCounter* counter : finished) {
+                recordJobStats(*counter);
+                completed.push_back(counter->node);
+            }
+        }
+
+        // add worker command buffers to unexecuted command list
+        scheduler.flushCommands(&sysManager.unexecutedCommands);
+    }
+};
 
 void ECS::Systems::executeSystemSingleThreaded(SystemManager& sysManager, System* system, const std::vector<std::vector<const ArchetypePool*>>& groupPools) {
     if (system->flushCommandBuffers) {
+        PROFILE_SCOPE("Flush commands", CommandFlush);
         sysManager.entityManager->executeCommandBuffer(&sysManager.unexecutedCommands);
     }
     // systems still flush command buffers (if value is set) when disabled
@@ -344,20 +681,22 @@ void ECS::Systems::executeSystems(SystemManager& sysManager) {
         LogOnce(Error, "Did not set up system manager before executing!");
         return;
     }
+    PROFILE_SCOPE("executeSystems", Frame);
+    sysManager.frame++;
 
     int systemCount = sysManager.systems.size();
 
-    std::vector<std::vector<const ArchetypePool*>> groupPools;
+    // pool pointers can't be kept between frames since making an archetype can move every pool,
+    // but the vectors can be
+    auto& groupPools = sysManager.groupPools;
     groupPools.resize(sysManager.groups.size());
 
     for (GroupID id = 0; id < sysManager.groups.size(); id++) {
         Group* group = &sysManager.groups[id];
+        groupPools[id].clear();
         int totalJobEntities;
         if (group->trigger == Group::EntityInGroup) {
-            totalJobEntities = findEligiblePools(
-                group->group.signature, group->group.subtract, 
-                *sysManager.entityManager,
-                &groupPools[id]);
+            totalJobEntities = findEligiblePools(group->query, *sysManager.entityManager, &groupPools[id]);
         } else {
             ArchetypePool* pool = group->watcherPool;
             if (!pool) {
@@ -385,70 +724,22 @@ void ECS::Systems::executeSystems(SystemManager& sysManager) {
             else if (array.capacity > totalJobEntities * 4) {
                 // shrink to a third
                 data = realloc(data, array.capacity / 3 * array.typeSize);
+                array.capacity /= 3;
             }
         }
     }
 
-    // don't bother parallelizing if we can't use atleast two worker threads
-    bool parallelize = sysManager.allowParallelization && Global.threadManager.unusedThreads() >= 2;
-
-    if (parallelize) {
-        SmallVector<Thread, 8> threads;
-
-        auto concurrentQueue = SharedQueue<JobChunk>();
-
-        ThreadData::SharedData* sharedThreadData = new ThreadData::SharedData {
-            .taskQueue = &concurrentQueue,
-            .quit = false,
-            .tasksToComplete = {0}
-        };
-
-        // determine how many threads we should use
-        // TODO: DEBUG: high thread count
-        int idealThreadCount = 4;
-        idealThreadCount = MIN(idealThreadCount, Global.threadManager.unusedThreads());
-        assert(idealThreadCount > 0);
-
-        threads.reserve(idealThreadCount);
-
-        for (int i = 0; i < idealThreadCount; i++) {
-            auto* threadData = new ThreadData{
-                .personal = {
-                    .threadNumber = i,
-                    .commandBuffer = {},
-                },
-                .entityManager = sysManager.entityManager,
-                .shared = sharedThreadData
-            };
-            Threads::ThreadID thread = Global.threadManager.openThread(jobThreadFunc, threadData);
-            
-            if (thread) {
-                threads.push_back({threadData, thread});
-            } else {
-                delete threadData;
-                // no point trying to keep opening threads after it already failed
-                LogError("Failed to open thread!");
-                break;
-            }
-        }
-
-        for (int s = 0; s < systemCount; s++) {
-            System* system = sysManager.systems[s];
-            executeSystemParallel(sysManager, system, groupPools, threads, sharedThreadData);
-        }
-
-        for (int i = 0; i < threads.size(); i++) {
-            sharedThreadData->quit.store(true);
-            Global.threadManager.waitThread(threads[i].id);
-        }
+    // workers are persistent, so one worker plus the main thread helping is already worth it
+    JobScheduler* scheduler = sysManager.jobScheduler;
+    bool parallelize = sysManager.allowParallelization && scheduler && scheduler->started();
 
-        for (auto& thread : threads) {
-            delete thread.threadData;
-        }
-        delete sharedThreadData;
+    if (parallelize && sysManager.jobGraph.valid) {
+        JobGraphExecution execution{sysManager, groupPools, *scheduler};
+        execution.run();
     } else {
         for (int s = 0; s < systemCount; s++) {
             System* system = sysManager.systems[s];
+            PROFILE_SCOPE(system->name, System, s);
             executeSystemSingleThreaded(sysManager, system, groupPools);
         }
     }
@@ -461,5 +752,6 @@ void ECS::Systems::executeSystems(SystemManager& sysManager) {
     }
 
     // flush all commands at end of systems execution
+    PROFILE_SCOPE("Flush commands", CommandFlush);
     sysManager.entityManager->executeCommandBuffer(&sysManager.unexecutedCommands);
 }
@@ -1,5 +1,6 @@
 #include "GUI/update.hpp"
 #include "Game.hpp"
+#include <utility>
 
 namespace GUI {
 
@@ -87,7 +88,7 @@ Element buildHotbar(GuiManager& gui) {
     gui.addComponent(bar, EC::Border({borderColor, Vec2(0), Vec2(borderSize)}));
     gui.addComponent(bar, EC::Update{
         .update = {(GuiAction)[](Game* game, GuiManager& manager, Element hotbarElement){
-            auto* inventory = game->state->player.inventory();
+            auto* inventory = std::as_const(game->state->player).inventory();
             if (!inventory) {
                 manager.hideElement(hotbarElement);
                 return;
@@ -142,7 +143,7 @@ Element buildHotbar(GuiManager& gui) {
 }
 
 void updateHotbar(Game* g, GuiManager& manager, Element hotbarElement) {
-    auto* inventory = g->state->player.inventory();
+    auto* inventory = std::as_const(g->state->player).inventory();
     if (!inventory) {
         manager.hideElement(hotbarElement);
         return;
@@ -152,7 +153,7 @@ void updateHotbar(Game* g, GuiManager& manager, Element hotbarElement) {
 }
 
 void updateHotbarSlot(Game* game, GuiManager& manager, Element slot) {
-    auto* playerInventory = game->state->player.inventory();
+    auto* playerInventory = std::as_const(game->state->player).inventory();
     if (!playerInventory) return;
 
     auto* slotComponent = manager.getComponent<EC::HotbarSlot>(slot);
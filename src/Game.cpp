@@ -9,10 +9,12 @@
 #include "PlayerControls.hpp"
 #include "rendering/rendering.hpp"
 #include "commands.hpp"
+#include "utils/MappedFile.hpp"
 
 #include "world/entities/entities.hpp"
 #include "world/components/components.hpp"
 #include "ECS/ArchetypePool.hpp"
+#include "ECS/Query.hpp"
 #include "rendering/systems/new.hpp"
 
 #include "ADT/SmallVector.hpp"
@@ -64,28 +66,37 @@ void GameEntitySystems::init(GameState* state, RenderContext* renderContext, Cam
  
     ECS::Systems::setupSystems(ecsRenderSystems);
     ECS::Systems::setupSystems(ecsStateSystems);
+
+    // workers stay open for the whole game instead of being opened every frame
+    if (Global.multithreadingEnabled) {
+        jobScheduler.start(Global.threadManager, Global.threadManager.unusedThreads());
+    }
+    ecsRenderSystems.jobScheduler = &jobScheduler;
+    ecsStateSystems.jobScheduler = &jobScheduler;
+}
+
+void GameEntitySystems::destroy() {
+    jobScheduler.stop(Global.threadManager);
 }
 
 void updateDynamicEntityChunkPositions(EntityWorld& ecs, GameState* state) {
     namespace EC = World::EC;
     
-    ecs.ForEach([](ECS::Signature components){
-        return components.hasAll(ECS::getSignature<EC::Position, EC::Dynamic, EC::ViewBox>());
-    }, [&](auto entity){
-        //auto* viewbox  = ecs.Get<EC::ViewBox>(entity);
-        auto* positionEc = ecs.Get<EC::Position>(entity);
-        auto* dynamicEc = ecs.Get<EC::Dynamic>(entity);
-
-        Vec2 oldPos = positionEc->vec2();
-        Vec2 newPos = dynamicEc->pos;
+    using namespace ECS::Systems;
+    
+    ECS::Query<ReadWrite<EC::Position>, ReadOnly<EC::Dynamic>, Tag<EC::ViewBox>>::forEach(ecs,
+      [&](Entity entity, EC::Position& positionEc, const EC::Dynamic& dynamicEc){
+        Vec2 oldPos = positionEc.vec2();
+        Vec2 newPos = dynamicEc.pos;
         if (oldPos.x == newPos.x && oldPos.y == newPos.y) {
-            return;
+            return false;
         }
 
-        positionEc->x = newPos.x;
-        positionEc->y = newPos.y;
+        positionEc.x = newPos.x;
+        positionEc.y = newPos.y;
 
         World::entityPositionChanged(state, entity, oldPos);
+        return true;
     });
 }
 
@@ -94,102 +105,105 @@ static void updateSystems(GameState* state) {
     auto& chunkmap = state->chunkmap;
 
     namespace EC = World::EC;
+    using namespace ECS::Systems;
     ECS::Systems::executeSystems(*state->ecsSystems);
 
-    ecs.ForEach([](ECS::Signature components){
-        return components[EC::Follow::ID] && components[EC::CollisionBox::ID] && components[EC::Dynamic::ID] && components[EC::Position::ID]; 
-    }, [&](Entity entity){
-        auto followComponent = ecs.Get<EC::Follow>(entity);
-        assert(followComponent);
-        if (!ecs.EntityExists(followComponent->entity)) {
+    // followers are grouped by who they follow, so each followed entity is only looked up once
+    ecs.follows.forEachTarget([&](Entity following, ArrayRef<ECS::Relation::Pair> followers){
+        auto followingRef = ecs.GetRef(following);
+        if (followingRef.Null()) return;
+        const auto* followingPos = ecs.Get<const EC::Position>(followingRef);
+        const auto* followingCollision = ecs.Get<const EC::CollisionBox>(followingRef);
+        if (!followingPos || !followingCollision) {
             return;
         }
-        Entity following = followComponent->entity;
-        Vec2 followingPos = ecs.Get<EC::Position>(following)->vec2();
-        Box followingCollision = ecs.Get<EC::CollisionBox>(following)->box;
-        Vec2 target = followingPos + followingCollision.center();
-
-        auto* position = ecs.Get<EC::Dynamic>(entity);
-        Box collision = ecs.Get<EC::CollisionBox>(entity)->box;
-        Vec2 center = position->pos + collision.center();;
-        Vec2 delta = {target.x - center.x, target.y - center.y};
-
-        if (delta.x*delta.x + delta.y*delta.y < followComponent->speed * followComponent->speed) {
-            //Vec2 oldPos = position->vec2();
-            position->pos += delta;
-            //entityPositionChanged(&state->chunkmap, &ecs, entity, oldPos);
-
-            // do something
-            // hurt them if they have health
-            if (ecs.EntityHas<EC::Health>(following)) {
-                ecs.Get<EC::Health>(following)->damage(10);
+        Vec2 target = followingPos->vec2() + followingCollision->box.center();
+        EC::Health* followingHealth = ecs.Get<EC::Health>(followingRef);
+
+        for (auto& pair : followers) {
+            auto ref = ecs.GetRef(pair.source);
+            if (ref.Null()) continue;
+            const auto* followComponent = ecs.Get<const EC::Follow>(ref);
+            const auto* collisionBox = ecs.Get<const EC::CollisionBox>(ref);
+            auto* position = ecs.Get<EC::Dynamic>(ref);
+            if (!followComponent || !collisionBox || !position || !ecs.Get<const EC::Position>(ref)) {
+                continue;
             }
+            ecs.MarkChanged<EC::Dynamic>(ref);
+
+            Box collision = collisionBox->box;
+            Vec2 center = position->pos + collision.center();
+            Vec2 delta = {target.x - center.x, target.y - center.y};
+
+            if (delta.x*delta.x + delta.y*delta.y < followComponent->speed * followComponent->speed) {
+                position->pos += delta;
+
+                // do something
+                // hurt them if they have health
+                if (followingHealth) {
+                    followingHealth->damage(10);
+                }
 
-        } else {
-            Vec2 unit;
-            // normalized vector with x = 0.0 is NaN
-            if (delta.x == 0.0f) {
-                unit = Vec2{0.0f, ((delta.y > 0.0f) ? 1 : -1) * followComponent->speed};
             } else {
-                unit = glm::normalize(delta) * followComponent->speed;
+                Vec2 unit;
+                // normalized vector with x = 0.0 is NaN
+                if (delta.x == 0.0f) {
+                    unit = Vec2{0.0f, ((delta.y > 0.0f) ? 1 : -1) * followComponent->speed};
+                } else {
+                    unit = glm::normalize(delta) * followComponent->speed;
+                }
+                position->pos += unit;
+
+                float rotationRadians = atan2f(delta.y, delta.x);
+                if (auto* rotation = ecs.Get<EC::Rotation>(ref)) {
+                    *rotation = {glm::degrees(rotationRadians) - 90.0f};
+                    ecs.MarkChanged<EC::Rotation>(ref);
+                }
             }
-            
-            /*
-            Vec2 oldPos = position->vec2();
-            position->x += unit.x;
-            position->y += unit.y;
-            */
-            position->pos += unit;
-            //entityPositionChanged(&state->chunkmap, &ecs, entity, oldPos);
-
-            float rotationRadians = atan2f(delta.y, delta.x);
-            ecs.Set<EC::Rotation>(entity, {glm::degrees(rotationRadians) - 90.0f});
         }
     });
 
     ECS::EntityCommandBuffer destroyEntities;
     ecs.useCommandBuffer(&destroyEntities);
-    ecs.ForEach([](ECS::Signature components){
-       return components[EC::Health::ID]; 
-    }, [&](Entity entity){
-        auto* health = ecs.Get<EC::Health>(entity);
+    // only reads, so the pools of everything with health (like all the trees) aren't marked as changed every tick
+    ECS::Query<ReadOnly<EC::Health>>::forEach(ecs, [&](Entity entity, const EC::Health& health){
         // Must do check like this instead of (*health <= 0.0f) to account for NaN values,
         // which can occur when infinite damage is done to an entity with infinite health
         // so in that situation the infinite damage wins out, rather than the infinte health
-        if (!(health->health > 0.0f)) {
+        if (!(health.health > 0.0f)) {
             if (!ecs.EntityHas<EC::Immortal>(entity)) {
                 ecs.Destroy(entity);
             }
         }
 
-        if (health->iFrames > 0) {
-            health->iFrames--;
+        if (health.iFrames > 0) {
+            ecs.Get<EC::Health>(entity)->iFrames--;
+            ecs.MarkChanged<EC::Health>(entity);
         }
     });
     ecs.flushCurrentCommandBuffer();
 
-    ecs.ForEach([](ECS::Signature components){
-        return components[EC::Dynamic::ID] && components[EC::Motion::ID];
-    }, [&](auto entity){
-        auto* pos = ecs.Get<EC::Dynamic>(entity);
-        Vec2 oldPos = pos->pos;
-        auto* motion = ecs.Get<EC::Motion>(entity);
-        Vec2 target = motion->target;
-        Vec2 delta = target - oldPos;
-        float speed = motion->speed;
-        Vec2 unit = glm::normalize(delta) * speed;
-
-        float dist = delta.x*delta.x + delta.y*delta.y;
-
-        if (dist < speed*speed) {
-            pos->pos.x = target.x;
-            pos->pos.y = target.y;
-        } else {
-            pos->pos.x += unit.x;
-            pos->pos.y += unit.y;
-        }
+    ECS::Query<ReadWrite<EC::Dynamic>, ReadOnly<EC::Motion>>::forEachBlock(ecs,
+      [&](int count, const Entity* entities, EC::Dynamic* dynamics, const EC::Motion* motions){
+        bool moved = false;
+        for (int i = 0; i < count; i++) {
+            Vec2 oldPos = dynamics[i].pos;
+            Vec2 target = motions[i].target;
+            Vec2 delta = target - oldPos;
+            if (delta.x == 0.0f && delta.y == 0.0f) continue;
+            moved = true;
+            float speed = motions[i].speed;
+            float dist = delta.x*delta.x + delta.y*delta.y;
+
+            if (dist < speed*speed) {
+                dynamics[i].pos = target;
+            } else {
+                dynamics[i].pos += delta * (speed / sqrtf(dist));
+            }
 
-        //entityPositionChanged(state, entity, oldPos);
+            //entityPositionChanged(state, entity, oldPos);
+        }
+        return moved;
     });
 }
 
@@ -206,10 +220,7 @@ int tick(GameState* state, PlayerControls* playerControls) {
     // auto dyn = state->player.get<World::EC::Dynamic>()->pos;
     // LogInfo("pos: %.1f,%.1f", newPos.x, newPos.y);
     // LogInfo("dyn: %.1f,%.1f", dyn.x, dyn.y);
-    // IVec2 chunkPos = toChunkPosition(newPos);
-    // auto* chunk = state->chunkmap.get(chunkPos);
-    // auto* player = std::find(chunk->closeEntities.begin(), chunk->closeEntities.end(), state->player.entity);
-    // if (player == chunk->closeEntities.end()) {
+    // if (!state->chunkmap.entityGrid.contains(state->player.entity)) {
     //     LogError("player not found!");
     // }
 
@@ -344,6 +355,19 @@ void focusCamera(Camera* camera, const CameraFocus* focus, const EntityWorld* ec
     }
 }
 
+// generate the chunks the camera can see, plus a chunk around them so they're ready before they come into view.
+// Chunks spilled by the streamer are read back instead, and chunks far away are evicted to stay in the memory budget
+static void updateChunkGeneration(GameState* state, const Camera& camera) {
+    state->chunkGenerator.commit(&state->chunkmap);
+    Boxf area = camera.maxBoundingArea();
+    ChunkCoord minChunk = toChunkPosition(area[0]) - IVec2(1);
+    ChunkCoord maxChunk = toChunkPosition(area[1]) + IVec2(1);
+    state->chunkStreamer.use(&state->chunkmap, minChunk, maxChunk);
+    state->chunkStreamer.evict(&state->chunkmap);
+    Vec2 center = Vec2(camera.position.x, camera.position.y) / (float)CHUNKSIZE;
+    state->chunkGenerator.requestArea(state->chunkmap, minChunk, maxChunk, center);
+}
+
 int Game::update() {
 
     DO_ONCE(LogInfo("Whats up?"));
@@ -391,8 +415,12 @@ int Game::update() {
 
         // update to new state from tick
         focusCamera(&camera, &cameraFocus, state->ecs);
+
+        autosaver.update(state);
     }
 
+    updateChunkGeneration(state, camera);
+
     float scale = SDL::pixelScale;
     RenderOptions options = {
         {camera.pixelWidth, camera.pixelHeight},
@@ -445,28 +473,41 @@ int Game::init(SDLContext sdlContext) {
     // init systems
     systems.init(state, renderContext, camera);
 
-    this->state->createWorld();
-
-    for (int e = 0; e < 8000; e++) {
-        Vec2 pos = {(float)randomInt(-100, 100), (float)randomInt(-100, 100)};
-        // do placing collision checks
-        auto tree = World::Entities::Tree::make(state->ecs, pos, {4, 4});
-        // World::entityCreated(state, tree);
-        (void)tree;
+    auto savePath = FileSystem.save.get("world.save");
+    state->chunkStreamer.regionPath = FileSystem.save.get("world.regions").str;
+    bool loaded = false;
+    if (fileExists(savePath)) {
+        loaded = GameSave::load(state, savePath) == 0;
+        if (!loaded) {
+            // the new world is saved right away, which would wipe out the old one for good
+            GameSave::moveAside(savePath);
+        }
     }
+    if (!loaded) {
+        this->state->createWorld();
+
+        for (int e = 0; e < 8000; e++) {
+            Vec2 pos = {(float)randomInt(-100, 100), (float)randomInt(-100, 100)};
+            // do placing collision checks
+            auto tree = World::Entities::Tree::make(state->ecs, pos, {4, 4});
+            // World::entityCreated(state, tree);
+            (void)tree;
+        }
 
-    // auto tree = World::Entities::Tree::make(state->ecs, {10.5, 10.5}, {40, 40})();
-
-    World::Entities::TextBox::make(state->ecs, {10, -5}, World::EC::Text{
-        .message = "This is an example of a text box!",
-        .rendering = TextRenderingSettings{
-            .color = {0, 255, 55, 255},
-            .font = Fonts->get("Debug")
-        },
-        .formatting = TextFormattingSettings{
-            .align = TextAlignment::TopCenter
-        },
-    });
+        // auto tree = World::Entities::Tree::make(state->ecs, {10.5, 10.5}, {40, 40})();
+
+        World::Entities::TextBox::make(state->ecs, {10, -5}, World::EC::Text{
+            .message = "This is an example of a text box!",
+            .rendering = TextRenderingSettings{
+                .color = {0, 255, 55, 255},
+                .font = Fonts->get("Debug")
+            },
+            .formatting = TextFormattingSettings{
+                .align = TextAlignment::TopCenter
+            },
+        });
+    }
+    autosaver.init(savePath);
 
     this->playerControls = NEW(PlayerControls(this), essentialAllocator);
     SDL_FPoint mousePos = SDL::getMousePixelPosition();
@@ -511,12 +552,19 @@ void Game::quit() {
 
 void Game::destroy() {
     LogInfo("destroying game");
+    // a full save, so the game starts from one file next time instead of replaying the change log
+    if (state) {
+        autosaver.save(state, true);
+    }
+    autosaver.destroy();
+    if (state) {
+        state->chunkGenerator.stop(Global.threadManager);
+    }
+    systems.destroy();
     Debug = nullptr;
 }
 
 int Game::start() {
-    // GameSave::load()
-
     LogInfo("Starting!");
     mode = Playing;
 
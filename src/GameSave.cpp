@@ -0,0 +1,793 @@
+#include "GameSave.hpp"
+#include <string>
+#include "ECS/Serialization.hpp"
+#include "utils/MappedFile.hpp"
+#include "rendering/context.hpp"
+#include "world/entities/entities.hpp"
+#include "world/functions.hpp"
+#include "global.hpp"
+#include <time.h>
+
+using ECS::SaveWriter;
+using ECS::SaveReader;
+using ECS::ComponentSerializers;
+
+namespace GameSave {
+
+namespace {
+
+constexpr char Magic[8] = {'N','O','V','A','S','A','V','E'};
+
+constexpr char LogMagic[8] = {'N','O','V','A','L','O','G','\0'};
+
+struct Header {
+    char magic[8];
+    Uint32 version;
+    Uint32 sectionCount;
+    Uint64 saveID;
+};
+
+// a change log starts with this, then has records of a size, a section count and sections
+struct LogHeader {
+    char magic[8];
+    Uint32 version;
+    Uint32 padding;
+    Uint64 saveID;
+};
+
+enum SectionTag : Uint32 {
+    SectionItems = 1,
+    SectionEntities = 2,
+    SectionChunks = 3,
+    SectionPlayer = 4,
+    SectionChunkTiles = 5, // just the tiles of some chunks, for change logs and evicted chunks
+    SectionFollows = 6 // the world's follows relation, after the entities it's between
+};
+
+constexpr Uint32 NullStringLength = UINT32_MAX;
+
+void writeString(SaveWriter& writer, const char* str) {
+    if (!str) {
+        writer.write(NullStringLength);
+        return;
+    }
+    Uint32 length = strlen(str);
+    writer.write(length);
+    writer.write(str, length);
+}
+
+// the returned string is malloc'd, or null if a null string was saved
+bool readString(SaveReader& reader, char** str) {
+    Uint32 length;
+    if (!reader.read(&length)) return false;
+    if (length == NullStringLength) {
+        *str = nullptr;
+        return true;
+    }
+    const char* chars = reader.read(length);
+    if (!chars) return false;
+    *str = (char*)malloc(length + 1);
+    memcpy(*str, chars, length);
+    (*str)[length] = '\0';
+    return true;
+}
+
+// fonts are saved by name since they're loaded again every run
+const char* getFontName(const Font* font) {
+    if (!font || !Fonts) return nullptr;
+    for (const auto& [name, f] : Fonts->fonts) {
+        if (f == font) return name.c_str();
+    }
+    return nullptr;
+}
+
+// functions that guns can fire, saved by index
+const World::EC::Gun::CreateProjectileFunc ProjectileFuncs[] = {
+    &World::Entities::Laser::make
+};
+constexpr int ProjectileFuncCount = sizeof(ProjectileFuncs) / sizeof(ProjectileFuncs[0]);
+
+ComponentSerializers makeWorldSerializers(GameState* state, int componentCount) {
+    using namespace World;
+    ComponentSerializers serializers(componentCount);
+
+    serializers[EC::Inventory::ID] = {
+        [](const void* component, SaveWriter& writer){
+            auto* inventory = &((const EC::Inventory*)component)->inventory;
+            Sint32 size = inventory->items ? inventory->size : 0;
+            writer.write(size);
+            writer.write(inventory->items, MAX(size, 0) * sizeof(ItemStack));
+        },
+        [state](void* component, SaveReader& reader){
+            auto* inventory = &((EC::Inventory*)component)->inventory;
+            Sint32 size;
+            if (!reader.read(&size) || size < 0) return false;
+            const char* items = reader.read(size * sizeof(ItemStack));
+            if (!items) return false;
+            inventory->manager = &state->itemManager;
+            inventory->size = size;
+            inventory->items = size > 0 ? state->itemManager.inventoryAllocator.allocate(size) : nullptr;
+            if (size > 0) memcpy(inventory->items, items, size * sizeof(ItemStack));
+            return true;
+        }
+    };
+
+    serializers[EC::Text::ID] = {
+        [](const void* component, SaveWriter& writer){
+            auto* text = (const EC::Text*)component;
+            writeString(writer, text->message);
+            writeString(writer, getFontName(text->rendering.font));
+        },
+        [](void* component, SaveReader& reader){
+            auto* text = (EC::Text*)component;
+            char* message;
+            char* fontName;
+            if (!readString(reader, &message) || !readString(reader, &fontName)) return false;
+            text->message = message;
+            text->rendering.font = (fontName && Fonts) ? Fonts->get(fontName) : nullptr;
+            free(fontName);
+            return true;
+        }
+    };
+
+    serializers[EC::TransportLineEC::ID] = {
+        [](const void* component, SaveWriter& writer){
+            auto* line = (const EC::TransportLineEC*)component;
+            writer.write((Sint32)line->belts.size);
+            writer.write(line->belts.data, line->belts.size * sizeof(IVec2));
+        },
+        [](void* component, SaveReader& reader){
+            auto* line = (EC::TransportLineEC*)component;
+            Sint32 size;
+            if (!reader.read(&size) || size < 0) return false;
+            const char* belts = reader.read(size * sizeof(IVec2));
+            if (!belts) return false;
+            line->belts = My::Vec<IVec2>::WithCapacity(size);
+            if (size > 0) memcpy(line->belts.data, belts, size * sizeof(IVec2));
+            line->belts.size = size;
+            return true;
+        }
+    };
+
+    serializers[EC::Gun::ID] = {
+        [](const void* component, SaveWriter& writer){
+            auto* gun = (const EC::Gun*)component;
+            Sint32 index = -1;
+            for (int i = 0; i < ProjectileFuncCount; i++) {
+                if (ProjectileFuncs[i] == gun->projectileFired) index = i;
+            }
+            if (index == -1 && gun->projectileFired) {
+                LogOnce(Warn, "Gun fires a projectile that isn't in the projectile table, it won't be saved");
+            }
+            writer.write(index);
+        },
+        [](void* component, SaveReader& reader){
+            auto* gun = (EC::Gun*)component;
+            Sint32 index;
+            if (!reader.read(&index)) return false;
+            gun->projectileFired = (index >= 0 && index < ProjectileFuncCount) ? ProjectileFuncs[index] : nullptr;
+            return true;
+        }
+    };
+
+    return serializers;
+}
+
+// only the chunks in the map are written, slots in the chunk list that were freed by evicting are skipped
+void saveChunk(IVec2 position, const ChunkData& chunkdata, SaveWriter& writer) {
+    writer.write(position);
+    writer.write((Sint32)chunkdata.modified);
+    writer.write(chunkdata.chunk, sizeof(Chunk));
+}
+
+int loadChunks(ChunkMap* chunkmap, SaveReader& reader) {
+    chunkmap->destroy();
+    chunkmap->init();
+
+    // chunks that weren't made yet are generated the same way they would have been
+    if (!reader.read(&chunkmap->seed)) return -1;
+    Sint32 chunkCount;
+    if (!reader.read(&chunkCount) || chunkCount < 0) return -1;
+    chunkmap->map.reserve(chunkCount);
+    for (int i = 0; i < chunkCount; i++) {
+        IVec2 position;
+        Sint32 modified;
+        if (!reader.read(&position) || !reader.read(&modified)) return -1;
+        const char* tiles = reader.read(sizeof(Chunk));
+        if (!tiles || chunkmap->existsAt(position)) return -1;
+        ChunkData* chunkdata = chunkmap->newChunkAt(position);
+        if (!chunkdata) return -1;
+        memcpy(chunkdata->chunk, tiles, sizeof(Chunk));
+        chunkdata->modified = modified != 0;
+    }
+    return 0;
+}
+
+// what the player is holding is saved as a value or as the inventory slot it points to
+struct SavedPlayer {
+    Entity entity;
+    Entity selectedEntity;
+    Uint32 numHotbarSlots;
+    Sint32 selectedHotbarSlot;
+    Sint32 grenadeThrowCooldown;
+    Sint32 heldType;
+    Sint32 heldSlot;
+    ItemStack heldValue;
+};
+
+void savePlayer(const Player& player, SaveWriter& writer) {
+    SavedPlayer saved;
+    saved.entity = player.entity;
+    saved.selectedEntity = player.selectedEntity;
+    saved.numHotbarSlots = player.numHotbarSlots;
+    saved.selectedHotbarSlot = player.selectedHotbarSlot;
+    saved.grenadeThrowCooldown = player.grenadeThrowCooldown;
+    saved.heldType = player.heldItemStack.type;
+    saved.heldSlot = -1;
+    saved.heldValue = ItemStack();
+    if (player.heldItemStack.type == ItemHold::Value) {
+        saved.heldValue = player.heldItemStack.data.value;
+    } else if (player.heldItemStack.type == ItemHold::Inventory) {
+        const Inventory* inventory = player.inventory();
+        if (inventory && player.heldItemStack.data.pointer) {
+            saved.heldSlot = (Sint32)(player.heldItemStack.data.pointer - inventory->items);
+        }
+    }
+    writer.write(saved);
+}
+
+int loadPlayer(GameState* state, SaveReader& reader) {
+    SavedPlayer saved;
+    if (!reader.read(&saved)) return -1;
+    Player& player = state->player;
+    player = Player();
+    player.ecs = state->ecs;
+    player.entity = saved.entity;
+    player.selectedEntity = saved.selectedEntity;
+    player.numHotbarSlots = saved.numHotbarSlots;
+    player.selectedHotbarSlot = saved.selectedHotbarSlot;
+    player.grenadeThrowCooldown = saved.grenadeThrowCooldown;
+    if (saved.heldType == ItemHold::Value) {
+        player.heldItemStack = ItemHold(saved.heldValue);
+    } else if (saved.heldType == ItemHold::Inventory) {
+        Inventory* inventory = player.inventory();
+        if (inventory && saved.heldSlot >= 0 && saved.heldSlot < inventory->size) {
+            player.heldItemStack = ItemHold(ItemHold::Inventory, ItemHold::DataType(&inventory->items[saved.heldSlot]));
+        }
+    }
+    if (!state->ecs->EntityExists(player.entity)) {
+        LogError("Saved player entity doesn't exist!");
+        return -1;
+    }
+    return 0;
+}
+
+// tiles of the chunks the chunk streamer spilled and are still unloaded, or only the dirty ones
+void saveSpilledChunkTiles(const ChunkMap& chunkmap, const ChunkStreamer& streamer, SaveWriter& writer, bool onlyDirty) {
+    std::vector<IVec2> positions;
+    streamer.forEachSpilled(chunkmap, [&](IVec2 position, bool dirty){
+        if (dirty || !onlyDirty) positions.push_back(position);
+    });
+    writer.write((Sint32)positions.size());
+    Chunk* tiles = (Chunk*)malloc(sizeof(Chunk));
+    for (IVec2 position : positions) {
+        bool modified = true; // only changed chunks are spilled
+        if (!streamer.readSpilled(position, tiles)) {
+            LogError("Failed to read spilled chunk (%d,%d) for saving! Its changes are lost", position.x, position.y);
+            generateChunk(tiles, position, chunkmap.seed);
+            modified = false;
+        }
+        writer.write(position);
+        writer.write((Sint32)modified);
+        writer.write(tiles, sizeof(Chunk));
+    }
+    free(tiles);
+}
+
+// tiles of the dirty chunks, clearing their dirty flags
+void saveDirtyChunkTiles(ChunkMap& chunkmap, SaveWriter& writer) {
+    Sint32 count = 0;
+    chunkmap.map.forEach([&](IVec2, const ChunkData& chunkdata){
+        if (chunkdata.dirty) count++;
+    });
+    writer.write(count);
+    chunkmap.map.forEach([&](IVec2 position, ChunkData& chunkdata){
+        if (!chunkdata.dirty) return;
+        writer.write(position);
+        writer.write((Sint32)chunkdata.modified);
+        writer.write(chunkdata.chunk, sizeof(Chunk));
+        chunkdata.dirty = false;
+    });
+}
+
+int loadChunkTiles(ChunkMap* chunkmap, SaveReader& reader) {
+    Sint32 count;
+    if (!reader.read(&count) || count < 0) return -1;
+    for (int i = 0; i < count; i++) {
+        IVec2 position;
+        Sint32 modified;
+        if (!reader.read(&position) || !reader.read(&modified)) return -1;
+        const char* tiles = reader.read(sizeof(Chunk));
+        if (!tiles) return -1;
+        ChunkData* chunkdata = chunkmap->getOrMakeNew(position);
+        if (!chunkdata) return -1;
+        memcpy(chunkdata->chunk, tiles, sizeof(Chunk));
+        chunkdata->dirty = false;
+        chunkdata->modified = modified != 0;
+    }
+    return 0;
+}
+
+// the entity grid isn't saved, it's worked out again from entity positions after loading
+void rebuildEntityGrid(GameState* state) {
+    state->chunkmap.entityGrid.clear();
+    state->ecs->forEachEntity<World::EC::Position, World::EC::ViewBox>([&](Entity entity){
+        World::entityCreated(state, entity);
+    });
+}
+
+Uint64 newSaveID() {
+    return ((Uint64)time(nullptr) << 32) ^ SDL_GetTicksNS();
+}
+
+template<typename Func>
+void writeSection(SaveWriter& writer, SectionTag tag, Func writeContents) {
+    writer.write((Uint32)tag);
+    size_t block = writer.beginBlock();
+    writeContents();
+    writer.align(16);
+    writer.endBlock(block);
+}
+
+// start a full save with the header and the chunks section, which copyFullSaveChunks fills in
+void beginFullSave(GameState* state, SaveWriter& writer, Uint64 saveID, FullSaveProgress* progress) {
+    Header header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.sectionCount = 7;
+    header.saveID = saveID;
+    writer.write(header);
+
+    // chunks go first since loading them starts the chunk map over
+    writer.write((Uint32)SectionChunks);
+    progress->chunksBlock = writer.beginBlock();
+    writer.write(state->chunkmap.seed);
+    progress->chunkCountPosition = writer.position;
+    writer.write(Sint32(0));
+    progress->chunksCopied = 0;
+    progress->chunksLeft.clear();
+    progress->chunksLeft.reserve(state->chunkmap.size());
+    state->chunkmap.map.forEach([&](IVec2 position, const ChunkData&){
+        progress->chunksLeft.push_back(position);
+    });
+}
+
+// copy up to maxChunks more of the chunks that were there when the save began. Returns true once they're all copied
+bool copyFullSaveChunks(GameState* state, SaveWriter& writer, FullSaveProgress* progress, size_t maxChunks, bool clearDirty) {
+    size_t count = MIN(maxChunks, progress->chunksLeft.size());
+    for (size_t i = 0; i < count; i++) {
+        IVec2 position = progress->chunksLeft.back();
+        progress->chunksLeft.pop_back();
+        // evicted since the save began. If it was changed, it's written with the spilled chunks
+        ChunkData* chunkdata = state->chunkmap.get(position);
+        if (!chunkdata) continue;
+        saveChunk(position, *chunkdata, writer);
+        if (clearDirty) chunkdata->dirty = false;
+        progress->chunksCopied++;
+    }
+    return progress->chunksLeft.empty();
+}
+
+/* Copy everything else, all in the same frame.
+ * With clearDirty, chunks copied earlier that have changed since, or were made since, are written again after the chunks section,
+ * so the save matches this frame. Otherwise the chunks must have all been copied this frame, and nothing extra is written.
+ */
+void endFullSave(GameState* state, SaveWriter& writer, FullSaveProgress* progress, bool clearDirty, ECS::SavedVersions* worldVersions, ECS::SavedVersions* itemVersions) {
+    memcpy(writer.buffer->data() + writer.bufferStart + progress->chunkCountPosition, &progress->chunksCopied, sizeof(Sint32));
+    writer.align(16);
+    writer.endBlock(progress->chunksBlock);
+
+    writeSection(writer, SectionChunkTiles, [&](){
+        if (clearDirty) {
+            saveDirtyChunkTiles(state->chunkmap, writer);
+        } else {
+            writer.write(Sint32(0));
+        }
+    });
+    // evicted chunks with changes aren't in the chunk map, but still have to be saved
+    writeSection(writer, SectionChunkTiles, [&](){
+        saveSpilledChunkTiles(state->chunkmap, state->chunkStreamer, writer, false);
+    });
+    if (clearDirty) {
+        state->chunkStreamer.clearDirty();
+    }
+
+    auto worldSerializers = makeWorldSerializers(state, state->ecs->nComponents);
+    writeSection(writer, SectionItems, [&](){
+        ECS::saveEntities(state->itemManager, writer, nullptr, itemVersions);
+    });
+    writeSection(writer, SectionEntities, [&](){
+        ECS::saveEntities(*state->ecs, writer, &worldSerializers, worldVersions);
+    });
+    writeSection(writer, SectionFollows, [&](){
+        ECS::saveRelation(state->ecs->follows, writer);
+    });
+    writeSection(writer, SectionPlayer, [&](){
+        savePlayer(state->player, writer);
+    });
+}
+
+// one record of a change log
+void writeChanges(GameState* state, SaveWriter& writer, ECS::SavedVersions* worldVersions, ECS::SavedVersions* itemVersions) {
+    size_t record = writer.beginBlock();
+    writer.write(Uint32(6));
+    writer.align(8);
+
+    auto worldSerializers = makeWorldSerializers(state, state->ecs->nComponents);
+    writeSection(writer, SectionItems, [&](){
+        ECS::saveEntityChanges(state->itemManager, writer, nullptr, itemVersions);
+    });
+    writeSection(writer, SectionEntities, [&](){
+        ECS::saveEntityChanges(*state->ecs, writer, &worldSerializers, worldVersions);
+    });
+    // not worth tracking changes to, it's written whole
+    writeSection(writer, SectionFollows, [&](){
+        ECS::saveRelation(state->ecs->follows, writer);
+    });
+    writeSection(writer, SectionChunkTiles, [&](){
+        saveDirtyChunkTiles(state->chunkmap, writer);
+    });
+    writeSection(writer, SectionChunkTiles, [&](){
+        saveSpilledChunkTiles(state->chunkmap, state->chunkStreamer, writer, true);
+    });
+    state->chunkStreamer.clearDirty();
+    writeSection(writer, SectionPlayer, [&](){
+        savePlayer(state->player, writer);
+    });
+    writer.endBlock(record);
+}
+
+// read sectionCount sections. Entity sections are applied as changes if changes is true
+int readSections(GameState* state, SaveReader& reader, Uint32 sectionCount, bool changes, bool* loadedPlayer) {
+    auto worldSerializers = makeWorldSerializers(state, state->ecs->nComponents);
+    for (Uint32 s = 0; s < sectionCount; s++) {
+        Uint32 tag;
+        Uint64 sectionSize;
+        if (!reader.read(&tag) || !reader.read(&sectionSize) || sectionSize > reader.size - reader.position) {
+            return -1;
+        }
+        size_t sectionEnd = reader.position + sectionSize;
+        // sections only get to read their own data
+        SaveReader sectionReader(reader.data, sectionEnd);
+        sectionReader.position = reader.position;
+        int result = 0;
+        switch (tag) {
+        case SectionItems:
+            result = changes ? ECS::loadEntityChanges(state->itemManager, sectionReader, nullptr)
+                             : ECS::loadEntities(state->itemManager, sectionReader, nullptr);
+            break;
+        case SectionEntities:
+            result = changes ? ECS::loadEntityChanges(*state->ecs, sectionReader, &worldSerializers)
+                             : ECS::loadEntities(*state->ecs, sectionReader, &worldSerializers);
+            break;
+        case SectionChunks:
+            result = loadChunks(&state->chunkmap, sectionReader);
+            break;
+        case SectionChunkTiles:
+            result = loadChunkTiles(&state->chunkmap, sectionReader);
+            break;
+        case SectionFollows:
+            result = ECS::loadRelation(*state->ecs, state->ecs->follows, sectionReader);
+            break;
+        case SectionPlayer:
+            result = loadPlayer(state, sectionReader);
+            *loadedPlayer = result == 0;
+            break;
+        default:
+            LogWarn("Skipping unknown save section %u", tag);
+            break;
+        }
+        if (result != 0) return result;
+        reader.position = sectionEnd;
+    }
+    return 0;
+}
+
+// apply every complete record in the change log. A record cut off by a crash is ignored.
+// Returns the number of records applied, or -1 on failure
+int applyChangeLog(GameState* state, const char* logPath, Uint64 saveID) {
+    // there's no log until the first autosave after a full save
+    if (!fileExists(logPath)) return 0;
+    MappedFile file;
+    if (file.open(logPath) != 0) return 0;
+
+    SaveReader reader(file.data, file.size);
+    LogHeader header;
+    if (!reader.read(&header) || memcmp(header.magic, LogMagic, sizeof(LogMagic)) != 0
+     || header.version != Version || header.saveID != saveID) {
+        LogWarn("Ignoring change log %s, it doesn't belong to the save", logPath);
+        file.close();
+        return 0;
+    }
+
+    int records = 0;
+    while (reader.position < reader.size) {
+        Uint64 recordSize;
+        Uint32 sectionCount;
+        if (!reader.read(&recordSize) || recordSize > reader.size - reader.position) {
+            LogWarn("Change log %s ends with an incomplete record, ignoring it", logPath);
+            break;
+        }
+        size_t recordEnd = reader.position + recordSize;
+        SaveReader recordReader(reader.data, recordEnd);
+        recordReader.position = reader.position;
+        if (!recordReader.read(&sectionCount)) break;
+        recordReader.align(8);
+        bool loadedPlayer = false;
+        if (readSections(state, recordReader, sectionCount, true, &loadedPlayer) != 0) {
+            file.close();
+            return -1;
+        }
+        reader.position = recordEnd;
+        records++;
+    }
+    file.close();
+    return records;
+}
+
+bool writeFile(const char* filepath, const char* mode, const std::vector<char>& data) {
+    FILE* file = fopen(filepath, mode);
+    if (!file) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (fclose(file) != 0) ok = false;
+    return ok;
+}
+
+// write to a temporary file first so a failed save can't wreck the last good one
+bool writeFileAtomically(const char* filepath, const std::vector<char>& data) {
+    std::string tempPath = std::string(filepath) + ".tmp";
+    if (!writeFile(tempPath.c_str(), "wb", data)) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    remove(filepath);
+    return rename(tempPath.c_str(), filepath) == 0;
+}
+
+bool startChangeLog(const char* logPath, Uint64 saveID) {
+    LogHeader header;
+    memcpy(header.magic, LogMagic, sizeof(LogMagic));
+    header.version = Version;
+    header.padding = 0;
+    header.saveID = saveID;
+    std::vector<char> data((const char*)&header, (const char*)&header + sizeof(header));
+    return writeFile(logPath, "wb", data);
+}
+
+}
+
+int save(const GameState& constState, const char* filepath) {
+    Uint64 start = SDL_GetTicksNS();
+    // the serializers are made for loading too, saving doesn't change anything
+    GameState* state = const_cast<GameState*>(&constState);
+    std::vector<char> data;
+    SaveWriter writer(&data);
+    // all in one go, so nothing can change between the chunks and the rest. The autosaver's dirty flags are left alone
+    FullSaveProgress progress;
+    beginFullSave(state, writer, newSaveID(), &progress);
+    copyFullSaveChunks(state, writer, &progress, SIZE_MAX, false);
+    endFullSave(state, writer, &progress, false, nullptr, nullptr);
+    if (!writeFileAtomically(filepath, data)) {
+        LogError("Failed to write save to %s!", filepath);
+        return -1;
+    }
+    // a log left over from an older save would be ignored anyway
+    remove((std::string(filepath) + ".log").c_str());
+
+    double ms = (double)(SDL_GetTicksNS() - start) / 1e6;
+    LogInfo("Saved game to %s (%zu bytes) in %.2f ms", filepath, data.size(), ms);
+    return 0;
+}
+
+int load(GameState* state, const char* filepath) {
+    Uint64 start = SDL_GetTicksNS();
+    MappedFile file;
+    if (file.open(filepath) != 0) {
+        LogError("Failed to open save %s!", filepath);
+        return -1;
+    }
+
+    SaveReader reader(file.data, file.size);
+    Header header;
+    if (!reader.read(&header) || memcmp(header.magic, Magic, sizeof(Magic)) != 0) {
+        LogError("%s is not a save file!", filepath);
+        file.close();
+        return -1;
+    }
+    if (header.version != Version) {
+        LogError("Save %s is version %u, but only version %u can be loaded!", filepath, header.version, Version);
+        file.close();
+        return -1;
+    }
+
+    // spilled chunks belong to the world being replaced
+    state->chunkStreamer.clear();
+    bool loadedPlayer = false;
+    int result = readSections(state, reader, header.sectionCount, false, &loadedPlayer);
+    file.close();
+    if (result == 0 && loadedPlayer) {
+        std::string logPath = std::string(filepath) + ".log";
+        int records = applyChangeLog(state, logPath.c_str(), header.saveID);
+        if (records < 0) {
+            result = -1;
+        } else if (records > 0) {
+            LogInfo("Applied %d autosaves from %s", records, logPath.c_str());
+        }
+    }
+
+    if (result != 0 || !loadedPlayer) {
+        LogError("Failed to load save %s!", filepath);
+        state->ecs->components.clearEntities();
+        state->chunkmap.entityGrid.clear();
+        return -1;
+    }
+
+    rebuildEntityGrid(state);
+
+    // everything matches the save now
+    state->chunkmap.map.forEach([](IVec2, ChunkData& chunkdata){
+        chunkdata.dirty = false;
+    });
+
+    double ms = (double)(SDL_GetTicksNS() - start) / 1e6;
+    LogInfo("Loaded save %s in %.2f ms", filepath, ms);
+    return 0;
+}
+
+int moveAside(const char* filepath) {
+    // name it after the version it was saved with, so it's clear what can load it
+    std::string backupPath = std::string(filepath) + ".bak";
+    FILE* file = fopen(filepath, "rb");
+    if (file) {
+        Header header;
+        if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, Magic, sizeof(Magic)) == 0) {
+            backupPath = std::string(filepath) + ".v" + std::to_string(header.version) + ".bak";
+        }
+        fclose(file);
+    }
+
+    remove(backupPath.c_str());
+    if (rename(filepath, backupPath.c_str()) != 0) {
+        LogError("Failed to move save %s aside to %s!", filepath, backupPath.c_str());
+        return -1;
+    }
+    std::string logPath = std::string(filepath) + ".log";
+    if (fileExists(logPath.c_str())) {
+        std::string backupLogPath = backupPath + ".log";
+        remove(backupLogPath.c_str());
+        if (rename(logPath.c_str(), backupLogPath.c_str()) != 0) {
+            LogError("Failed to move change log %s aside to %s!", logPath.c_str(), backupLogPath.c_str());
+            return -1;
+        }
+    }
+    LogWarn("Moved save %s that couldn't be loaded to %s", filepath, backupPath.c_str());
+    return 0;
+}
+
+void Autosaver::init(const char* filepath) {
+    this->filepath = filepath;
+    this->logPath = this->filepath + ".log";
+    lastSaveTicks = SDL_GetTicks();
+}
+
+void Autosaver::update(GameState* state) {
+    // never wait on the writer here, just try again next frame
+    if (writing.load(std::memory_order_acquire)) return;
+    if (copyingFullSave) {
+        Uint64 start = SDL_GetTicksNS();
+        bool copied = copyFullSaveChunks(state, writer, &fullSaveProgress, fullSaveChunksPerFrame, true);
+        copyNanoseconds += SDL_GetTicksNS() - start;
+        if (copied) {
+            finishFullSave(state);
+        }
+        return;
+    }
+    if (SDL_GetTicks() - lastSaveTicks < intervalMilliseconds) return;
+    if (needsFullSave()) {
+        startFullSave(state);
+    } else {
+        save(state, false);
+    }
+}
+
+void Autosaver::wait() {
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+}
+
+bool Autosaver::needsFullSave() {
+    if (writeFailed.exchange(false)) {
+        LogError("Autosave to %s failed, doing a full save", filepath.c_str());
+        return true;
+    }
+    return !worldVersions.valid || !itemVersions.valid || changeSaves >= changeSavesPerFullSave;
+}
+
+void Autosaver::startFullSave(GameState* state) {
+    lastSaveTicks = SDL_GetTicks();
+    Uint64 start = SDL_GetTicksNS();
+    buffer.clear();
+    writer = SaveWriter(&buffer);
+    saveID = newSaveID();
+    beginFullSave(state, writer, saveID, &fullSaveProgress);
+    copyingFullSave = true;
+    copyNanoseconds = SDL_GetTicksNS() - start;
+}
+
+void Autosaver::finishFullSave(GameState* state) {
+    Uint64 start = SDL_GetTicksNS();
+    endFullSave(state, writer, &fullSaveProgress, true, &worldVersions, &itemVersions);
+    copyingFullSave = false;
+    fullSaveProgress.chunksLeft = std::vector<IVec2>();
+    changeSaves = 0;
+    copyNanoseconds += SDL_GetTicksNS() - start;
+    LogInfo("Autosave copied %zu bytes (full) in %.2f ms", buffer.size(), (double)copyNanoseconds / 1e6);
+    startWriting(true);
+}
+
+void Autosaver::save(GameState* state, bool full) {
+    if (filepath.empty()) return;
+    wait();
+    if (needsFullSave() || copyingFullSave) {
+        full = true;
+    }
+
+    if (full) {
+        if (!copyingFullSave) {
+            startFullSave(state);
+        }
+        copyFullSaveChunks(state, writer, &fullSaveProgress, SIZE_MAX, true);
+        finishFullSave(state);
+        return;
+    }
+
+    lastSaveTicks = SDL_GetTicks();
+    Uint64 start = SDL_GetTicksNS();
+    buffer.clear();
+    writer = SaveWriter(&buffer);
+    writeChanges(state, writer, &worldVersions, &itemVersions);
+    changeSaves++;
+    double ms = (double)(SDL_GetTicksNS() - start) / 1e6;
+    LogInfo("Autosave copied %zu bytes (changes) in %.2f ms", buffer.size(), ms);
+    startWriting(false);
+}
+
+void Autosaver::startWriting(bool full) {
+    // the last write is done by now, but its thread still has to be joined before it can be replaced
+    wait();
+    writing.store(true, std::memory_order_release);
+    auto write = [this, full](){
+        bool ok = full ? writeFileAtomically(filepath.c_str(), buffer) && startChangeLog(logPath.c_str(), saveID)
+                       : writeFile(logPath.c_str(), "ab", buffer);
+        if (!ok) {
+            // the next save writes everything again, since these changes never made it
+            writeFailed.store(true);
+        }
+        writing.store(false, std::memory_order_release);
+    };
+    if (Global.multithreadingEnabled) {
+        writerThread = std::thread(write);
+    } else {
+        write();
+    }
+}
+
+void Autosaver::destroy() {
+    wait();
+    copyingFullSave = false;
+    fullSaveProgress = FullSaveProgress();
+    buffer = std::vector<char>();
+}
+
+}
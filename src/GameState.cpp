@@ -61,18 +61,15 @@ void GameState::init(const TextureManager* textureManager) {
 
     /* Init Chunkmap */
     chunkmap.init();
-    int chunkRadius = 4;
-    for (int chunkX = -chunkRadius; chunkX < chunkRadius; chunkX++) {
-        for (int chunkY = -chunkRadius; chunkY < chunkRadius; chunkY++) {
-            ChunkData* chunkdata = chunkmap.newChunkAt({chunkX, chunkY});
-            if (chunkdata) {
-                generateChunk(chunkdata);
-            } else {
-                LogError("Failed to create chunk at tile (%d,%d) for initialization", chunkX * CHUNKSIZE, chunkY * CHUNKSIZE);
-                continue;
-            }
-        }
+    chunkmap.seed = ((Uint64)time(nullptr) << 32) ^ SDL_GetTicksNS();
+    // workers are opened before the job scheduler takes the rest of the threads
+    if (Global.multithreadingEnabled) {
+        chunkGenerator.start(Global.threadManager, ChunkGenerator::DefaultWorkerCount);
     }
+    int chunkRadius = 4;
+    chunkGenerator.requestArea(chunkmap, {-chunkRadius, -chunkRadius}, {chunkRadius - 1, chunkRadius - 1}, {0, 0});
+    chunkGenerator.finish(&chunkmap);
+    chunkStreamer.init();
 
     /* Init ECS */
     ecs = NEW(EntityWorld(), scratch);
@@ -94,6 +91,9 @@ void GameState::init(const TextureManager* textureManager) {
 }
 
 void GameState::destroy() {
+    chunkGenerator.stop(Global.threadManager);
+    chunkGenerator.destroy();
+    chunkStreamer.destroy();
     chunkmap.destroy();
     ecs->destroy();
 }
@@ -101,8 +101,10 @@ std::vector<GameAction> PlayerControls::handleClick(const SDL_MouseButtonEvent&
                         if (onUse) {
                             bool success = onUse(game);
                             if (success) {
-                                if (usable->oneTimeUse)
+                                if (usable->oneTimeUse) {
                                     heldItemStack->reduceQuantity(1);
+                                    game->state->player.heldItemStackChanged();
+                                }
                             }
                         }
                     }
@@ -201,10 +203,7 @@ void PlayerControls::playerMouseTargetMoved(const MouseState& mouseState, const
             if (!justGrabbedItem) {
                 if (heldItemStack && game->state->player.canPlaceItemStack(*heldItemStack, game->state->itemManager)) {
                     for (int i = 0; i < line.size(); i++) {
-                        Tile* tile = getTileAtPosition(game->state->chunkmap, line[i]);
-                        if (tile) {
-                            game->state->player.tryPlaceItemStack(heldItemStack, tile, game->state->itemManager);
-                        }
+                        placeItem(heldItemStack, Vec2{(float)line[i].x, (float)line[i].y});
                     }
                 }
             }
@@ -466,7 +465,9 @@ void PlayerControls::movePlayer(Vec2 movement) {
     for (int x = minTile.x; x <= maxTile.x; x++) {
         for (int y = minTile.y; y <= maxTile.y; y++) {
             Tile* tile = getTileAtPosition(game->state->chunkmap, Vec2{x, y});
-            if (TileTypeData[tile->type].flags & TileTypes::Solid) {
+            // chunks are generated in the background now, so the one next to the player might not be there yet.
+            // Treat it as solid so the player can't walk into it before it exists
+            if (!tile || TileTypeData[tile->type].flags & TileTypes::Solid) {
                 Vec2 nearestPoint = glm::clamp(potentialPosition, {x, y}, {x+1, y+1});
                 Vec2 nearestPointDelta = nearestPoint - potentialPosition;
                 float length = glm::length(nearestPointDelta);
@@ -485,11 +486,16 @@ void PlayerControls::movePlayer(Vec2 movement) {
     }
 
     oldPlayerPos->pos = potentialPosition - collisionRadius;
+    game->state->ecs->MarkChanged<World::EC::Dynamic>(player->entity);
 }
 
 void PlayerControls::placeItem(ItemStack* item, Vec2 at) {
+    ChunkData* chunkdata = game->state->chunkmap.get(toChunkPosition(at));
+    if (!chunkdata) return;
     Tile* tile = getTileAtPosition(game->state->chunkmap, at);
-    if (tile) {
-        game->state->player.tryPlaceItemStack(item, tile, game->state->itemManager);
+    if (game->state->player.tryPlaceItemStack(item, tile, game->state->itemManager)) {
+        chunkdata->dirty = true;
+        chunkdata->modified = true;
+        game->state->player.heldItemStackChanged();
     }
 }
\ No newline at end of file
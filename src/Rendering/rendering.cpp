@@ -163,15 +163,8 @@ int renderTilemap(RenderContext& ren, const Camera& camera, ChunkMap* chunkmap)
             }
             ChunkData* chunkdata = chunkmap->get({x, y});
             if (!chunkdata) {
-                ChunkData* newChunk = chunkmap->newChunkAt({x, y});
-                if (newChunk) {
-                    generateChunk(newChunk);
-                    chunkdata = newChunk;
-                } else {
-                    LogError("Failed to create missing chunk at tile (%d,%d) for rendering", x*CHUNKSIZE, y*CHUNKSIZE);
-                    // perhaps this should render some missing texture thing, but atleast for now just render nothing
-                    continue;
-                }
+                // still being generated. perhaps this should render some missing texture thing, but atleast for now just render nothing
+                continue;
             }
 
             chunks.push_back({chunkdata->chunk, {x, y}});
@@ -0,0 +1,163 @@
+#include "SpatialGrid.hpp"
+#include <algorithm>
+
+void SpatialGrid::init() {
+    cells.resize(1); // oversized entities
+    cellIndices = decltype(cellIndices)::WithBuckets(64);
+    count = 0;
+}
+
+void SpatialGrid::destroy() {
+    cells = std::vector<Cell>();
+    freeCells = std::vector<Sint32>();
+    slots = std::vector<Slot>();
+    cellIndices.destroy();
+    count = 0;
+}
+
+void SpatialGrid::clear() {
+    for (auto& cell : cells) {
+        cell.entities.clear();
+        cell.minX.clear();
+        cell.minY.clear();
+        cell.maxX.clear();
+        cell.maxY.clear();
+    }
+    // every cell is empty now
+    freeCells.clear();
+    for (Sint32 cell = (Sint32)cells.size() - 1; cell > OversizedCell; cell--) {
+        freeCells.push_back(cell);
+    }
+    int bucketCount = cellIndices.bucketCount;
+    cellIndices.destroy();
+    cellIndices = decltype(cellIndices)::WithBuckets(MAX(bucketCount, 64));
+    removedCellIndices = 0;
+    slots.clear();
+    count = 0;
+}
+
+void SpatialGrid::releaseFreeCells() {
+    // free cells at the end can go, the rest keep their place but not their arrays
+    std::sort(freeCells.begin(), freeCells.end());
+    while (!freeCells.empty() && freeCells.back() == (Sint32)cells.size() - 1) {
+        freeCells.pop_back();
+        cells.pop_back();
+    }
+    for (Sint32 cell : freeCells) {
+        cells[cell] = Cell();
+    }
+    // lowest first, so the cells at the end are the last to be used again
+    std::reverse(freeCells.begin(), freeCells.end());
+    cells.shrink_to_fit();
+    freeCells.shrink_to_fit();
+
+    if (cellIndices.bucketCount > 64 && cellIndices.size * 4 < cellIndices.bucketCount) {
+        cellIndices.rehash(MAX(64, cellIndices.size * 2));
+        removedCellIndices = 0;
+    }
+}
+
+size_t SpatialGrid::memoryUsage() const {
+    size_t bytes = cells.capacity() * sizeof(Cell) + freeCells.capacity() * sizeof(Sint32) + slots.capacity() * sizeof(Slot);
+    bytes += (size_t)cellIndices.bucketCount * (sizeof(My::Bucket) + sizeof(IVec2) + sizeof(Sint32));
+    for (const Cell& cell : cells) {
+        bytes += cell.entities.capacity() * sizeof(Entity);
+        bytes += (cell.minX.capacity() + cell.minY.capacity() + cell.maxX.capacity() + cell.maxY.capacity()) * sizeof(float);
+    }
+    return bytes;
+}
+
+Sint32 SpatialGrid::getOrMakeCell(Vec2 min, Vec2 max) {
+    if (max.x - min.x > CellSize || max.y - min.y > CellSize) {
+        return OversizedCell;
+    }
+    IVec2 position = toCell(min);
+    const Sint32* cell = cellIndices.lookup(position);
+    if (cell) return *cell;
+    Sint32 newCell;
+    if (!freeCells.empty()) {
+        newCell = freeCells.back();
+        freeCells.pop_back();
+    } else {
+        newCell = (Sint32)cells.size();
+        cells.emplace_back();
+    }
+    cells[newCell].position = position;
+    cellIndices.insert(position, newCell);
+    return newCell;
+}
+
+void SpatialGrid::freeCell(Sint32 cell) {
+    cellIndices.remove(cells[cell].position);
+    freeCells.push_back(cell);
+    // removed markers make looking up missing cells slower until the map is rehashed
+    if (++removedCellIndices > cellIndices.bucketCount / 4) {
+        cellIndices.rehash(cellIndices.bucketCount);
+        removedCellIndices = 0;
+    }
+}
+
+void SpatialGrid::removeFromCell(Slot slot) {
+    Cell& cell = cells[slot.cell];
+    Sint32 last = (Sint32)cell.entities.size() - 1;
+    if (slot.index != last) {
+        // move the last entity in the cell into the hole
+        Entity moved = cell.entities[last];
+        cell.entities[slot.index] = moved;
+        cell.minX[slot.index] = cell.minX[last];
+        cell.minY[slot.index] = cell.minY[last];
+        cell.maxX[slot.index] = cell.maxX[last];
+        cell.maxY[slot.index] = cell.maxY[last];
+        slots[moved.id].index = slot.index;
+    }
+    cell.entities.pop_back();
+    cell.minX.pop_back();
+    cell.minY.pop_back();
+    cell.maxX.pop_back();
+    cell.maxY.pop_back();
+    if (cell.entities.empty() && slot.cell != OversizedCell) {
+        freeCell(slot.cell);
+    }
+}
+
+void SpatialGrid::update(Entity entity, Vec2 min, Vec2 max) {
+    assert(entity.NotNull());
+    if (entity.id >= slots.size()) {
+        slots.resize(MAX(entity.id + 1, slots.size() * 2), Slot{NotInGrid, 0});
+    }
+
+    Sint32 newCell = getOrMakeCell(min, max);
+    Slot slot = slots[entity.id];
+    if (slot.cell != NotInGrid) {
+        if (slot.cell == newCell) {
+            // the usual case, moved without leaving its cell
+            Cell& cell = cells[newCell];
+            cell.entities[slot.index] = entity;
+            cell.minX[slot.index] = min.x;
+            cell.minY[slot.index] = min.y;
+            cell.maxX[slot.index] = max.x;
+            cell.maxY[slot.index] = max.y;
+            return;
+        }
+        // an entity with the same id can only still be here if this one replaced it, so it can be removed either way
+        removeFromCell(slot);
+    } else {
+        count++;
+    }
+
+    Cell& cell = cells[newCell];
+    slots[entity.id] = {newCell, (Sint32)cell.entities.size()};
+    cell.entities.push_back(entity);
+    cell.minX.push_back(min.x);
+    cell.minY.push_back(min.y);
+    cell.maxX.push_back(max.x);
+    cell.maxY.push_back(max.y);
+}
+
+bool SpatialGrid::remove(Entity entity) {
+    if (!contains(entity)) return false;
+    removeFromCell(slots[entity.id]);
+    slots[entity.id].cell = NotInGrid;
+    count--;
+    return true;
+}
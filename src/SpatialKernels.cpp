@@ -0,0 +1,253 @@
+#include "SpatialKernels.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SPATIAL_KERNELS_AVX 1
+#elif defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define SPATIAL_KERNELS_SSE 1
+#endif
+
+namespace SpatialKernels {
+
+namespace {
+
+/* The line is start + t * delta for t from 0 to 1.
+ * An axis the line doesn't move along is flat. Its inverse delta is infinite, and a box edge right on the start
+ * would give 0 * infinity = NaN, so flat axes aren't put through the slab math. The line is in a flat axis's slab
+ * for every t if it starts within the box on that axis, and for none otherwise.
+ */
+struct Line {
+    Vec2 start;
+    Vec2 invDelta;
+    bool flatX;
+    bool flatY;
+
+    Line(Vec2 start, Vec2 end) : start(start) {
+        Vec2 delta = end - start;
+        invDelta = {1.0f / delta.x, 1.0f / delta.y};
+        flatX = std::isinf(invDelta.x);
+        flatY = std::isinf(invDelta.y);
+    }
+};
+
+inline bool overlaps(const PackedBoxes& boxes, int i, Vec2 min, Vec2 max) {
+    return boxes.minX[i] < max.x && boxes.maxX[i] > min.x
+        && boxes.minY[i] < max.y && boxes.maxY[i] > min.y;
+}
+
+inline bool inCircle(const PackedBoxes& boxes, int i, Vec2 center, float radiusSqrd) {
+    // distance from the center to the closest point in the box
+    float dx = std::max(std::max(boxes.minX[i] - center.x, center.x - boxes.maxX[i]), 0.0f);
+    float dy = std::max(std::max(boxes.minY[i] - center.y, center.y - boxes.maxY[i]), 0.0f);
+    return dx * dx + dy * dy < radiusSqrd;
+}
+
+// the range of t where the line is between min and max on one axis. Empty when tMin > tMax
+inline void slab(float min, float max, float start, float invDelta, bool flat, float* tMin, float* tMax) {
+    if (flat) {
+        bool inside = min <= start && start <= max;
+        *tMin = inside ? -INFINITY : INFINITY;
+        *tMax = inside ? INFINITY : -INFINITY;
+        return;
+    }
+    float t1 = (min - start) * invDelta;
+    float t2 = (max - start) * invDelta;
+    *tMin = std::min(t1, t2);
+    *tMax = std::max(t1, t2);
+}
+
+inline bool onLine(const PackedBoxes& boxes, int i, const Line& line) {
+    float txMin, txMax, tyMin, tyMax;
+    slab(boxes.minX[i], boxes.maxX[i], line.start.x, line.invDelta.x, line.flatX, &txMin, &txMax);
+    slab(boxes.minY[i], boxes.maxY[i], line.start.y, line.invDelta.y, line.flatY, &tyMin, &tyMax);
+    float tNear = std::max(std::max(txMin, tyMin), 0.0f);
+    float tFar  = std::min(std::min(txMax, tyMax), 1.0f);
+    return tNear <= tFar;
+}
+
+// the scalar loops start somewhere so the simd versions can use them for the boxes left over at the end
+
+inline int overlappingBoxFrom(const PackedBoxes& boxes, int start, Vec2 min, Vec2 max, Sint32* hits, int hitCount) {
+    for (int i = start; i < boxes.count; i++) {
+        hits[hitCount] = i;
+        hitCount += overlaps(boxes, i, min, max);
+    }
+    return hitCount;
+}
+
+inline int inCircleFrom(const PackedBoxes& boxes, int start, Vec2 center, float radiusSqrd, Sint32* hits, int hitCount) {
+    for (int i = start; i < boxes.count; i++) {
+        hits[hitCount] = i;
+        hitCount += inCircle(boxes, i, center, radiusSqrd);
+    }
+    return hitCount;
+}
+
+inline int onLineFrom(const PackedBoxes& boxes, int start, const Line& line, Sint32* hits, int hitCount) {
+    for (int i = start; i < boxes.count; i++) {
+        hits[hitCount] = i;
+        hitCount += onLine(boxes, i, line);
+    }
+    return hitCount;
+}
+
+#if defined(SPATIAL_KERNELS_AVX) || defined(SPATIAL_KERNELS_SSE)
+
+/* Write the lanes set in mask to hits without branching.
+ * Every lane gets written, but only set lanes move hitCount forward, and hitCount is never past the lane's index,
+ * so it can't go past the end of hits.
+ */
+template<int Lanes>
+inline int compactHits(int mask, int first, Sint32* hits, int hitCount) {
+    for (int lane = 0; lane < Lanes; lane++) {
+        hits[hitCount] = first + lane;
+        hitCount += (mask >> lane) & 1;
+    }
+    return hitCount;
+}
+
+#endif
+
+#if defined(SPATIAL_KERNELS_AVX)
+
+constexpr int Lanes = 8;
+using Floats = __m256;
+
+inline Floats load(const float* p) { return _mm256_loadu_ps(p); }
+inline Floats splat(float f) { return _mm256_set1_ps(f); }
+inline Floats add(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+inline Floats sub(Floats a, Floats b) { return _mm256_sub_ps(a, b); }
+inline Floats mul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+inline Floats min(Floats a, Floats b) { return _mm256_min_ps(a, b); }
+inline Floats max(Floats a, Floats b) { return _mm256_max_ps(a, b); }
+inline Floats less(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline Floats lessEqual(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline Floats both(Floats a, Floats b) { return _mm256_and_ps(a, b); }
+inline int mask(Floats a) { return _mm256_movemask_ps(a); }
+
+#elif defined(SPATIAL_KERNELS_SSE)
+
+constexpr int Lanes = 4;
+using Floats = __m128;
+
+inline Floats load(const float* p) { return _mm_loadu_ps(p); }
+inline Floats splat(float f) { return _mm_set1_ps(f); }
+inline Floats add(Floats a, Floats b) { return _mm_add_ps(a, b); }
+inline Floats sub(Floats a, Floats b) { return _mm_sub_ps(a, b); }
+inline Floats mul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+inline Floats min(Floats a, Floats b) { return _mm_min_ps(a, b); }
+inline Floats max(Floats a, Floats b) { return _mm_max_ps(a, b); }
+inline Floats less(Floats a, Floats b) { return _mm_cmplt_ps(a, b); }
+inline Floats lessEqual(Floats a, Floats b) { return _mm_cmple_ps(a, b); }
+inline Floats both(Floats a, Floats b) { return _mm_and_ps(a, b); }
+inline int mask(Floats a) { return _mm_movemask_ps(a); }
+
+#endif
+
+#if defined(SPATIAL_KERNELS_AVX) || defined(SPATIAL_KERNELS_SSE)
+
+// like slab, but the lanes outside a flat axis are masked out of inside instead of getting an empty range
+inline void slabs(Floats boxMin, Floats boxMax, Floats start, Floats invDelta, bool flat, Floats* tMin, Floats* tMax, int* inside) {
+    if (flat) {
+        *tMin = splat(-INFINITY);
+        *tMax = splat(INFINITY);
+        *inside &= mask(both(lessEqual(boxMin, start), lessEqual(start, boxMax)));
+        return;
+    }
+    Floats t1 = mul(sub(boxMin, start), invDelta);
+    Floats t2 = mul(sub(boxMax, start), invDelta);
+    *tMin = min(t1, t2);
+    *tMax = max(t1, t2);
+}
+
+#endif
+
+}
+
+#if defined(SPATIAL_KERNELS_AVX) || defined(SPATIAL_KERNELS_SSE)
+
+int overlappingBox(PackedBoxes boxes, Vec2 min, Vec2 max, Sint32* hits) {
+    Floats minX = splat(min.x), minY = splat(min.y);
+    Floats maxX = splat(max.x), maxY = splat(max.y);
+    int hitCount = 0;
+    int i = 0;
+    for (; i + Lanes <= boxes.count; i += Lanes) {
+        Floats hit = both(
+            both(less(load(boxes.minX + i), maxX), less(minX, load(boxes.maxX + i))),
+            both(less(load(boxes.minY + i), maxY), less(minY, load(boxes.maxY + i)))
+        );
+        hitCount = compactHits<Lanes>(mask(hit), i, hits, hitCount);
+    }
+    return overlappingBoxFrom(boxes, i, min, max, hits, hitCount);
+}
+
+int inCircle(PackedBoxes boxes, Vec2 center, float radius, Sint32* hits) {
+    Floats centerX = splat(center.x), centerY = splat(center.y);
+    Floats radiusSqrd = splat(radius * radius);
+    Floats zero = splat(0.0f);
+    int hitCount = 0;
+    int i = 0;
+    for (; i + Lanes <= boxes.count; i += Lanes) {
+        Floats dx = max(max(sub(load(boxes.minX + i), centerX), sub(centerX, load(boxes.maxX + i))), zero);
+        Floats dy = max(max(sub(load(boxes.minY + i), centerY), sub(centerY, load(boxes.maxY + i))), zero);
+        Floats distSqrd = add(mul(dx, dx), mul(dy, dy));
+        hitCount = compactHits<Lanes>(mask(less(distSqrd, radiusSqrd)), i, hits, hitCount);
+    }
+    return inCircleFrom(boxes, i, center, radius * radius, hits, hitCount);
+}
+
+int onLine(PackedBoxes boxes, Vec2 start, Vec2 end, Sint32* hits) {
+    Line line(start, end);
+    Floats startX = splat(line.start.x), startY = splat(line.start.y);
+    Floats invDeltaX = splat(line.invDelta.x), invDeltaY = splat(line.invDelta.y);
+    Floats zero = splat(0.0f), one = splat(1.0f);
+    int hitCount = 0;
+    int i = 0;
+    for (; i + Lanes <= boxes.count; i += Lanes) {
+        int inside = (1 << Lanes) - 1;
+        Floats txMin, txMax, tyMin, tyMax;
+        slabs(load(boxes.minX + i), load(boxes.maxX + i), startX, invDeltaX, line.flatX, &txMin, &txMax, &inside);
+        slabs(load(boxes.minY + i), load(boxes.maxY + i), startY, invDeltaY, line.flatY, &tyMin, &tyMax, &inside);
+        Floats tNear = max(max(txMin, tyMin), zero);
+        Floats tFar  = min(min(txMax, tyMax), one);
+        hitCount = compactHits<Lanes>(mask(lessEqual(tNear, tFar)) & inside, i, hits, hitCount);
+    }
+    return onLineFrom(boxes, i, line, hits, hitCount);
+}
+
+#else
+
+int overlappingBox(PackedBoxes boxes, Vec2 min, Vec2 max, Sint32* hits) {
+    return Scalar::overlappingBox(boxes, min, max, hits);
+}
+
+int inCircle(PackedBoxes boxes, Vec2 center, float radius, Sint32* hits) {
+    return Scalar::inCircle(boxes, center, radius, hits);
+}
+
+int onLine(PackedBoxes boxes, Vec2 start, Vec2 end, Sint32* hits) {
+    return Scalar::onLine(boxes, start, end, hits);
+}
+
+#endif
+
+namespace Scalar {
+
+int overlappingBox(PackedBoxes boxes, Vec2 min, Vec2 max, Sint32* hits) {
+    return overlappingBoxFrom(boxes, 0, min, max, hits, 0);
+}
+
+int inCircle(PackedBoxes boxes, Vec2 center, float radius, Sint32* hits) {
+    return inCircleFrom(boxes, 0, center, radius * radius, hits, 0);
+}
+
+int onLine(PackedBoxes boxes, Vec2 start, Vec2 end, Sint32* hits) {
+    return onLineFrom(boxes, 0, Line(start, end), hits, 0);
+}
+
+}
+
+}
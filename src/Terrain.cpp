@@ -0,0 +1,182 @@
+#include "Terrain.hpp"
+#include "utils/random.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define TERRAIN_AVX 1
+#elif defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define TERRAIN_SSE 1
+#endif
+
+namespace Terrain {
+
+namespace {
+
+constexpr int OctaveCount = sizeof(Octaves) / sizeof(Octaves[0]);
+// lattice points along one side of a chunk for the smallest wavelength
+constexpr int MaxLatticeSize = CHUNKSIZE / 16 + 1;
+
+inline int floorDiv(int a, int b) {
+    return a / b - (a % b < 0);
+}
+
+// smoothstep, so the noise doesn't have creases along lattice lines
+inline float fade(float t) {
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// the noise for one octave over one chunk
+struct OctaveNoise {
+    float amplitude;
+    int wavelength;
+    int cellCount; // lattice cells along one side that the chunk touches
+    int firstCellY;
+    float lattice[MaxLatticeSize * MaxLatticeSize]; // random values at lattice points, row by row
+    float fadeX[CHUNKSIZE]; // how far each tile column is across its cell
+    float fadeY[CHUNKSIZE];
+
+    void init(Octave octave, int octaveIndex, ChunkCoord position, Uint64 seed) {
+        static_assert(CHUNKSIZE % 16 == 0, "Chunks must be a whole number of the smallest octave cells");
+        assert(octave.wavelength >= 16 && (octave.wavelength & (octave.wavelength - 1)) == 0);
+        amplitude = octave.amplitude;
+        wavelength = octave.wavelength;
+        cellCount = MAX(CHUNKSIZE / wavelength, 1);
+
+        int originX = position.x * CHUNKSIZE;
+        int originY = position.y * CHUNKSIZE;
+        int firstCellX = floorDiv(originX, wavelength);
+        firstCellY = floorDiv(originY, wavelength);
+
+        // every octave gets its own lattice
+        Uint64 octaveSeed = seed ^ ((Uint64)(octaveIndex + 1) * 0x9E3779B97F4A7C15ull);
+        int latticeSize = cellCount + 1;
+        for (int i = 0; i < latticeSize; i++) {
+            for (int j = 0; j < latticeSize; j++) {
+                Uint64 hash = seedForPosition(octaveSeed, firstCellX + j, firstCellY + i);
+                lattice[i * latticeSize + j] = (float)(hash >> 40) / (float)(1 << 24);
+            }
+        }
+
+        float invWavelength = 1.0f / (float)wavelength;
+        for (int i = 0; i < CHUNKSIZE; i++) {
+            fadeX[i] = fade((float)(originX + i - firstCellX * wavelength) * invWavelength - (float)(i / wavelength));
+            fadeY[i] = fade((float)(originY + i - firstCellY * wavelength) * invWavelength - (float)(i / wavelength));
+        }
+    }
+};
+
+struct ChunkNoise {
+    OctaveNoise octaves[OctaveCount];
+
+    ChunkNoise(ChunkCoord position, Uint64 seed) {
+        for (int i = 0; i < OctaveCount; i++) {
+            octaves[i].init(Octaves[i], i, position, seed);
+        }
+    }
+};
+
+// row[x] += value + slope * fade[x] for x from start to end
+inline void addSpanScalar(float* row, const float* fade, int start, int end, float value, float slope) {
+    for (int x = start; x < end; x++) {
+        row[x] += value + slope * fade[x];
+    }
+}
+
+#if defined(TERRAIN_AVX)
+
+inline void addSpanSimd(float* row, const float* fade, int start, int end, float value, float slope) {
+    __m256 values = _mm256_set1_ps(value);
+    __m256 slopes = _mm256_set1_ps(slope);
+    for (int x = start; x < end; x += 8) {
+        __m256 noise = _mm256_add_ps(values, _mm256_mul_ps(slopes, _mm256_loadu_ps(fade + x)));
+        _mm256_storeu_ps(row + x, _mm256_add_ps(_mm256_loadu_ps(row + x), noise));
+    }
+}
+
+#elif defined(TERRAIN_SSE)
+
+inline void addSpanSimd(float* row, const float* fade, int start, int end, float value, float slope) {
+    __m128 values = _mm_set1_ps(value);
+    __m128 slopes = _mm_set1_ps(slope);
+    for (int x = start; x < end; x += 4) {
+        __m128 noise = _mm_add_ps(values, _mm_mul_ps(slopes, _mm_loadu_ps(fade + x)));
+        _mm_storeu_ps(row + x, _mm_add_ps(_mm_loadu_ps(row + x), noise));
+    }
+}
+
+#else
+
+inline void addSpanSimd(float* row, const float* fade, int start, int end, float value, float slope) {
+    addSpanScalar(row, fade, start, end, value, slope);
+}
+
+#endif
+
+/* Heights for one row of tiles.
+ * Interpolating down the lattice columns first leaves each cell's tiles in the row on a single curve,
+ * so whole spans of tiles can be done at once with the same two numbers. Spans are always a multiple of 16 tiles.
+ */
+template<void (*AddSpan)(float*, const float*, int, int, float, float)>
+void rowHeights(const ChunkNoise& noise, int y, float* row) {
+    for (int x = 0; x < CHUNKSIZE; x++) {
+        row[x] = 0.0f;
+    }
+    for (const OctaveNoise& octave : noise.octaves) {
+        int latticeSize = octave.cellCount + 1;
+        // wavelengths larger than a chunk only have one cell, and can't have more than one cell row
+        int cellY = octave.cellCount == 1 ? 0 : y / octave.wavelength;
+        const float* top = &octave.lattice[cellY * latticeSize];
+        const float* bottom = top + latticeSize;
+        float fadeY = octave.fadeY[y];
+
+        float column[MaxLatticeSize];
+        for (int j = 0; j < latticeSize; j++) {
+            column[j] = octave.amplitude * (top[j] + (bottom[j] - top[j]) * fadeY);
+        }
+
+        int span = MIN(octave.wavelength, CHUNKSIZE);
+        for (int cell = 0; cell < octave.cellCount; cell++) {
+            AddSpan(row, octave.fadeX, cell * span, (cell + 1) * span, column[cell], column[cell + 1] - column[cell]);
+        }
+    }
+}
+
+}
+
+void heights(ChunkCoord position, Uint64 seed, float* heights) {
+    ChunkNoise noise(position, seed);
+    for (int y = 0; y < CHUNKSIZE; y++) {
+        rowHeights<addSpanSimd>(noise, y, heights + y * CHUNKSIZE);
+    }
+}
+
+TileType tileForHeight(float height) {
+    if (height < WaterLevel) return TileTypes::Water;
+    if (height < SandLevel) return TileTypes::Sand;
+    return TileTypes::Grass;
+}
+
+void generate(Chunk* chunk, ChunkCoord position, Uint64 seed) {
+    ChunkNoise noise(position, seed);
+    float row[CHUNKSIZE];
+    for (int y = 0; y < CHUNKSIZE; y++) {
+        rowHeights<addSpanSimd>(noise, y, row);
+        for (int x = 0; x < CHUNKSIZE; x++) {
+            (*chunk)[y][x] = Tile(tileForHeight(row[x]));
+        }
+    }
+}
+
+namespace Scalar {
+
+void heights(ChunkCoord position, Uint64 seed, float* heights) {
+    ChunkNoise noise(position, seed);
+    for (int y = 0; y < CHUNKSIZE; y++) {
+        rowHeights<addSpanScalar>(noise, y, heights + y * CHUNKSIZE);
+    }
+}
+
+}
+
+}
@@ -2,6 +2,8 @@
 #include "Game.hpp"
 #include "rendering/textures.hpp"
 #include "utils/FileSystem.hpp"
+#include "utils/Profiler.hpp"
+#include "GameSave.hpp"
 #include <sstream>
 
 namespace Commands {
@@ -516,6 +518,91 @@ namespace Commands {
         return RES_SUCCESS("");
     }
 
+    Result jobStats(Args args, Game* game) {
+        REQUIRE(0);
+        struct {
+            const char* name;
+            const ECS::Systems::SystemManager* manager;
+        } managers[] = {
+            {"State", &game->systems.ecsStateSystems},
+            {"Render", &game->systems.ecsRenderSystems}
+        };
+
+        std::string output = "";
+        for (auto& manager : managers) {
+            output += string_format("---%s systems---\n", manager.name);
+            auto& systems = manager.manager->systems;
+            for (int s = 0; s < systems.size(); s++) {
+                for (int j = 0; j < systems[s]->jobs.size(); j++) {
+                    auto& stats = systems[s]->jobs[j].stats;
+                    if (stats.chunkCount == 0) continue; // never run in parallel
+                    output += string_format("System %d job %d: %d entities in %d chunks of %d, %.1f ns/entity, imbalance %.2f\n",
+                        s, j, stats.entityCount, stats.chunkCount, stats.chunkSize, stats.nsPerEntity, stats.imbalance);
+                }
+            }
+        }
+        return {Result::Success, output};
+    }
+
+    Result profiler(Args args, int) {
+        auto action = args.get();
+        if (action == "start") {
+            Profiler::start();
+            return RES_SUCCESS("Profiler started.");
+        } else if (action == "stop") {
+            Profiler::stop();
+            return RES_SUCCESS("Profiler stopped.");
+        } else if (action == "clear") {
+            Profiler::clear();
+            return RES_SUCCESS("Profiler cleared.");
+        } else if (action == "dump") {
+            auto filename = args.get();
+            if (filename.empty()) filename = "trace.json";
+            auto filepath = FileSystem.save.get(filename.c_str());
+            if (Profiler::writeChromeTrace(filepath.str) != 0) {
+                return RES_ERROR(string_format("Failed to write trace to %s!", filepath.str));
+            }
+            return RES_SUCCESS(string_format("Wrote trace to %s", filepath.str));
+        } else if (action == "summary") {
+            auto msStr = args.get();
+            int milliseconds = msStr.empty() ? 1000 : atoi(msStr.c_str());
+            if (milliseconds <= 0) {
+                return RES_ERROR("Invalid number of milliseconds!");
+            }
+            return {Result::Success, Profiler::summary(milliseconds)};
+        }
+        return RES_ERROR("Expected start, stop, clear, dump [file] or summary [ms].");
+    }
+
+    Result save(Args args, Game* game) {
+        auto filename = args.get();
+        if (filename.empty()) {
+            // the autosave has a change log that has to be started over
+            game->autosaver.save(game->state, true);
+            game->autosaver.wait();
+            return RES_SUCCESS("Saved the world.");
+        }
+        auto filepath = FileSystem.save.get(filename.c_str());
+        if (GameSave::save(*game->state, filepath.str) != 0) {
+            return RES_ERROR(string_format("Failed to save to %s!", filepath.str));
+        }
+        return RES_SUCCESS(string_format("Saved to %s", filepath.str));
+    }
+
+    Result chunkBudget(Args args, GameState* state) {
+        auto& streamer = state->chunkStreamer;
+        auto megabytesStr = args.get();
+        if (!megabytesStr.empty()) {
+            int megabytes = atoi(megabytesStr.c_str());
+            if (megabytes <= 0) {
+                return RES_ERROR("Invalid number of megabytes!");
+            }
+            streamer.memoryBudget = (size_t)megabytes * 1024 * 1024;
+        }
+        return RES_SUCCESS("Chunk memory budget: %zu MB (%zu chunks). %zu chunks loaded",
+            streamer.memoryBudget / (1024 * 1024), streamer.maxLoadedChunks(), state->chunkmap.size());
+    }
+
     Result getPos(Args args, const Player& player) {
         auto* pos = player.get<World::EC::Position>();
         if (!pos) {
@@ -597,6 +684,14 @@ void setCommands(Game* game) {
     REG_COMMAND(toggleWireframeMode, 0);
     REG_COMMAND(logAllocatorStats, game);
     REG_COMMAND(getPos, state->player);
+    REG_COMMAND(jobStats, game);
+    DESCRIBE(jobStats, "Show the chunk size, cost per entity and load imbalance of every parallel job");
+    REG_COMMAND(profiler, 0);
+    DESCRIBE(profiler, "Record systems, jobs and job chunks on every thread. profiler start|stop|clear|dump [file]|summary [ms]");
+    REG_COMMAND(save, game);
+    DESCRIBE(save, "Save the world now, or to a different file in the save folder. save [file]");
+    REG_COMMAND(chunkBudget, state);
+    DESCRIBE(chunkBudget, "Show or set how many megabytes of chunks are kept loaded before far away chunks are evicted. chunkBudget [megabytes]");
 }
 
 CommandInput processMessage(std::string message, ArrayRef<Command> possibleCommands) {
@@ -99,8 +99,7 @@ int Main(int argc, char** argv) {
     assert(CACHE_LINE_SIZE == SDL_GetCPUCacheLineSize() && "Incorrect cache line size constant!");
     
     if (Global.multithreadingEnabled) {
-        int numCores = SDL_GetNumLogicalCPUCores();
-        int numThreadsToPool = MIN(numCores - 1, 3);
+        int numThreadsToPool = getIdealWorkerThreadCount();
         Global.threadManager = ThreadManager(numThreadsToPool);
     }
 
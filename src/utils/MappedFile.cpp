@@ -0,0 +1,90 @@
+#include "utils/MappedFile.hpp"
+#include "utils/Log.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define USE_MMAP 0
+#endif
+
+int MappedFile::open(const char* filepath) {
+    close();
+#if USE_MMAP
+    int fd = ::open(filepath, O_RDONLY);
+    if (fd < 0) {
+        LogError("Failed to open %s for reading", filepath);
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        LogError("Failed to get size of %s", filepath);
+        ::close(fd);
+        return -1;
+    }
+    void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        LogError("Failed to map %s", filepath);
+        return -1;
+    }
+    data = (const char*)memory;
+    size = info.st_size;
+    mapped = true;
+    return 0;
+#else
+    FILE* file = fopen(filepath, "rb");
+    if (!file) {
+        LogError("Failed to open %s for reading", filepath);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (fileSize <= 0) {
+        fclose(file);
+        return -1;
+    }
+    char* buffer = (char*)malloc(fileSize);
+    size_t read = fread(buffer, 1, fileSize, file);
+    fclose(file);
+    if (read != (size_t)fileSize) {
+        LogError("Failed to read %s", filepath);
+        free(buffer);
+        return -1;
+    }
+    data = buffer;
+    size = fileSize;
+    mapped = false;
+    return 0;
+#endif
+}
+
+void MappedFile::close() {
+    if (!data) return;
+#if USE_MMAP
+    if (mapped) {
+        munmap((void*)data, size);
+    } else {
+        free((void*)data);
+    }
+#else
+    free((void*)data);
+#endif
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+bool fileExists(const char* filepath) {
+    FILE* file = fopen(filepath, "rb");
+    if (!file) return false;
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,219 @@
+#include "utils/Profiler.hpp"
+#include "utils/Log.hpp"
+#include "utils/common-macros.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+namespace Profiler {
+
+std::atomic<bool> enabled{false};
+
+static std::atomic<ThreadBuffer*> threadBuffers[MaxThreads];
+static std::atomic<int> threadCount{0};
+// events that ended before this are ignored, so clearing doesn't have to touch other threads' buffers
+static std::atomic<Uint64> clearedTime{0};
+
+static thread_local ThreadBuffer* localBuffer = nullptr;
+static thread_local bool outOfBuffers = false;
+static thread_local char localThreadName[32] = {0};
+
+const char* categoryName(Category category) {
+    switch (category) {
+    case Category::Frame: return "frame";
+    case Category::System: return "system";
+    case Category::Job: return "job";
+    case Category::Chunk: return "chunk";
+    case Category::CommandFlush: return "command flush";
+    case Category::Wait: return "wait";
+    default: return "unknown";
+    }
+}
+
+ThreadBuffer* getThreadBuffer() {
+    if (localBuffer || outOfBuffers) return localBuffer;
+
+    int index = threadCount.fetch_add(1, std::memory_order_relaxed);
+    if (index >= MaxThreads) {
+        LogError("Too many threads for the profiler! Events from this thread won't be recorded");
+        outOfBuffers = true;
+        return nullptr;
+    }
+
+    // buffers are kept until the program exits, threads are long lived
+    ThreadBuffer* buffer = new ThreadBuffer();
+    buffer->threadIndex = index;
+    if (localThreadName[0]) {
+        strncpy(buffer->threadName, localThreadName, sizeof(buffer->threadName) - 1);
+    } else {
+        snprintf(buffer->threadName, sizeof(buffer->threadName), "Thread %d", index);
+    }
+    threadBuffers[index].store(buffer, std::memory_order_release);
+    localBuffer = buffer;
+    return buffer;
+}
+
+void setThreadName(const char* name) {
+    strncpy(localThreadName, name, sizeof(localThreadName) - 1);
+    if (localBuffer) {
+        strncpy(localBuffer->threadName, name, sizeof(localBuffer->threadName) - 1);
+    }
+}
+
+void start() {
+    enabled.store(true);
+}
+
+void stop() {
+    enabled.store(false);
+}
+
+void clear() {
+    clearedTime.store(now());
+}
+
+// copy the events of a buffer that haven't been overwritten
+static void copyEvents(const ThreadBuffer* buffer, std::vector<Event>* events) {
+    Uint64 written = buffer->written.load(std::memory_order_acquire);
+    Uint64 first = written > ThreadBuffer::Capacity ? written - ThreadBuffer::Capacity : 0;
+    size_t start = events->size();
+    for (Uint64 i = first; i < written; i++) {
+        events->push_back(buffer->events[i % ThreadBuffer::Capacity].load());
+    }
+    // the owning thread may have kept writing while we copied. Event i's slot is reused by event i + Capacity,
+    // so drop every event whose slot the owner has started to overwrite, including one it is in the middle of
+    std::atomic_thread_fence(std::memory_order_acquire);
+    Uint64 startedAfter = buffer->started.load(std::memory_order_relaxed);
+    if (startedAfter > first + ThreadBuffer::Capacity) {
+        size_t overwritten = MIN(startedAfter - first - ThreadBuffer::Capacity, written - first);
+        events->erase(events->begin() + start, events->begin() + start + overwritten);
+    }
+    Uint64 cleared = clearedTime.load(std::memory_order_relaxed);
+    events->erase(std::remove_if(events->begin() + start, events->end(), [cleared](const Event& event){
+        return event.end < cleared;
+    }), events->end());
+}
+
+// write a string as a json string literal, quotes included
+static void writeJsonString(FILE* file, const char* string) {
+    fputc('"', file);
+    for (const char* c = string; *c; c++) {
+        switch (*c) {
+        case '"': fputs("\\\"", file); break;
+        case '\\': fputs("\\\\", file); break;
+        case '\n': fputs("\\n", file); break;
+        case '\r': fputs("\\r", file); break;
+        case '\t': fputs("\\t", file); break;
+        default:
+            if ((unsigned char)*c < 0x20) {
+                fprintf(file, "\\u%04x", (unsigned char)*c);
+            } else {
+                fputc(*c, file);
+            }
+        }
+    }
+    fputc('"', file);
+}
+
+template<typename F>
+static void forEachThreadBuffer(const F& function) {
+    int count = MIN(threadCount.load(std::memory_order_acquire), MaxThreads);
+    for (int i = 0; i < count; i++) {
+        // may still be null if the thread is in the middle of making it
+        const ThreadBuffer* buffer = threadBuffers[i].load(std::memory_order_acquire);
+        if (buffer) function(buffer);
+    }
+}
+
+int writeChromeTrace(const char* filepath) {
+    FILE* file = fopen(filepath, "w");
+    if (!file) {
+        LogError("Failed to open %s for writing profiler trace", filepath);
+        return -1;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    std::vector<Event> events;
+    forEachThreadBuffer([&](const ThreadBuffer* buffer){
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+            first ? "" : ",\n", buffer->threadIndex);
+        writeJsonString(file, buffer->threadName);
+        fprintf(file, "}}");
+        first = false;
+
+        events.clear();
+        copyEvents(buffer, &events);
+        for (const Event& event : events) {
+            fprintf(file, ",\n{\"name\":");
+            writeJsonString(file, event.name);
+            fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d",
+                categoryName(event.category),
+                event.begin / 1000.0, (event.end - event.begin) / 1000.0,
+                buffer->threadIndex);
+            if (event.arg != -1) {
+                fprintf(file, ",\"args\":{\"n\":%d}", event.arg);
+            }
+            fprintf(file, "}");
+        }
+    });
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return 0;
+}
+
+std::string summary(int milliseconds) {
+    Uint64 currentTime = now();
+    Uint64 window = (Uint64)milliseconds * 1000000;
+    // the clock starts at zero, so the window can reach back before it
+    Uint64 since = currentTime > window ? currentTime - window : 0;
+
+    struct Totals {
+        int count = 0;
+        Uint64 total = 0;
+        Uint64 max = 0;
+    };
+    std::map<std::pair<const char*, Category>, Totals> totals;
+    std::string threadLines;
+
+    std::vector<Event> events;
+    forEachThreadBuffer([&](const ThreadBuffer* buffer){
+        events.clear();
+        copyEvents(buffer, &events);
+        Uint64 chunkTime = 0;
+        for (const Event& event : events) {
+            if (event.end < since) continue;
+            Uint64 duration = event.end - event.begin;
+            auto& total = totals[{event.name, event.category}];
+            total.count++;
+            total.total += duration;
+            total.max = MAX(total.max, duration);
+            if (event.category == Category::Chunk) chunkTime += duration;
+        }
+        char line[128];
+        snprintf(line, sizeof(line), "%s: %.1f%% running chunks\n", buffer->threadName, chunkTime / (milliseconds * 10000.0));
+        threadLines += line;
+    });
+
+    std::vector<std::pair<std::pair<const char*, Category>, Totals>> sorted(totals.begin(), totals.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& lhs, const auto& rhs){
+        return lhs.second.total > rhs.second.total;
+    });
+
+    std::string output;
+    char line[256];
+    snprintf(line, sizeof(line), "---Last %d ms---\n", milliseconds);
+    output += line;
+    for (auto& [key, total] : sorted) {
+        snprintf(line, sizeof(line), "%s (%s): %d times, %.3f ms total, %.3f ms avg, %.3f ms max\n",
+            key.first, categoryName(key.second), total.count,
+            total.total / 1e6, total.total / 1e6 / total.count, total.max / 1e6);
+        output += line;
+    }
+    output += threadLines;
+    return output;
+}
+
+}
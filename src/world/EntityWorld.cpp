@@ -39,12 +39,12 @@ namespace World {
         using namespace EC::Proto;
         static const auto infoList = ECS::getComponentInfoList<WORLD_COMPONENT_LIST>();
         Base::init(infoList, World::Entities::PrototypeIDs::Count);
+        addRelation(&follows);
     }
 
     ECS::EntityVersion EntityWorld::GetEntityVersion(ECS::EntityID id) const {
-        assert(id <= ECS::MaxEntityID);
-        auto index = Base::components.entityIndices[id];
-        return Base::components.entityData.version[(Uint16)index];
+        auto index = Base::components.getEntityIndex(id);
+        return Base::components.getVersion(index);
     }
 
     void EntityWorld::Set(Entity entity, ECS::ComponentID componentID, void* value) {
@@ -52,6 +52,7 @@ namespace World {
         void* component = Base::getComponent(entity, componentID);
         if (component) {
             memcpy(component, value, getComponentSize(componentID));
+            components.markChanged(entity, componentID);
         } else {
             LogError("Failed to set component, it could not be found.");
         }
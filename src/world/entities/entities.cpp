@@ -55,7 +55,8 @@ namespace Entities {
         ecs->Add<EC::CollisionBox>(enemy, {Box{Vec2(0.05), Vec2(0.9)}});
         ecs->Add<EC::Render>(enemy, EC::Render(TextureIDs::Player, RenderLayers::Player));
         ecs->Add<EC::Rotatable>(enemy, EC::Rotatable(0.0f, 45.0f));
-        ecs->Add<EC::Follow>(enemy, EC::Follow(following, 0.05));
+        ecs->Add<EC::Follow>(enemy, EC::Follow(0.05));
+        ecs->follows.set(enemy, following);
         ecs->StopDeferringEvents();
         return enemy;
     }
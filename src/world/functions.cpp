@@ -17,11 +17,11 @@ Box getEntityViewBoxBounds(const EntityWorld* ecs, Entity entity) {
     };
 }
 
-bool pointInEntity(Vec2 point, Entity entity, const EntityWorld& ecs) {
+static bool pointInEntity(Vec2 point, ECS::EntityRef ref, const EntityWorld& ecs) {
     bool clickedOnEntity = false;
 
-    const auto* viewbox = ecs.Get<const EC::ViewBox>(entity);
-    const auto* position = ecs.Get<const EC::Position>(entity);
+    const auto* viewbox = ecs.Get<const EC::ViewBox>(ref);
+    const auto* position = ecs.Get<const EC::Position>(ref);
     if (viewbox && position) {
         FRect entityRect = viewbox->box.rect();
         entityRect.x += position->x;
@@ -32,162 +32,75 @@ bool pointInEntity(Vec2 point, Entity entity, const EntityWorld& ecs) {
     return clickedOnEntity;
 }
 
+bool pointInEntity(Vec2 point, Entity entity, const EntityWorld& ecs) {
+    auto ref = ecs.GetRef(entity);
+    if (ref.Null()) return false;
+    return pointInEntity(point, ref, ecs);
+}
+
 void setEventCallbacks(EntityWorld& ecs, ChunkMap& chunkmap) {
-    ecs.setComponentDestructor(EC::Position::ID, [&](Entity entity){
-        auto* viewbox = ecs.Get<EC::ViewBox>(entity);
-        if (!viewbox) {
-            LogError("entity viewbox not found!");
-            return;
-        }
-        auto* position = ecs.Get<EC::Position>(entity);
-        if (!position) {
-            LogError("Entity position not found");
-            return;
-        }
-        forEachChunkContainingBounds(&chunkmap, {{position->vec2() + viewbox->box.min, position->vec2() + viewbox->box.max()}}, [entity](ChunkData* chunkdata){
-            chunkdata->removeCloseEntity(entity);
-        });
+    ecs.setComponentDestructor(EC::Position::ID, [&](Entity entity, void* component){
+        chunkmap.entityGrid.remove(entity);
     });
 
-    ecs.setComponentDestructor(EC::Inventory::ID, [&ecs](Entity entity){
-        ecs.Get<EC::Inventory>(entity)->inventory.destroy();
+    ecs.setComponentDestructor(EC::Inventory::ID, [](Entity entity, void* component){
+        ((EC::Inventory*)component)->inventory.destroy();
     });
 }
 
 void forEachEntityInRange(const EntityWorld& ecs, const ChunkMap* chunkmap, Vec2 pos, float radius, const std::function<int(Entity)>& callback) {
-    radius = abs(radius);
-    float radiusSqrd = radius * radius;
-
-    // form rectangle of chunks to search for entities in
-    IVec2 highChunkBound = {(int)floor((pos.x + radius) / CHUNKSIZE), (int)floor((pos.y + radius) / CHUNKSIZE)};
-    IVec2 lowChunkBound =  {(int)floor((pos.x - radius) / CHUNKSIZE), (int)floor((pos.y - radius) / CHUNKSIZE)};
-
-    // go through each chunk in chunk search rectangle
-    for (int y = lowChunkBound.y; y <= highChunkBound.y; y++) {
-        for (int x = lowChunkBound.x; x <= highChunkBound.x; x++) {
-            const ChunkData* chunkdata = chunkmap->get({x, y});
-            if (chunkdata == NULL) {
-                // entities can't be in non-existent chunks
-                continue;
-            }
-
-            for (int e = 0; e < chunkdata->closeEntities.size; e++) {
-                Entity closeEntity = chunkdata->closeEntities[e];
-                if (!ecs.EntityExists(closeEntity)) {
-                    LogError("Entity in closeEntities is dead!");
-                    continue;
-                }
-                EC::ViewBox* entityBox = ecs.Get<EC::ViewBox>(closeEntity);
-                assert(entityBox);
-                Vec2 entityCenter = entityBox->box.center();
-                Vec2 entitySize = entityBox->box.size;
-
-                Vec2 halfSize = entitySize * 0.5f;
+    // an entity is in range if any part of its view box is
+    chunkmap->entityGrid.forEachInCircle(pos, abs(radius), [&](Entity entity){
+        return callback(entity);
+    });
+}
 
-                // TODO: collision is broke for non squares. need math and stuff
+SmallVectorA<Entity, VirtualAllocator, 4> getAllEntitiesInRange(const EntityWorld& ecs, const ChunkMap* chunkmap, Vec2 pos, float radius, VirtualAllocator allocator) {
+    SmallVectorA<Entity, VirtualAllocator, 4> result{allocator};
+    chunkmap->entityGrid.forEachInCircle(pos, abs(radius), [&](Entity entity){
+        result.push_back(entity);
+        return false;
+    });
+    return result;
+}
 
-                radiusSqrd += (halfSize.x * halfSize.y + halfSize.y * halfSize.y) * M_SQRT2;
-            
-                Vec2 delta = entityCenter - pos;
-                float distSqrd = delta.x * delta.x + delta.y * delta.y;
-                if (distSqrd < radiusSqrd) {
-                    // entity is within radius
-                    if (callback(closeEntity)) {
-                        return;
-                    }
-                }
-            }
-        }
-    }
+SmallVectorA<Entity, VirtualAllocator, 4> getAllEntitiesOnLine(const EntityWorld& ecs, const ChunkMap* chunkmap, Vec2 start, Vec2 end, VirtualAllocator allocator) {
+    SmallVectorA<Entity, VirtualAllocator, 4> result{allocator};
+    chunkmap->entityGrid.forEachOnLine(start, end, [&](Entity entity){
+        result.push_back(entity);
+        return false;
+    });
+    return result;
 }
 
 void forEachEntityNearPoint(const EntityWorld& ecs, const ChunkMap* chunkmap, Vec2 point, const std::function<int(Entity)>& callback) {
-    IVec2 chunkPos = toChunkPosition(point);
-    const ChunkData* chunkdata = chunkmap->get(chunkPos);
-    if (!chunkdata) {
-        // entities can't be in non-existent chunks
-        return;
-    }
-
-    for (int e = 0; e < chunkdata->closeEntities.size; e++) {
-        Entity closeEntity = chunkdata->closeEntities[e];
-        if (callback(closeEntity)) {
-            return;
-        }
-    }
+    chunkmap->entityGrid.forEachNear(point, point, [&](Entity entity){
+        return callback(entity);
+    });
 }
 
 void forEachEntityInBounds(const EntityWorld& ecs, const ChunkMap* chunkmap, Boxf bounds, const std::function<void(Entity)>& callback) {
-    forEachChunkContainingBounds(chunkmap, bounds, [&](ChunkData* chunkdata){
-        Vec2 min = bounds[0];
-        Vec2 max = bounds[1];
-
-        for (int i = chunkdata->closeEntities.size-1 ; i >= 0; i--) {
-            auto closeEntity = chunkdata->closeEntities[i];
-            /* TEMPORARY!  TODO: replace this */
-            if (!ecs.EntityExists(closeEntity)) {
-                chunkdata->removeCloseEntity(closeEntity);
-                continue;
-            }
-
-            auto* entityViewbox = ecs.Get<const EC::ViewBox>(closeEntity);
-            auto* entityPos = ecs.Get<const EC::Position>(closeEntity);
-            assert(entityViewbox && entityPos);
-
-            Vec2 eMin = entityPos->vec2() + entityViewbox->box.min;
-            Vec2 eMax = eMin + entityViewbox->box.size;
-
-            if (eMin.x < max.x && eMax.x > min.x &&
-                eMin.y < max.y && eMax.y > min.y)
-            {
-                callback(closeEntity);
-            }
-        }
+    chunkmap->entityGrid.forEachOverlapping(bounds[0], bounds[1], [&](Entity entity){
+        callback(entity);
+        return false;
     });
 }
 
 SmallVectorA<Entity, VirtualAllocator, 4> getAllEntitiesInBounds(const EntityWorld& ecs, const ChunkMap* chunkmap, Boxf bounds, VirtualAllocator allocator) {
     SmallVectorA<Entity, VirtualAllocator, 4> result{allocator};
-    
-    forEachChunkContainingBounds(chunkmap, bounds, [&](ChunkData* chunkdata){
-        Vec2 min = bounds[0];
-        Vec2 max = bounds[1];
-
-        result.reserve(result.size() + chunkdata->closeEntities.size);
-        for (int i = chunkdata->closeEntities.size-1 ; i >= 0; i--) {
-            auto closeEntity = chunkdata->closeEntities[i];
-            /* TEMPORARY!  TODO: replace this */
-            if (!ecs.EntityExists(closeEntity)) {
-                chunkdata->closeEntities[i] = chunkdata->closeEntities.back();
-                chunkdata->closeEntities.pop();
-                continue;
-            }
-
-            auto* entityViewbox = ecs.Get<const EC::ViewBox>(closeEntity);
-            auto* entityPos = ecs.Get<const EC::Position>(closeEntity);
-            assert(entityViewbox && entityPos);
-
-            Vec2 eMin = entityPos->vec2() + entityViewbox->box.min;
-            Vec2 eMax = eMin + entityViewbox->box.size;
-
-            if (eMin.x < max.x && eMax.x > min.x &&
-                eMin.y < max.y && eMax.y > min.y)
-            {
-                result.push_back(closeEntity);
-            }
-        }
+    chunkmap->entityGrid.forEachOverlapping(bounds[0], bounds[1], [&](Entity entity){
+        result.push_back(entity);
+        return false;
     });
-
     return result;
 }
 
 SmallVectorA<Entity, VirtualAllocator, 0> getAllEntitiesNearBounds(const EntityWorld& ecs, const ChunkMap* chunkmap, Boxf bounds, VirtualAllocator allocator) {
     SmallVectorA<Entity, VirtualAllocator, 0> result{allocator};
-    
-    forEachChunkContainingBounds(chunkmap, bounds, [&](ChunkData* chunkdata){
-        result.append(chunkdata->closeEntities.begin(), chunkdata->closeEntities.end());
+    chunkmap->entityGrid.forEachNear(bounds[0], bounds[1], [&](Entity entity){
+        result.push_back(entity);
+        return false;
     });
-
     return result;
 }
 
@@ -227,26 +140,23 @@ Entity findPlayerFocusedEntity(const EntityWorld& ecs, const ChunkMap& chunkmap,
     Vec2 target = playerMousePos;
     Entity focusedEntity = NullEntity;
     int focusedEntityLayer = RenderLayers::Lowest;
-    forEachEntityNearPoint(ecs, &chunkmap, target,
+    // the grid has the view boxes, so only entities under the mouse are looked up
+    chunkmap.entityGrid.forEachOverlapping(target, target,
     [&](Entity entity){
-        if (!ecs.EntityHas<EC::Position, EC::ViewBox, EC::Render>(entity)) {
-            return 0;
-        }
-
-        auto render = ecs.Get<const EC::Render>(entity);
-        if (pointInEntity(target, entity, ecs)) {
-            for (int i = 0; i < render->numTextures; i++) {
-                int entityLayer = render->textures[i].layer;
-                if (entityLayer > focusedEntityLayer 
-                    || (entityLayer == focusedEntityLayer
-                    && entity.id > focusedEntity.id)) {
-                    focusedEntity = entity;
-                    focusedEntityLayer = entityLayer;
-                }
+        auto* render = ecs.Get<const EC::Render>(entity);
+        if (!render) return false;
+
+        for (int i = 0; i < render->numTextures; i++) {
+            int entityLayer = render->textures[i].layer;
+            if (entityLayer > focusedEntityLayer 
+                || (entityLayer == focusedEntityLayer
+                && entity.id > focusedEntity.id)) {
+                focusedEntity = entity;
+                focusedEntityLayer = entityLayer;
             }
         }
 
-        return 0;
+        return false;
     });
     return focusedEntity;
 }
@@ -262,65 +172,13 @@ void rotateEntity(const EntityWorld& ecs, Entity entity, bool clockwise) {
     }
 }
 
-void entityViewChanged(ChunkMap* chunkmap, Entity entity, Vec2 newPos, Vec2 oldPos, Box newViewbox, Box oldViewbox, bool justMade) {
-    /* put entity in to the chunks it's visible in */
-    if (UNLIKELY(!isValidEntityPosition(newPos))) {
-        LogCritical("Entity has invalid position! Position: %f,%f", newPos.x, newPos.y);
-    }
-
-    IVec2 oldMinChunkPosition = toChunkPosition(oldPos + oldViewbox.min);
-    IVec2 oldMaxChunkPosition = toChunkPosition(oldPos + oldViewbox.max());
-    IVec2 newMinChunkPosition = toChunkPosition(newPos + newViewbox.min);
-    IVec2 newMaxChunkPosition = toChunkPosition(newPos + newViewbox.max());
-
-    // early exit for simple and common case where entity never changed what chunks its in
-    if ((newMinChunkPosition == oldMinChunkPosition) &&
-        (newMaxChunkPosition == oldMaxChunkPosition) &&
-        !justMade) return;
-
-    IVec2 minChunkPosition = {
-        (oldMinChunkPosition.x < newMinChunkPosition.x) ? oldMinChunkPosition.x : newMinChunkPosition.x,
-        (oldMinChunkPosition.y < newMinChunkPosition.y) ? oldMinChunkPosition.y : newMinChunkPosition.y
-    };
-    IVec2 maxChunkPosition = {
-        (oldMaxChunkPosition.x > newMaxChunkPosition.x) ? oldMaxChunkPosition.x : newMaxChunkPosition.x,
-        (oldMaxChunkPosition.y > newMaxChunkPosition.y) ? oldMaxChunkPosition.y : newMaxChunkPosition.y
-    };
-
-    if (!justMade) {
-        for (int col = oldMinChunkPosition.x; col <= oldMaxChunkPosition.x; col++) {
-            for (int row = oldMinChunkPosition.y; row <= oldMaxChunkPosition.y; row++) {
-                IVec2 chunkPosition = {col, row};
-
-                bool inNewArea = (chunkPosition.x >= newMinChunkPosition.x && chunkPosition.y >= newMinChunkPosition.y &&
-                    chunkPosition.x <= newMaxChunkPosition.x && chunkPosition.y <= newMaxChunkPosition.y);
-
-                if (!inNewArea) {
-                    // remove entity from old chunk
-                    ChunkData* oldChunkdata = chunkmap->get(chunkPosition);
-                    if (oldChunkdata) {
-                        oldChunkdata->removeCloseEntity(entity);
-                    }
-                }
-            }
-        }
+void entityViewChanged(ChunkMap* chunkmap, Entity entity, Vec2 position, Box viewbox) {
+    if (UNLIKELY(!isValidEntityPosition(position))) {
+        LogCritical("Entity has invalid position! Position: %f,%f", position.x, position.y);
     }
 
-    for (int col = newMinChunkPosition.x; col <= newMaxChunkPosition.x; col++) {
-        for (int row = newMinChunkPosition.y; row <= newMaxChunkPosition.y; row++) {
-            IVec2 chunkPosition = {col, row};
-            bool inOldArea = (chunkPosition.x >= oldMinChunkPosition.x && chunkPosition.y >= oldMinChunkPosition.y &&
-                chunkPosition.x <= oldMaxChunkPosition.x && chunkPosition.y <= oldMaxChunkPosition.y && !justMade);
-
-            if (!inOldArea) {
-                // add entity to new chunk
-                ChunkData* newChunkdata = chunkmap->get(chunkPosition);
-                if (newChunkdata) {
-                    newChunkdata->closeEntities.push(entity);
-                }
-            }
-        }
-    }
+    Vec2 min = position + viewbox.min;
+    chunkmap->entityGrid.update(entity, min, min + viewbox.size);
 }
 
 void entityPositionChanged(GameState* state, Entity entity, Vec2 oldPos) {
@@ -329,7 +187,7 @@ void entityPositionChanged(GameState* state, Entity entity, Vec2 oldPos) {
     if (!position || !viewbox) {
         LogError("why here? no veiwbox or pos");
     }
-    entityViewChanged(&state->chunkmap, entity, position->vec2(), oldPos, viewbox->box, viewbox->box, false);
+    entityViewChanged(&state->chunkmap, entity, position->vec2(), viewbox->box);
 }
 
 void entityViewboxChanged(GameState* state, Entity entity, Box oldViewbox) {
@@ -338,7 +196,7 @@ void entityViewboxChanged(GameState* state, Entity entity, Box oldViewbox) {
     if (!position || !viewbox) {
         LogError("why here? no veiwbox or pos");
     }
-    entityViewChanged(&state->chunkmap, entity, position->vec2(), position->vec2(), viewbox->box, oldViewbox, false);
+    entityViewChanged(&state->chunkmap, entity, position->vec2(), viewbox->box);
 }
 
 void entityViewAndPosChanged(GameState* state, Entity entity, Vec2 oldPos, Box oldViewbox) {
@@ -347,7 +205,7 @@ void entityViewAndPosChanged(GameState* state, Entity entity, Vec2 oldPos, Box o
     if (!position || !viewbox) {
         LogError("why here? no veiwbox or pos");
     }
-    entityViewChanged(&state->chunkmap, entity, position->vec2(), oldPos, viewbox->box, oldViewbox, false);
+    entityViewChanged(&state->chunkmap, entity, position->vec2(), viewbox->box);
 }
 
 void entityCreated(GameState* state, Entity entity) {
@@ -356,7 +214,7 @@ void entityCreated(GameState* state, Entity entity) {
     if (!position || !viewbox) {
         LogError("why here? no veiwbox or pos");
     }
-    entityViewChanged(&state->chunkmap, entity, position->vec2(), position->vec2(), viewbox->box, viewbox->box, true);
+    entityViewChanged(&state->chunkmap, entity, position->vec2(), viewbox->box);
 }
 
 }
\ No newline at end of file
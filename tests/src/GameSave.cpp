@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include "GameSave.hpp"
+#include "GameState.hpp"
+#include "rendering/textures.hpp"
+
+TEST(AutosaverTest, FullSaveAfterChangeSave) {
+    bool multithreading = Global.multithreadingEnabled;
+    Global.multithreadingEnabled = true;
+    TextureManager textures(TextureIDs::NumTextureSlots);
+    GameState state;
+    state.init(&textures);
+    state.createWorld();
+    Vec2 playerPosition = state.ecs->Get<World::EC::Position>(state.player.entity)->vec2();
+
+    const char* path = "autosaver_test.save";
+    GameSave::Autosaver autosaver;
+    autosaver.init(path);
+    // a save every frame it can, alternating between full saves and change saves, each written on a new thread
+    autosaver.intervalMilliseconds = 0;
+    autosaver.changeSavesPerFullSave = 1;
+    autosaver.fullSaveChunksPerFrame = 16;
+    for (int frame = 0; frame < 200; frame++) {
+        autosaver.update(&state);
+        SDL_Delay(1);
+    }
+    autosaver.save(&state, false);
+    autosaver.destroy();
+
+    GameState loaded;
+    loaded.init(&textures);
+    ASSERT_EQ(GameSave::load(&loaded, path), 0);
+    auto* position = loaded.ecs->Get<World::EC::Position>(loaded.player.entity);
+    ASSERT_NE(position, nullptr);
+    EXPECT_EQ(position->vec2(), playerPosition);
+
+    loaded.destroy();
+    state.destroy();
+    remove(path);
+    remove((std::string(path) + ".log").c_str());
+    Global.multithreadingEnabled = multithreading;
+}
@@ -13,4 +13,35 @@ struct ArchetypePoolTest : testing::Test {
 
 TEST_F(ArchetypePoolTest, Clone) {
 
-}
\ No newline at end of file
+}
+
+TEST_F(ArchetypePoolTest, GrowthDoesntMoveComponents) {
+    Sint32 componentSizes[] = {4, 12};
+    Signature signature = Signature::OneComponent(0) | Signature::OneComponent(1);
+    ArchetypeAllocator allocator;
+    ArchetypePool pool(signature, componentSizes, &mallocator);
+
+    Entity first = {1, 1};
+    int firstIndex = pool.addNew(1, &first, &allocator, componentSizes, 1);
+    int* component = (int*)pool.getComponent(0, firstIndex, componentSizes[0]);
+    *component = 1234;
+
+    // enough entities to need several blocks
+    std::vector<Entity> entities(pool.blockCapacity() * 3);
+    for (int i = 0; i < entities.size(); i++) {
+        entities[i] = {(EntityID)i + 2, 1};
+    }
+    int start = pool.addNew(entities.size(), entities.data(), &allocator, componentSizes, 2);
+    EXPECT_GT(pool.numBlocks, 1);
+    EXPECT_EQ(pool.getComponent(0, firstIndex, componentSizes[0]), (char*)component);
+    EXPECT_EQ(*component, 1234);
+    for (int i = 0; i < entities.size(); i++) {
+        EXPECT_EQ(pool.getEntity(start + i), entities[i]);
+    }
+    // every block the new entities went into was marked as written
+    for (int b = 0; b < pool.usedBlockCount(); b++) {
+        EXPECT_EQ(pool.getColumnTick(b, 1), 2);
+    }
+
+    pool.destroy(&mallocator, &allocator, componentSizes);
+}
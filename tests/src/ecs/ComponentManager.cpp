@@ -14,7 +14,7 @@ struct ComponentManagerTest : testing::Test {
 };
 
 // TEST_F(ComponentManagerTest, Clone) {
-//     Entity entity = this->manager.createEntity(-1);
+//     Entity entity = this->manager.createEntity(-1, {0});
 //     World::EC::Position pos{{1.0f, 2.0f}};
 //     void* component = this->manager.addComponent(entity, World::EC::Position::ID);
 //     ASSERT_NE(component, nullptr);
@@ -50,4 +50,132 @@ struct ComponentManagerTest : testing::Test {
 
 //     free(clones);
 //     free(clones2);
-// }
\ No newline at end of file
+// }
+
+TEST_F(ComponentManagerTest, ManyEntities) {
+    // more than fit in 16 bit indices, all in one archetype
+    constexpr int count = 100000;
+    std::vector<Entity> entities(count);
+    for (int i = 0; i < count; i++) {
+        entities[i] = manager.createEntity(-1, {0});
+        auto* pos = (World::EC::Position*)manager.addComponent(entities[i], World::EC::Position::ID);
+        ASSERT_NE(pos, nullptr);
+        pos->x = (float)i;
+    }
+
+    for (int i = 0; i < count; i += 997) {
+        auto* pos = (World::EC::Position*)manager.getComponent(entities[i], World::EC::Position::ID);
+        ASSERT_NE(pos, nullptr);
+        EXPECT_EQ(pos->x, (float)i);
+    }
+
+    // deleting swaps the last entity into the hole, make sure it can still be found
+    manager.deleteEntity(entities[5]);
+    auto* last = (World::EC::Position*)manager.getComponent(entities[count-1], World::EC::Position::ID);
+    ASSERT_NE(last, nullptr);
+    EXPECT_EQ(last->x, (float)(count-1));
+}
+
+TEST_F(ComponentManagerTest, TransitionsAreCached) {
+    using ArchetypeID = ArchetypalComponentManager::ArchetypeID;
+    ComponentID position = World::EC::Position::ID;
+    ComponentID size = World::EC::Size::ID;
+    Entity entity = manager.createEntity(-1, {0});
+    ArchetypeID empty = manager.getArchetype(manager.getEntityIndex(entity.id));
+
+    // the second time follows the edges made the first time, and has to end up in the same place
+    ArchetypeID withPosition = manager.getAddTransition(empty, position);
+    EXPECT_NE(withPosition, empty);
+    EXPECT_EQ(manager.getAddTransition(empty, position), withPosition);
+    EXPECT_EQ(manager.getRemoveTransition(withPosition, position), empty);
+    EXPECT_EQ(manager.getRemoveTransition(withPosition, position), empty);
+
+    for (int i = 0; i < 2; i++) {
+        manager.addComponent(entity, position);
+        EXPECT_EQ(manager.getArchetype(manager.getEntityIndex(entity.id)), withPosition);
+        manager.removeComponent(entity, position);
+        EXPECT_EQ(manager.getArchetype(manager.getEntityIndex(entity.id)), empty);
+    }
+
+    Signature both = Signature::OneComponent(position) | Signature::OneComponent(size);
+    EXPECT_EQ(manager.pools[empty].getMultiEdge(both, {0}), NullArchetypeID);
+    ArchetypeID withBoth = manager.getTransition(empty, both, {0});
+    // changing more than one component is remembered as a whole
+    EXPECT_EQ(manager.pools[empty].getMultiEdge(both, {0}), withBoth);
+    EXPECT_EQ(manager.getTransition(empty, both, {0}), withBoth);
+    EXPECT_EQ(manager.getAddTransition(withPosition, size), withBoth);
+    EXPECT_EQ(manager.getTransition(withBoth, {0}, both), empty);
+    EXPECT_EQ(manager.pools[withBoth].getMultiEdge({0}, both), empty);
+    EXPECT_EQ(manager.getTransition(withBoth, {0}, both), empty);
+}
+
+TEST_F(ComponentManagerTest, BatchedSignatureChanges) {
+    constexpr int count = 5000;
+    std::vector<Entity> entities(count);
+    for (int i = 0; i < count; i++) {
+        entities[i] = manager.createEntity(-1, {0});
+        auto* pos = (World::EC::Position*)manager.addComponent(entities[i], World::EC::Position::ID);
+        pos->x = (float)i;
+    }
+
+    // every other entity gets a size, the rest lose their position
+    std::vector<ArchetypalComponentManager::SignatureChange> changes;
+    for (int i = 0; i < count; i++) {
+        if (i % 2 == 0) {
+            changes.push_back({entities[i], Signature::OneComponent(World::EC::Size::ID), {0}});
+        } else {
+            changes.push_back({entities[i], {0}, Signature::OneComponent(World::EC::Position::ID)});
+        }
+    }
+    manager.changeSignatures(changes.data(), changes.size());
+
+    for (int i = 0; i < count; i++) {
+        if (i % 2 == 0) {
+            EXPECT_TRUE(manager.hasComponent(entities[i], World::EC::Size::ID));
+            auto* pos = (World::EC::Position*)manager.getComponent(entities[i], World::EC::Position::ID);
+            ASSERT_NE(pos, nullptr);
+            EXPECT_EQ(pos->x, (float)i);
+        } else {
+            EXPECT_FALSE(manager.hasComponent(entities[i], World::EC::Position::ID));
+        }
+    }
+}
+
+TEST_F(ComponentManagerTest, RepeatedEntitiesInBatchChange) {
+    Entity entity = manager.createEntity(-1, {0});
+    Entity other = manager.createEntity(-1, {0});
+    Entity entities[] = {entity, other, entity, entity};
+    manager.addComponent(ArrayRef<Entity>(entities, 4), World::EC::Position::ID);
+
+    EXPECT_TRUE(manager.hasComponent(entity, World::EC::Position::ID));
+    EXPECT_TRUE(manager.hasComponent(other, World::EC::Position::ID));
+    ArchetypeID archetype = manager.getArchetype(manager.lookupEntity(entity));
+    EXPECT_EQ(manager.pools[archetype].size, 2);
+
+    // different changes to the same entity, only one of them is applied
+    std::vector<ArchetypalComponentManager::SignatureChange> changes = {
+        {entity, Signature::OneComponent(World::EC::Size::ID), {0}},
+        {entity, {0}, Signature::OneComponent(World::EC::Position::ID)},
+    };
+    manager.changeSignatures(changes.data(), changes.size());
+    EXPECT_EQ(manager.pools[archetype].size, 1);
+    EXPECT_NE(manager.hasComponent(entity, World::EC::Size::ID), !manager.hasComponent(entity, World::EC::Position::ID));
+    EXPECT_TRUE(manager.hasComponent(other, World::EC::Position::ID));
+}
+
+TEST_F(ComponentManagerTest, QueryFollowsNewArchetypes) {
+    Signature position = Signature::OneComponent(World::EC::Position::ID);
+    Signature size = Signature::OneComponent(World::EC::Size::ID);
+    int query = manager.getQuery({position, size});
+    EXPECT_EQ(manager.getQuery({position, size}), query);
+    EXPECT_EQ(manager.getQueryArchetypes(query).size(), 0);
+
+    Entity entity = manager.createEntity(-1, {0});
+    manager.addComponent(entity, World::EC::Position::ID);
+    ASSERT_EQ(manager.getQueryArchetypes(query).size(), 1);
+    EXPECT_EQ(manager.pools[manager.getQueryArchetypes(query)[0]].signature(), position);
+
+    // rejected archetypes stay out
+    manager.addComponent(entity, World::EC::Size::ID);
+    EXPECT_EQ(manager.getQueryArchetypes(query).size(), 1);
+}
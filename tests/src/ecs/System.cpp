@@ -0,0 +1,482 @@
+#include <gtest/gtest.h>
+#include "ECS/System.hpp"
+#include "ECS/componentMacros.hpp"
+
+using namespace ECS::Systems;
+using ECS::ComponentID;
+using ECS::Entity;
+using ECS::EntityManager;
+
+// kept out of the other test files' way, they have their own components with the same ID namespace
+namespace {
+
+namespace ComponentIDs {
+    #define SYSTEM_TEST_COMPONENTS Runs, First, Second, Third, Unrelated, SharedLayer
+    GEN_IDS(ids, ComponentID, SYSTEM_TEST_COMPONENTS, Count)
+}
+
+BEGIN_COMPONENT(Runs)
+    int runs;
+END_COMPONENT(Runs)
+
+BEGIN_COMPONENT(First)
+    int value;
+END_COMPONENT(First)
+
+BEGIN_COMPONENT(Second)
+    int value;
+END_COMPONENT(Second)
+
+BEGIN_COMPONENT(Third)
+    int value;
+END_COMPONENT(Third)
+
+BEGIN_COMPONENT(Unrelated)
+    int value;
+END_COMPONENT(Unrelated)
+
+BEGIN_PROTO_COMPONENT(SharedLayer)
+    int layer;
+END_PROTO_COMPONENT(SharedLayer)
+
+// small chunks so every job is spread over all the workers
+constexpr int TestChunkSize = 16;
+
+struct CountRunsJob : JobParallelFor<CountRunsJob, Runs> {
+    CountRunsJob() {
+        this->chunkSize = TestChunkSize;
+    }
+
+    void Execute(int N) {
+        Get<Runs>(N).runs++;
+    }
+};
+
+struct WriteFirstJob : JobParallelFor<WriteFirstJob, First> {
+    const int* frame;
+
+    WriteFirstJob(const int* frame) : frame(frame) {
+        this->chunkSize = TestChunkSize;
+    }
+
+    void Execute(int N) {
+        Get<First>(N).value = *frame;
+    }
+};
+
+struct FirstToSecondJob : JobParallelFor<FirstToSecondJob, const First, Second> {
+    FirstToSecondJob() {
+        this->chunkSize = TestChunkSize;
+    }
+
+    void Execute(int N) {
+        Get<Second>(N).value = Get<First>(N).value + 1;
+    }
+};
+
+struct SecondToThirdJob : JobParallelFor<SecondToThirdJob, const Second, Third> {
+    SecondToThirdJob() {
+        this->chunkSize = TestChunkSize;
+    }
+
+    void Execute(int N) {
+        Get<Third>(N).value = Get<Second>(N).value + 1;
+    }
+};
+
+struct ReadUnrelatedJob : JobParallelFor<ReadUnrelatedJob, const Unrelated> {
+    ReadUnrelatedJob() {
+        this->chunkSize = TestChunkSize;
+    }
+
+    void Execute(int N) {}
+};
+
+struct IdleSystem : System {
+    GroupID group = MakeGroup(ComponentGroup<
+        ReadOnly<Unrelated>
+    >());
+
+    ReadUnrelatedJob readUnrelated;
+    JobHandle readUnrelatedHandle;
+
+    IdleSystem(SystemManager& manager) : System(manager, "IdleSystem") {
+        readUnrelatedHandle = Schedule(group, readUnrelated);
+    }
+};
+
+struct ProducerSystem : System {
+    GroupID group = MakeGroup(ComponentGroup<
+        ReadWrite<Runs>,
+        ReadWrite<First>,
+        ReadWrite<Second>
+    >());
+
+    CountRunsJob countRuns;
+    WriteFirstJob writeFirst;
+    FirstToSecondJob firstToSecond;
+    JobHandle writeFirstHandle;
+    JobHandle firstToSecondHandle;
+
+    ProducerSystem(SystemManager& manager, const int* frame) : System(manager, "ProducerSystem"), writeFirst(frame) {
+        Schedule(group, countRuns);
+        writeFirstHandle = Schedule(group, writeFirst);
+        firstToSecondHandle = Schedule(group, firstToSecond, writeFirstHandle);
+    }
+};
+
+// only ordered after the producer by reading what it writes
+struct ConsumerSystem : System {
+    GroupID group = MakeGroup(ComponentGroup<
+        ReadOnly<Second>,
+        ReadWrite<Third>
+    >());
+
+    SecondToThirdJob secondToThird;
+    JobHandle secondToThirdHandle;
+
+    ConsumerSystem(SystemManager& manager) : System(manager, "ConsumerSystem") {
+        secondToThirdHandle = Schedule(group, secondToThird);
+    }
+};
+
+int findJobNode(const JobGraph& graph, const System* system, JobHandle job) {
+    for (int i = 0; i < graph.nodes.size(); i++) {
+        const auto& node = graph.nodes[i];
+        if (node.type == JobGraph::Node::RunJob && node.system == system && node.job == job) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// whether the node to has to wait for the node from
+bool reaches(const JobGraph& graph, int from, int to) {
+    std::vector<bool> visited(graph.nodes.size(), false);
+    std::vector<int> stack = {from};
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        if (node == to) return true;
+        if (visited[node]) continue;
+        visited[node] = true;
+        for (int successor : graph.nodes[node].successors) {
+            stack.push_back(successor);
+        }
+    }
+    return false;
+}
+
+}
+
+class SystemTest : public testing::Test {
+protected:
+    EntityManager manager;
+    SystemManager systems{&manager};
+    int frame = 0;
+    // made after the entity manager is initialized, since making groups needs it
+    IdleSystem* idle;
+    ProducerSystem* producer;
+    ConsumerSystem* consumer;
+    std::vector<Entity> entities;
+
+    SystemTest() {
+        static constexpr auto info = ECS::getComponentInfoList<Runs, First, Second, Third, Unrelated>();
+        manager.init(ArrayRef(info), 0);
+        idle = new IdleSystem(systems);
+        producer = new ProducerSystem(systems, &frame);
+        consumer = new ConsumerSystem(systems);
+        // ordered without any system dependencies, so only component conflicts order their jobs
+        idle->systemOrder = 2;
+        producer->systemOrder = 1;
+        consumer->systemOrder = 0;
+
+        for (int i = 0; i < 2000; i++) {
+            Entity entity = manager.createEntity(-1);
+            manager.addComponent<Runs>(entity, {0});
+            manager.addComponent<First>(entity, {-1});
+            manager.addComponent<Second>(entity, {-1});
+            manager.addComponent<Third>(entity, {-1});
+            if (i % 2 == 0) {
+                manager.addComponent<Unrelated>(entity, {i});
+            }
+            entities.push_back(entity);
+        }
+        setupSystems(systems);
+    }
+
+    ~SystemTest() {
+        cleanupSystems(systems);
+        delete consumer;
+        delete producer;
+        delete idle;
+        manager.destroy();
+    }
+};
+
+TEST_F(SystemTest, GraphOrdersConflictingJobs) {
+    const JobGraph& graph = systems.jobGraph;
+    ASSERT_TRUE(graph.valid);
+
+    int writeFirst = findJobNode(graph, producer, producer->writeFirstHandle);
+    int firstToSecond = findJobNode(graph, producer, producer->firstToSecondHandle);
+    int secondToThird = findJobNode(graph, consumer, consumer->secondToThirdHandle);
+    int readUnrelated = findJobNode(graph, idle, idle->readUnrelatedHandle);
+    ASSERT_NE(writeFirst, -1);
+    ASSERT_NE(firstToSecond, -1);
+    ASSERT_NE(secondToThird, -1);
+    ASSERT_NE(readUnrelated, -1);
+
+    // explicit dependency in one system, and a component conflict between systems
+    EXPECT_TRUE(reaches(graph, writeFirst, firstToSecond));
+    EXPECT_TRUE(reaches(graph, firstToSecond, secondToThird));
+    EXPECT_FALSE(reaches(graph, secondToThird, firstToSecond));
+
+    // jobs that share nothing are free to run at the same time
+    EXPECT_FALSE(reaches(graph, readUnrelated, writeFirst));
+    EXPECT_FALSE(reaches(graph, writeFirst, readUnrelated));
+    EXPECT_FALSE(reaches(graph, firstToSecond, readUnrelated));
+}
+
+TEST_F(SystemTest, WorkersRunEveryJobOnceInOrder) {
+    ThreadManager threadManager(3);
+    JobScheduler scheduler;
+    ASSERT_EQ(scheduler.start(threadManager, 3), 3);
+    systems.jobScheduler = &scheduler;
+
+    for (frame = 0; frame < 20; frame++) {
+        executeSystems(systems);
+        for (Entity entity : entities) {
+            // a chunk run twice or never would be off here
+            ASSERT_EQ(manager.getComponent<Runs>(entity)->runs, frame + 1);
+            // and a job run before the one it depends on would see last frame's value
+            ASSERT_EQ(manager.getComponent<First>(entity)->value, frame);
+            ASSERT_EQ(manager.getComponent<Second>(entity)->value, frame + 1);
+            ASSERT_EQ(manager.getComponent<Third>(entity)->value, frame + 2);
+        }
+    }
+
+    systems.jobScheduler = nullptr;
+    scheduler.stop(threadManager);
+    threadManager.destroy();
+}
+
+namespace {
+
+// counts the entities it visits, and leaves the frame in a group array for the job checking it
+struct ChangedFirstJob : JobSingleThreaded<ChangedFirstJob, Runs> {
+    const int* frame;
+
+    ChangedFirstJob(const int* frame) : frame(frame) {}
+
+    void Execute(int N, GroupArray<int> visitedFrame) {
+        Get<Runs>(N).runs++;
+        visitedFrame[N] = *frame;
+    }
+};
+
+struct TouchFirstJob : JobSingleThreaded<TouchFirstJob, First> {
+    void Execute(int N) {}
+};
+
+struct CheckVisitedJob : JobSingleThreaded<CheckVisitedJob, const Runs> {
+    const int* frame;
+    int* mismatches;
+
+    CheckVisitedJob(const int* frame, int* mismatches) : frame(frame), mismatches(mismatches) {}
+
+    void Execute(int N, GroupArray<const int> visitedFrame) {
+        if (visitedFrame[N] != *frame) (*mismatches)++;
+    }
+};
+
+struct ChangedFirstSystem : System {
+    GroupID group = MakeGroup(ComponentGroup<
+        ReadWrite<Runs>,
+        Changed<First>
+    >());
+
+    GroupArray<int> visitedFrame{this, group};
+    ChangedFirstJob changedFirst;
+
+    ChangedFirstSystem(SystemManager& manager, const int* frame) : System(manager, "ChangedFirstSystem"), changedFirst(frame) {
+        Schedule(group, changedFirst, &visitedFrame);
+    }
+};
+
+// writes First between the two jobs on the changed group when enabled
+struct TouchFirstSystem : System {
+    GroupID group = MakeGroup(ComponentGroup<
+        ReadWrite<First>
+    >());
+
+    TouchFirstJob touchFirst;
+
+    TouchFirstSystem(SystemManager& manager) : System(manager, "TouchFirstSystem") {
+        Schedule(group, touchFirst);
+    }
+};
+
+struct CheckVisitedSystem : System {
+    CheckVisitedJob checkVisited;
+
+    CheckVisitedSystem(SystemManager& manager, ChangedFirstSystem* changedSystem, const int* frame, int* mismatches)
+    : System(manager, "CheckVisitedSystem"), checkVisited(frame, mismatches) {
+        Schedule(changedSystem->group, checkVisited, changedSystem->visitedFrame.refConst());
+    }
+};
+
+}
+
+TEST(ChangedFilterTest, VisitsOnlyWrittenBlocks) {
+    static constexpr auto info = ECS::getComponentInfoList<Runs, First, Second, Third, Unrelated>();
+    EntityManager manager;
+    manager.init(ArrayRef(info), 0);
+    SystemManager systems{&manager};
+    int frame = 0;
+    int mismatches = 0;
+    auto* changedSystem = new ChangedFirstSystem(systems, &frame);
+    auto* touchSystem = new TouchFirstSystem(systems);
+    auto* checkSystem = new CheckVisitedSystem(systems, changedSystem, &frame, &mismatches);
+    changedSystem->systemOrder = 2;
+    touchSystem->systemOrder = 1;
+    checkSystem->systemOrder = 0;
+
+    // enough entities for several blocks
+    std::vector<Entity> entities;
+    for (int i = 0; i < 5000; i++) {
+        Entity entity = manager.createEntity(-1);
+        manager.addComponent<Runs>(entity, {0});
+        manager.addComponent<First>(entity, {i});
+        entities.push_back(entity);
+    }
+    setupSystems(systems);
+    auto& pool = manager.components.pools[manager.components.getArchetype(manager.components.lookupEntity(entities[0]))];
+    ASSERT_GT(pool.usedBlockCount(), 2);
+
+    auto countRuns = [&](int runs){
+        int count = 0;
+        for (Entity entity : entities) {
+            if (manager.getComponent<Runs>(entity)->runs == runs) count++;
+        }
+        return count;
+    };
+
+    // every block is new
+    touchSystem->enabled = false;
+    frame = 1;
+    executeSystems(systems);
+    EXPECT_EQ(countRuns(1), entities.size());
+
+    // nothing written since
+    frame = 2;
+    executeSystems(systems);
+    EXPECT_EQ(countRuns(1), entities.size());
+
+    // only the block with the written entity is visited. First is written everywhere after the changed job,
+    // which the check job on the same group must not pick up until next frame
+    Entity written = entities[entities.size() / 2];
+    manager.markChanged<First>(written);
+    touchSystem->enabled = true;
+    frame = 3;
+    executeSystems(systems);
+    int writtenBlock = pool.blockOf(manager.components.getPoolIndex(manager.components.lookupEntity(written)));
+    EXPECT_EQ(manager.getComponent<Runs>(written)->runs, 2);
+    EXPECT_EQ(countRuns(2), pool.blockEntityCount(writtenBlock));
+    EXPECT_EQ(mismatches, 0);
+
+    // now every block was written
+    touchSystem->enabled = false;
+    frame = 4;
+    executeSystems(systems);
+    EXPECT_EQ(countRuns(2) + countRuns(3), entities.size());
+    EXPECT_EQ(countRuns(3), pool.blockEntityCount(writtenBlock));
+    EXPECT_EQ(mismatches, 0);
+
+    cleanupSystems(systems);
+    delete checkSystem;
+    delete touchSystem;
+    delete changedSystem;
+    manager.destroy();
+}
+
+namespace {
+
+// copies the prototype's layer to every entity, and remembers where it read it from
+struct ReadPrototypeLayerJob : JobSingleThreaded<ReadPrototypeLayerJob, Runs> {
+    std::vector<const SharedLayer*>* seen;
+
+    ReadPrototypeLayerJob(std::vector<const SharedLayer*>* seen) : seen(seen) {}
+
+    void Execute(int N) {
+        const SharedLayer& layer = GetPrototype<SharedLayer>();
+        Get<Runs>(N).runs = layer.layer;
+        seen->push_back(&layer);
+    }
+};
+
+struct PrototypeLayerSystem : System {
+    GroupID group = MakeGroup(ComponentGroup<
+        ReadWrite<Runs>,
+        Tag<SharedLayer>
+    >());
+
+    ReadPrototypeLayerJob readLayer;
+
+    PrototypeLayerSystem(SystemManager& manager, std::vector<const SharedLayer*>* seen)
+    : System(manager, "PrototypeLayerSystem"), readLayer(seen) {
+        Schedule(group, readLayer);
+    }
+};
+
+}
+
+TEST(PrototypeJobTest, ChunksGiveJobsTheirPrototype) {
+    static constexpr auto info = ECS::getComponentInfoList<Runs, First, Second, Third, Unrelated, SharedLayer>();
+    EntityManager manager;
+    manager.init(ArrayRef(info), 3);
+    auto* low = new ECS::Prototype(manager.prototypes.New(0));
+    low->setName("low");
+    low->add(SharedLayer{3});
+    manager.prototypes.add(low);
+    auto* high = new ECS::Prototype(manager.prototypes.New(1));
+    high->setName("high");
+    high->add(SharedLayer{7});
+    manager.prototypes.add(high);
+    auto* plain = new ECS::Prototype(manager.prototypes.New(2));
+    plain->setName("plain");
+    manager.prototypes.add(plain);
+
+    SystemManager systems{&manager};
+    std::vector<const SharedLayer*> seen;
+    auto* system = new PrototypeLayerSystem(systems, &seen);
+
+    std::vector<Entity> entities;
+    for (int i = 0; i < 300; i++) {
+        Entity entity = manager.createEntity(i % 3);
+        manager.addComponent<Runs>(entity, {-1});
+        entities.push_back(entity);
+    }
+    setupSystems(systems);
+    executeSystems(systems);
+
+    // entities without the prototype component aren't in the group
+    EXPECT_EQ(seen.size(), 200);
+    const SharedLayer* lowLayer = manager.getPrototype(0)->get<SharedLayer>();
+    const SharedLayer* highLayer = manager.getPrototype(1)->get<SharedLayer>();
+    for (const SharedLayer* layer : seen) {
+        // straight from the prototype, not a copy
+        EXPECT_TRUE(layer == lowLayer || layer == highLayer);
+    }
+    for (int i = 0; i < entities.size(); i++) {
+        int expected = i % 3 == 0 ? 3 : i % 3 == 1 ? 7 : -1;
+        EXPECT_EQ(manager.getComponent<Runs>(entities[i])->runs, expected);
+    }
+
+    cleanupSystems(systems);
+    delete system;
+    manager.destroy();
+    delete low;
+    delete high;
+    delete plain;
+}
@@ -1,11 +1,13 @@
 #include <gtest/gtest.h>
 #include "ECS/EntityManager.hpp"
 #include "ECS/componentMacros.hpp"
+#include "ECS/Serialization.hpp"
+#include "ECS/Query.hpp"
 
 using namespace ECS;
 
 namespace ComponentIDs {
-    #define COMPONENTS Position, Health
+    #define COMPONENTS Position, Health, Layer
     GEN_IDS(ids, ComponentID, COMPONENTS, Count)
 }
 
@@ -22,6 +24,10 @@ BEGIN_COMPONENT(Health)
     float health;
 END_COMPONENT(Health)
 
+BEGIN_PROTO_COMPONENT(Layer)
+    int layer;
+END_PROTO_COMPONENT(Layer)
+
 class EntityManagerTest : public testing::Test {
 protected:
     EntityManager manager;
@@ -62,6 +68,470 @@ TEST_F(EntityManagerTest, AddComponent) {
     this->manager.deleteEntity(entity);
 }
 
+TEST_F(EntityManagerTest, CommandBufferCreates) {
+    // creating then adding to each entity, 50K commands
+    constexpr int count = 25000;
+    EntityCommandBuffer commands;
+    for (int i = 0; i < count; i++) {
+        Entity fake = commands.createEntity(-1);
+        commands.addComponent(fake, Position{i, -i});
+    }
+    manager.executeCommandBuffer(&commands);
+
+    int found = 0;
+    long long xSum = 0;
+    manager.forEachEntity<Position>([&](Entity entity){
+        Position* pos = manager.getComponent<Position>(entity);
+        ASSERT_NE(pos, nullptr);
+        EXPECT_EQ(pos->y, -pos->x);
+        xSum += pos->x;
+        found++;
+    });
+    EXPECT_EQ(found, count);
+    EXPECT_EQ(xSum, (long long)count * (count - 1) / 2);
+}
+
+TEST_F(EntityManagerTest, CommandBufferCoalesces) {
+    Entity kept = manager.createEntity(-1);
+    Entity deleted = manager.createEntity(-1);
+
+    EntityCommandBuffer commands;
+    commands.addComponent(kept, Position{1, 2});
+    commands.addComponent(deleted, Health{1.0f});
+    commands.addComponent(kept, Health{2.0f});
+    commands.removeComponent<Position>(kept);
+    commands.addComponent(kept, Position{3, 4});
+    commands.deleteEntity(deleted);
+    manager.executeCommandBuffer(&commands);
+
+    Position* pos = manager.getComponent<Position>(kept);
+    ASSERT_NE(pos, nullptr);
+    EXPECT_EQ(*pos, (Position{3, 4}));
+    Health* health = manager.getComponent<Health>(kept);
+    ASSERT_NE(health, nullptr);
+    EXPECT_EQ(health->health, 2.0f);
+    EXPECT_FALSE(manager.entityExists(deleted));
+}
+
+TEST_F(EntityManagerTest, CombinedCommandBuffers) {
+    // both buffers hand out the same fake ids
+    EntityCommandBuffer first;
+    EntityCommandBuffer second;
+    first.addComponent(first.createEntity(-1), Position{1, 1});
+    second.addComponent(second.createEntity(-1), Position{2, 2});
+    first.combine(second);
+    EXPECT_TRUE(second.empty());
+    first.addComponent(first.createEntity(-1), Position{3, 3});
+    EXPECT_EQ(first.size(), 6);
+    manager.executeCommandBuffer(&first);
+
+    int sum = 0;
+    int found = 0;
+    manager.forEachEntity<Position>([&](Entity entity){
+        Position* pos = manager.getComponent<Position>(entity);
+        EXPECT_EQ(pos->x, pos->y);
+        sum += pos->x;
+        found++;
+    });
+    EXPECT_EQ(found, 3);
+    EXPECT_EQ(sum, 6);
+}
+
+TEST_F(EntityManagerTest, CommandBufferDestructsPending) {
+    int destructed = 0;
+    float lastHealth = 0.0f;
+    manager.setComponentDestructor(Health::ID, [&](Entity entity, void* component){
+        destructed++;
+        lastHealth = ((Health*)component)->health;
+    });
+    Entity removed = manager.createEntity(-1);
+    Entity deleted = manager.createEntity(-1);
+    size_t archetypeCount = manager.components.pools.size();
+
+    // neither Health is ever on the entities outside the buffer, but their destructors should still see them
+    EntityCommandBuffer commands;
+    commands.addComponent(removed, Health{1.0f});
+    commands.removeComponent<Health>(removed);
+    manager.executeCommandBuffer(&commands);
+    EXPECT_EQ(destructed, 1);
+    EXPECT_EQ(lastHealth, 1.0f);
+    EXPECT_FALSE(manager.entityHas<Health>(removed));
+
+    commands.addComponent(deleted, Health{2.0f});
+    commands.deleteEntity(deleted);
+    manager.executeCommandBuffer(&commands);
+    EXPECT_EQ(destructed, 2);
+    EXPECT_EQ(lastHealth, 2.0f);
+    EXPECT_FALSE(manager.entityExists(deleted));
+
+    Entity spawned = commands.createEntity(-1);
+    commands.addComponent(spawned, Health{3.0f});
+    commands.deleteEntity(spawned);
+    manager.executeCommandBuffer(&commands);
+    EXPECT_EQ(destructed, 3);
+    EXPECT_EQ(lastHealth, 3.0f);
+    // the pending values were destructed where they were, none of the entities were ever moved to an archetype with Health
+    EXPECT_EQ(manager.components.pools.size(), archetypeCount);
+}
+
+TEST_F(EntityManagerTest, CommandBufferSkipsStaleCommands) {
+    Entity old = manager.createEntity(-1);
+    manager.deleteEntity(old);
+    Entity entity = manager.createEntity(-1);
+    ASSERT_EQ(entity.id, old.id);
+    ASSERT_NE(entity.version, old.version);
+
+    // the stale command is first in the group, it shouldn't take the live entity's commands down with it
+    EntityCommandBuffer commands;
+    commands.addComponent(old, Health{1.0f});
+    commands.addComponent(entity, Position{5, 6});
+    manager.executeCommandBuffer(&commands);
+
+    Position* pos = manager.getComponent<Position>(entity);
+    ASSERT_NE(pos, nullptr);
+    EXPECT_EQ(*pos, (Position{5, 6}));
+    EXPECT_FALSE(manager.entityHas<Health>(entity));
+}
+
+TEST_F(EntityManagerTest, SaveLoadRoundTrip) {
+    constexpr int count = 1000;
+    std::vector<Entity> entities;
+    for (int i = 0; i < count; i++) {
+        Entity entity = manager.createEntity(-1);
+        manager.addComponent(entity, Position{i, i * 2});
+        if (i % 3 == 0) manager.addComponent(entity, Health{(float)i});
+        entities.push_back(entity);
+    }
+    Relation follows;
+    manager.addRelation(&follows);
+    follows.set(entities[1], entities[2]);
+    follows.set(entities[3], entities[10]);
+    // leave a hole so unused ids are saved too
+    manager.deleteEntity(entities[10]);
+
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    SaveWriter writer(file);
+    saveEntities(manager, writer, nullptr);
+    saveRelation(follows, writer);
+    ASSERT_FALSE(writer.failed);
+
+    std::vector<char> data(writer.position);
+    rewind(file);
+    ASSERT_EQ(fread(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+
+    EntityManager* loaded = makeEntityManager();
+    SaveReader reader(data.data(), data.size());
+    ASSERT_EQ(loadEntities(*loaded, reader, nullptr), 0);
+    Relation loadedFollows;
+    ASSERT_EQ(loadRelation(*loaded, loadedFollows, reader), 0);
+    EXPECT_EQ(loadedFollows.size(), 1);
+    EXPECT_EQ(loadedFollows.getTarget(entities[1]), entities[2]);
+    EXPECT_EQ(loadedFollows.getTarget(entities[3]), NullEntity);
+
+    EXPECT_FALSE(loaded->entityExists(entities[10]));
+    for (int i = 0; i < count; i++) {
+        if (i == 10) continue;
+        ASSERT_TRUE(loaded->entityExists(entities[i]));
+        Position* pos = loaded->getComponent<Position>(entities[i]);
+        ASSERT_NE(pos, nullptr);
+        EXPECT_EQ(*pos, (Position{i, i * 2}));
+        Health* health = loaded->getComponent<Health>(entities[i]);
+        if (i % 3 == 0) {
+            ASSERT_NE(health, nullptr);
+            EXPECT_EQ(health->health, (float)i);
+        } else {
+            EXPECT_EQ(health, nullptr);
+        }
+    }
+    // new entities shouldn't reuse ids that are still in use
+    Entity created = loaded->createEntity(-1);
+    for (Entity entity : entities) {
+        if (entity.id == created.id) {
+            EXPECT_NE(entity.version, created.version);
+        }
+    }
+    loadedFollows.destroy();
+    follows.destroy();
+    loaded->destroy();
+    delete loaded;
+}
+
+TEST_F(EntityManagerTest, SaveChangesOnTopOfFullSave) {
+    std::vector<Entity> entities;
+    for (int i = 0; i < 100; i++) {
+        Entity entity = manager.createEntity(-1);
+        manager.addComponent(entity, Position{i, i});
+        entities.push_back(entity);
+    }
+    std::vector<Entity> untouched;
+    for (int i = 0; i < 100; i++) {
+        Entity entity = manager.createEntity(-1);
+        manager.addComponent(entity, Health{(float)i});
+        untouched.push_back(entity);
+    }
+
+    SavedVersions versions;
+    std::vector<char> full;
+    SaveWriter fullWriter(&full);
+    saveEntities(manager, fullWriter, nullptr, &versions);
+
+    manager.addComponent(entities[0], Health{1.0f});
+    manager.deleteEntity(entities[1]);
+    Entity created = manager.createEntity(-1);
+    manager.addComponent(created, Position{-1, -1});
+
+    std::vector<char> changes;
+    SaveWriter changesWriter(&changes);
+    saveEntityChanges(manager, changesWriter, nullptr, &versions);
+    // the health only pool didn't change, so it isn't written again
+    EXPECT_LT(changes.size(), full.size());
+
+    EntityManager* loaded = makeEntityManager();
+    SaveReader fullReader(full.data(), full.size());
+    ASSERT_EQ(loadEntities(*loaded, fullReader, nullptr), 0);
+    SaveReader changesReader(changes.data(), changes.size());
+    ASSERT_EQ(loadEntityChanges(*loaded, changesReader, nullptr), 0);
+
+    EXPECT_FALSE(loaded->entityExists(entities[1]));
+    ASSERT_TRUE(loaded->entityExists(created));
+    EXPECT_EQ(*loaded->getComponent<Position>(created), (Position{-1, -1}));
+    ASSERT_NE(loaded->getComponent<Health>(entities[0]), nullptr);
+    EXPECT_EQ(loaded->getComponent<Health>(entities[0])->health, 1.0f);
+    for (int i = 2; i < 100; i++) {
+        ASSERT_NE(loaded->getComponent<Position>(entities[i]), nullptr);
+        EXPECT_EQ(*loaded->getComponent<Position>(entities[i]), (Position{i, i}));
+    }
+    for (int i = 0; i < 100; i++) {
+        ASSERT_NE(loaded->getComponent<Health>(untouched[i]), nullptr);
+        EXPECT_EQ(loaded->getComponent<Health>(untouched[i])->health, (float)i);
+    }
+    loaded->destroy();
+    delete loaded;
+}
+
+TEST_F(EntityManagerTest, QueryPassesComponents) {
+    for (int i = 0; i < 1000; i++) {
+        Entity entity = manager.createEntity(-1);
+        manager.addComponent(entity, Position{i, 0});
+        if (i % 2 == 0) {
+            manager.addComponent(entity, Health{(float)i});
+        }
+    }
+
+    int count = 0;
+    Query<ReadOnly<Health>, ReadWrite<Position>>::forEach(manager, [&](Entity entity, const Health& health, Position& position){
+        EXPECT_EQ(manager.getComponent<Position>(entity), &position);
+        EXPECT_EQ((float)position.x, health.health);
+        position.y = 1;
+        count++;
+    });
+    EXPECT_EQ(count, 500);
+
+    count = 0;
+    Query<ReadOnly<Position>, Without<Health>>::forEachBlock(manager, [&](int blockCount, const Entity*, const Position* positions){
+        for (int i = 0; i < blockCount; i++) {
+            EXPECT_EQ(positions[i].x % 2, 1);
+            EXPECT_EQ(positions[i].y, 0);
+        }
+        count += blockCount;
+    });
+    EXPECT_EQ(count, 500);
+}
+
+TEST_F(EntityManagerTest, WritesSetColumnTicks) {
+    using namespace ECS::Systems;
+    Entity entity = manager.createEntity(-1);
+    manager.addComponent(entity, Position{1, 2});
+    manager.addComponent(entity, Health{1.0f});
+    auto& pool = manager.components.pools[manager.components.getArchetype(manager.components.lookupEntity(entity))];
+    int positionArray = pool.getArrayNumber(Position::ID);
+    int healthArray = pool.getArrayNumber(Health::ID);
+
+    Uint32 lastRun = manager.components.takeChangeTick();
+    EXPECT_LE(pool.getColumnTick(0, positionArray), lastRun);
+
+    Query<ReadWrite<Position>, ReadOnly<Health>>::forEach(manager, [](Entity, Position& position, const Health&){
+        position.x++;
+    });
+    EXPECT_GT(pool.getColumnTick(0, positionArray), lastRun);
+    EXPECT_LE(pool.getColumnTick(0, healthArray), lastRun);
+
+    lastRun = manager.components.takeChangeTick();
+    Uint32 changeCount = pool.changeCount;
+    manager.getComponent<Health>(entity)->health = 2.0f;
+    manager.markChanged<Health>(entity);
+    EXPECT_GT(pool.getColumnTick(0, healthArray), lastRun);
+    // savers see marked writes too
+    EXPECT_NE(pool.changeCount, changeCount);
+}
+
+TEST_F(EntityManagerTest, UnwrittenBlocksStayUnchanged) {
+    using namespace ECS::Systems;
+    Entity entity = manager.createEntity(-1);
+    manager.addComponent(entity, Position{1, 2});
+    auto& pool = manager.components.pools[manager.components.getArchetype(manager.components.lookupEntity(entity))];
+    int positionArray = pool.getArrayNumber(Position::ID);
+
+    Uint32 lastRun = manager.components.takeChangeTick();
+    Uint32 changeCount = pool.changeCount;
+    Query<ReadWrite<Position>>::forEach(manager, [](Entity, Position& position){
+        return position.x > 100;
+    });
+    EXPECT_LE(pool.getColumnTick(0, positionArray), lastRun);
+    EXPECT_EQ(pool.changeCount, changeCount);
+
+    Query<ReadWrite<Position>>::forEachBlock(manager, [](int, const Entity*, Position* positions){
+        positions[0].x = 200;
+        return true;
+    });
+    EXPECT_GT(pool.getColumnTick(0, positionArray), lastRun);
+    EXPECT_NE(pool.changeCount, changeCount);
+}
+
+TEST_F(EntityManagerTest, EntityRefsGoStale) {
+    Entity first = manager.createEntity(-1);
+    Entity second = manager.createEntity(-1);
+    manager.addComponent(first, Position{1, 1});
+    manager.addComponent(second, Position{2, 2});
+
+    EntityRef ref = manager.getRef(second);
+    ASSERT_TRUE(manager.refValid(ref));
+    EXPECT_EQ(manager.getComponent<Position>(ref), manager.getComponent<Position>(second));
+    EXPECT_EQ(manager.getComponent<Health>(ref), nullptr);
+
+    // adding doesn't move anything
+    manager.addComponent(manager.createEntity(-1), Position{3, 3});
+    EXPECT_TRUE(manager.refValid(ref));
+
+    // removing moves the last entity into the hole
+    manager.deleteEntity(first);
+    EXPECT_FALSE(manager.refValid(ref));
+    EXPECT_TRUE(manager.getRef(first).Null());
+    ref = manager.getRef(second);
+    EXPECT_EQ(manager.getComponent<Position>(ref)->x, 2);
+}
+
+TEST_F(EntityManagerTest, RelationDropsDeletedEntities) {
+    Relation follows;
+    manager.addRelation(&follows);
+    Entity targets[2] = {manager.createEntity(-1), manager.createEntity(-1)};
+    Entity sources[6];
+    for (int i = 0; i < 6; i++) {
+        sources[i] = manager.createEntity(-1);
+        follows.set(sources[i], targets[i % 2]);
+    }
+    follows.set(sources[0], targets[1]);
+    EXPECT_EQ(follows.getTarget(sources[0]), targets[1]);
+    EXPECT_EQ(follows.getSources(targets[0]).size(), 2);
+    EXPECT_EQ(follows.getSources(targets[1]).size(), 4);
+
+    int seen = 0;
+    follows.forEachTarget([&](Entity target, ArrayRef<Relation::Pair> pairs){
+        for (auto& pair : pairs) {
+            EXPECT_EQ(pair.target, target);
+            EXPECT_EQ(follows.getTarget(pair.source), target);
+        }
+        seen += pairs.size();
+    });
+    EXPECT_EQ(seen, 6);
+
+    manager.deleteEntity(sources[1]);
+    EXPECT_EQ(follows.getSources(targets[1]).size(), 3);
+    manager.deleteEntity(targets[1]);
+    EXPECT_FALSE(follows.isTarget(targets[1]));
+    EXPECT_EQ(follows.getTarget(sources[3]), NullEntity);
+    EXPECT_EQ(follows.size(), 2);
+    follows.destroy();
+}
+
+TEST(RelationTest, RetargetAndRemoveThenSet) {
+    Relation follows;
+    Entity source = {1, 1};
+    Entity a = {2, 1};
+    Entity b = {3, 1};
+
+    // moving to a target that sorts after the old one
+    follows.set(source, a);
+    EXPECT_EQ(follows.getSources(a).size(), 1);
+    follows.set(source, b);
+    EXPECT_EQ(follows.getSources(a).size(), 0);
+    ASSERT_EQ(follows.getSources(b).size(), 1);
+    EXPECT_EQ(follows.getSources(b)[0].source, source);
+
+    // setting the same pair again after removing it
+    follows.remove(source);
+    follows.set(source, a);
+    EXPECT_EQ(follows.getSources(a).size(), 1);
+    EXPECT_EQ(follows.getSources(b).size(), 0);
+
+    int seen = 0;
+    follows.forEachTarget([&](Entity target, ArrayRef<Relation::Pair> pairs){
+        EXPECT_EQ(target, a);
+        seen += pairs.size();
+    });
+    EXPECT_EQ(seen, follows.size());
+    EXPECT_EQ(seen, 1);
+    follows.destroy();
+}
+
+TEST(PrototypeArchetypes, SplitByPrototype) {
+    using namespace ECS::Systems;
+    EntityManager manager;
+    static constexpr auto info = getComponentInfoList<Position, Health, Layer>();
+    manager.init(ArrayRef(info), 2);
+    auto* layered = new Prototype(manager.prototypes.New(0));
+    layered->setName("layered");
+    layered->add(Layer{3});
+    manager.prototypes.add(layered);
+    auto* plain = new Prototype(manager.prototypes.New(1));
+    plain->setName("plain");
+    manager.prototypes.add(plain);
+
+    Entity layeredEntity, plainEntity;
+    for (int i = 0; i < 10; i++) {
+        layeredEntity = manager.createEntity(0);
+        manager.addComponent(layeredEntity, Position{i, 0});
+        plainEntity = manager.createEntity(1);
+        manager.addComponent(plainEntity, Position{i, 1});
+        manager.addComponent(manager.createEntity(-1), Position{i, 2});
+    }
+    auto& components = manager.components;
+    auto layeredArchetype = components.getArchetype(components.lookupEntity(layeredEntity));
+    EXPECT_NE(layeredArchetype, components.getArchetype(components.lookupEntity(plainEntity)));
+    EXPECT_EQ(components.pools[layeredArchetype].prototype, 0);
+    EXPECT_EQ(components.pools[layeredArchetype].size, 10);
+    EXPECT_TRUE(manager.entityHas<Layer>(layeredEntity));
+    EXPECT_FALSE(manager.entityHas<Layer>(plainEntity));
+
+    int count = 0;
+    Query<ReadOnly<Position>, Tag<Layer>>::forEach(manager, [&](Entity entity, const Position& position){
+        EXPECT_EQ(position.y, 0);
+        EXPECT_EQ(manager.getPrototypeID(entity), 0);
+        count++;
+    });
+    EXPECT_EQ(count, 10);
+
+    count = 0;
+    Query<ReadOnly<Position>, Without<Layer>>::forEach(manager, [&](Entity, const Position& position){
+        EXPECT_NE(position.y, 0);
+        count++;
+    });
+    EXPECT_EQ(count, 20);
+
+    // removing the last component keeps the entity with its prototype
+    manager.removeComponent<Position>(layeredEntity);
+    auto emptyArchetype = components.getArchetype(components.lookupEntity(layeredEntity));
+    EXPECT_TRUE(components.pools[emptyArchetype].null());
+    EXPECT_EQ(components.pools[emptyArchetype].prototype, 0);
+    EXPECT_TRUE(manager.entityHas<Layer>(layeredEntity));
+
+    manager.destroy();
+    delete layered;
+    delete plain;
+}
+
 using EntityManagerDeathTest = EntityManagerTest;
 
 volatile void* donotread;
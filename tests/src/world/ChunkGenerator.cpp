@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include "ChunkGenerator.hpp"
+
+TEST(ChunkGeneratorTest, SameSeedSameChunks) {
+    ChunkMap chunkmap;
+    chunkmap.init();
+    chunkmap.seed = 1234;
+    ChunkGenerator generator;
+    generator.requestArea(chunkmap, {-1, -1}, {1, 0}, {0, 0});
+    generator.finish(&chunkmap);
+    EXPECT_EQ(chunkmap.size(), 6);
+
+    // chunks come out the same no matter when or in what order they're made
+    Chunk* tiles = (Chunk*)malloc(sizeof(Chunk));
+    for (int y = -1; y <= 0; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ChunkData* chunkdata = chunkmap.get({x, y});
+            ASSERT_NE(chunkdata, nullptr);
+            generateChunk(tiles, {x, y}, 1234);
+            EXPECT_EQ(memcmp(tiles, chunkdata->chunk, sizeof(Chunk)), 0);
+        }
+    }
+
+    // existing chunks aren't generated again
+    generator.requestArea(chunkmap, {-1, -1}, {1, 1}, {0, 0});
+    generator.finish(&chunkmap);
+    EXPECT_EQ(chunkmap.size(), 9);
+
+    generateChunk(tiles, {0, 0}, 4321);
+    EXPECT_NE(memcmp(tiles, chunkmap.get({0, 0})->chunk, sizeof(Chunk)), 0);
+
+    free(tiles);
+    generator.destroy();
+    chunkmap.destroy();
+}
+
+TEST(ChunkGeneratorTest, WorkersMakeTheSameChunks) {
+    ChunkMap chunkmap;
+    chunkmap.init();
+    chunkmap.seed = 99;
+    ThreadManager threadManager(2);
+    ChunkGenerator generator;
+    ASSERT_EQ(generator.start(threadManager, 2), 2);
+
+    generator.requestArea(chunkmap, {-2, -2}, {2, 1}, {0, 0});
+    generator.finish(&chunkmap);
+    EXPECT_EQ(chunkmap.size(), 20);
+
+    Chunk* tiles = (Chunk*)malloc(sizeof(Chunk));
+    for (int y = -2; y <= 1; y++) {
+        for (int x = -2; x <= 2; x++) {
+            ChunkData* chunkdata = chunkmap.get({x, y});
+            ASSERT_NE(chunkdata, nullptr);
+            generateChunk(tiles, {x, y}, chunkmap.seed);
+            EXPECT_EQ(memcmp(tiles, chunkdata->chunk, sizeof(Chunk)), 0);
+        }
+    }
+
+    free(tiles);
+    generator.stop(threadManager);
+    generator.destroy();
+    threadManager.destroy();
+    chunkmap.destroy();
+}
+
+TEST(ChunkGeneratorTest, DropsChunksFromAnotherSeed) {
+    ChunkMap chunkmap;
+    chunkmap.init();
+    chunkmap.seed = 5;
+    ChunkGenerator generator;
+    generator.requestArea(chunkmap, {0, 0}, {1, 0}, {0, 0});
+
+    // a new world is made before the chunks asked for are done
+    chunkmap.seed = 6;
+    generator.finish(&chunkmap);
+    EXPECT_EQ(chunkmap.size(), 0);
+
+    generator.requestArea(chunkmap, {0, 0}, {1, 0}, {0, 0});
+    generator.finish(&chunkmap);
+    EXPECT_EQ(chunkmap.size(), 2);
+    Chunk* tiles = (Chunk*)malloc(sizeof(Chunk));
+    for (int x = 0; x <= 1; x++) {
+        ChunkData* chunkdata = chunkmap.get({x, 0});
+        ASSERT_NE(chunkdata, nullptr);
+        generateChunk(tiles, {x, 0}, 6);
+        EXPECT_EQ(memcmp(tiles, chunkdata->chunk, sizeof(Chunk)), 0);
+    }
+
+    free(tiles);
+    generator.destroy();
+    chunkmap.destroy();
+}
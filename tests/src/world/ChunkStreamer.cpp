@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include "ChunkStreamer.hpp"
+
+TEST(ChunkStreamerTest, EvictSpillAndRestore) {
+    ChunkMap chunkmap;
+    chunkmap.init();
+    chunkmap.seed = 42;
+    ChunkStreamer streamer;
+    streamer.init();
+    streamer.memoryBudget = 4 * sizeof(Chunk);
+
+    for (int x = 0; x < 8; x++) {
+        ChunkData* chunkdata = chunkmap.newChunkAt({x, 0});
+        ASSERT_NE(chunkdata, nullptr);
+        generateChunk(chunkdata->chunk, {x, 0}, chunkmap.seed);
+    }
+    ChunkData* changed = chunkmap.get({0, 0});
+    (*changed->chunk)[5][7] = Tile(TileTypes::Wall);
+    changed->modified = true;
+    int chunkListSize = chunkmap.chunkList.size();
+
+    // the chunks in use stay, the rest are evicted and the changed one is spilled
+    streamer.use(&chunkmap, {4, 0}, {7, 0});
+    EXPECT_EQ(streamer.evict(&chunkmap), 4);
+    EXPECT_EQ(chunkmap.size(), 4);
+    EXPECT_TRUE(chunkmap.existsAt({7, 0}));
+    EXPECT_FALSE(chunkmap.existsAt({1, 0}));
+    EXPECT_TRUE(streamer.isSpilled(chunkmap, {0, 0}));
+    EXPECT_FALSE(streamer.isSpilled(chunkmap, {1, 0}));
+    EXPECT_EQ(chunkmap.freeChunks.size(), 4);
+
+    // coming back into view reads it back from the region file, into a freed slot
+    streamer.use(&chunkmap, {0, 0}, {0, 0});
+    ChunkData* restored = chunkmap.get({0, 0});
+    ASSERT_NE(restored, nullptr);
+    EXPECT_TRUE(restored->modified);
+    EXPECT_EQ((*restored->chunk)[5][7].type, TileTypes::Wall);
+    Chunk* expected = (Chunk*)malloc(sizeof(Chunk));
+    generateChunk(expected, {0, 0}, chunkmap.seed);
+    (*expected)[5][7] = Tile(TileTypes::Wall);
+    EXPECT_EQ(memcmp(expected, restored->chunk, sizeof(Chunk)), 0);
+    EXPECT_EQ(chunkmap.chunkList.size(), chunkListSize);
+    EXPECT_FALSE(streamer.isSpilled(chunkmap, {0, 0}));
+
+    free(expected);
+    streamer.destroy();
+    chunkmap.destroy();
+}
+
+TEST(ChunkStreamerTest, EvictReleasesBuckets) {
+    ChunkMap chunkmap;
+    chunkmap.init();
+    chunkmap.seed = 7;
+    ChunkStreamer streamer;
+    streamer.init();
+    streamer.memoryBudget = 4 * sizeof(Chunk);
+
+    constexpr int count = CHUNK_BUCKET_SIZE * 3;
+    for (int x = 0; x < count; x++) {
+        ChunkData* chunkdata = chunkmap.newChunkAt({x, 0});
+        ASSERT_NE(chunkdata, nullptr);
+        generateChunk(chunkdata->chunk, {x, 0}, chunkmap.seed);
+    }
+    EXPECT_EQ(chunkmap.chunkList.buckets.size(), 3);
+
+    // the chunks kept are in the top bucket, so they have to be moved down for the others to be released
+    streamer.use(&chunkmap, {count - 4, 0}, {count - 1, 0});
+    EXPECT_EQ(streamer.evict(&chunkmap), count - 4);
+    EXPECT_EQ(chunkmap.chunkList.buckets.size(), 1);
+    EXPECT_EQ(chunkmap.chunkList.size(), 4);
+    EXPECT_TRUE(chunkmap.freeChunks.empty());
+
+    Chunk* expected = (Chunk*)malloc(sizeof(Chunk));
+    for (int x = count - 4; x < count; x++) {
+        ChunkData* chunkdata = chunkmap.get({x, 0});
+        ASSERT_NE(chunkdata, nullptr);
+        EXPECT_GE(chunkmap.chunkIndex(chunkdata->chunk), 0);
+        generateChunk(expected, {x, 0}, chunkmap.seed);
+        EXPECT_EQ(memcmp(expected, chunkdata->chunk, sizeof(Chunk)), 0);
+    }
+    // new chunks carry on from the slots kept
+    EXPECT_NE(chunkmap.newChunkAt({0, 1}), nullptr);
+    EXPECT_EQ(chunkmap.chunkList.size(), 5);
+
+    free(expected);
+    streamer.destroy();
+    chunkmap.destroy();
+}
+
+TEST(ChunkStreamerTest, MemoryStaysFlatWalkingOutAndBack) {
+    ChunkMap chunkmap;
+    chunkmap.init();
+    chunkmap.seed = 3;
+    ChunkStreamer streamer;
+    streamer.init();
+    streamer.memoryBudget = 4 * sizeof(Chunk);
+
+    constexpr int viewChunks = 4;
+    constexpr int cellsPerChunk = (int)(CHUNKSIZE / SpatialGrid::CellSize);
+    constexpr int rowEntities = viewChunks * cellsPerChunk;
+    auto cellBox = [](int x, int y){
+        Vec2 min = {x * SpatialGrid::CellSize + 1, y * SpatialGrid::CellSize + 1};
+        return std::make_pair(min, min + Vec2(1));
+    };
+    // a row of entities, one per cell, that goes along with the chunks in view
+    auto step = [&](int chunkX){
+        for (int x = chunkX; x < chunkX + viewChunks; x++) {
+            if (!chunkmap.existsAt({x, 0})) {
+                ChunkData* chunkdata = chunkmap.newChunkAt({x, 0});
+                ASSERT_NE(chunkdata, nullptr);
+                generateChunk(chunkdata->chunk, {x, 0}, chunkmap.seed);
+            }
+        }
+        for (int cellX = chunkX * cellsPerChunk; cellX < (chunkX + viewChunks) * cellsPerChunk; cellX++) {
+            Entity entity = {(Uint32)(cellX % rowEntities), 1};
+            auto box = cellBox(cellX, 0);
+            chunkmap.entityGrid.update(entity, box.first, box.second);
+        }
+        streamer.use(&chunkmap, {chunkX, 0}, {chunkX + viewChunks - 1, 0});
+        streamer.evict(&chunkmap);
+    };
+
+    constexpr int farChunk = 32;
+    constexpr int measureChunk = 8;
+    size_t outboundGrid = 0;
+    size_t outboundBuckets = 0;
+    for (int x = 0; x <= farChunk; x++) {
+        step(x);
+        if (x == measureChunk) {
+            outboundGrid = chunkmap.entityGrid.memoryUsage();
+            outboundBuckets = chunkmap.chunkList.buckets.size();
+        }
+    }
+
+    // a crowd far out fills a lot of cells before leaving
+    constexpr int crowdSize = 32;
+    for (int y = 0; y < crowdSize; y++) {
+        for (int x = 0; x < crowdSize; x++) {
+            Entity entity = {(Uint32)(rowEntities + y * crowdSize + x), 1};
+            auto box = cellBox(farChunk * cellsPerChunk + x, y + 1);
+            chunkmap.entityGrid.update(entity, box.first, box.second);
+        }
+    }
+    EXPECT_GT(chunkmap.entityGrid.cellCount(), crowdSize * crowdSize);
+    for (int i = 0; i < crowdSize * crowdSize; i++) {
+        EXPECT_TRUE(chunkmap.entityGrid.remove({(Uint32)(rowEntities + i), 1}));
+    }
+
+    for (int x = farChunk; x >= measureChunk; x--) {
+        step(x);
+    }
+    // only the row is left, so the grid and chunk list went back to what they were on the way out
+    EXPECT_EQ(chunkmap.entityGrid.size(), rowEntities);
+    EXPECT_LE(chunkmap.entityGrid.cellCount(), rowEntities * 2);
+    EXPECT_LE(chunkmap.entityGrid.memoryUsage(), outboundGrid * 2);
+    EXPECT_EQ(chunkmap.chunkList.buckets.size(), outboundBuckets);
+    EXPECT_LE(chunkmap.size(), viewChunks);
+
+    streamer.destroy();
+    chunkmap.destroy();
+}
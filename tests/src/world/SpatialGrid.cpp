@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "SpatialGrid.hpp"
+
+static std::vector<Entity> overlapping(const SpatialGrid& grid, Vec2 min, Vec2 max) {
+    std::vector<Entity> result;
+    grid.forEachOverlapping(min, max, [&](Entity entity){
+        result.push_back(entity);
+        return false;
+    });
+    return result;
+}
+
+TEST(SpatialGridTest, MoveAndRemove) {
+    SpatialGrid grid;
+    grid.init();
+
+    Entity a = {1, 1};
+    Entity b = {2, 1};
+    Entity big = {3, 1};
+    grid.update(a, {0, 0}, {1, 1});
+    grid.update(b, {0.5f, 0.5f}, {1.5f, 1.5f});
+    grid.update(big, {-50, -50}, {50, 50});
+    EXPECT_EQ(grid.size(), 3);
+
+    // b's min corner is in the cell left of the query, but its box still overlaps
+    auto found = overlapping(grid, {1.2f, 1.2f}, {2, 2});
+    EXPECT_EQ(found.size(), 2);
+
+    // move a into another cell, far away
+    grid.update(a, {100, 100}, {101, 101});
+    found = overlapping(grid, {100.5f, 100.5f}, {100.6f, 100.6f});
+    ASSERT_EQ(found.size(), 1);
+    EXPECT_EQ(found[0], a);
+    EXPECT_EQ(grid.size(), 3);
+
+    // removing b moves nothing else out of place
+    EXPECT_TRUE(grid.remove(b));
+    EXPECT_FALSE(grid.remove(b));
+    EXPECT_FALSE(grid.contains(b));
+    EXPECT_TRUE(grid.contains(a));
+    found = overlapping(grid, {0, 0}, {2, 2});
+    ASSERT_EQ(found.size(), 1);
+    EXPECT_EQ(found[0], big);
+
+    // a dead entity doesn't remove the entity that took its id
+    Entity newA = {1, 2};
+    EXPECT_FALSE(grid.remove(newA));
+    EXPECT_TRUE(grid.contains(a));
+    EXPECT_EQ(grid.size(), 2);
+
+    grid.destroy();
+}
+
+TEST(SpatialGridTest, ReusesEmptyCells) {
+    SpatialGrid grid;
+    grid.init();
+
+    Entity stays = {1, 1};
+    Entity walker = {2, 1};
+    grid.update(stays, {0, 0}, {1, 1});
+    // walk through a thousand cells, only the one it's in and the one it left need to exist
+    for (int i = 0; i < 1000; i++) {
+        float x = i * SpatialGrid::CellSize;
+        grid.update(walker, {x, 50}, {x + 1, 51});
+    }
+    EXPECT_LE(grid.cellCount(), 4);
+    EXPECT_TRUE(grid.contains(stays));
+    auto found = overlapping(grid, {0, 0}, {1, 1});
+    ASSERT_EQ(found.size(), 1);
+    EXPECT_EQ(found[0], stays);
+    found = overlapping(grid, {999 * SpatialGrid::CellSize, 50}, {999 * SpatialGrid::CellSize + 1, 51});
+    ASSERT_EQ(found.size(), 1);
+    EXPECT_EQ(found[0], walker);
+    // the cells it left are gone from the lookup too
+    EXPECT_TRUE(overlapping(grid, {500 * SpatialGrid::CellSize, 50}, {500 * SpatialGrid::CellSize + 1, 51}).empty());
+
+    grid.destroy();
+}
+
+TEST(SpatialGridTest, KernelsMatchScalar) {
+    // enough boxes for full simd batches and a few left over
+    const int count = 37;
+    std::vector<float> minX(count), minY(count), maxX(count), maxY(count);
+    for (int i = 0; i < count; i++) {
+        minX[i] = (float)(i % 7) - 3.0f;
+        minY[i] = (float)(i % 5) - 2.0f;
+        maxX[i] = minX[i] + (float)(i % 3) + 0.5f;
+        maxY[i] = minY[i] + (float)(i % 4) + 0.5f;
+    }
+    SpatialKernels::PackedBoxes boxes = {minX.data(), minY.data(), maxX.data(), maxY.data(), count};
+
+    Sint32 hits[count], scalarHits[count];
+    auto expectSame = [&](int hitCount, int scalarHitCount){
+        ASSERT_EQ(hitCount, scalarHitCount);
+        for (int i = 0; i < hitCount; i++) {
+            EXPECT_EQ(hits[i], scalarHits[i]);
+        }
+    };
+
+    int hitCount = SpatialKernels::overlappingBox(boxes, {-1, -1}, {1, 0.5f}, hits);
+    EXPECT_GT(hitCount, 0);
+    EXPECT_LT(hitCount, count);
+    expectSame(hitCount, SpatialKernels::Scalar::overlappingBox(boxes, {-1, -1}, {1, 0.5f}, scalarHits));
+
+    hitCount = SpatialKernels::inCircle(boxes, {2, 2}, 1.5f, hits);
+    EXPECT_GT(hitCount, 0);
+    EXPECT_LT(hitCount, count);
+    expectSame(hitCount, SpatialKernels::Scalar::inCircle(boxes, {2, 2}, 1.5f, scalarHits));
+
+    hitCount = SpatialKernels::onLine(boxes, {-5, 3}, {5, -1}, hits);
+    EXPECT_GT(hitCount, 0);
+    EXPECT_LT(hitCount, count);
+    expectSame(hitCount, SpatialKernels::Scalar::onLine(boxes, {-5, 3}, {5, -1}, scalarHits));
+
+    // lines that don't move along an axis, starting right on some of the boxes' edges
+    Vec2 flatLines[][2] = {
+        {{-5, 0}, {5, 0}}, // horizontal
+        {{1, -4}, {1, 4}}, // vertical
+        {{1, 0}, {1, 0}}   // a point
+    };
+    for (auto& line : flatLines) {
+        hitCount = SpatialKernels::onLine(boxes, line[0], line[1], hits);
+        EXPECT_GT(hitCount, 0);
+        EXPECT_LT(hitCount, count);
+        expectSame(hitCount, SpatialKernels::Scalar::onLine(boxes, line[0], line[1], scalarHits));
+    }
+}
@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "Terrain.hpp"
+
+TEST(TerrainTest, NoiseMatchesScalarAndNeighbors) {
+    std::vector<float> heights(CHUNKSIZE * CHUNKSIZE), scalarHeights(CHUNKSIZE * CHUNKSIZE);
+    for (ChunkCoord position : {ChunkCoord{0, 0}, ChunkCoord{-3, 2}, ChunkCoord{5, -7}}) {
+        Terrain::heights(position, 99, heights.data());
+        Terrain::Scalar::heights(position, 99, scalarHeights.data());
+        for (int i = 0; i < CHUNKSIZE * CHUNKSIZE; i++) {
+            ASSERT_NEAR(heights[i], scalarHeights[i], 1e-5f);
+            ASSERT_GE(heights[i], 0.0f);
+            ASSERT_LE(heights[i], 1.0f);
+        }
+    }
+
+    // the noise is continuous across chunk borders
+    std::vector<float> right(CHUNKSIZE * CHUNKSIZE);
+    Terrain::heights({0, 0}, 99, heights.data());
+    Terrain::heights({1, 0}, 99, right.data());
+    for (int y = 0; y < CHUNKSIZE; y++) {
+        EXPECT_NEAR(heights[y * CHUNKSIZE + CHUNKSIZE - 1], right[y * CHUNKSIZE], 0.05f);
+    }
+}
+
+TEST(TerrainTest, HasEveryBiome) {
+    Chunk* chunk = (Chunk*)malloc(sizeof(Chunk));
+    int counts[TileTypes::Count] = {0};
+    for (int x = 0; x < 8; x++) {
+        Terrain::generate(chunk, {x, x}, 7);
+        for (int row = 0; row < CHUNKSIZE; row++) {
+            for (int col = 0; col < CHUNKSIZE; col++) {
+                counts[(*chunk)[row][col].type]++;
+            }
+        }
+    }
+    EXPECT_GT(counts[TileTypes::Water], 0);
+    EXPECT_GT(counts[TileTypes::Sand], 0);
+    EXPECT_GT(counts[TileTypes::Grass], 0);
+    free(chunk);
+}